@@ -0,0 +1,581 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+/*
+	Stop Visual C++ from warning about thread safety when asked to compile idiomatic ANSI
+*/
+#ifdef _MSC_VER
+#pragma warning(disable : 4996)
+#endif
+
+/*
+	Compares two ensembles of runs of landscapeScaleSimulation (used by regression/runRegression.sh)
+
+	Engines which are only meant to be statistically equivalent to the exact engine cannot be checked by
+	diffing output files, so instead do two-sample Kolmogorov-Smirnov tests on
+		- the times at which runs stopped (endTime_<i>.txt)
+		- the number of cells infected in each run
+	and a two-proportion test in each cell on
+		- the probability the cell is infected (i.e. the proportion of runs in which it was infected), so an epidemic
+			in the wrong place fails even if the distribution over all cells looks right
+			(with a Bonferroni correction for the number of cells tested)
+	and exit with EXIT_FAILURE if any of the tests reject at significance level alpha
+
+	Runs from a simulation with splitLevels or introStrata are weighted (weight_<i>.txt), in which case the empirical distributions
+	are weighted, and the size of the ensemble used in the tests is the total weight (i.e. the number of iterations,
+	since copies of a run are not independent of each other)
+*/
+
+#define		_MAX_STATIC_BUFF_LEN			1024
+#define		_HOST_ID_TOKEN					12		/* position of the host ID in each line of <outStub>_<i>.txt */
+#define		BRK_ENDLINE						"\r\n"
+#define		TOK_WHITESPACE					" \t,"
+
+#ifdef _MSC_VER
+#define 	C_DIR_DELIMITER '\\'
+#else
+#define 	C_DIR_DELIMITER '/'
+#endif
+
+/*
+	A value in a (possibly weighted) sample
+*/
+typedef struct
+{
+	double	value;
+	double	weight;
+} t_Sample;
+
+/*
+	Summary of an ensemble of runs
+*/
+typedef struct
+{
+	int			numRuns;
+	int			numCells;
+	double		totalWeight;	/* sum of the weights of the runs (=numRuns unless runs are weighted) */
+	double		effectiveRuns;	/* number of independent runs the ensemble is worth in the tests */
+	t_Sample	*aEndTime;		/* time each run stopped */
+	t_Sample	*aNumInf;		/* number of cells infected in each run */
+	t_Sample	*aProbInf;		/* (weighted) proportion of runs in which each cell was infected */
+} t_Ensemble;
+
+/*
+	Parameters which control the comparison
+*/
+typedef struct
+{
+	char	refDirectory[_MAX_STATIC_BUFF_LEN];
+	char	testDirectory[_MAX_STATIC_BUFF_LEN];
+	char	outStub[_MAX_STATIC_BUFF_LEN];
+	double	alpha;
+} t_CompareParams;
+
+/*
+	Utility functions for reading configuration options
+*/
+int	getCfgFileName(char *szProgName, char *szCfgFile)
+{
+	/*
+		Work out configuration file name from that of the executable
+		and check whether it exists by attempting to read it
+	*/
+	char	*pPtr;
+	FILE 	*fp;
+
+	szCfgFile[0] = '\0';
+	{
+		if((pPtr = strrchr(szProgName,C_DIR_DELIMITER))!=NULL)
+		{
+			strcpy(szCfgFile,pPtr+1);
+		}
+		else
+		{
+			strcpy(szCfgFile,szProgName);
+		}
+		if((pPtr = strstr(szCfgFile,".exe"))!=NULL)
+		{
+			*pPtr = '\0';
+		}
+		strcat(szCfgFile,".cfg");
+	}
+	/* check file exists */
+	fp = fopen(szCfgFile, "rb");
+	if(fp)
+	{
+		fclose(fp);
+		return 1;
+	}
+	return 0;
+}
+
+/*
+	Following set of routines find values of parameters from the command line options,
+ 	or, failing that, from the cfg file
+*/
+int findKey(int argc, char **argv, char*szCfgFile, char *szKey, char *szValue)
+{
+	char *pVal;
+	int	 bRet,i;
+	FILE *fp;
+	char *pThisPair;
+	char *szArgvCopy;
+
+	bRet = 0;
+	i=0;
+	/* try to find the relevant key on the command line */
+	while(bRet == 0 && i<argc)
+	{
+		szArgvCopy = strdup(argv[i]);
+		if(szArgvCopy)
+		{
+			pThisPair = strtok(szArgvCopy, " \t");
+			while(pThisPair)
+			{
+				if(strncmp(pThisPair,szKey,strlen(szKey))==0)
+				{
+					pVal = strchr(pThisPair,'=');
+					if(pVal)
+					{
+						/* make sure isn't just start of string matching the key */
+						if(pThisPair[strlen(szKey)] == '=')
+						{
+							strcpy(szValue,pVal+1);
+							fprintf(stdout, "extracted %s->%s from command line\n", szKey, szValue);
+							bRet = 1;
+						}
+					}
+				}
+				pThisPair = strtok(NULL, " \t");
+			}
+			free(szArgvCopy);
+		}
+		i++;
+	}
+	/* otherwise, look in the cfg file */
+	if(bRet == 0)
+	{
+		fp = fopen(szCfgFile,"rb");
+		if(fp)
+		{
+			char szLine[_MAX_STATIC_BUFF_LEN];
+
+			while(!bRet && fgets(szLine,_MAX_STATIC_BUFF_LEN,fp))
+			{
+				char *pPtr;
+				if((pPtr = strchr(szLine,'='))!=NULL)
+				{
+					*pPtr = '\0';
+					if(strcmp(szKey,szLine)==0)
+					{
+						strcpy(szValue,pPtr+1);
+						/* strip off newline (if any) */
+						if((pPtr = strpbrk(szValue,"\r\n"))!=NULL)
+							*pPtr = '\0';
+						bRet = 1;
+					}
+				}
+			}
+			fclose(fp);
+		}
+	}
+	return bRet;
+}
+
+int readStringFromCfg(int argc, char **argv, char *szCfgFile, char *szKey, char *szValue)
+{
+	return(findKey(argc, argv, szCfgFile,szKey,szValue));
+}
+
+int readDoubleFromCfg(int argc, char **argv, char *szCfgFile, char *szKey, double *pdValue)
+{
+	char szValue[_MAX_STATIC_BUFF_LEN];
+
+	if(findKey(argc, argv, szCfgFile,szKey,szValue))
+	{
+		*pdValue = atof(szValue);
+		return 1;
+	}
+	return 0;
+}
+
+int readIntFromCfg(int argc, char **argv, char *szCfgFile, char *szKey, int *pnValue)
+{
+	char szValue[_MAX_STATIC_BUFF_LEN];
+
+	if(findKey(argc, argv, szCfgFile,szKey,szValue))
+	{
+		*pnValue = atoi(szValue);
+		return 1;
+	}
+	return 0;
+}
+
+int readParams(t_CompareParams *pParams, int argc, char **argv)
+{
+	char szCfgFile[_MAX_STATIC_BUFF_LEN];
+
+	fprintf(stdout, "readParams()\n");
+	memset(pParams,0,sizeof(t_CompareParams));
+	if(!getCfgFileName(argv[0], szCfgFile))
+	{
+		fprintf(stderr, "Couldn't find cfg file for program name '%s'\n", argv[0]);
+		return 0;
+	}
+	if(!readStringFromCfg(argc, argv, szCfgFile, "refDirectory", pParams->refDirectory))
+	{
+		fprintf(stdout, "Couldn't read refDirectory\n");
+		return 0;
+	}
+	if(!readStringFromCfg(argc, argv, szCfgFile, "testDirectory", pParams->testDirectory))
+	{
+		fprintf(stdout, "Couldn't read testDirectory\n");
+		return 0;
+	}
+	if(!readStringFromCfg(argc, argv, szCfgFile, "outStub", pParams->outStub))
+	{
+		fprintf(stdout, "Couldn't read outStub\n");
+		return 0;
+	}
+	if(!readDoubleFromCfg(argc, argv, szCfgFile, "alpha", &pParams->alpha))
+	{
+		fprintf(stdout, "Couldn't read alpha\n");
+		return 0;
+	}
+	return 1;
+}
+
+/*
+	Count lines in a file (or -1 if the file can't be opened)
+*/
+int countLines(char *fileName)
+{
+	FILE	*fIn;
+	char	szBuffer[_MAX_STATIC_BUFF_LEN];
+	int		numLines;
+
+	fIn = fopen(fileName, "rb");
+	if(!fIn)
+	{
+		return -1;
+	}
+	numLines = 0;
+	while(fgets(szBuffer, _MAX_STATIC_BUFF_LEN, fIn))
+	{
+		numLines++;
+	}
+	fclose(fIn);
+	return numLines;
+}
+
+/*
+	Read the summary of all runs in one directory
+*/
+int readEnsemble(t_Ensemble *pEnsemble, char *szDir, char *szStub)
+{
+	FILE	*fIn;
+	char	szFile[_MAX_STATIC_BUFF_LEN];
+	char	szBuffer[_MAX_STATIC_BUFF_LEN];
+	char	*pPtr;
+	int		i,thisTok,hostID,bRet;
+	double	thisWeight,sumSqWeight;
+
+	fprintf(stdout, "readEnsemble(%s)\n", szDir);
+	memset(pEnsemble, 0, sizeof(t_Ensemble));
+	sprintf(szFile, "%s%clastRunNumber.txt", szDir, C_DIR_DELIMITER);
+	fIn = fopen(szFile, "rb");
+	if(!fIn)
+	{
+		fprintf(stderr, "couldn't open %s\n", szFile);
+		return 0;
+	}
+	if(fgets(szBuffer, _MAX_STATIC_BUFF_LEN, fIn))
+	{
+		pEnsemble->numRuns = atoi(szBuffer);
+	}
+	fclose(fIn);
+	sprintf(szFile, "%s%cactiveLandscape.txt", szDir, C_DIR_DELIMITER);
+	pEnsemble->numCells = countLines(szFile);
+	if(pEnsemble->numRuns <= 0 || pEnsemble->numCells <= 0)
+	{
+		fprintf(stderr, "no runs or no cells in %s\n", szDir);
+		return 0;
+	}
+	pEnsemble->aEndTime = malloc(sizeof(t_Sample) * pEnsemble->numRuns);
+	pEnsemble->aNumInf = malloc(sizeof(t_Sample) * pEnsemble->numRuns);
+	pEnsemble->aProbInf = calloc(pEnsemble->numCells, sizeof(t_Sample));
+	if(!(pEnsemble->aEndTime && pEnsemble->aNumInf && pEnsemble->aProbInf))
+	{
+		fprintf(stderr, "out of memory\n");
+		return 0;
+	}
+	bRet = 1;
+	sumSqWeight = 0.0;
+	for(i=0;bRet && i<pEnsemble->numRuns;i++)
+	{
+		/* runs are only weighted if the simulation used splitLevels */
+		thisWeight = 1.0;
+		sprintf(szFile, "%s%cweight_%d.txt", szDir, C_DIR_DELIMITER, i);
+		fIn = fopen(szFile, "rb");
+		if(fIn)
+		{
+			if(fgets(szBuffer, _MAX_STATIC_BUFF_LEN, fIn))
+			{
+				thisWeight = atof(szBuffer);
+			}
+			fclose(fIn);
+		}
+		pEnsemble->totalWeight += thisWeight;
+		sumSqWeight += thisWeight*thisWeight;
+		pEnsemble->aEndTime[i].weight = pEnsemble->aNumInf[i].weight = thisWeight;
+		sprintf(szFile, "%s%cendTime_%d.txt", szDir, C_DIR_DELIMITER, i);
+		fIn = fopen(szFile, "rb");
+		if(fIn && fgets(szBuffer, _MAX_STATIC_BUFF_LEN, fIn))
+		{
+			pEnsemble->aEndTime[i].value = atof(szBuffer);
+		}
+		else
+		{
+			fprintf(stderr, "couldn't read %s\n", szFile);
+			bRet = 0;
+		}
+		if(fIn)
+		{
+			fclose(fIn);
+		}
+		sprintf(szFile, "%s%c%s_%d.txt", szDir, C_DIR_DELIMITER, szStub, i);
+		fIn = fopen(szFile, "rb");
+		if(bRet && fIn)
+		{
+			pEnsemble->aNumInf[i].value = 0.0;
+			while(fgets(szBuffer, _MAX_STATIC_BUFF_LEN, fIn))
+			{
+				if((pPtr = strpbrk(szBuffer, BRK_ENDLINE))!=NULL)
+				{
+					*pPtr = '\0';
+				}
+				thisTok = 0;
+				pPtr = strtok(szBuffer, TOK_WHITESPACE);
+				while(pPtr && thisTok < _HOST_ID_TOKEN)
+				{
+					pPtr = strtok(NULL, TOK_WHITESPACE);
+					thisTok++;
+				}
+				if(pPtr)
+				{
+					hostID = atoi(pPtr);
+					if(hostID >= 0 && hostID < pEnsemble->numCells)
+					{
+						pEnsemble->aProbInf[hostID].value += thisWeight;
+					}
+					pEnsemble->aNumInf[i].value += 1.0;
+				}
+			}
+		}
+		else if(bRet)
+		{
+			fprintf(stderr, "couldn't read %s\n", szFile);
+			bRet = 0;
+		}
+		if(fIn)
+		{
+			fclose(fIn);
+		}
+	}
+	for(i=0;i<pEnsemble->numCells;i++)
+	{
+		pEnsemble->aProbInf[i].value /= pEnsemble->totalWeight;
+		pEnsemble->aProbInf[i].weight = 1.0;
+	}
+	/* Kish's effective sample size, but no more than the total weight (as copies of a run are correlated) */
+	pEnsemble->effectiveRuns = pEnsemble->totalWeight*pEnsemble->totalWeight/sumSqWeight;
+	if(pEnsemble->effectiveRuns > pEnsemble->totalWeight)
+	{
+		pEnsemble->effectiveRuns = pEnsemble->totalWeight;
+	}
+	fprintf(stdout, "\t%d runs (worth %.1f), %d cells\n", pEnsemble->numRuns, pEnsemble->effectiveRuns, pEnsemble->numCells);
+	return bRet;
+}
+
+static int cmpSample(const void *p1, const void *p2)
+{
+	double d1 = ((t_Sample *)p1)->value;
+	double d2 = ((t_Sample *)p2)->value;
+
+	return (d1 > d2) - (d1 < d2);
+}
+
+/*
+	Kolmogorov-Smirnov probability function (asymptotic distribution of the statistic)
+*/
+double probKS(double lambda)
+{
+	int		j;
+	double	a2,fac,sum,term,termBF;
+
+	a2 = -2.0*lambda*lambda;
+	fac = 2.0;
+	sum = 0.0;
+	termBF = 0.0;
+	for(j=1;j<=100;j++)
+	{
+		term = fac*exp(a2*j*j);
+		sum += term;
+		if(fabs(term) <= 0.001*termBF || fabs(term) <= 1.0e-8*sum)
+		{
+			return sum;
+		}
+		fac = -fac;
+		termBF = fabs(term);
+	}
+	return 1.0;		/* failed to converge, which only happens for lambda close to zero */
+}
+
+/*
+	Two-sample Kolmogorov-Smirnov test (sorts both arrays), returning the p-value and setting *pD to the statistic
+	(the empirical distributions are weighted, and eff1 and eff2 are the sample sizes used for the p-value)
+*/
+double testKS(t_Sample *aData1, int n1, double eff1, t_Sample *aData2, int n2, double eff2, double *pD)
+{
+	int		j1,j2;
+	double	d1,d2,dt,fn1,fn2,en,cum1,cum2,tot1,tot2;
+
+	qsort(aData1, n1, sizeof(t_Sample), cmpSample);
+	qsort(aData2, n2, sizeof(t_Sample), cmpSample);
+	tot1 = tot2 = 0.0;
+	for(j1=0;j1<n1;j1++)
+	{
+		tot1 += aData1[j1].weight;
+	}
+	for(j2=0;j2<n2;j2++)
+	{
+		tot2 += aData2[j2].weight;
+	}
+	j1 = j2 = 0;
+	fn1 = fn2 = 0.0;
+	cum1 = cum2 = 0.0;
+	*pD = 0.0;
+	while(j1 < n1 && j2 < n2)
+	{
+		d1 = aData1[j1].value;
+		d2 = aData2[j2].value;
+		/* step past all tied values in both samples before comparing the empirical distributions */
+		if(d1 <= d2)
+		{
+			while(j1 < n1 && aData1[j1].value == d1)
+			{
+				cum1 += aData1[j1++].weight;
+				fn1 = cum1 / tot1;
+			}
+		}
+		if(d2 <= d1)
+		{
+			while(j2 < n2 && aData2[j2].value == d2)
+			{
+				cum2 += aData2[j2++].weight;
+				fn2 = cum2 / tot2;
+			}
+		}
+		dt = fabs(fn2 - fn1);
+		if(dt > *pD)
+		{
+			*pD = dt;
+		}
+	}
+	en = sqrt(eff1*eff2/(eff1+eff2));
+	return probKS((en + 0.12 + 0.11/en) * (*pD));
+}
+
+int reportKS(char *szName, t_Sample *aData1, int n1, double eff1, t_Sample *aData2, int n2, double eff2, double alpha)
+{
+	double	pValue,dStat;
+
+	pValue = testKS(aData1, n1, eff1, aData2, n2, eff2, &dStat);
+	fprintf(stdout, "\t%-24s D=%.4f p=%.4f %s\n", szName, dStat, pValue, (pValue < alpha) ? "FAILED" : "ok");
+	return (pValue >= alpha);
+}
+
+/*
+	Two-proportion z-test of the probability of infection in each cell (with Yates' continuity correction, as many cells
+	are rarely infected), returning the smallest p-value times the number of cells tested (Bonferroni), and setting
+	*pMaxDiff to the largest difference in a cell and *pWorst to the cell with the smallest p-value
+	(cells infected in every run or none of either ensemble can't differ, so aren't tested)
+*/
+double testCellProportions(t_Ensemble *pRef, t_Ensemble *pTest, double *pMaxDiff, int *pWorst)
+{
+	int		i,numTested;
+	double	p1,p2,n1,n2,pooled,diff,se,z,pValue,minP;
+
+	n1 = pRef->effectiveRuns;
+	n2 = pTest->effectiveRuns;
+	numTested = 0;
+	minP = 1.0;
+	*pMaxDiff = 0.0;
+	*pWorst = -1;
+	for(i=0;i<pRef->numCells;i++)
+	{
+		p1 = pRef->aProbInf[i].value;
+		p2 = pTest->aProbInf[i].value;
+		pooled = (n1*p1 + n2*p2)/(n1 + n2);
+		if(pooled <= 0.0 || pooled >= 1.0)
+		{
+			continue;
+		}
+		numTested++;
+		diff = fabs(p1 - p2);
+		if(diff > *pMaxDiff)
+		{
+			*pMaxDiff = diff;
+		}
+		se = sqrt(pooled*(1.0 - pooled)*(1.0/n1 + 1.0/n2));
+		z = (diff - 0.5*(1.0/n1 + 1.0/n2))/se;
+		pValue = (z > 0.0) ? erfc(z/sqrt(2.0)) : 1.0;
+		if(pValue < minP || *pWorst < 0)
+		{
+			minP = pValue;
+			*pWorst = i;
+		}
+	}
+	minP *= numTested;
+	return (minP < 1.0) ? minP : 1.0;
+}
+
+int reportCells(char *szName, t_Ensemble *pRef, t_Ensemble *pTest, double alpha)
+{
+	double	pValue,maxDiff;
+	int		worst;
+
+	pValue = testCellProportions(pRef, pTest, &maxDiff, &worst);
+	fprintf(stdout, "	%-24s maxDiff=%.4f p=%.4f (cell %d) %s\n", szName, maxDiff, pValue, worst, (pValue < alpha) ? "FAILED" : "ok");
+	return (pValue >= alpha);
+}
+
+int main(int argc, char **argv)
+{
+	t_CompareParams		sParams;
+	t_Ensemble			sRef,sTest;
+	int					bPassed;
+
+	bPassed = 0;
+	if(readParams(&sParams, argc, argv))
+	{
+		if(readEnsemble(&sRef, sParams.refDirectory, sParams.outStub) && readEnsemble(&sTest, sParams.testDirectory, sParams.outStub))
+		{
+			if(sRef.numCells == sTest.numCells)
+			{
+				fprintf(stdout, "compareEnsembles() (alpha=%.4f)\n", sParams.alpha);
+				bPassed = 1;
+				bPassed &= reportKS("endTime", sRef.aEndTime, sRef.numRuns, sRef.effectiveRuns, sTest.aEndTime, sTest.numRuns, sTest.effectiveRuns, sParams.alpha);
+				bPassed &= reportKS("numInfected", sRef.aNumInf, sRef.numRuns, sRef.effectiveRuns, sTest.aNumInf, sTest.numRuns, sTest.effectiveRuns, sParams.alpha);
+				bPassed &= reportCells("cellProbInfected", &sRef, &sTest, sParams.alpha);
+			}
+			else
+			{
+				fprintf(stderr, "ensembles are on different landscapes (%d vs %d cells)\n", sRef.numCells, sTest.numCells);
+			}
+		}
+	}
+	return bPassed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,482 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+/*
+	Random number library function
+	http://www.math.sci.hiroshima-u.ac.jp/~m-mat/MT/MT2002/emt19937ar.html
+*/
+#include "mt19937ar.h"
+
+/*
+	Stop Visual C++ from warning about thread safety when asked to compile idiomatic ANSI
+*/
+#ifdef _MSC_VER
+#pragma warning(disable : 4996)
+#endif
+
+/*
+	Generates synthetic host landscapes (in the same gis raster format as read by landscapeScaleSimulation)
+	so that performance can be benchmarked on landscapes of arbitrary size
+
+	Hosts are placed by thresholding a smoothed random field:
+		- clusterScale controls the spatial scale (in cells) of smoothing (=0 means hosts are placed independently)
+		- hostDensity controls the proportion of cells in the raster that contain any host
+		- binaryHosts=1 means every host cell is full (propFull=1.0); otherwise propFull varies with the field
+*/
+
+#define		_MAX_STATIC_BUFF_LEN			1024
+#define		_GIS_NODATA						-9999
+#define		_GIS_CELLSIZE					1000
+#define		_NUM_BLUR_PASSES				3		/* three passes of a box blur is close to a Gaussian blur */
+#define		_MIN_PROP_FULL					0.05
+#define		_MIN_REL_PRI					0.1
+
+#ifdef _MSC_VER
+#define 	C_DIR_DELIMITER '\\'
+#include 	<direct.h>
+#else
+#define 	C_DIR_DELIMITER '/'
+#include 	<sys/types.h>
+#include 	<sys/stat.h>
+#endif
+
+/*
+	Parameters which control the landscape that is generated
+*/
+typedef struct
+{
+	int		numRows;
+	int		numCols;
+	double	hostDensity;	/* proportion of cells which contain host */
+	double	clusterScale;	/* spatial scale of clustering of hosts (measured in cells) */
+	int		binaryHosts;	/* whether (=1) or not (=0) all cells with host are full */
+	int		seed;			/* seed for the random number generator */
+	char	outDir[_MAX_STATIC_BUFF_LEN];
+} t_GenParams;
+
+/*
+	Utility functions for reading configuration options
+*/
+int	getCfgFileName(char *szProgName, char *szCfgFile)
+{
+	/*
+		Work out configuration file name from that of the executable
+		and check whether it exists by attempting to read it
+	*/
+	char	*pPtr;
+	FILE 	*fp;
+
+	szCfgFile[0] = '\0';
+	{
+		if((pPtr = strrchr(szProgName,C_DIR_DELIMITER))!=NULL)
+		{
+			strcpy(szCfgFile,pPtr+1);
+		}
+		else
+		{
+			strcpy(szCfgFile,szProgName);
+		}
+		if((pPtr = strstr(szCfgFile,".exe"))!=NULL)
+		{
+			*pPtr = '\0';
+		}
+		strcat(szCfgFile,".cfg");
+	}
+	/* check file exists */
+	fp = fopen(szCfgFile, "rb");
+	if(fp)
+	{
+		fclose(fp);
+		return 1;
+	}
+	return 0;
+}
+
+/*
+	Following set of routines find values of parameters from the command line options,
+ 	or, failing that, from the cfg file
+*/
+int findKey(int argc, char **argv, char*szCfgFile, char *szKey, char *szValue)
+{
+	char *pVal;
+	int	 bRet,i;
+	FILE *fp;
+	char *pThisPair;
+	char *szArgvCopy;
+
+	bRet = 0;
+	i=0;
+	/* try to find the relevant key on the command line */
+	while(bRet == 0 && i<argc)
+	{
+		szArgvCopy = strdup(argv[i]);
+		if(szArgvCopy)
+		{
+			pThisPair = strtok(szArgvCopy, " \t");
+			while(pThisPair)
+			{
+				if(strncmp(pThisPair,szKey,strlen(szKey))==0)
+				{
+					pVal = strchr(pThisPair,'=');
+					if(pVal)
+					{
+						/* make sure isn't just start of string matching the key */
+						if(pThisPair[strlen(szKey)] == '=')
+						{
+							strcpy(szValue,pVal+1);
+							fprintf(stdout, "extracted %s->%s from command line\n", szKey, szValue);
+							bRet = 1;
+						}
+					}
+				}
+				pThisPair = strtok(NULL, " \t");
+			}
+			free(szArgvCopy);
+		}
+		i++;
+	}
+	/* otherwise, look in the cfg file */
+	if(bRet == 0)
+	{
+		fp = fopen(szCfgFile,"rb");
+		if(fp)
+		{
+			char szLine[_MAX_STATIC_BUFF_LEN];
+
+			while(!bRet && fgets(szLine,_MAX_STATIC_BUFF_LEN,fp))
+			{
+				char *pPtr;
+				if((pPtr = strchr(szLine,'='))!=NULL)
+				{
+					*pPtr = '\0';
+					if(strcmp(szKey,szLine)==0)
+					{
+						strcpy(szValue,pPtr+1);
+						/* strip off newline (if any) */
+						if((pPtr = strpbrk(szValue,"\r\n"))!=NULL)
+							*pPtr = '\0';
+						bRet = 1;
+					}
+				}
+			}
+			fclose(fp);
+		}
+	}
+	return bRet;
+}
+
+int readStringFromCfg(int argc, char **argv, char *szCfgFile, char *szKey, char *szValue)
+{
+	return(findKey(argc, argv, szCfgFile,szKey,szValue));
+}
+
+int readDoubleFromCfg(int argc, char **argv, char *szCfgFile, char *szKey, double *pdValue)
+{
+	char szValue[_MAX_STATIC_BUFF_LEN];
+
+	if(findKey(argc, argv, szCfgFile,szKey,szValue))
+	{
+		*pdValue = atof(szValue);
+		return 1;
+	}
+	return 0;
+}
+
+int readIntFromCfg(int argc, char **argv, char *szCfgFile, char *szKey, int *pnValue)
+{
+	char szValue[_MAX_STATIC_BUFF_LEN];
+
+	if(findKey(argc, argv, szCfgFile,szKey,szValue))
+	{
+		*pnValue = atoi(szValue);
+		return 1;
+	}
+	return 0;
+}
+
+int readParams(t_GenParams *pParams, int argc, char **argv)
+{
+	char szCfgFile[_MAX_STATIC_BUFF_LEN];
+
+	fprintf(stdout, "readParams()\n");
+	memset(pParams,0,sizeof(t_GenParams));
+	if(!getCfgFileName(argv[0], szCfgFile))
+	{
+		fprintf(stderr, "Couldn't find cfg file for program name '%s'\n", argv[0]);
+		return 0;
+	}
+	if(!readIntFromCfg(argc, argv, szCfgFile, "numRows", &pParams->numRows))
+	{
+		fprintf(stdout, "Couldn't read numRows\n");
+		return 0;
+	}
+	if(!readIntFromCfg(argc, argv, szCfgFile, "numCols", &pParams->numCols))
+	{
+		fprintf(stdout, "Couldn't read numCols\n");
+		return 0;
+	}
+	if(!readDoubleFromCfg(argc, argv, szCfgFile, "hostDensity", &pParams->hostDensity))
+	{
+		fprintf(stdout, "Couldn't read hostDensity\n");
+		return 0;
+	}
+	if(!readDoubleFromCfg(argc, argv, szCfgFile, "clusterScale", &pParams->clusterScale))
+	{
+		fprintf(stdout, "Couldn't read clusterScale\n");
+		return 0;
+	}
+	if(!readIntFromCfg(argc, argv, szCfgFile, "binaryHosts", &pParams->binaryHosts))
+	{
+		fprintf(stdout, "Couldn't read binaryHosts\n");
+		return 0;
+	}
+	if(!readIntFromCfg(argc, argv, szCfgFile, "seed", &pParams->seed))
+	{
+		fprintf(stdout, "Couldn't read seed\n");
+		return 0;
+	}
+	if(!readStringFromCfg(argc, argv, szCfgFile, "outDir", pParams->outDir))
+	{
+		fprintf(stdout, "Couldn't read outDir\n");
+		return 0;
+	}
+	if(pParams->numRows <= 0 || pParams->numCols <= 0 || pParams->hostDensity <= 0.0 || pParams->hostDensity > 1.0)
+	{
+		fprintf(stderr, "need numRows > 0, numCols > 0 and 0 < hostDensity <= 1\n");
+		return 0;
+	}
+#ifdef _MSC_VER
+	if(!mkdir(pParams->outDir))
+#else
+	if(!mkdir(pParams->outDir, 0777))
+#endif
+	{
+		fprintf(stdout, "\tcreated directory %s for output\n",pParams->outDir);
+	}
+	else
+	{
+		fprintf(stdout, "\tdirectory %s already exists\n",pParams->outDir);
+	}
+	return 1;
+}
+
+/*
+	One pass of a box blur of radius r along rows (bRows=1) or columns (bRows=0), using a running sum
+	(near the edge of the raster only average over the part of the window that is on the raster)
+*/
+void boxBlur(double *aField, double *aTmp, int numRows, int numCols, int r, int bRows)
+{
+	int		i,j,lineLen,numLines,stride,lineStride,lo,hi;
+	double	runSum;
+
+	lineLen = bRows ? numCols : numRows;
+	numLines = bRows ? numRows : numCols;
+	stride = bRows ? 1 : numCols;
+	lineStride = bRows ? numCols : 1;
+	for(i=0;i<numLines;i++)
+	{
+		double *pLine = aField + i*lineStride;
+
+		runSum = 0.0;
+		for(j=0;j<=r && j<lineLen;j++)
+		{
+			runSum += pLine[j*stride];
+		}
+		for(j=0;j<lineLen;j++)
+		{
+			lo = (j-r > 0) ? j-r : 0;
+			hi = (j+r < lineLen-1) ? j+r : lineLen-1;
+			aTmp[j] = runSum / (hi-lo+1);
+			if(j+r+1 < lineLen)
+			{
+				runSum += pLine[(j+r+1)*stride];
+			}
+			if(j-r >= 0)
+			{
+				runSum -= pLine[(j-r)*stride];
+			}
+		}
+		for(j=0;j<lineLen;j++)
+		{
+			pLine[j*stride] = aTmp[j];
+		}
+	}
+}
+
+/*
+	Fill aField with uniform noise, smoothed over a scale of clusterScale cells
+*/
+int smoothedField(double *aField, int numRows, int numCols, double clusterScale)
+{
+	int		i,r;
+	double	*aTmp;
+
+	for(i=0;i<numRows*numCols;i++)
+	{
+		aField[i] = genrand_real3();
+	}
+	r = (int)(clusterScale + 0.5);
+	if(r > 0)
+	{
+		aTmp = malloc(sizeof(double) * (numRows > numCols ? numRows : numCols));
+		if(!aTmp)
+		{
+			return 0;
+		}
+		for(i=0;i<_NUM_BLUR_PASSES;i++)
+		{
+			boxBlur(aField, aTmp, numRows, numCols, r, 1);
+			boxBlur(aField, aTmp, numRows, numCols, r, 0);
+		}
+		free(aTmp);
+	}
+	return 1;
+}
+
+static int cmpDouble(const void *p1, const void *p2)
+{
+	double d1 = *(double *)p1;
+	double d2 = *(double *)p2;
+
+	return (d1 > d2) - (d1 < d2);
+}
+
+/*
+	Write a single raster in gis format (cells without host are written as NODATA)
+*/
+int writeRaster(t_GenParams *pParams, char *fileName, double *aValues, unsigned char *aHost)
+{
+	FILE	*fOut;
+	char	outFile[_MAX_STATIC_BUFF_LEN];
+	int		x,y;
+
+	sprintf(outFile, "%s%c%s", pParams->outDir, C_DIR_DELIMITER, fileName);
+	fprintf(stdout, "\t%s\n", outFile);
+	fOut = fopen(outFile, "wb");
+	if(!fOut)
+	{
+		fprintf(stderr, "couldn't open %s for writing\n", outFile);
+		return 0;
+	}
+	fprintf(fOut, "ncols\t%d\n", pParams->numCols);
+	fprintf(fOut, "nrows\t%d\n", pParams->numRows);
+	fprintf(fOut, "xllcorner\t0\n");
+	fprintf(fOut, "yllcorner\t0\n");
+	fprintf(fOut, "cellsize\t%d\n", _GIS_CELLSIZE);
+	fprintf(fOut, "NODATA_value\t%d\n", _GIS_NODATA);
+	for(y=0;y<pParams->numRows;y++)
+	{
+		for(x=0;x<pParams->numCols;x++)
+		{
+			if(aHost[x + y*pParams->numCols])
+			{
+				fprintf(fOut, "%s%.6f", x ? " " : "", aValues[x + y*pParams->numCols]);
+			}
+			else
+			{
+				fprintf(fOut, "%s%d", x ? " " : "", _GIS_NODATA);
+			}
+		}
+		fprintf(fOut, "\n");
+	}
+	fclose(fOut);
+	return 1;
+}
+
+int generateLandscape(t_GenParams *pParams)
+{
+	int				i,numPos,numHosts,retVal;
+	double			threshold,maxVal,minPri,maxPri;
+	double			*aField,*aSorted,*aPropFull,*aRelPri,*aOnes;
+	unsigned char	*aHost;
+
+	fprintf(stdout, "generateLandscape()\n");
+	retVal = 0;
+	numPos = pParams->numRows * pParams->numCols;
+	aField = malloc(sizeof(double) * numPos);
+	aSorted = malloc(sizeof(double) * numPos);
+	aPropFull = malloc(sizeof(double) * numPos);
+	aRelPri = malloc(sizeof(double) * numPos);
+	aOnes = malloc(sizeof(double) * numPos);
+	aHost = malloc(sizeof(unsigned char) * numPos);
+	if(aField && aSorted && aPropFull && aRelPri && aOnes && aHost && smoothedField(aField, pParams->numRows, pParams->numCols, pParams->clusterScale))
+	{
+		/* threshold the field so that the required proportion of cells contain host */
+		memcpy(aSorted, aField, sizeof(double) * numPos);
+		qsort(aSorted, numPos, sizeof(double), cmpDouble);
+		i = (int)((1.0 - pParams->hostDensity) * numPos);
+		if(i >= numPos)
+		{
+			i = numPos - 1;
+		}
+		threshold = aSorted[i];
+		maxVal = aSorted[numPos-1];
+		numHosts = 0;
+		for(i=0;i<numPos;i++)
+		{
+			aOnes[i] = 1.0;
+			aHost[i] = (aField[i] >= threshold);
+			if(aHost[i])
+			{
+				numHosts++;
+				if(pParams->binaryHosts || maxVal <= threshold)
+				{
+					aPropFull[i] = 1.0;
+				}
+				else
+				{
+					aPropFull[i] = _MIN_PROP_FULL + (1.0 - _MIN_PROP_FULL) * (aField[i] - threshold) / (maxVal - threshold);
+				}
+			}
+		}
+		/* relative rate of primary infection is an independent smoothed field */
+		retVal = smoothedField(aRelPri, pParams->numRows, pParams->numCols, pParams->clusterScale);
+		if(retVal)
+		{
+			minPri = maxPri = aRelPri[0];
+			for(i=1;i<numPos;i++)
+			{
+				minPri = (aRelPri[i] < minPri) ? aRelPri[i] : minPri;
+				maxPri = (aRelPri[i] > maxPri) ? aRelPri[i] : maxPri;
+			}
+			for(i=0;i<numPos;i++)
+			{
+				aRelPri[i] = (maxPri > minPri) ? _MIN_REL_PRI + (1.0 - _MIN_REL_PRI) * (aRelPri[i] - minPri) / (maxPri - minPri) : 1.0;
+			}
+			fprintf(stdout, "\t%d host cells (%d rows; %d cols)\n", numHosts, pParams->numRows, pParams->numCols);
+			retVal = writeRaster(pParams, "propFull.txt", aPropFull, aHost)
+				&& writeRaster(pParams, "relInfectivity.txt", aOnes, aHost)
+				&& writeRaster(pParams, "relSusceptibility.txt", aOnes, aHost)
+				&& writeRaster(pParams, "relPrimaryInf.txt", aRelPri, aHost);
+		}
+	}
+	else
+	{
+		fprintf(stderr, "out of memory\n");
+	}
+	free(aField);
+	free(aSorted);
+	free(aPropFull);
+	free(aRelPri);
+	free(aOnes);
+	free(aHost);
+	return retVal;
+}
+
+int main(int argc, char **argv)
+{
+	t_GenParams		sParams;
+
+	if(readParams(&sParams, argc, argv))
+	{
+		init_genrand((unsigned long)sParams.seed);
+		if(generateLandscape(&sParams))
+		{
+			return EXIT_SUCCESS;
+		}
+	}
+	return EXIT_FAILURE;
+}
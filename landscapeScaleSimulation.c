@@ -9,6 +9,41 @@
 	http://www.math.sci.hiroshima-u.ac.jp/~m-mat/MT/MT2002/emt19937ar.html
 */
 #include "mt19937ar.h"
+#include "xoshiro256.h"
+
+/*
+	Hardware performance counters around the event loop and dispersal (only used if profile=1)
+*/
+#include "perfCounters.h"
+
+/*
+	Memory accounting by structure (memory.txt, and the estimate made with dryRun=1)
+*/
+#include "memTrack.h"
+
+/*
+	The tiled engine steps its tiles in parallel if compiled with OpenMP (-fopenmp), and one after the other otherwise
+*/
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+/*
+	Progress (progressInterval) is reported by a separate thread, which needs POSIX threads
+*/
+#ifndef _MSC_VER
+#include <pthread.h>
+#endif
+
+/*
+	When built as part of samplingPipeline, each run is passed straight to the annealer
+*/
+#ifdef _PIPELINE
+#include "samplingPipeline.h"
+#define		CFG_PROG_NAME			"landscapeScaleSimulation"	/* the pipeline reads the cfg files of both programs */
+#else
+#define		CFG_PROG_NAME			argv[0]
+#endif
 
 /*
 	Stop Visual C++ from warning about thread safety when asked to compile idiomatic ANSI
@@ -28,12 +63,65 @@
 #define		_GIS_WHITESPACE					",\t "
 #define		_GIS_NEWLINES					"\r\n"
 #define		_GIS_NODATA						"-9999"
+#define		_GIS_NODATA_VALUE				-9999.0
 #define		_LANDSCAPE_BLOCK_SIZE			128
 #define		_PI								3.1415926535897932384626433
 #define		_PRI_INF_TYPE					1
 #define		_SEC_INF_TYPE					2
 #define		_SETUP_DISPERSAL_PRINT_DOT		10000
 #define		_VERY_LONG_TIME					10000000.0
+#define		_ENGINE_EXACT					0
+#define		_ENGINE_TAULEAP					1
+#define		_ENGINE_FFT						2
+#define		_ENGINE_MEANFIELD				3
+#define		_ENGINE_TILED					4
+#define		_NUM_ENGINES					5
+#define		_CELL_ORDER_RASTER				0
+#define		_CELL_ORDER_MORTON				1
+#define		_CELL_ORDER_HILBERT				2
+#define		_NUM_CELL_ORDERS				3
+#define		_RNG_MT							0
+#define		_RNG_XOSHIRO					1
+#define		_NUM_RNGS						2
+#define		_STATE_NO_HOST					0		/* states of a grid position in the state map (2 bits each) */
+#define		_STATE_SUSCEPTIBLE				1
+#define		_STATE_INFECTED					2
+#define		_STREAM_PRIMARY					0		/* times and locations of primary infection (and the first infection if ratePriInf=0) */
+#define		_STREAM_DISPERSAL				1		/* times and destinations of secondary challenges */
+#define		_STREAM_SUSCEPTIBILITY			2		/* whether challenges cause infection */
+#define		_NUM_STREAMS					3
+#define		_MIN_FFT_HAZARD					1e-12	/* hazards below this are rounding error in the FFT, and are ignored */
+#define		_FFT_KERNEL_TAIL				1e-6	/* proportion of the kernel which can be dropped to allow less padding in the FFT */
+#define		_MAX_THRESHOLDS					32		/* maximum number of values in the maxIncidence list */
+#define		_MAX_SPLIT_LEVELS				8		/* maximum number of values in the splitLevels list */
+#define		_SNAPSHOT_MAGIC					"LSSNAP02"	/* first bytes of a snapshot file (changed if the format changes) */
+#define		_POISSON_SMALL_MEAN				30.0	/* use inversion below this mean, and rejection above */
+#define		_TILE_MSG_BLOCK					64		/* initial size of each buffer of messages in the tiled engine */
+#define		_SURVEY_OFFSET_STEP				(1.0/365.0)	/* step between the survey start times averaged over (one day, as in simulatedAnnealing) */
+#define		_SURVEY_TINY_EPS				1e-10
+#define		_AGGREGATE_PROB_INF				0		/* rasters summarising the ensemble (see writeAggregate()) */
+#define		_AGGREGATE_MEAN_FINAL_INC		1
+#define		_AGGREGATE_MEAN_TIME_INF		2
+#define		_AGGREGATE_SD_TIME_INF			3
+#define		_AGGREGATE_PROP_PRIMARY			4
+#define		_NUM_AGGREGATES					5
+#define		_LOG_QUIET						0		/* levels of output to the screen (see logLevel) */
+#define		_LOG_NORMAL						1
+#define		_LOG_VERBOSE					2
+#define		_NUM_LOG_LEVELS					3
+#define		_PROGRESS_POLL_SECS				0.1		/* how often the progress thread checks if it should stop */
+
+/*
+	Storage of cell attributes (compile with -D_SINGLE_PRECISION to store them as float, which roughly halves their memory;
+	times and accumulated quantities, including the cumulative dispersal kernel, are always double)
+*/
+#ifdef _SINGLE_PRECISION
+typedef float	t_Real;
+#define		_SINGLE_PRECISION_FLAG			1
+#else
+typedef double	t_Real;
+#define		_SINGLE_PRECISION_FLAG			0
+#endif
 
 #ifdef _MSC_VER
 #define 	C_DIR_DELIMITER '\\'
@@ -43,9 +131,59 @@
 #define 	C_DIR_DELIMITER '/'
 #include 	<sys/types.h>
 #include 	<sys/stat.h>
+#include 	<sys/time.h>
 #include 	<unistd.h>
 #endif
 
+/*
+	Names of engines as given in the cfg file (in order of the _ENGINE_ constants)
+*/
+const char *g_aEngineNames[_NUM_ENGINES] = { "exact", "tauleap", "fft", "meanfield", "tiled" };
+
+/*
+	Names of the orders cells can be stored in (in order of the _CELL_ORDER_ constants)
+*/
+const char *g_aCellOrderNames[_NUM_CELL_ORDERS] = { "raster", "morton", "hilbert" };
+
+/*
+	Names of the random number generators (in order of the _RNG_ constants)
+*/
+const char *g_aRngNames[_NUM_RNGS] = { "mt", "xoshiro" };
+
+/*
+	Names of the rasters summarising the ensemble, as in aggregate_<name>.asc (in order of the _AGGREGATE_ constants)
+*/
+const char *g_aAggregateNames[_NUM_AGGREGATES] = { "probInf", "meanFinalInc", "meanTimeInf", "sdTimeInf", "propPrimary" };
+
+/*
+	Names of the levels of output to the screen (in order of the _LOG_ constants)
+*/
+const char *g_aLogLevelNames[_NUM_LOG_LEVELS] = { "quiet", "normal", "verbose" };
+
+/*
+	Signs of the x and y offsets in each quadrant of the dispersal kernel (only one quadrant is stored)
+*/
+const int g_aQuadSignX[4] = { 1, -1, -1, 1 };
+const int g_aQuadSignY[4] = { 1, 1, -1, -1 };
+
+/*
+	Separate random number streams for common random numbers (only used if commonRandomNumbers=1)
+*/
+int			g_bCommonRandom = 0;
+mt_state	g_aRandomStreams[_NUM_STREAMS];
+
+/*
+	Which generator streamRandom() uses, and the streams of the block generator (if it isn't using common random numbers,
+	every stream is the first of these)
+*/
+int				g_rng = _RNG_MT;
+xoshiro_state	g_aBlockStreams[_NUM_STREAMS];
+
+/*
+	How much is written to the screen (one of the _LOG_ constants, set from logLevel by readParams())
+*/
+int				g_logLevel = _LOG_VERBOSE;
+
 /*
 	Information on a single cell
 */
@@ -53,10 +191,10 @@ typedef struct
 {
 	int		xPos;			/* column in gis raster */
 	int		yPos;			/* row in gis raster */
-	double	propFull;		/* proportion of cell with host */
-	double	relInf;			/* relative infectivity */
-	double	relSus;			/* relative susceptibility */
-	double	relPri;			/* relative force of primary infection */
+	t_Real	propFull;		/* proportion of cell with host */
+	t_Real	relInf;			/* relative infectivity */
+	t_Real	relSus;			/* relative susceptibility */
+	t_Real	relPri;			/* relative force of primary infection */
 	double	tInf;			/* time of first infection of this cell */
 	double	tNext;			/* time of next possible secondary infection caused by this cell */
 	int		infType;		/* whether this cell became infected via primary or secondary infection */
@@ -75,6 +213,13 @@ typedef struct
 	int		numCellsSpace;
 	int		*aCellLookup;
 	double	totalFull;		/* this stores the total number of cells that are full, accounting for fractions */
+	int		*aCellID;		/* original (raster order) number of each cell, as used in all output (NULL if cells are in raster order) */
+	int		*aCellIndex;	/* position in aCells of the cell with each original number (NULL if cells are in raster order) */
+	int		*aLookupX;		/* if aCellLookup is tiled, offset of each column and row in it (NULL if it is in raster order) */
+	int		*aLookupY;
+	long	lookupSize;		/* number of entries in aCellLookup */
+	unsigned char	*aStateMap;	/* state of each entry in aCellLookup, packed four to a byte, so most failed challenges don't touch aCells */
+	char	aszGISHeader[_GIS_HEADER_LENGTH][_MAX_STATIC_BUFF_LEN];	/* header of the host raster (adjusted if coarsened), for rasters that are written out */
 } t_Landscape;
 
 /*
@@ -101,27 +246,118 @@ typedef struct
 	int		totalInf;
 } t_Epidemic;
 
+/*
+	In multilevel splitting the state of a run is saved when it first reaches each splitLevel, so the copies
+	which are still to be run from that level can start from it (runs are done depth first, so only one state
+	is needed per level)
+*/
+typedef struct
+{
+	t_Cell	*aCells;		/* copy of the landscape (tInf, tNext, ... for every cell) */
+	int		*aQueueCells;	/* copy of the epidemic */
+	int		queueLen;
+	int		*aInfCells;
+	int		totalInf;
+	double	priNextT;		/* time of the next primary infection */
+	double	thisTime;
+	double	nextReport;
+	double	trueIncidence;
+	int		numCrossed;		/* thresholds crossed so far (and when) */
+	double	aThreshTime[_MAX_THRESHOLDS];
+	int		aThreshNumInf[_MAX_THRESHOLDS];
+	char	dpcFile[_MAX_STATIC_BUFF_LEN];	/* dpc file of the run that reached the level */
+	long	dpcLength;		/* length of that file when the level was reached */
+	int		numCopiesLeft;	/* number of copies still to run from this level */
+} t_SplitState;
+
+/*
+	A run can be saved part way through to a binary snapshot (snapshotIncidence), and every iteration of a later
+	simulation can carry on from it (snapshotFile); only cells which have been infected are stored
+*/
+typedef struct
+{
+	int			numInf;
+	int			*aInfCells;		/* infected cells (in order of infection), with the state of each */
+	double		*aTInf;
+	double		*aTNext;
+	int			*aInfType;
+	int			*aInfBy;
+	int			queueLen;
+	int			*aQueueCells;	/* priority queue (in heap order) */
+	double		priNextT;		/* time of the next primary infection */
+	double		thisTime;
+	double		nextReport;
+	double		trueIncidence;
+	int			numCrossed;		/* values of maxIncidence reached before the snapshot (matched to the current list), and when */
+	double		aThreshVal[_MAX_THRESHOLDS];
+	double		aThreshTime[_MAX_THRESHOLDS];
+	int			aThreshNumInf[_MAX_THRESHOLDS];
+	int			commonRandom;	/* whether the run used common random numbers (and so which random number state is stored) */
+	int			rng;			/* and which generator */
+	mt_state	sRandom;
+	mt_state	aStreams[_NUM_STREAMS];
+	xoshiro_state	aBlockStreams[_NUM_STREAMS];
+} t_Snapshot;
+
 /*
 	Parameters which control behaviour of simulation
 */
 typedef struct
 {
 	double	cellThresh;		/* minimum proportion covered for cell to be included */
+	int		coarsen;		/* size of the blocks of cells the landscape is aggregated into (1 means full resolution) */
 	char	filePropFull[_MAX_STATIC_BUFF_LEN];
 	char	fileRelInf[_MAX_STATIC_BUFF_LEN];
 	char	fileRelSus[_MAX_STATIC_BUFF_LEN];
 	char	fileRelPri[_MAX_STATIC_BUFF_LEN];
 	int		numIts;			/* number of iterations of the simulation to run */
 	char	outStub[_MAX_STATIC_BUFF_LEN];
+	char	outDir[_MAX_STATIC_BUFF_LEN];	/* directory for output (=outStub, or <outStub>/<outStub>_<i> for the i'th set in a sweep, or <outStub>/<outStub>_shard<k> for shard k) */
+	int		shardIndex;		/* this process runs iterations shardIndex, shardIndex+numShards, ... */
+	int		numShards;		/* number of shards the ensemble is split into (=0 if not sharded) */
+	int		mergeShards;	/* number of shards to merge into a single ensemble (=0 to run the simulation as usual) */
+	char	sweepFile[_MAX_STATIC_BUFF_LEN];	/* file of parameter sets to run in a single process (empty if not a sweep) */
 	double	ratePriInf;		/* this is the max rate at which expect primary infections over entire landscape */
 	double	rateSecInf;		/* this is the secondary infection rate */
 	double	dispScale;		/* average dispersal scale (measured in cells) */
 	double	reportTime;		/* how frequently to report to the screen */
 	double	maxTime;		/* maximum time to run epidemics up to (only used if don't set incidence) */
-	double	maxIncidence;	/* this gives an alternate stopping condition */
+	double	maxIncidence;	/* this gives an alternate stopping condition (largest value if a list is given) */
+	double	aThresholds[_MAX_THRESHOLDS];	/* all values of maxIncidence (in increasing order) */
+	int		numThresholds;
+	double	aSplitLevels[_MAX_SPLIT_LEVELS];	/* incidences at which runs are split into copies (in increasing order) */
+	int		numSplitLevels;	/* number of values in aSplitLevels (=0 means no splitting) */
+	int		splitFactor;	/* number of copies a run is split into at each level */
+	int		cellOrder;		/* order cells are stored in (one of _CELL_ORDER_RASTER, _CELL_ORDER_MORTON, ...) */
+	int		introStrata;	/* number of strata the first infection of each run is drawn from (<2 means not stratified) */
+	double	snapshotIncidence;	/* incidence at which to write a snapshot of each run (=0 means no snapshots) */
+	char	snapshotFile[_MAX_STATIC_BUFF_LEN];	/* snapshot every iteration carries on from (empty if runs start from t=0) */
 	double	withinCellBulkUp;	/* logistic rate of increase of within-cell infection */
 	double	withinCellMin;		/* minimum fraction of cell that can be infected (note if trueMinFlag=0 this is relative to carrying capacity of cell) */
 	int		trueMinFlag;	/* whether to make withinCellMin relative to amount of hosts in cell (trueMinFlag=0) or a raw proportion (trueMinFlag=1) */
+	int		seed;			/* seed for the random number generator (=0 means seed from the clock and process ID) */
+	int		commonRandom;	/* whether to use common random numbers, so iteration i is coupled across parameter sets */
+	int		rng;			/* which random number generator the simulation draws from (_RNG_MT or _RNG_XOSHIRO) */
+	int		archiveRuns;	/* whether to write the output files for each run (can only be turned off in samplingPipeline, or with surveyFile) */
+	int		aggregateRasters;	/* whether to write rasters of per-cell summaries over the ensemble (see writeAggregate()) */
+	int		logLevel;		/* how much is written to the screen (one of _LOG_QUIET, _LOG_NORMAL, _LOG_VERBOSE) */
+	double	progressInterval;	/* seconds between reports of progress from a separate thread (=0 means no reports) */
+	int		profile;		/* whether to profile the event loop and whichCellSecondary() with hardware performance counters */
+	int		profileEvery;	/* only one call in profileEvery is measured (and the totals scaled up) */
+	int		dryRun;			/* whether to just estimate the memory needed and stop (see estimateMemory()) */
+	char	surveyFile[_MAX_STATIC_BUFF_LEN];	/* sampling patterns to evaluate in every run (empty if none) */
+	double	surveyDelta;	/* time between surveys of each pattern */
+	int		surveySamples;	/* samples taken from each site at each survey */
+	double	surveyTestSens;	/* sensitivity of a single sample */
+	double	surveyDetLag;	/* period after infection within which infection cannot be detected */
+	int		engine;			/* which simulation engine to use (one of _ENGINE_EXACT, _ENGINE_TAULEAP, ...) */
+	int		tauLeapSwitch;	/* number of infected cells at which the tau-leaping (or tiled) engine takes over from the exact engine */
+	double	tauLeapEpsilon;	/* maximum relative change in landscape incidence in a single tau-leaping step (or window of the tiled engine) */
+	int		tileSize;		/* width (in cells) of the square tiles the tiled engine divides the landscape into */
+	int		numThreads;		/* number of threads the tiled engine uses (=0 means the OpenMP default) */
+	int		fftSwitch;		/* number of infected cells at which the FFT engine takes over from the exact engine */
+	double	fftStep;		/* time step used by the FFT and mean-field engines */
+	double	fftTolerance;	/* relative change in total infectivity (or number infected) before force of infection is recalculated */
 } t_Params;
 
 /*
@@ -131,16 +367,48 @@ typedef struct
 typedef struct
 {
 	int		numProbs;		/* number of probabilities that are stored */
-	double  *aProbs;		/* array of dispersal probabilities */
+	double	*aProbs;		/* array of dispersal probabilities (cumulative, so always double: near the top of the table
+								a float can't resolve the small entries of the tail, which would never be chosen) */
 	double	inCell;			/* probability of dispersing back to original cell (=aProbs[0]) */
 	double	onLandscape;	/* probability of dispersing on the landscape */
 } t_Dispersal;
 
+/*
+	The dispersal kernel is translation invariant, so the force of infection on every cell is a convolution of the
+	infectivity of all cells with the kernel, which can be done with FFTs on a zero-padded copy of the raster
+*/
+typedef struct
+{
+	int		nx;				/* padded size (powers of two large enough to avoid wrap around) */
+	int		ny;
+	double	*aKernelRe;		/* transform of the kernel */
+	double	*aKernelIm;
+	double	*aWorkRe;		/* work space (nx*ny) */
+	double	*aWorkIm;
+	double	*aInfectivity;	/* infectivity of each cell (numCells) */
+	double	*aForce;		/* force of (secondary) infection on each cell, before accounting for its susceptibility (numCells) */
+	double	lastTotal;		/* total infectivity when force was last recalculated (<0 means force must be recalculated) */
+	int		lastNumInf;		/* number of infected cells when force was last recalculated */
+} t_FFTKernel;
+
+/*
+	In a parameter sweep dispersal kernels (and their transforms) are cached for each distinct dispScale
+*/
+typedef struct
+{
+	double		dispScale;
+	double		rateSecFactor;	/* factor by which setupDispersal() scales rateSecInf when renormalising the kernel */
+	t_Dispersal	sDispersal;
+	t_FFTKernel	sFFT;
+	int			bFFT;			/* whether sFFT has been set up */
+} t_KernelCache;
+
 /*
 	Keep track of how many of each type of event were attempted
 */
 typedef struct
 {
+	long	numPrimaryAttempts;
 	long	numSecondaryAttempts;
 	long	numNonEmpty;
 	long	numNonInfected;
@@ -148,6 +416,136 @@ typedef struct
 	long	numFindNextSecondary;
 } t_RunStats;
 
+/*
+	The tiled engine divides the grid into square tiles, each with its own infected cells, priority queue and random number
+	stream, so the tiles can be run through a window of time independently; infections of a tile's cells from elsewhere
+	(primary infection, or challenges from other tiles) are passed to it as messages (see tiledStep())
+*/
+typedef struct
+{
+	double	tInf;
+	int		cell;			/* cell infected (which can be in any tile) */
+	int		infBy;			/* (=_EMPTY_CELL for primary infection) */
+} t_TileMsg;
+
+typedef struct
+{
+	int			*aInfCells;		/* infected cells in the tile (in order of infection) */
+	int			numInf;
+	int			numInfStart;	/* number infected at the start of the window */
+	t_Epidemic	sQueue;			/* next challenge from each cell in the tile (only aQueueCells and queueLen are used) */
+	t_TileMsg	*aMsgs;			/* successful challenges of cells in other tiles in the current window */
+	int			numMsgs;
+	int			maxMsgs;
+	t_TileMsg	*aIn;			/* infections of cells in the tile from elsewhere that the tile was last run with (in order of time) */
+	int			numIn;
+	int			maxIn;
+	t_TileMsg	*aNextIn;		/* and as gathered for the next pass */
+	int			numNextIn;
+	int			maxNextIn;
+	int			bDirty;			/* set if aIn has changed since the tile was last run in the window */
+	int			bSaved;			/* whether the random number stream at the start of the window has been saved */
+	int			bNoMemory;		/* set if a buffer couldn't be grown */
+	mt_state	sRandom;		/* random number stream for the tile (with rng=mt) */
+	xoshiro_state	sBlockRandom;	/* (with rng=xoshiro) */
+	mt_state	sSavedRandom;	/* the stream at the start of the window */
+	xoshiro_state	sSavedBlockRandom;
+	double		incidence;		/* contribution to the landscape incidence, and its rate of change, at the start of the window */
+	double		incidenceRate;
+	t_RunStats	sStats;
+} t_Tile;
+
+typedef struct
+{
+	int		tileSize;
+	int		numTileCols;
+	int		numTiles;
+	t_Tile	*aTiles;
+	int		numAssigned;	/* number of infections (from the start of pEpidemic->aInfCells) handed to their tiles */
+	int		bSeeded;		/* whether the tile streams have been seeded in this run */
+	t_TileMsg	*aPriMsgs;	/* primary infections in the current window */
+	int		numPriMsgs;
+	int		maxPriMsgs;
+	long	numWindows;		/* to report how many passes over the tiles each window needed */
+	long	numPasses;
+} t_Tiling;
+
+/*
+	Sampling patterns evaluated as each run finishes (see evaluateSurveillance()), so testing a pattern on an ensemble
+	doesn't need the runs to be written out
+*/
+typedef struct
+{
+	int		numPatterns;
+	int		*aNumSites;		/* number of sites in each pattern */
+	int		**aaSites;		/* cells (positions in aCells) in each pattern */
+	int		maxSites;
+	double	*aTInf;			/* work space (maxSites) for the infected sites in a pattern */
+	int		*aInfSites;		/* (and which cells they are) */
+	double	*aPHost;		/* (probability each is detected, averaged over survey start times) */
+	double	*aPNotHost;		/* (probability each is not detected, for a single start time) */
+	FILE	*fOut;			/* surveillance.txt */
+} t_Surveillance;
+
+/*
+	Per-cell totals over the runs of an ensemble, weighted by the weight of each run (see addToAggregate()), which are
+	written out as rasters at the end, so maps of risk don't need the runs to be written out (or read back in)
+*/
+typedef struct
+{
+	char	aszGISHeader[_GIS_HEADER_LENGTH][_MAX_STATIC_BUFF_LEN];
+	int		numRows;
+	int		numCols;
+	int		numCells;
+	int		*aPos;			/* position in the raster of each cell */
+	int		numRuns;
+	double	totalWeight;
+	double	*aInfWeight;	/* total weight of the runs in which each cell was infected */
+	double	*aSumFinal;		/* (weighted) sums of its incidence at the end of the run, */
+	double	*aSumTime;		/* of its time of infection, */
+	double	*aSumTimeSq;	/* of the square of that, */
+	double	*aPriWeight;	/* and total weight of the runs in which it was infected by primary infection */
+} t_Aggregate;
+
+/*
+	Time spent in each stage of the program (reported to allow performance to be benchmarked)
+*/
+typedef struct
+{
+	double	readLandscape;
+	double	setupPrimary;
+	double	setupDispersal;
+	double	setupEpidemic;
+	double	runEpidemics;
+} t_Timings;
+
+/*
+	Where the simulation has got to, for the progress thread to sample (see startProgress())
+	The event loop only stores numbers here, so reporting progress costs it nothing but a few writes, and never formats
+	a string; a value read part way through being written is only ever out of date by an event
+*/
+typedef struct
+{
+	volatile int	iteration;
+	volatile double	thisTime;
+	volatile long	numEvents;		/* events since the start of runEpidemics() */
+	volatile int	bStop;
+	int		numIts;
+	double	interval;		/* seconds between reports */
+	int		bRunning;
+#ifndef _MSC_VER
+	pthread_t	thread;
+#endif
+} t_Progress;
+
+t_Progress	g_sProgress;
+
+/*
+	Regions profiled with profile=1 (on the main thread only, so with engine=tiled just the serial parts are counted)
+*/
+perf_region	g_sProfileEventLoop = { .szName = "eventLoop" };
+perf_region	g_sProfileWhichCell = { .szName = "whichCellSecondary" };
+
 /*
 	Utility functions for the priority queue
 */
@@ -482,6 +880,51 @@ void posToGrid(int pos, int numCols, int *pX, int *pY)
 	*pX = pos%numCols;
 }
 
+/*
+	Cells can be stored in a different order to the raster (see reorderCells()), so these convert between the position of a
+	cell in aCells and its original number (which is used in all output), and find the cell (if any) at a point on the grid
+*/
+int cellID(t_Landscape *pLandscape, int cell)
+{
+	return pLandscape->aCellID ? pLandscape->aCellID[cell] : cell;
+}
+
+int cellIndex(t_Landscape *pLandscape, int id)
+{
+	return pLandscape->aCellIndex ? pLandscape->aCellIndex[id] : id;
+}
+
+int lookupPos(t_Landscape *pLandscape, int x, int y)
+{
+	if (pLandscape->aLookupX)
+	{
+		return pLandscape->aLookupX[x] | pLandscape->aLookupY[y];
+	}
+	return gridToPos(x, y, pLandscape->numCols);
+}
+
+int lookupCell(t_Landscape *pLandscape, int x, int y)
+{
+	return pLandscape->aCellLookup[lookupPos(pLandscape, x, y)];
+}
+
+/*
+	Read (or set) the 2-bit state (_STATE_NO_HOST, _STATE_SUSCEPTIBLE or _STATE_INFECTED) of a position in the state map
+*/
+int getPosState(t_Landscape *pLandscape, int pos)
+{
+	return (pLandscape->aStateMap[pos >> 2] >> ((pos & 3) << 1)) & 3;
+}
+
+void setCellState(t_Landscape *pLandscape, int cell, int state)
+{
+	int pos,shift;
+
+	pos = lookupPos(pLandscape, pLandscape->aCells[cell].xPos, pLandscape->aCells[cell].yPos);
+	shift = (pos & 3) << 1;
+	pLandscape->aStateMap[pos >> 2] = (unsigned char)((pLandscape->aStateMap[pos >> 2] & ~(3 << shift)) | (state << shift));
+}
+
 /*
 	Return uniform random number between 0 and 1
 
@@ -502,29 +945,145 @@ double	uniformRandom()
 #endif
 }
 
+/*
+	Uniform random number from one of the streams used for common random numbers
+	(if common random numbers are not being used every stream is just uniformRandom(), or the first block stream with rng=xoshiro)
+*/
+double	streamRandom(int stream)
+{
+	if(g_rng == _RNG_XOSHIRO)
+	{
+		return xoshiro_uniform(&g_aBlockStreams[g_bCommonRandom ? stream : 0]);
+	}
+	if(g_bCommonRandom)
+	{
+		return genrand_real3_r(&g_aRandomStreams[stream]);
+	}
+	return uniformRandom();
+}
+
+/*
+	Exponential random number with mean 1 from a stream, for waiting times
+	(the block generator transforms a whole buffer at once; otherwise this is just -log of a uniform)
+*/
+double	streamExponential(int stream)
+{
+	if(g_rng == _RNG_XOSHIRO)
+	{
+		return xoshiro_exponential(&g_aBlockStreams[g_bCommonRandom ? stream : 0]);
+	}
+	return -log(streamRandom(stream));
+}
+
+/*
+	Uniform random number from a tile's own stream (see tiledStep())
+*/
+double	tileRandom(t_Tile *pTile)
+{
+	if(g_rng == _RNG_XOSHIRO)
+	{
+		return xoshiro_uniform(&pTile->sBlockRandom);
+	}
+	return genrand_real3_r(&pTile->sRandom);
+}
+
+/*
+	Exponential random number with mean 1 from a tile's own stream (as streamExponential())
+*/
+double	tileExponential(t_Tile *pTile)
+{
+	if(g_rng == _RNG_XOSHIRO)
+	{
+		return xoshiro_exponential(&pTile->sBlockRandom);
+	}
+	return -log(tileRandom(pTile));
+}
+
+/*
+	Uniform random number from a tile's stream if there is one, and from the given stream otherwise
+*/
+static inline double	randomFrom(int stream, t_Tile *pTile)
+{
+	if(pTile)
+	{
+		return tileRandom(pTile);
+	}
+	return streamRandom(stream);
+}
+
+/*
+	Seed each stream for a single iteration from (seed, iteration, stream), so iteration i
+	draws the same random numbers from each stream whatever the other parameters are
+*/
+void	seedStreams(int seed, int iteration)
+{
+	unsigned long	aKey[3];
+	int				i;
+
+	for(i=0;i<_NUM_STREAMS;i++)
+	{
+		aKey[0] = (unsigned long) seed;
+		aKey[1] = (unsigned long) iteration;
+		aKey[2] = (unsigned long) i;
+		init_by_array_r(&g_aRandomStreams[i], aKey, 3);
+		if(g_rng == _RNG_XOSHIRO)
+		{
+			xoshiro_seed(&g_aBlockStreams[i], aKey, 3);
+		}
+	}
+}
+
 /*
 	Seed random number generator
 
 	Encapsulated to allow easy replacement if necessary
+	(a non-zero fixedSeed gives reproducible runs, e.g. for benchmarking)
 */
-void	seedRandom()
+void	seedRandom(int fixedSeed)
 {
 	unsigned long		ulnSeed;
 	unsigned long		myPID;
 
-	ulnSeed =(unsigned long) time(NULL);
-	/* Make sure that multiple different processes started at same time have different seeds */
+	if(fixedSeed)
+	{
+		ulnSeed = (unsigned long) fixedSeed;
+	}
+	else
+	{
+		ulnSeed =(unsigned long) time(NULL);
+		/* Make sure that multiple different processes started at same time have different seeds */
 #ifndef _MSC_VER
-	myPID = (unsigned long) getpid();
+		myPID = (unsigned long) getpid();
 #else
-	myPID = (unsigned long) _getpid();
+		myPID = (unsigned long) _getpid();
 #endif
-	ulnSeed += myPID;
+		ulnSeed += myPID;
+	}
 #if 0
 	srand((unsigned int)ulnSeed);
 #else
 	init_genrand(ulnSeed);
 #endif
+	xoshiro_seed(&g_aBlockStreams[0], &ulnSeed, 1);
+}
+
+/*
+	Make a directory for output (if it doesn't already exist)
+*/
+void makeOutputDir(char *szDir)
+{
+#ifdef _MSC_VER
+	if(!mkdir(szDir))
+#else
+	if(!mkdir(szDir, 0777))
+#endif
+	{
+		fprintf(stdout, "\tcreated directory %s for output\n",szDir);
+	}
+	else
+	{
+		fprintf(stdout, "\tdirectory %s already exists\n",szDir);
+	}
 }
 
 /*
@@ -532,15 +1091,17 @@ void	seedRandom()
 	(and dump to a new file so can tell which values program used)
 */
 
-int readParams(t_Params *pParams, int argc, char **argv)
+int readParams(t_Params *pParams, int argc, char **argv, int sweepIndex)
 {
-	char szCfgFile[_MAX_STATIC_BUFF_LEN];
+	char	szCfgFile[_MAX_STATIC_BUFF_LEN];
+	char	szShard[_MAX_STATIC_BUFF_LEN];
+	int		i;
 
 	fprintf(stdout, "readParams()\n");
 	memset(pParams,0,sizeof(t_Params));
-	if(!getCfgFileName(argv[0], szCfgFile))
+	if(!getCfgFileName(CFG_PROG_NAME, szCfgFile))
 	{
-		fprintf(stderr, "Couldn't find cfg file for program name '%s'\n", argv[0]);
+		fprintf(stderr, "Couldn't find cfg file for program name '%s'\n", CFG_PROG_NAME);
 		return 0;
 	}
 	if(!readDoubleFromCfg(argc, argv, szCfgFile, "cellThresh", &pParams->cellThresh))
@@ -578,17 +1139,47 @@ int readParams(t_Params *pParams, int argc, char **argv)
 		fprintf(stdout, "Couldn't read outStub\n");
 		return 0;
 	}
-#ifdef _MSC_VER
-	if(!mkdir(pParams->outStub))
-#else
-	if(!mkdir(pParams->outStub, 0777))
-#endif
+	/* dryRun is optional (if not set then the simulation is run); it is read here as a dry run writes no output */
+	if (!readIntFromCfg(argc, argv, szCfgFile, "dryRun", &pParams->dryRun))
 	{
-		fprintf(stdout, "\tcreated directory %s for output\n",pParams->outStub);
+		pParams->dryRun = 0;
+	}
+	if (!pParams->dryRun)
+	{
+		makeOutputDir(pParams->outStub);
+	}
+	/* shard is optional (if not set then run every iteration) */
+	pParams->shardIndex = 0;
+	pParams->numShards = 0;
+	if (readStringFromCfg(argc, argv, szCfgFile, "shard", szShard) && szShard[0] != '\0')
+	{
+		if (sscanf(szShard, "%d/%d", &pParams->shardIndex, &pParams->numShards) != 2 || pParams->numShards < 1 || pParams->shardIndex < 0 || pParams->shardIndex >= pParams->numShards)
+		{
+			fprintf(stdout, "Couldn't read shard (must be k/n, with 0 <= k < n)\n");
+			return 0;
+		}
+	}
+	if (sweepIndex >= 0)
+	{
+		/* each set in a sweep has its own directory inside the outStub directory */
+		sprintf(pParams->outDir, "%s%c%s_%d", pParams->outStub, C_DIR_DELIMITER, pParams->outStub, sweepIndex);
+		if (!pParams->dryRun)
+		{
+			makeOutputDir(pParams->outDir);
+		}
+	}
+	else if (pParams->numShards)
+	{
+		/* as does each shard (so shards can share a file system, or have their directories gathered together to be merged) */
+		sprintf(pParams->outDir, "%s%c%s_shard%d", pParams->outStub, C_DIR_DELIMITER, pParams->outStub, pParams->shardIndex);
+		if (!pParams->dryRun)
+		{
+			makeOutputDir(pParams->outDir);
+		}
 	}
 	else
 	{
-		fprintf(stdout, "\tdirectory %s already exists\n",pParams->outStub);
+		strcpy(pParams->outDir, pParams->outStub);
 	}
 	if(!readDoubleFromCfg(argc, argv, szCfgFile, "maxTime", &pParams->maxTime))
 	{
@@ -615,10 +1206,48 @@ int readParams(t_Params *pParams, int argc, char **argv)
 		fprintf(stdout, "Couldn't read reportTime\n");
 		return 0;
 	}
-	if(!readDoubleFromCfg(argc, argv, szCfgFile, "maxIncidence", &pParams->maxIncidence))
+	/* maxIncidence can be a comma separated list, in which case runs continue to the largest value */
 	{
-		fprintf(stdout, "Couldn't read maxIncidence\n");
-		return 0;
+		char	szThresholds[_MAX_STATIC_BUFF_LEN];
+		char	*pPtr;
+		double	thisVal;
+		int		j;
+
+		if(!readStringFromCfg(argc, argv, szCfgFile, "maxIncidence", szThresholds))
+		{
+			fprintf(stdout, "Couldn't read maxIncidence\n");
+			return 0;
+		}
+		pParams->numThresholds = 0;
+		pPtr = strtok(szThresholds, ",");
+		while(pPtr)
+		{
+			if(pParams->numThresholds == _MAX_THRESHOLDS)
+			{
+				fprintf(stdout, "Too many values of maxIncidence (maximum %d)\n", _MAX_THRESHOLDS);
+				return 0;
+			}
+			/* insertion sort into increasing order */
+			thisVal = atof(pPtr);
+			for(j=pParams->numThresholds;j>0 && pParams->aThresholds[j-1] > thisVal;j--)
+			{
+				pParams->aThresholds[j] = pParams->aThresholds[j-1];
+			}
+			pParams->aThresholds[j] = thisVal;
+			pParams->numThresholds++;
+			pPtr = strtok(NULL, ",");
+		}
+		if(pParams->numThresholds == 0)
+		{
+			fprintf(stdout, "Couldn't read maxIncidence\n");
+			return 0;
+		}
+		if(pParams->numThresholds > 1 && pParams->aThresholds[0] <= 0.0)
+		{
+			fprintf(stdout, "All values of maxIncidence must be > 0 if a list is given\n");
+			return 0;
+		}
+		pParams->maxIncidence = pParams->aThresholds[pParams->numThresholds - 1];
 	}
 	if(!readDoubleFromCfg(argc, argv, szCfgFile, "withinCellBulkUp", &pParams->withinCellBulkUp))
 	{
@@ -635,17 +1264,409 @@ int readParams(t_Params *pParams, int argc, char **argv)
 		fprintf(stdout, "Couldn't read trueMinFlag\n");
 		return 0;
 	}
-	/* Following code dumps out parameters as read in */
+	/* sweepFile is optional (if not set then just run the one set of parameters) */
+	if (!readStringFromCfg(argc, argv, szCfgFile, "sweepFile", pParams->sweepFile))
 	{
-		FILE	*paramsOut;
-		char	outFile[_MAX_STATIC_BUFF_LEN];
-
-		sprintf(outFile, "%s%cparamsOut.txt", pParams->outStub, C_DIR_DELIMITER);
-		fprintf(stdout, "\twriting copy of parameters to %s\n", outFile);
-		paramsOut = fopen(outFile, "wb");
-		if(paramsOut)
+		pParams->sweepFile[0] = '\0';
+	}
+	/* seed is optional (if not set then seed from clock) */
+	if (!readIntFromCfg(argc, argv, szCfgFile, "seed", &pParams->seed))
+	{
+		pParams->seed = 0;
+	}
+	/* commonRandomNumbers is optional (if not set then don't use common random numbers) */
+	if (!readIntFromCfg(argc, argv, szCfgFile, "commonRandomNumbers", &pParams->commonRandom))
+	{
+		pParams->commonRandom = 0;
+	}
+	if (pParams->commonRandom && pParams->seed == 0)
+	{
+		fprintf(stdout, "commonRandomNumbers=1 needs a fixed seed (seed > 0)\n");
+		return 0;
+	}
+	if (pParams->numShards)
+	{
+		/* iteration i must draw the same random numbers whichever shard runs it */
+		if (pParams->seed == 0)
+		{
+			fprintf(stdout, "shard needs a fixed seed (seed > 0)\n");
+			return 0;
+		}
+		if (pParams->sweepFile[0] != '\0')
+		{
+			fprintf(stdout, "shard cannot be used with sweepFile\n");
+			return 0;
+		}
+		pParams->commonRandom = 1;
+	}
+	/* mergeShards is optional (if set then merge the output of that many shards, rather than running the simulation) */
+	if (!readIntFromCfg(argc, argv, szCfgFile, "mergeShards", &pParams->mergeShards))
+	{
+		pParams->mergeShards = 0;
+	}
+	/* singlePrecision is optional (if set, it is checked against how the program was compiled) */
+	if (readIntFromCfg(argc, argv, szCfgFile, "singlePrecision", &i) && i != _SINGLE_PRECISION_FLAG)
+	{
+		fprintf(stdout, "singlePrecision=%d, but program was compiled %s -D_SINGLE_PRECISION\n", i, _SINGLE_PRECISION_FLAG ? "with" : "without");
+		return 0;
+	}
+	/* engine is optional (if not set then use the exact event-driven engine) */
+	{
+		char szEngine[_MAX_STATIC_BUFF_LEN];
+
+		pParams->engine = _ENGINE_EXACT;
+		if (readStringFromCfg(argc, argv, szCfgFile, "engine", szEngine))
+		{
+			pParams->engine = _NUM_ENGINES;
+			for (i = 0; i < _NUM_ENGINES; i++)
+			{
+				if (strcmp(szEngine, g_aEngineNames[i]) == 0)
+				{
+					pParams->engine = i;
+				}
+			}
+			if (pParams->engine == _NUM_ENGINES)
+			{
+				fprintf(stdout, "Unknown engine %s\n", szEngine);
+				return 0;
+			}
+		}
+	}
+	/* coarsen is optional (if not set then run at full resolution) */
+	if (!readIntFromCfg(argc, argv, szCfgFile, "coarsen", &pParams->coarsen))
+	{
+		pParams->coarsen = 1;
+	}
+	if (pParams->coarsen < 1)
+	{
+		fprintf(stdout, "coarsen must be at least 1\n");
+		return 0;
+	}
+	/* rng is optional (if not set then use the Mersenne twister) */
+	{
+		char szRng[_MAX_STATIC_BUFF_LEN];
+
+		pParams->rng = _RNG_MT;
+		if (readStringFromCfg(argc, argv, szCfgFile, "rng", szRng))
+		{
+			pParams->rng = _NUM_RNGS;
+			for (i = 0; i < _NUM_RNGS; i++)
+			{
+				if (strcmp(szRng, g_aRngNames[i]) == 0)
+				{
+					pParams->rng = i;
+				}
+			}
+			if (pParams->rng == _NUM_RNGS)
+			{
+				fprintf(stdout, "Unknown rng %s\n", szRng);
+				return 0;
+			}
+		}
+	}
+	/* logLevel is optional (if not set then everything is written to the screen, as it always was) */
+	{
+		char szLevel[_MAX_STATIC_BUFF_LEN];
+
+		pParams->logLevel = _LOG_VERBOSE;
+		if (readStringFromCfg(argc, argv, szCfgFile, "logLevel", szLevel))
+		{
+			pParams->logLevel = _NUM_LOG_LEVELS;
+			for (i = 0; i < _NUM_LOG_LEVELS; i++)
+			{
+				if (strcmp(szLevel, g_aLogLevelNames[i]) == 0)
+				{
+					pParams->logLevel = i;
+				}
+			}
+			if (pParams->logLevel == _NUM_LOG_LEVELS)
+			{
+				fprintf(stdout, "Unknown logLevel %s\n", szLevel);
+				return 0;
+			}
+		}
+		g_logLevel = pParams->logLevel;
+	}
+	/* progressInterval is optional (if not set then progress is not reported) */
+	if (!readDoubleFromCfg(argc, argv, szCfgFile, "progressInterval", &pParams->progressInterval))
+	{
+		pParams->progressInterval = 0.0;
+	}
+	if (pParams->progressInterval < 0.0)
+	{
+		fprintf(stdout, "progressInterval must be >= 0\n");
+		return 0;
+	}
+#ifdef _MSC_VER
+	if (pParams->progressInterval > 0.0)
+	{
+		fprintf(stdout, "progressInterval needs POSIX threads, which this build doesn't have\n");
+		return 0;
+	}
+#endif
+	/* profile is optional (if not set then nothing is profiled) */
+	if (!readIntFromCfg(argc, argv, szCfgFile, "profile", &pParams->profile))
+	{
+		pParams->profile = 0;
+	}
+	if (!readIntFromCfg(argc, argv, szCfgFile, "profileEvery", &pParams->profileEvery))
+	{
+		pParams->profileEvery = 1;
+	}
+	if (pParams->profileEvery < 1)
+	{
+		fprintf(stdout, "profileEvery must be >= 1\n");
+		return 0;
+	}
+	if (pParams->profile)
+	{
+		perf_init(pParams->profileEvery);
+	}
+	/* cellOrder is optional (if not set then cells are stored in raster order) */
+	{
+		char szOrder[_MAX_STATIC_BUFF_LEN];
+
+		pParams->cellOrder = _CELL_ORDER_RASTER;
+		if (readStringFromCfg(argc, argv, szCfgFile, "cellOrder", szOrder))
+		{
+			pParams->cellOrder = _NUM_CELL_ORDERS;
+			for (i = 0; i < _NUM_CELL_ORDERS; i++)
+			{
+				if (strcmp(szOrder, g_aCellOrderNames[i]) == 0)
+				{
+					pParams->cellOrder = i;
+				}
+			}
+			if (pParams->cellOrder == _NUM_CELL_ORDERS)
+			{
+				fprintf(stdout, "Unknown cellOrder %s\n", szOrder);
+				return 0;
+			}
+		}
+	}
+	if (pParams->engine == _ENGINE_TAULEAP || pParams->engine == _ENGINE_TILED)
+	{
+		if (!readIntFromCfg(argc, argv, szCfgFile, "tauLeapSwitch", &pParams->tauLeapSwitch))
+		{
+			fprintf(stdout, "Couldn't read tauLeapSwitch\n");
+			return 0;
+		}
+		if (!readDoubleFromCfg(argc, argv, szCfgFile, "tauLeapEpsilon", &pParams->tauLeapEpsilon) || pParams->tauLeapEpsilon <= 0.0)
+		{
+			fprintf(stdout, "Couldn't read tauLeapEpsilon (must be > 0)\n");
+			return 0;
+		}
+	}
+	if (pParams->engine == _ENGINE_TILED)
+	{
+		if (!readIntFromCfg(argc, argv, szCfgFile, "tileSize", &pParams->tileSize) || pParams->tileSize < 1)
+		{
+			fprintf(stdout, "Couldn't read tileSize (must be >= 1)\n");
+			return 0;
+		}
+		/* numThreads is optional (if not set then OpenMP decides) */
+		if (!readIntFromCfg(argc, argv, szCfgFile, "numThreads", &pParams->numThreads))
+		{
+			pParams->numThreads = 0;
+		}
+	}
+	if (pParams->engine == _ENGINE_FFT || pParams->engine == _ENGINE_MEANFIELD)
+	{
+		if (pParams->engine == _ENGINE_FFT && !readIntFromCfg(argc, argv, szCfgFile, "fftSwitch", &pParams->fftSwitch))
+		{
+			fprintf(stdout, "Couldn't read fftSwitch\n");
+			return 0;
+		}
+		if (!readDoubleFromCfg(argc, argv, szCfgFile, "fftStep", &pParams->fftStep) || pParams->fftStep <= 0.0)
+		{
+			fprintf(stdout, "Couldn't read fftStep (must be > 0)\n");
+			return 0;
+		}
+		if (!readDoubleFromCfg(argc, argv, szCfgFile, "fftTolerance", &pParams->fftTolerance))
+		{
+			fprintf(stdout, "Couldn't read fftTolerance\n");
+			return 0;
+		}
+	}
+	/* splitLevels is optional (if set then runs are split into splitFactor copies as each incidence in the list is reached) */
+	{
+		char	szLevels[_MAX_STATIC_BUFF_LEN];
+		char	*pPtr;
+		double	thisVal;
+		int		j;
+
+		pParams->numSplitLevels = 0;
+		pParams->splitFactor = 1;
+		if (readStringFromCfg(argc, argv, szCfgFile, "splitLevels", szLevels))
+		{
+			pPtr = strtok(szLevels, ",");
+			while (pPtr)
+			{
+				if (pParams->numSplitLevels == _MAX_SPLIT_LEVELS)
+				{
+					fprintf(stdout, "Too many values of splitLevels (maximum %d)\n", _MAX_SPLIT_LEVELS);
+					return 0;
+				}
+				/* insertion sort into increasing order */
+				thisVal = atof(pPtr);
+				for (j = pParams->numSplitLevels; j > 0 && pParams->aSplitLevels[j - 1] > thisVal; j--)
+				{
+					pParams->aSplitLevels[j] = pParams->aSplitLevels[j - 1];
+				}
+				pParams->aSplitLevels[j] = thisVal;
+				pParams->numSplitLevels++;
+				pPtr = strtok(NULL, ",");
+			}
+		}
+		if (pParams->numSplitLevels)
+		{
+			if (pParams->maxIncidence <= 0.0 || pParams->aSplitLevels[0] <= 0.0 || pParams->aSplitLevels[pParams->numSplitLevels - 1] >= pParams->maxIncidence)
+			{
+				fprintf(stdout, "splitLevels must all be > 0 and < maxIncidence\n");
+				return 0;
+			}
+			if (!readIntFromCfg(argc, argv, szCfgFile, "splitFactor", &pParams->splitFactor) || pParams->splitFactor < 2)
+			{
+				fprintf(stdout, "Couldn't read splitFactor (must be >= 2)\n");
+				return 0;
+			}
+			/* copies of a run share everything up to the split, so cannot be reproduced from the iteration number alone */
+			if (pParams->commonRandom || pParams->numShards)
+			{
+				fprintf(stdout, "splitLevels cannot be used with commonRandomNumbers or shard\n");
+				return 0;
+			}
+			if (pParams->engine != _ENGINE_EXACT && pParams->engine != _ENGINE_TAULEAP)
+			{
+				fprintf(stdout, "splitLevels can only be used with engine=exact or engine=tauleap\n");
+				return 0;
+			}
+		}
+	}
+	/* introStrata is optional (if set then the first infection of iteration i is drawn from stratum i % introStrata) */
+	if (!readIntFromCfg(argc, argv, szCfgFile, "introStrata", &pParams->introStrata))
+	{
+		pParams->introStrata = 0;
+	}
+	if (pParams->introStrata > 1 && pParams->introStrata > pParams->numIts)
+	{
+		fprintf(stdout, "introStrata must be no more than numIts\n");
+		return 0;
+	}
+	/* snapshotIncidence is optional (if set then a snapshot of each run is written when it reaches this incidence) */
+	if (!readDoubleFromCfg(argc, argv, szCfgFile, "snapshotIncidence", &pParams->snapshotIncidence))
+	{
+		pParams->snapshotIncidence = 0.0;
+	}
+	/* snapshotFile is optional (if set then every iteration carries on from this snapshot, rather than starting from t=0) */
+	if (!readStringFromCfg(argc, argv, szCfgFile, "snapshotFile", pParams->snapshotFile))
+	{
+		pParams->snapshotFile[0] = '\0';
+	}
+	if ((pParams->snapshotIncidence > 0.0 || pParams->snapshotFile[0] != '\0') && pParams->engine != _ENGINE_EXACT && pParams->engine != _ENGINE_TAULEAP)
+	{
+		fprintf(stdout, "snapshotIncidence and snapshotFile can only be used with engine=exact or engine=tauleap\n");
+		return 0;
+	}
+	if (pParams->introStrata > 1 && (pParams->snapshotFile[0] != '\0' || pParams->engine == _ENGINE_MEANFIELD))
+	{
+		fprintf(stdout, "introStrata cannot be used with snapshotFile or engine=meanfield (runs do not start with a first infection)\n");
+		return 0;
+	}
+	/* surveyFile is optional (if set then each sampling pattern in it is evaluated in every run, with the survey parameters of simulatedAnnealing) */
+	if (!readStringFromCfg(argc, argv, szCfgFile, "surveyFile", pParams->surveyFile))
+	{
+		pParams->surveyFile[0] = '\0';
+	}
+	if (pParams->surveyFile[0] != '\0')
+	{
+		if (!readDoubleFromCfg(argc, argv, szCfgFile, "delta", &pParams->surveyDelta) || pParams->surveyDelta <= 0.0)
+		{
+			fprintf(stdout, "Couldn't read delta (must be > 0)\n");
+			return 0;
+		}
+		if (!readIntFromCfg(argc, argv, szCfgFile, "samplesPerSite", &pParams->surveySamples))
+		{
+			fprintf(stdout, "Couldn't read samplesPerSite\n");
+			return 0;
+		}
+		if (!readDoubleFromCfg(argc, argv, szCfgFile, "testSens", &pParams->surveyTestSens))
+		{
+			fprintf(stdout, "Couldn't read testSens\n");
+			return 0;
+		}
+		if (!readDoubleFromCfg(argc, argv, szCfgFile, "detLag", &pParams->surveyDetLag))
+		{
+			fprintf(stdout, "Couldn't read detLag\n");
+			return 0;
+		}
+		if (pParams->engine == _ENGINE_MEANFIELD)
+		{
+			fprintf(stdout, "surveyFile cannot be used with engine=meanfield (there are no individual runs)\n");
+			return 0;
+		}
+	}
+	/* aggregateRasters is optional (if not set then the rasters summarising the ensemble are not written) */
+	if (!readIntFromCfg(argc, argv, szCfgFile, "aggregateRasters", &pParams->aggregateRasters))
+	{
+		pParams->aggregateRasters = 0;
+	}
+	/* archiveRuns is optional (if not set then the output for each run is written as usual) */
+	if (!readIntFromCfg(argc, argv, szCfgFile, "archiveRuns", &pParams->archiveRuns))
+	{
+		pParams->archiveRuns = 1;
+	}
+#ifndef _PIPELINE
+	if (!pParams->archiveRuns && pParams->surveyFile[0] == '\0')
+	{
+		fprintf(stdout, "archiveRuns=0 can only be used in samplingPipeline, or with surveyFile\n");
+		return 0;
+	}
+	if (!pParams->archiveRuns && pParams->numShards)
+	{
+		fprintf(stdout, "archiveRuns=0 cannot be used with shard (merging shards needs the files for each run)\n");
+		return 0;
+	}
+#else
+	if (pParams->sweepFile[0] != '\0')
+	{
+		fprintf(stdout, "sweepFile cannot be used in samplingPipeline\n");
+		return 0;
+	}
+	if (pParams->engine == _ENGINE_MEANFIELD)
+	{
+		fprintf(stdout, "engine=meanfield cannot be used in samplingPipeline (there are no individual runs)\n");
+		return 0;
+	}
+	if (pParams->numShards || pParams->mergeShards)
+	{
+		fprintf(stdout, "shard and mergeShards cannot be used in samplingPipeline\n");
+		return 0;
+	}
+	if (pParams->numSplitLevels)
+	{
+		fprintf(stdout, "splitLevels cannot be used in samplingPipeline\n");
+		return 0;
+	}
+#endif
+	if (pParams->numShards && pParams->engine == _ENGINE_MEANFIELD)
+	{
+		fprintf(stdout, "shard cannot be used with engine=meanfield (there are no individual runs)\n");
+		return 0;
+	}
+	/* Following code dumps out parameters as read in (but not for a dry run, which leaves the output directory alone) */
+	if (!pParams->dryRun)
+	{
+		FILE	*paramsOut;
+		char	outFile[_MAX_STATIC_BUFF_LEN];
+
+		sprintf(outFile, "%s%cparamsOut.txt", pParams->outDir, C_DIR_DELIMITER);
+		fprintf(stdout, "\twriting copy of parameters to %s\n", outFile);
+		paramsOut = fopen(outFile, "wb");
+		if(paramsOut)
 		{
 			fprintf(paramsOut, "pParams->cellThresh=%.6f\n", pParams->cellThresh);
+			fprintf(paramsOut, "pParams->coarsen=%d\n", pParams->coarsen);
 			fprintf(paramsOut, "pParams->numIts=%d\n", pParams->numIts);
 			fprintf(paramsOut, "pParams->filePropFull=%s\n", pParams->filePropFull);
 			fprintf(paramsOut, "pParams->fileRelInf=%s\n", pParams->fileRelInf);
@@ -658,9 +1679,85 @@ int readParams(t_Params *pParams, int argc, char **argv)
 			fprintf(paramsOut, "pParams->dispScale=%.6f\n", pParams->dispScale);
 			fprintf(paramsOut, "pParams->reportTime=%f\n", pParams->reportTime);
 			fprintf(paramsOut, "pParams->maxIncidence=%.6f\n", pParams->maxIncidence);
+			if (pParams->numThresholds > 1)
+			{
+				fprintf(paramsOut, "pParams->aThresholds=");
+				for (i = 0; i < pParams->numThresholds; i++)
+				{
+					fprintf(paramsOut, "%s%.6f", i ? "," : "", pParams->aThresholds[i]);
+				}
+				fprintf(paramsOut, "\n");
+			}
+			if (pParams->numSplitLevels)
+			{
+				fprintf(paramsOut, "pParams->aSplitLevels=");
+				for (i = 0; i < pParams->numSplitLevels; i++)
+				{
+					fprintf(paramsOut, "%s%.6f", i ? "," : "", pParams->aSplitLevels[i]);
+				}
+				fprintf(paramsOut, "\n");
+				fprintf(paramsOut, "pParams->splitFactor=%d\n", pParams->splitFactor);
+			}
+			if (pParams->introStrata > 1)
+			{
+				fprintf(paramsOut, "pParams->introStrata=%d\n", pParams->introStrata);
+			}
+			if (pParams->snapshotIncidence > 0.0)
+			{
+				fprintf(paramsOut, "pParams->snapshotIncidence=%.6f\n", pParams->snapshotIncidence);
+			}
+			if (pParams->snapshotFile[0] != '\0')
+			{
+				fprintf(paramsOut, "pParams->snapshotFile=%s\n", pParams->snapshotFile);
+			}
 			fprintf(paramsOut, "pParams->withinCellMin=%.6f\n", pParams->withinCellMin);
 			fprintf(paramsOut, "pParams->withinCellBulkUp=%.6f\n", pParams->withinCellBulkUp);
 			fprintf(paramsOut, "pParams->trueMinFlag=%d\n", pParams->trueMinFlag);
+			if (sweepIndex >= 0)
+			{
+				fprintf(paramsOut, "pParams->sweepFile=%s\n", pParams->sweepFile);
+				fprintf(paramsOut, "sweepIndex=%d\n", sweepIndex);
+			}
+			fprintf(paramsOut, "pParams->seed=%d\n", pParams->seed);
+			fprintf(paramsOut, "pParams->commonRandom=%d\n", pParams->commonRandom);
+			fprintf(paramsOut, "pParams->rng=%s\n", g_aRngNames[pParams->rng]);
+			if (pParams->numShards)
+			{
+				fprintf(paramsOut, "pParams->shard=%d/%d\n", pParams->shardIndex, pParams->numShards);
+			}
+			fprintf(paramsOut, "singlePrecision=%d\n", _SINGLE_PRECISION_FLAG);
+			fprintf(paramsOut, "pParams->archiveRuns=%d\n", pParams->archiveRuns);
+			fprintf(paramsOut, "pParams->aggregateRasters=%d\n", pParams->aggregateRasters);
+			fprintf(paramsOut, "pParams->logLevel=%s\n", g_aLogLevelNames[pParams->logLevel]);
+			fprintf(paramsOut, "pParams->progressInterval=%f\n", pParams->progressInterval);
+			fprintf(paramsOut, "pParams->profile=%d\n", pParams->profile);
+			fprintf(paramsOut, "pParams->profileEvery=%d\n", pParams->profileEvery);
+			fprintf(paramsOut, "pParams->dryRun=%d\n", pParams->dryRun);
+			if (pParams->surveyFile[0] != '\0')
+			{
+				fprintf(paramsOut, "pParams->surveyFile=%s\n", pParams->surveyFile);
+				fprintf(paramsOut, "pParams->delta=%.6f\n", pParams->surveyDelta);
+				fprintf(paramsOut, "pParams->samplesPerSite=%d\n", pParams->surveySamples);
+				fprintf(paramsOut, "pParams->testSens=%.6f\n", pParams->surveyTestSens);
+				fprintf(paramsOut, "pParams->detLag=%.6f\n", pParams->surveyDetLag);
+			}
+			fprintf(paramsOut, "pParams->engine=%s\n", g_aEngineNames[pParams->engine]);
+			fprintf(paramsOut, "pParams->cellOrder=%s\n", g_aCellOrderNames[pParams->cellOrder]);
+			if (pParams->engine == _ENGINE_TAULEAP || pParams->engine == _ENGINE_TILED)
+			{
+				fprintf(paramsOut, "pParams->tauLeapSwitch=%d\n", pParams->tauLeapSwitch);
+				fprintf(paramsOut, "pParams->tauLeapEpsilon=%.6f\n", pParams->tauLeapEpsilon);
+			}
+			if (pParams->engine == _ENGINE_TILED)
+			{
+				fprintf(paramsOut, "pParams->tileSize=%d\n", pParams->tileSize);
+			}
+			if (pParams->engine == _ENGINE_FFT || pParams->engine == _ENGINE_MEANFIELD)
+			{
+				fprintf(paramsOut, "pParams->fftSwitch=%d\n", pParams->fftSwitch);
+				fprintf(paramsOut, "pParams->fftStep=%.6f\n", pParams->fftStep);
+				fprintf(paramsOut, "pParams->fftTolerance=%.6f\n", pParams->fftTolerance);
+			}
 			fclose(paramsOut);
 		}
 		else
@@ -673,29 +1770,345 @@ int readParams(t_Params *pParams, int argc, char **argv)
 }
 
 /*
-	Rather unwieldy parsing routine which reads in all data from GIS format
+	Write out information on all cells that are active in the simulation (i.e. >= cellThresh)
 */
-int readLandscape(t_Landscape *pLandscape, char *filePropFull, char *fileRelInf, char *fileRelPri, char *filRelSus, double cellThresh, char *outStub)
+void writeActiveLandscape(t_Landscape *pLandscape, char *outDir)
 {
-	FILE	*fIn;
-	char	*fileName,*inBuff,*pPtr;
-	int		noData,retVal,thisX,thisY,i,headerCount;
-	double	thisVal;
+	FILE	*fpOut;
+	int		i;
 	char	outFile[_MAX_STATIC_BUFF_LEN];
-	t_Cell* pTmp;
 
-	fprintf(stdout, "readLandscape()\n");
-	retVal = 0;
-	memset(pLandscape,0,sizeof(t_Landscape));
-	inBuff = malloc(_MAX_DYNAMIC_BUFF_LEN*sizeof(char));
-	if(inBuff)
+	sprintf(outFile, "%s%cactiveLandscape.txt", outDir, C_DIR_DELIMITER);
+	fpOut = fopen(outFile, "wb");
+	if(fpOut)
 	{
-		retVal = 1;
-		for(i=0;i<4 && retVal;i++)
+		for(i=0;i<pLandscape->numCells;i++)
 		{
-			retVal = 0;
-			fileName = NULL;
-			switch(i)
+			fprintf(fpOut, "%d %d %f %d\n", pLandscape->aCells[cellIndex(pLandscape, i)].xPos, pLandscape->aCells[cellIndex(pLandscape, i)].yPos, pLandscape->aCells[cellIndex(pLandscape, i)].propFull, i);
+		}
+		fclose(fpOut);
+	}
+}
+
+/*
+	Position of (x, y) along a Hilbert curve filling a square of side n (a power of two)
+*/
+long hilbertIndex(int n, int x, int y)
+{
+	int		rx,ry,s,tmp;
+	long	d;
+
+	d = 0;
+	for (s = n / 2; s > 0; s /= 2)
+	{
+		rx = (x & s) > 0;
+		ry = (y & s) > 0;
+		d += (long)s * s * ((3 * rx) ^ ry);
+		/* rotate the quadrant so the curve inside it has the standard orientation */
+		if (ry == 0)
+		{
+			if (rx == 1)
+			{
+				x = n - 1 - x;
+				y = n - 1 - y;
+			}
+			tmp = x;
+			x = y;
+			y = tmp;
+		}
+	}
+	return d;
+}
+
+typedef struct
+{
+	long	key;
+	int		cell;
+} t_CellKey;
+
+static int cmpCellKey(const void *p1, const void *p2)
+{
+	long k1 = ((t_CellKey *)p1)->key;
+	long k2 = ((t_CellKey *)p2)->key;
+
+	return (k1 > k2) - (k1 < k2);
+}
+
+/*
+	Renumber the cells along a space-filling curve (Morton or Hilbert), so cells which are close together on the
+	landscape tend to be close together in memory, and tile aCellLookup in Morton order for the same reason
+		(a Morton position is the bits of x and y interleaved, so is just aLookupX[x] | aLookupY[y])
+	The original numbering is kept in aCellID/aCellIndex, and is used for all output
+*/
+int reorderCells(t_Landscape *pLandscape, int cellOrder)
+{
+	int			numBitsX,numBitsY,numBits,bit,shift,i,x,y;
+	long		lookupSize;
+	t_CellKey	*aKey;
+	t_Cell		*aNewCells;
+
+	fprintf(stdout, "reorderCells(%s)\n", g_aCellOrderNames[cellOrder]);
+	for (numBitsX = 0; (1 << numBitsX) < pLandscape->numCols; numBitsX++)
+	{
+	}
+	for (numBitsY = 0; (1 << numBitsY) < pLandscape->numRows; numBitsY++)
+	{
+	}
+	numBits = (numBitsX > numBitsY) ? numBitsX : numBitsY;
+	lookupSize = 1L << (numBitsX + numBitsY);
+	pLandscape->aLookupX = calloc(pLandscape->numCols, sizeof(int));
+	pLandscape->aLookupY = calloc(pLandscape->numRows, sizeof(int));
+	pLandscape->aCellID = mem_malloc(sizeof(int) * pLandscape->numCells, "aCellID");
+	pLandscape->aCellIndex = mem_malloc(sizeof(int) * pLandscape->numCells, "aCellIndex");
+	aKey = mem_malloc(sizeof(t_CellKey) * pLandscape->numCells, "reorderKeys");
+	aNewCells = mem_malloc(sizeof(t_Cell) * pLandscape->numCells, "aCells");
+	if (!(pLandscape->aLookupX && pLandscape->aLookupY && pLandscape->aCellID && pLandscape->aCellIndex && aKey && aNewCells))
+	{
+		fprintf(stderr, "out of memory\n");
+		return 0;
+	}
+	/* interleave the bits of x and y (once one runs out of bits, the rest come from the other) */
+	shift = 0;
+	for (bit = 0; bit < numBits; bit++)
+	{
+		if (bit < numBitsX)
+		{
+			for (x = 0; x < pLandscape->numCols; x++)
+			{
+				pLandscape->aLookupX[x] |= ((x >> bit) & 1) << shift;
+			}
+			shift++;
+		}
+		if (bit < numBitsY)
+		{
+			for (y = 0; y < pLandscape->numRows; y++)
+			{
+				pLandscape->aLookupY[y] |= ((y >> bit) & 1) << shift;
+			}
+			shift++;
+		}
+	}
+	for (i = 0; i < pLandscape->numCells; i++)
+	{
+		x = pLandscape->aCells[i].xPos;
+		y = pLandscape->aCells[i].yPos;
+		aKey[i].cell = i;
+		if (cellOrder == _CELL_ORDER_HILBERT)
+		{
+			aKey[i].key = hilbertIndex(1 << numBits, x, y);
+		}
+		else
+		{
+			aKey[i].key = pLandscape->aLookupX[x] | pLandscape->aLookupY[y];
+		}
+	}
+	qsort(aKey, pLandscape->numCells, sizeof(t_CellKey), cmpCellKey);
+	for (i = 0; i < pLandscape->numCells; i++)
+	{
+		aNewCells[i] = pLandscape->aCells[aKey[i].cell];
+		pLandscape->aCellID[i] = aKey[i].cell;
+		pLandscape->aCellIndex[aKey[i].cell] = i;
+	}
+	mem_free(aKey);
+	mem_free(pLandscape->aCells);
+	pLandscape->aCells = aNewCells;
+	pLandscape->numCellsSpace = pLandscape->numCells;
+	/* and the tiled lookup */
+	mem_free(pLandscape->aCellLookup);
+	pLandscape->lookupSize = lookupSize;
+	pLandscape->aCellLookup = mem_malloc(sizeof(int) * lookupSize, "aCellLookup");
+	if (!pLandscape->aCellLookup)
+	{
+		fprintf(stderr, "out of memory\n");
+		return 0;
+	}
+	for (i = 0; i < lookupSize; i++)
+	{
+		pLandscape->aCellLookup[i] = _EMPTY_CELL;
+	}
+	for (i = 0; i < pLandscape->numCells; i++)
+	{
+		pLandscape->aCellLookup[pLandscape->aLookupX[pLandscape->aCells[i].xPos] | pLandscape->aLookupY[pLandscape->aCells[i].yPos]] = i;
+	}
+	fprintf(stdout, "\tlookup has %ld entries (raster would have %d)\n", lookupSize, pLandscape->numCols * pLandscape->numRows);
+	return 1;
+}
+
+/*
+	Rewrite the GIS header of the landscape for the grid of coarse cells (numRows x numCols blocks of coarsen x coarsen
+	cells, the blocks on the last row and column overhanging the original raster if it didn't divide exactly)
+	The top left corner stays put, so the lower left corner moves down by any overhang, and the centre of the lower left
+	cell moves by half a coarse cell less half a fine cell
+*/
+void coarsenGISHeader(t_Landscape *pLandscape, int coarsen, int numRows, int numCols)
+{
+	double	cellSize,shiftDown,thisVal;
+	char	*pPtr;
+	int		i;
+
+	cellSize = 0.0;
+	for (i = 0; i < _GIS_HEADER_LENGTH; i++)
+	{
+		if (strncmp(pLandscape->aszGISHeader[i], "cellsize", strlen("cellsize")) == 0)
+		{
+			pPtr = strpbrk(pLandscape->aszGISHeader[i], _GIS_WHITESPACE);
+			cellSize = pPtr ? atof(pPtr) : 0.0;
+		}
+	}
+	shiftDown = (numRows * coarsen - pLandscape->numRows) * cellSize;
+	for (i = 0; i < _GIS_HEADER_LENGTH; i++)
+	{
+		pPtr = strpbrk(pLandscape->aszGISHeader[i], _GIS_WHITESPACE);
+		thisVal = pPtr ? atof(pPtr) : 0.0;
+		if (strncmp(pLandscape->aszGISHeader[i], "ncols", strlen("ncols")) == 0)
+		{
+			sprintf(pLandscape->aszGISHeader[i], "ncols\t%d", numCols);
+		}
+		else if (strncmp(pLandscape->aszGISHeader[i], "nrows", strlen("nrows")) == 0)
+		{
+			sprintf(pLandscape->aszGISHeader[i], "nrows\t%d", numRows);
+		}
+		else if (strncmp(pLandscape->aszGISHeader[i], "cellsize", strlen("cellsize")) == 0)
+		{
+			sprintf(pLandscape->aszGISHeader[i], "cellsize\t%.12g", cellSize * coarsen);
+		}
+		else if (strncmp(pLandscape->aszGISHeader[i], "xllcenter", strlen("xllcenter")) == 0)
+		{
+			sprintf(pLandscape->aszGISHeader[i], "xllcenter\t%.12g", thisVal + 0.5 * (coarsen - 1) * cellSize);
+		}
+		else if (strncmp(pLandscape->aszGISHeader[i], "yllcorner", strlen("yllcorner")) == 0)
+		{
+			sprintf(pLandscape->aszGISHeader[i], "yllcorner\t%.12g", thisVal - shiftDown);
+		}
+		else if (strncmp(pLandscape->aszGISHeader[i], "yllcenter", strlen("yllcenter")) == 0)
+		{
+			sprintf(pLandscape->aszGISHeader[i], "yllcenter\t%.12g", thisVal - shiftDown + 0.5 * (coarsen - 1) * cellSize);
+		}
+	}
+}
+
+/*
+	Aggregate the landscape into blocks of coarsen x coarsen cells, for fast screening runs
+	The host in a block is summed, but stored as the proportion of the (larger) coarse cell it fills, so that propFull
+	stays a proportion and the chance a challenge finds host stays a probability; relInf, relSus and relPri are averaged
+	weighted by host (see coarsenParams() for the matching changes to dispScale and rateSecInf)
+	coarsenMap.txt gives the coarse cell each active fine cell went into, so results can be projected back
+*/
+int coarsenLandscape(t_Landscape *pLandscape, int coarsen, char *outDir)
+{
+	int		numRows,numCols,numCoarse,i,c,pos;
+	int		*aLookup,*aCoarseOf;
+	double	*aHost,*aRelInf,*aRelSus,*aRelPri;
+	t_Cell	*aCoarse;
+	char	outFile[_MAX_STATIC_BUFF_LEN];
+	FILE	*fOut;
+
+	fprintf(stdout, "coarsenLandscape(%d)\n", coarsen);
+	numRows = (pLandscape->numRows + coarsen - 1) / coarsen;
+	numCols = (pLandscape->numCols + coarsen - 1) / coarsen;
+	aLookup = mem_malloc(sizeof(int) * numRows * numCols, "aCellLookup");
+	aCoarseOf = mem_malloc(sizeof(int) * pLandscape->numCells, "coarsenTemp");
+	aHost = mem_calloc(pLandscape->numCells, sizeof(double), "coarsenTemp");
+	aRelInf = mem_calloc(pLandscape->numCells, sizeof(double), "coarsenTemp");
+	aRelSus = mem_calloc(pLandscape->numCells, sizeof(double), "coarsenTemp");
+	aRelPri = mem_calloc(pLandscape->numCells, sizeof(double), "coarsenTemp");
+	aCoarse = mem_malloc(sizeof(t_Cell) * pLandscape->numCells, "aCells");
+	if (!(aLookup && aCoarseOf && aHost && aRelInf && aRelSus && aRelPri && aCoarse))
+	{
+		fprintf(stderr, "out of memory\n");
+		return 0;
+	}
+	for (pos = 0; pos < numRows * numCols; pos++)
+	{
+		aLookup[pos] = _EMPTY_CELL;
+	}
+	/* fine cells are in raster order, so coarse cells are created in raster order too */
+	numCoarse = 0;
+	for (i = 0; i < pLandscape->numCells; i++)
+	{
+		pos = gridToPos(pLandscape->aCells[i].xPos / coarsen, pLandscape->aCells[i].yPos / coarsen, numCols);
+		if (aLookup[pos] == _EMPTY_CELL)
+		{
+			aLookup[pos] = numCoarse;
+			aCoarse[numCoarse] = pLandscape->aCells[i];
+			aCoarse[numCoarse].xPos = pLandscape->aCells[i].xPos / coarsen;
+			aCoarse[numCoarse].yPos = pLandscape->aCells[i].yPos / coarsen;
+			numCoarse++;
+		}
+		c = aLookup[pos];
+		aCoarseOf[i] = c;
+		aHost[c] += pLandscape->aCells[i].propFull;
+		aRelInf[c] += pLandscape->aCells[i].propFull * pLandscape->aCells[i].relInf;
+		aRelSus[c] += pLandscape->aCells[i].propFull * pLandscape->aCells[i].relSus;
+		aRelPri[c] += pLandscape->aCells[i].propFull * pLandscape->aCells[i].relPri;
+	}
+	sprintf(outFile, "%s%ccoarsenMap.txt", outDir, C_DIR_DELIMITER);
+	fOut = fopen(outFile, "wb");
+	if (!fOut)
+	{
+		fprintf(stderr, "couldn't open %s for writing\n", outFile);
+		return 0;
+	}
+	for (i = 0; i < pLandscape->numCells; i++)
+	{
+		fprintf(fOut, "%d %d %f %d\n", pLandscape->aCells[i].xPos, pLandscape->aCells[i].yPos, pLandscape->aCells[i].propFull, aCoarseOf[i]);
+	}
+	fclose(fOut);
+	pLandscape->totalFull = 0.0;
+	for (c = 0; c < numCoarse; c++)
+	{
+		/* (blocks with no host at all, which cellThresh=0.0 allows, keep the values of their first cell, as they can't matter) */
+		if (aHost[c] > 0.0)
+		{
+			aCoarse[c].relInf = (t_Real)(aRelInf[c] / aHost[c]);
+			aCoarse[c].relSus = (t_Real)(aRelSus[c] / aHost[c]);
+			aCoarse[c].relPri = (t_Real)(aRelPri[c] / aHost[c]);
+		}
+		aCoarse[c].propFull = (t_Real)(aHost[c] / (coarsen * coarsen));
+		pLandscape->totalFull += aCoarse[c].propFull;
+	}
+	fprintf(stdout, "\t%d cells (%d rows; %d cols) -> %d cells (%d rows; %d cols)\n", pLandscape->numCells, pLandscape->numRows, pLandscape->numCols, numCoarse, numRows, numCols);
+	mem_free(aCoarseOf);
+	mem_free(aHost);
+	mem_free(aRelInf);
+	mem_free(aRelSus);
+	mem_free(aRelPri);
+	mem_free(pLandscape->aCells);
+	mem_free(pLandscape->aCellLookup);
+	coarsenGISHeader(pLandscape, coarsen, numRows, numCols);
+	pLandscape->aCells = aCoarse;
+	pLandscape->numCells = numCoarse;
+	pLandscape->numCellsSpace = pLandscape->numCells;
+	pLandscape->aCellLookup = aLookup;
+	pLandscape->numRows = numRows;
+	pLandscape->numCols = numCols;
+	pLandscape->lookupSize = (long)numRows * numCols;
+	return 1;
+}
+
+/*
+	Rather unwieldy parsing routine which reads in all data from GIS format
+*/
+int readLandscape(t_Landscape *pLandscape, char *filePropFull, char *fileRelInf, char *fileRelPri, char *filRelSus, double cellThresh, int coarsen, int cellOrder, char *outDir)
+{
+	FILE	*fIn;
+	char	*fileName,*inBuff,*pPtr;
+	int		noData,retVal,thisX,thisY,i,headerCount;
+	double	thisVal;
+	t_Cell* pTmp;
+
+	fprintf(stdout, "readLandscape()\n");
+	retVal = 0;
+	memset(pLandscape,0,sizeof(t_Landscape));
+	inBuff = mem_malloc(_MAX_DYNAMIC_BUFF_LEN*sizeof(char), "inputBuffer");
+	if(inBuff)
+	{
+		retVal = 1;
+		for(i=0;i<4 && retVal;i++)
+		{
+			retVal = 0;
+			fileName = NULL;
+			switch(i)
 			{
 			case 0:
 				fileName = filePropFull;
@@ -724,6 +2137,12 @@ int readLandscape(t_Landscape *pLandscape, char *filePropFull, char *fileRelInf,
 				{
 					if(i == 0)
 					{
+						strncpy(pLandscape->aszGISHeader[headerCount], inBuff, _MAX_STATIC_BUFF_LEN - 1);
+						pPtr = strpbrk(pLandscape->aszGISHeader[headerCount], _GIS_NEWLINES);
+						if(pPtr)
+						{
+							pPtr[0] = '\0';
+						}
 						if(strncmp(inBuff, "ncols", strlen("ncols"))==0)
 						{
 							pPtr = strpbrk(inBuff,_GIS_WHITESPACE);
@@ -755,7 +2174,8 @@ int readLandscape(t_Landscape *pLandscape, char *filePropFull, char *fileRelInf,
 				{
 					if(i == 0)
 					{
-						pLandscape->aCellLookup = malloc(sizeof(int)*pLandscape->numCols*pLandscape->numRows);
+						pLandscape->lookupSize = (long)pLandscape->numCols*pLandscape->numRows;
+						pLandscape->aCellLookup = mem_malloc(sizeof(int)*pLandscape->lookupSize, "aCellLookup");
 						if(!pLandscape->aCellLookup)
 						{
 							retVal = 0;
@@ -800,7 +2220,7 @@ int readLandscape(t_Landscape *pLandscape, char *filePropFull, char *fileRelInf,
 										pLandscape->numCellsSpace += _LANDSCAPE_BLOCK_SIZE;
 
 										/* have to rewrite perfectly idiomatic C to get around visual studio warnings re. memory leaks */
-										pTmp = realloc(pLandscape->aCells, sizeof(t_Cell) * pLandscape->numCellsSpace);
+										pTmp = mem_realloc(pLandscape->aCells, sizeof(t_Cell) * pLandscape->numCellsSpace, "aCells");
 										if (pTmp)
 										{
 											pLandscape->aCells = pTmp;
@@ -880,764 +2300,4292 @@ int readLandscape(t_Landscape *pLandscape, char *filePropFull, char *fileRelInf,
 				}
 				fclose(fIn);
 			}
-			else
+			else
+			{
+				fprintf(stderr, "couldn't open %s\n", fileName);
+				retVal = 0;
+				break;
+			}
+		}
+		mem_free(inBuff);
+	}
+	else
+	{
+		fprintf(stderr, "out of memory\n");
+		retVal = 0;
+	}
+	if(retVal && coarsen > 1)
+	{
+		retVal = coarsenLandscape(pLandscape, coarsen, outDir);
+	}
+	if(retVal && cellOrder != _CELL_ORDER_RASTER)
+	{
+		retVal = reorderCells(pLandscape, cellOrder);
+	}
+	/*
+		Every host starts susceptible in the state map
+	*/
+	if(retVal)
+	{
+		pLandscape->aStateMap = mem_calloc((pLandscape->lookupSize + 3) / 4, 1, "aStateMap");
+		if(!pLandscape->aStateMap)
+		{
+			fprintf(stderr, "out of memory\n");
+			retVal = 0;
+		}
+		for(i = 0; retVal && i < pLandscape->numCells; i++)
+		{
+			setCellState(pLandscape, i, _STATE_SUSCEPTIBLE);
+		}
+	}
+	/*
+		Write out information on all cells that are active in the simulation (i.e. >= cellThresh)
+	*/
+	if(retVal)
+	{
+		writeActiveLandscape(pLandscape, outDir);
+		fprintf(stdout, "\t%d valid cells (%d rows; %d cols)\n", pLandscape->numCells, pLandscape->numRows, pLandscape->numCols);
+		fprintf(stdout, "\ttotalFull=%f\n", pLandscape->totalFull);
+	}
+	return retVal;
+}
+
+/*
+	Primary rate of infection is stored in cumulative form to make it easier to find out which cell is infected next
+*/
+int setupPrimary(t_PriInf *pPriInf, t_Landscape *pLandscape, double ratePri)
+{
+	int		i,retVal;
+	double	thisVal,cumVal;
+
+	fprintf(stdout, "setupPrimary()\n");
+	retVal = 0;
+	memset(pPriInf,0,sizeof(t_PriInf));
+	pPriInf->aCumPressure = mem_malloc(sizeof(double)*pLandscape->numCells, "aCumPressure");
+	if(pPriInf->aCumPressure)
+	{
+		cumVal = 0;
+		for(i=0;i<pLandscape->numCells;i++)
+		{
+			/*
+				Values in the GIS file are multipled by proportion of cell occupied, as well as relative susceptibility
+			*/
+			thisVal = pLandscape->aCells[i].propFull * pLandscape->aCells[i].relPri * pLandscape->aCells[i].relSus;
+			cumVal += thisVal;
+			pPriInf->aCumPressure[i] = cumVal;
+		}
+		pPriInf->totalPressure = cumVal;
+		pPriInf->nextT = _UNDEF_TIME;
+		pPriInf->ratePri = ratePri;
+		retVal = 1;
+		fprintf(stdout, "\ttotalPressure=%f\n", pPriInf->totalPressure);
+	}
+	return retVal;
+}
+
+/*
+	Allocate memory for epidemic
+*/
+int setupEpidemic(t_Epidemic *pEpidemic, t_Landscape *pLandscape, double dispScale)
+{
+	int retVal;
+
+	fprintf(stdout, "setupEpidemic()\n");
+	retVal = 0;
+	memset(pEpidemic,0,sizeof(t_Epidemic));
+	pEpidemic->queueLen = 0;
+	pEpidemic->aQueueCells = mem_malloc(sizeof(int) * pLandscape->numCells, "aQueueCells");
+	pEpidemic->totalInf = 0;
+	pEpidemic->aInfCells = mem_malloc(sizeof(int) * pLandscape->numCells, "aInfCells");
+	if(pEpidemic->aQueueCells && pEpidemic->aInfCells)
+	{
+		retVal = 1;
+		fprintf(stdout, "\t%d cells\n", pLandscape->numCells);
+	}
+	return retVal;
+}
+
+/*
+	Find the time of the next primary infection across the landscape
+		given that the total rate of entry on an entirely susceptible landscape is pPriInf->ratePri
+		per unit of time [that some will hit already infected cells is handled later]
+*/
+void setNextPossPriTime(t_PriInf *pPriInf, double thisTime)
+{
+	double expDbl;
+
+	expDbl = streamExponential(_STREAM_PRIMARY);
+	if(pPriInf->ratePri > 0.0)
+	{
+		pPriInf->nextT = thisTime + expDbl/pPriInf->ratePri;
+	}
+	else
+	{
+		pPriInf->nextT=_VERY_LONG_TIME;
+	}
+}
+
+double getNextPossPriTime(t_PriInf *pPriInf)
+{
+	return pPriInf->nextT;
+}
+
+/*
+	Binary chop to figure out cell at which the cumulative pressure reaches a proportion propPressure of the total
+*/
+int		whichCellCumPressure(t_PriInf *pPriInf, int numCells, double propPressure)
+{
+	double  randDbl;//,runningSum;
+	int		left,right,mid;//,cellID;
+
+	randDbl = pPriInf->totalPressure * propPressure;
+	left = 0;
+	right = numCells-1;
+	while((right-left) > 1)
+	{
+		mid=(left+right)/2;
+		if(pPriInf->aCumPressure[mid] < randDbl)
+		{
+			left = mid;
+		}
+		else
+		{
+			right = mid;
+		}
+	}
+	return right;
+}
+
+/*
+	Figure out cell which is infected by primary infection
+*/
+int		whichCellPrimary(t_PriInf *pPriInf,int numCells)
+{
+	return whichCellCumPressure(pPriInf, numCells, streamRandom(_STREAM_PRIMARY));
+}
+
+/*
+	As whichCellPrimary(), but only from the thisStratum'th of numStrata equal slices of the cumulative pressure
+	(each stratum is a run of consecutive cells with equal probability of the first infection, so a band of rows
+	 with cellOrder=raster, or a compact patch along the curve with cellOrder=morton or hilbert)
+*/
+int		whichCellPrimaryStratum(t_PriInf *pPriInf, int numCells, int thisStratum, int numStrata)
+{
+	return whichCellCumPressure(pPriInf, numCells, (thisStratum + streamRandom(_STREAM_PRIMARY)) / numStrata);
+}
+
+/*
+	Figure out which cell is challenged by a potential secondary infection
+	(the state of where the challenge lands is returned in pState, and the cell only if it is susceptible, since that is
+	 the only case where the challenge can succeed; otherwise the answer comes from the state map without touching aCells)
+*/
+static inline int whichCellSecondaryFrom(t_Dispersal *pDispersal, t_Landscape *pLandscape, int cellInfectFrom, double randDbl, int *pState)
+{
+	int		x,y,xOffset,yOffset,left,right,mid,cellToChallenge,cellQuad,pos;
+
+	cellToChallenge = _EMPTY_CELL;
+	*pState = _STATE_NO_HOST;
+	/*
+		First need to find cell to challenge (from randDbl, a uniform random number)
+	*/
+	randDbl *= 4.0;
+	cellQuad = (int)randDbl;
+	randDbl -= cellQuad;
+	if(!(randDbl < pDispersal->inCell || randDbl > pDispersal->onLandscape))
+	{
+		left = 0;
+		right = pDispersal->numProbs-1;
+		while((right-left) > 1)
+		{
+			mid=(left+right)/2;
+			if(pDispersal->aProbs[mid] < randDbl)
+			{
+				left = mid;
+			}
+			else
+			{
+				right = mid;
+			}
+		}
+		/* right is the cell to challenge*/;
+		posToGrid(right, pLandscape->numCols, &xOffset, &yOffset);
+		/* but need to account for only storing one quarter of the kernel (reflecting into quadrant cellQuad, without a branch) */
+		xOffset *= g_aQuadSignX[cellQuad];
+		yOffset *= g_aQuadSignY[cellQuad];
+		x = pLandscape->aCells[cellInfectFrom].xPos + xOffset;
+		if(x >= 0 && x < pLandscape->numCols)
+		{
+			y = pLandscape->aCells[cellInfectFrom].yPos + yOffset;
+			if(y >=0 && y < pLandscape->numRows)
+			{
+				pos = lookupPos(pLandscape, x, y);
+				*pState = getPosState(pLandscape, pos);
+				if(*pState == _STATE_SUSCEPTIBLE)
+				{
+					cellToChallenge = pLandscape->aCellLookup[pos];
+				}
+				else if(*pState == _STATE_NO_HOST)
+				{
+#ifdef _DEBUG_PRINT_MSG
+					fprintf(stdout, "\t\t\t\tno hosts\n");
+#endif
+				}
+			}
+			else
+			{
+#ifdef _DEBUG_PRINT_MSG
+				fprintf(stdout, "\t\t\t\toff landscape\n");
+#endif
+			}
+		}
+		else
+		{
+#ifdef _DEBUG_PRINT_MSG
+			fprintf(stdout, "\t\t\t\toff landscape\n");
+#endif
+		}
+	}
+	else
+	{
+		if(randDbl > pDispersal->onLandscape)
+		{
+#ifdef _DEBUG_PRINT_MSG
+			fprintf(stdout, "\t\t\t\toff landscape\n");
+#endif
+		}
+		else
+		{
+#ifdef _DEBUG_PRINT_MSG
+			fprintf(stdout, "\t\t\t\twithin cell\n");
+#endif
+		}
+	}
+	return cellToChallenge;
+}
+
+/*
+	(drawing from the dispersal stream)
+*/
+int whichCellSecondary(t_Dispersal *pDispersal, t_Landscape *pLandscape, int cellInfectFrom, t_Params *pParams, int *pState)
+{
+	int cellToChallenge;
+
+	perf_begin(&g_sProfileWhichCell);
+	cellToChallenge = whichCellSecondaryFrom(pDispersal, pLandscape, cellInfectFrom, streamRandom(_STREAM_DISPERSAL), pState);
+	perf_end(&g_sProfileWhichCell);
+	return cellToChallenge;
+}
+
+/*
+	Peek at minimum element in the priority queue to find time of next secondary infection
+*/
+double getNextPossSecTime(t_Epidemic *pEpidemic, t_Landscape *pLandscape, double tPrimary)
+{
+	if(pEpidemic->queueLen > 0)
+	{
+		/* Peek at min element of queue (do not remove it) */
+		return pLandscape->aCells[pEpidemic->aQueueCells[0]].tNext;
+	}
+	/*
+		If nothing in the queue (i.e. no primary infection has happened) make sure
+		the putative secondary comes after the next primary (and so won't be selected anyway)
+	*/
+	return tPrimary + 1.0;
+}
+
+/*
+	Retrieve element from the priority queue
+*/
+int getCellInfectFrom(t_Epidemic *pEpidemic, t_Landscape *pLandscape)
+{
+	int minCell;
+
+	if(pEpidemic->queueLen > 0)
+	{
+		minCell = pEpidemic->aQueueCells[0];
+		removeMinElement(pEpidemic, pLandscape);
+		return minCell;
+	}
+	return _EMPTY_CELL;
+}
+
+/*
+	J in the logistic bulk up of infection within a cell (see description in the cfg file)
+*/
+static inline double getLogisticJ(t_Landscape *pLandscape, int hostID, double withinCellMin, int trueMinFlag)
+{
+	double thisWCM;
+
+	if (trueMinFlag)
+	{
+		if (withinCellMin >= pLandscape->aCells[hostID].propFull)
+		{
+			return 0.0;
+		}
+		thisWCM = withinCellMin / pLandscape->aCells[hostID].propFull;
+		return (1.0 - thisWCM) / thisWCM;
+	}
+	return (1.0 - withinCellMin) / withinCellMin;
+}
+
+/*
+	Delay from thisTime before the next secondary infection from a cell, given the delay deltaMin there would be if the
+	cell were full of infection (lengthened to account for infectivity bulking up logistically)
+*/
+double secondaryDelay(t_Landscape *pLandscape, int thisCell, double thisTime, double deltaMin, double withinCellMin, double withinCellBulkUp, int trueMinFlag)
+{
+	double	tSinceInf;			/* time since this cell was infected */
+	double	logisticJ;			/* J= (1-withinCellMin)/withinCellMin */
+
+	tSinceInf = thisTime - pLandscape->aCells[thisCell].tInf;
+	logisticJ = getLogisticJ(pLandscape, thisCell, withinCellMin, trueMinFlag);
+	return (1.0/withinCellBulkUp)*(log(exp(withinCellBulkUp*(tSinceInf+deltaMin)) + logisticJ*(exp(withinCellBulkUp*deltaMin)-1.0))) - tSinceInf;
+}
+
+/*
+	Find the time of the next secondary infection from a given cell
+*/
+void findNextSecondary(t_Landscape *pLandscape, int thisCell, double thisTime, double rateSecInf, t_Epidemic *pEpidemic, t_RunStats *pRunStats, double withinCellMin, double withinCellBulkUp, int trueMinFlag)
+{
+	double	expDbl,rateSec;
+	double	deltaMin;			/* delay before next infection if cell were full of infection */
+
+	pRunStats->numFindNextSecondary++;
+	expDbl = streamExponential(_STREAM_DISPERSAL);
+	/* find maximum rate of infection from this cell */
+	rateSec = pLandscape->aCells[thisCell].propFull*pLandscape->aCells[thisCell].relInf*rateSecInf;
+	if(rateSec > 0)
+	{
+		deltaMin = expDbl/rateSec;
+		pLandscape->aCells[thisCell].tNext = thisTime + secondaryDelay(pLandscape, thisCell, thisTime, deltaMin, withinCellMin, withinCellBulkUp, trueMinFlag);
+		/* Add this entry to queue */
+		insertElement(thisCell, pEpidemic, pLandscape);
+	}
+}
+
+/*
+	Record that a cell has become infected (without scheduling its secondary infections)
+*/
+void recordInfection(t_Landscape *pLandscape, int thisCell, double thisTime, t_Epidemic *pEpidemic, int infType, int infBy)
+{
+	/* set the time of infection */
+	pLandscape->aCells[thisCell].tInf = thisTime;
+	pLandscape->aCells[thisCell].infType = infType;
+	pLandscape->aCells[thisCell].infBy = infBy;
+	setCellState(pLandscape, thisCell, _STATE_INFECTED);
+	/* add to the list of all infections for later dumping */
+	pEpidemic->aInfCells[pEpidemic->totalInf] = thisCell;
+	pEpidemic->totalInf++;
+}
+
+/*
+	Book-keeping to handle a cell newly becoming infected
+*/
+void infectCell(t_Landscape *pLandscape, int thisCell, double thisTime, double rateSecInf, t_Epidemic *pEpidemic, int infType, int infBy, t_RunStats *pRunStats, double withinCellMin, double withinCellBulkUp, int trueMinFlag)
+{
+	recordInfection(pLandscape, thisCell, thisTime, pEpidemic, infType, infBy);
+	/* find time of next (potential) secondary infection from this cell */
+	findNextSecondary(pLandscape, thisCell, thisTime, rateSecInf, pEpidemic, pRunStats, withinCellMin, withinCellBulkUp, trueMinFlag);
+}
+
+/*
+	Find the incidence in a given cell based on the current time and its time of infection
+*/
+static inline double getIncidence(t_Landscape *pLandscape, t_Epidemic *pEpidemic, double thisTime, int hostID, double withinCellMin, double withinCellBulkUp, int trueMinFlag)
+{
+	double tSinceInf,logisticJ,thisIncidence;
+
+	tSinceInf = thisTime - pLandscape->aCells[hostID].tInf;
+	if (tSinceInf >= 0.0)	/* getIncidence() can be called before a cell has become infected...if so ignore */
+	{
+		logisticJ = getLogisticJ(pLandscape, hostID, withinCellMin, trueMinFlag);
+		thisIncidence = pLandscape->aCells[hostID].propFull / (1 + logisticJ * exp(-withinCellBulkUp*tSinceInf));
+	}
+	else
+	{
+		thisIncidence = 0.0;
+	}
+	return thisIncidence;
+}
+
+/*
+	Total incidence at thisTime in the first numInf cells to have been infected
+	(this is the hot loop once many cells are infected; trueMinFlag is fixed for the whole ensemble, so is tested once
+	 here, leaving each loop with getIncidence() inlined and specialised to one model of within-cell bulk up)
+*/
+double sumIncidence(t_Landscape *pLandscape, t_Epidemic *pEpidemic, double thisTime, int numInf, double withinCellMin, double withinCellBulkUp, int trueMinFlag)
+{
+	double	total;
+	int		j;
+
+	total = 0.0;
+	if (trueMinFlag)
+	{
+		for (j = 0; j < numInf; j++)
+		{
+			total += getIncidence(pLandscape, pEpidemic, thisTime, pEpidemic->aInfCells[j], withinCellMin, withinCellBulkUp, 1);
+		}
+	}
+	else
+	{
+		for (j = 0; j < numInf; j++)
+		{
+			total += getIncidence(pLandscape, pEpidemic, thisTime, pEpidemic->aInfCells[j], withinCellMin, withinCellBulkUp, 0);
+		}
+	}
+	return total;
+}
+
+/*
+	Poisson distributed random number
+		inversion for small means
+		transformed rejection with squeeze (Hormann, 1993, "The transformed rejection method for generating Poisson random variables") for large means
+	(uniform random numbers come from the given stream, or the tile's own stream if pTile is not NULL; see randomFrom())
+*/
+long poissonRandom(double mean, int stream, t_Tile *pTile)
+{
+	long	k;
+	double	limit,prod,smu,b,a,invAlpha,vr,U,V,us;
+
+	if (mean <= 0.0)
+	{
+		return 0;
+	}
+	if (mean < _POISSON_SMALL_MEAN)
+	{
+		limit = exp(-mean);
+		prod = randomFrom(stream, pTile);
+		k = 0;
+		while (prod > limit)
+		{
+			prod *= randomFrom(stream, pTile);
+			k++;
+		}
+		return k;
+	}
+	smu = sqrt(mean);
+	b = 0.931 + 2.53 * smu;
+	a = -0.059 + 0.02483 * b;
+	invAlpha = 1.1239 + 1.1328 / (b - 3.4);
+	vr = 0.9277 - 3.6224 / (b - 2.0);
+	for (;;)
+	{
+		U = randomFrom(stream, pTile) - 0.5;
+		V = randomFrom(stream, pTile);
+		us = 0.5 - fabs(U);
+		k = (long)floor((2.0 * a / us + b) * U + mean + 0.43);
+		if (us >= 0.07 && V <= vr)
+		{
+			return k;
+		}
+		if (k < 0 || (us < 0.013 && V > us))
+		{
+			continue;
+		}
+		if (log(V) + log(invAlpha) - log(a / (us * us) + b) <= -mean + k * log(mean) - lgamma(k + 1.0))
+		{
+			return k;
+		}
+	}
+}
+
+/*
+	Integral of the logistic infectivity 1/(1+J*exp(-r*a)) of a cell over ages [age, age+tau]
+	(written to avoid overflow for cells which were infected a long time ago)
+*/
+double integratedInfectivity(double age, double tau, double logisticJ, double withinCellBulkUp)
+{
+	if (age < 0.0)
+	{
+		tau += age;
+		age = 0.0;
+	}
+	if (tau <= 0.0)
+	{
+		return 0.0;
+	}
+	return tau + (1.0 / withinCellBulkUp) * log((1.0 + logisticJ * exp(-withinCellBulkUp * (age + tau))) / (1.0 + logisticJ * exp(-withinCellBulkUp * age)));
+}
+
+/*
+	Sort the infections from a single tau-leaping step into order of time of infection
+	(output routines rely on aInfCells being in order of infection; steps only add a few infections so insertion sort is fine)
+*/
+void sortNewInfections(t_Landscape *pLandscape, t_Epidemic *pEpidemic, int firstNew)
+{
+	int i,j,thisCell;
+
+	for (i = firstNew + 1; i < pEpidemic->totalInf; i++)
+	{
+		thisCell = pEpidemic->aInfCells[i];
+		j = i - 1;
+		while (j >= firstNew && pLandscape->aCells[pEpidemic->aInfCells[j]].tInf > pLandscape->aCells[thisCell].tInf)
+		{
+			pEpidemic->aInfCells[j + 1] = pEpidemic->aInfCells[j];
+			j--;
+		}
+		pEpidemic->aInfCells[j + 1] = thisCell;
+	}
+}
+
+/*
+	Length of a tau-leaping step from the landscape incidence and its rate of change at the start of the step
+*/
+double tauLeapStepSize(t_Params *pParams, double thisTime, double incidence, double incidenceRate)
+{
+	double tau;
+
+	tau = pParams->reportTime;
+	if (incidenceRate > 0.0 && pParams->tauLeapEpsilon * incidence / incidenceRate < tau)
+	{
+		tau = pParams->tauLeapEpsilon * incidence / incidenceRate;
+	}
+	if (thisTime + tau > pParams->maxTime)
+	{
+		tau = pParams->maxTime - thisTime;
+	}
+	return tau;
+}
+
+/*
+	Single step of the (approximate) tau-leaping engine, returning the time at the end of the step
+
+	Rather than one event at a time, each infected cell generates a Poisson distributed batch of challenges over the step
+		- the step length is chosen so the relative change in landscape incidence over the step is at most tauLeapEpsilon
+			(and so that steps are no longer than reportTime)
+		- cells infected during a step are given a time of infection uniformly within the step, but only start to cause
+			infections themselves from the next step (their infectivity is tiny initially anyway, because of the logistic bulk up)
+*/
+double tauLeapStep(t_Params *pParams, t_Landscape *pLandscape, t_PriInf *pPriInf, t_Dispersal *pDispersal, t_Epidemic *pEpidemic, t_RunStats *pRunStats, double thisTime, int *pDoneInf)
+{
+	int		i,numAtStart,thisCell,cellToChallenge,cellState;
+	long	numChallenges,k;
+	double	tau,logisticJ,age,sigma,incidence,incidenceRate,thisRate,meanChallenges;
+
+	/* choose the size of the step from the current state */
+	numAtStart = pEpidemic->totalInf;
+	incidence = incidenceRate = 0.0;
+	for (i = 0; i < numAtStart; i++)
+	{
+		thisCell = pEpidemic->aInfCells[i];
+		logisticJ = getLogisticJ(pLandscape, thisCell, pParams->withinCellMin, pParams->trueMinFlag);
+		age = thisTime - pLandscape->aCells[thisCell].tInf;
+		sigma = 1.0 / (1.0 + logisticJ * exp(-pParams->withinCellBulkUp * age));
+		incidence += pLandscape->aCells[thisCell].propFull * sigma;
+		incidenceRate += pLandscape->aCells[thisCell].propFull * pParams->withinCellBulkUp * sigma * (1.0 - sigma);
+	}
+	tau = tauLeapStepSize(pParams, thisTime, incidence, incidenceRate);
+	/* secondary infection */
+	for (i = 0; i < numAtStart; i++)
+	{
+		thisCell = pEpidemic->aInfCells[i];
+		logisticJ = getLogisticJ(pLandscape, thisCell, pParams->withinCellMin, pParams->trueMinFlag);
+		age = thisTime - pLandscape->aCells[thisCell].tInf;
+		thisRate = pLandscape->aCells[thisCell].propFull * pLandscape->aCells[thisCell].relInf * pParams->rateSecInf;
+		meanChallenges = thisRate * integratedInfectivity(age, tau, logisticJ, pParams->withinCellBulkUp);
+		numChallenges = poissonRandom(meanChallenges, _STREAM_DISPERSAL, NULL);
+		for (k = 0; k < numChallenges; k++)
+		{
+			pRunStats->numSecondaryAttempts++;
+			cellToChallenge = whichCellSecondary(pDispersal, pLandscape, thisCell, pParams, &cellState);
+			if (cellState != _STATE_NO_HOST)
+			{
+				pRunStats->numNonEmpty++;
+				if (cellState == _STATE_SUSCEPTIBLE)
+				{
+					pRunStats->numNonInfected++;
+					if (streamRandom(_STREAM_SUSCEPTIBILITY) < pLandscape->aCells[cellToChallenge].relSus * pLandscape->aCells[cellToChallenge].propFull)
+					{
+						pRunStats->numSuccessful++;
+						recordInfection(pLandscape, cellToChallenge, thisTime + tau * streamRandom(_STREAM_DISPERSAL), pEpidemic, _SEC_INF_TYPE, thisCell);
+						*pDoneInf = 1;
+					}
+				}
+			}
+		}
+	}
+	/* primary infection */
+	numChallenges = poissonRandom(pPriInf->ratePri * tau, _STREAM_PRIMARY, NULL);
+	for (k = 0; k < numChallenges; k++)
+	{
+		pRunStats->numPrimaryAttempts++;
+		cellToChallenge = whichCellPrimary(pPriInf, pLandscape->numCells);
+		if (pLandscape->aCells[cellToChallenge].tInf < 0.0)
+		{
+			recordInfection(pLandscape, cellToChallenge, thisTime + tau * streamRandom(_STREAM_PRIMARY), pEpidemic, _PRI_INF_TYPE, _EMPTY_CELL);
+			*pDoneInf = 1;
+		}
+	}
+	sortNewInfections(pLandscape, pEpidemic, numAtStart);
+	return thisTime + tau;
+}
+
+/*
+	Tile containing a cell
+*/
+int tileOf(t_Tiling *pTiling, t_Landscape *pLandscape, int cell)
+{
+	return (pLandscape->aCells[cell].yPos / pTiling->tileSize) * pTiling->numTileCols + pLandscape->aCells[cell].xPos / pTiling->tileSize;
+}
+
+/*
+	Divide the landscape into tiles for the tiled engine
+*/
+int setupTiling(t_Tiling *pTiling, t_Params *pParams, t_Landscape *pLandscape)
+{
+	int		i,t,numThreads;
+	int		*aNumCells;
+	t_Tile	*pTile;
+
+	pTiling->tileSize = pParams->tileSize;
+	pTiling->numTileCols = (pLandscape->numCols + pTiling->tileSize - 1) / pTiling->tileSize;
+	pTiling->numTiles = pTiling->numTileCols * ((pLandscape->numRows + pTiling->tileSize - 1) / pTiling->tileSize);
+	pTiling->aTiles = (t_Tile*)mem_calloc(pTiling->numTiles, sizeof(t_Tile), "tiles");
+	aNumCells = (int*)mem_calloc(pTiling->numTiles, sizeof(int), "tiles");
+	pTiling->maxPriMsgs = _TILE_MSG_BLOCK;
+	pTiling->aPriMsgs = (t_TileMsg*)mem_malloc(sizeof(t_TileMsg) * pTiling->maxPriMsgs, "tileMsgs");
+	pTiling->numWindows = pTiling->numPasses = 0;
+	if (!pTiling->aTiles || !aNumCells || !pTiling->aPriMsgs)
+	{
+		fprintf(stderr, "couldn't allocate memory for %d tiles\n", pTiling->numTiles);
+		return 0;
+	}
+	for (i = 0; i < pLandscape->numCells; i++)
+	{
+		aNumCells[tileOf(pTiling, pLandscape, i)]++;
+	}
+	for (t = 0; t < pTiling->numTiles; t++)
+	{
+		pTile = &pTiling->aTiles[t];
+		pTile->aInfCells = (int*)mem_malloc(sizeof(int) * (aNumCells[t] > 0 ? aNumCells[t] : 1), "tiles");
+		pTile->sQueue.aQueueCells = (int*)mem_malloc(sizeof(int) * (aNumCells[t] > 0 ? aNumCells[t] : 1), "tiles");
+		pTile->maxMsgs = pTile->maxIn = pTile->maxNextIn = _TILE_MSG_BLOCK;
+		pTile->aMsgs = (t_TileMsg*)mem_malloc(sizeof(t_TileMsg) * pTile->maxMsgs, "tileMsgs");
+		pTile->aIn = (t_TileMsg*)mem_malloc(sizeof(t_TileMsg) * pTile->maxIn, "tileMsgs");
+		pTile->aNextIn = (t_TileMsg*)mem_malloc(sizeof(t_TileMsg) * pTile->maxNextIn, "tileMsgs");
+		if (!pTile->aInfCells || !pTile->sQueue.aQueueCells || !pTile->aMsgs || !pTile->aIn || !pTile->aNextIn)
+		{
+			fprintf(stderr, "couldn't allocate memory for tile %d\n", t);
+			return 0;
+		}
+	}
+	mem_free(aNumCells);
+	numThreads = 1;
+#ifdef _OPENMP
+	if (pParams->numThreads > 0)
+	{
+		omp_set_num_threads(pParams->numThreads);
+	}
+	numThreads = omp_get_max_threads();
+#endif
+	fprintf(stdout, "tiled engine: %d tiles of %dx%d cells, %d thread(s)\n", pTiling->numTiles, pTiling->tileSize, pTiling->tileSize, numThreads);
+	return 1;
+}
+
+void freeTiling(t_Tiling *pTiling)
+{
+	int t;
+
+	for (t = 0; t < pTiling->numTiles; t++)
+	{
+		mem_free(pTiling->aTiles[t].aInfCells);
+		mem_free(pTiling->aTiles[t].sQueue.aQueueCells);
+		mem_free(pTiling->aTiles[t].aMsgs);
+		mem_free(pTiling->aTiles[t].aIn);
+		mem_free(pTiling->aTiles[t].aNextIn);
+	}
+	mem_free(pTiling->aTiles);
+	mem_free(pTiling->aPriMsgs);
+}
+
+/*
+	Empty the tiles at the start of a run
+*/
+void resetTiling(t_Tiling *pTiling)
+{
+	int t;
+
+	for (t = 0; t < pTiling->numTiles; t++)
+	{
+		pTiling->aTiles[t].numInf = 0;
+	}
+	pTiling->numAssigned = 0;
+	pTiling->bSeeded = 0;
+}
+
+/*
+	Add a message to a buffer, growing it if need be (returns 0 if it couldn't be grown)
+*/
+int addTileMsg(t_TileMsg **paMsgs, int *pNumMsgs, int *pMaxMsgs, double tInf, int cell, int infBy)
+{
+	t_TileMsg *pMsgs;
+
+	if (*pNumMsgs == *pMaxMsgs)
+	{
+		/* (buffers can be grown by the thread running a tile, and memory tracking isn't locked) */
+#pragma omp critical(memTrack)
+		pMsgs = (t_TileMsg*)mem_realloc(*paMsgs, sizeof(t_TileMsg) * 2 * (*pMaxMsgs), "tileMsgs");
+		if (!pMsgs)
+		{
+			return 0;
+		}
+		*paMsgs = pMsgs;
+		*pMaxMsgs *= 2;
+	}
+	(*paMsgs)[*pNumMsgs].tInf = tInf;
+	(*paMsgs)[*pNumMsgs].cell = cell;
+	(*paMsgs)[*pNumMsgs].infBy = infBy;
+	(*pNumMsgs)++;
+	return 1;
+}
+
+/*
+	Messages in order of time (ties, which are vanishingly unlikely, are broken so the order is always the same)
+*/
+static int cmpTileMsg(const void *p1, const void *p2)
+{
+	const t_TileMsg *pMsg1 = (const t_TileMsg *)p1;
+	const t_TileMsg *pMsg2 = (const t_TileMsg *)p2;
+
+	if (pMsg1->tInf != pMsg2->tInf)
+	{
+		return (pMsg1->tInf > pMsg2->tInf) - (pMsg1->tInf < pMsg2->tInf);
+	}
+	if (pMsg1->cell != pMsg2->cell)
+	{
+		return (pMsg1->cell > pMsg2->cell) - (pMsg1->cell < pMsg2->cell);
+	}
+	return (pMsg1->infBy > pMsg2->infBy) - (pMsg1->infBy < pMsg2->infBy);
+}
+
+/*
+	Schedule the next challenge from a cell in a tile, drawing from the tile's stream (as findNextSecondary(), but
+	the cell is only queued if the challenge is before the end of the window)
+*/
+void tileNextSecondary(t_Params *pParams, t_Landscape *pLandscape, t_Tile *pTile, int thisCell, double thisTime, double windowEnd)
+{
+	double expDbl,rateSec,tNext;
+
+	pTile->sStats.numFindNextSecondary++;
+	expDbl = tileExponential(pTile);
+	rateSec = pLandscape->aCells[thisCell].propFull*pLandscape->aCells[thisCell].relInf*pParams->rateSecInf;
+	if (rateSec > 0)
+	{
+		tNext = thisTime + secondaryDelay(pLandscape, thisCell, thisTime, expDbl/rateSec, pParams->withinCellMin, pParams->withinCellBulkUp, pParams->trueMinFlag);
+		if (tNext < windowEnd)
+		{
+			pLandscape->aCells[thisCell].tNext = tNext;
+			insertElement(thisCell, &pTile->sQueue, pLandscape);
+		}
+	}
+}
+
+/*
+	Run tile t through the window [windowStart, windowEnd) with the infections from elsewhere in its aIn, exactly as the
+	exact engine would run its cells (starting again from the state at the start of the window if it has already been run)
+		- the tile only writes to its own cells, and the state map isn't changed until the end of the window, so
+			tiles can be run at the same time
+		- a successful challenge of a cell in another tile is sent to it as a message, and it is up to that tile whether
+			the cell is still susceptible (challenges are drawn whatever the state of the cell, so this changes nothing)
+*/
+void runTileWindow(t_Params *pParams, t_Landscape *pLandscape, t_Dispersal *pDispersal, t_Tiling *pTiling, int t, double windowStart, double windowEnd)
+{
+	int		i,nextIn,thisCell,cellToChallenge,cellState,bOwnCell;
+	double	thisTime,tNextIn;
+	t_Tile	*pTile;
+	t_Cell	*pCell;
+
+	pTile = &pTiling->aTiles[t];
+	if (pTile->bSaved)
+	{
+		/* undo the last run through the window */
+		for (i = pTile->numInfStart; i < pTile->numInf; i++)
+		{
+			pCell = &pLandscape->aCells[pTile->aInfCells[i]];
+			pCell->tInf = _UNDEF_TIME;
+			pCell->tNext = _UNDEF_TIME;
+			pCell->infType = _EMPTY_CELL;
+			pCell->infBy = _EMPTY_CELL;
+		}
+		pTile->numInf = pTile->numInfStart;
+		if (g_rng == _RNG_XOSHIRO)
+		{
+			memcpy(&pTile->sBlockRandom, &pTile->sSavedBlockRandom, sizeof(xoshiro_state));
+		}
+		else
+		{
+			memcpy(&pTile->sRandom, &pTile->sSavedRandom, sizeof(mt_state));
+		}
+	}
+	else if (pTile->numInf > 0 || pTile->numIn > 0)
+	{
+		/* (a tile with nothing to do draws no random numbers, so only needs saving once it has) */
+		if (g_rng == _RNG_XOSHIRO)
+		{
+			memcpy(&pTile->sSavedBlockRandom, &pTile->sBlockRandom, sizeof(xoshiro_state));
+		}
+		else
+		{
+			memcpy(&pTile->sSavedRandom, &pTile->sRandom, sizeof(mt_state));
+		}
+		pTile->bSaved = 1;
+	}
+	pTile->numMsgs = 0;
+	memset(&pTile->sStats, 0, sizeof(t_RunStats));
+	/* the next challenge from each cell is drawn afresh from the start of the window (waiting times are memoryless) */
+	pTile->sQueue.queueLen = 0;
+	for (i = 0; i < pTile->numInf; i++)
+	{
+		tileNextSecondary(pParams, pLandscape, pTile, pTile->aInfCells[i], windowStart, windowEnd);
+	}
+	nextIn = 0;
+	while (!pTile->bNoMemory)
+	{
+		tNextIn = (nextIn < pTile->numIn) ? pTile->aIn[nextIn].tInf : windowEnd;
+		if (pTile->sQueue.queueLen > 0 && pLandscape->aCells[pTile->sQueue.aQueueCells[0]].tNext < tNextIn)
+		{
+			/* challenge from a cell in the tile */
+			thisCell = getCellInfectFrom(&pTile->sQueue, pLandscape);
+			thisTime = pLandscape->aCells[thisCell].tNext;
+			pTile->sStats.numSecondaryAttempts++;
+			cellToChallenge = whichCellSecondaryFrom(pDispersal, pLandscape, thisCell, tileRandom(pTile), &cellState);
+			if (cellState != _STATE_NO_HOST)
+			{
+				pTile->sStats.numNonEmpty++;
+				/* (the state map is as at the start of the window, so cells in the tile infected since are checked here) */
+				bOwnCell = (cellState == _STATE_SUSCEPTIBLE && tileOf(pTiling, pLandscape, cellToChallenge) == t);
+				if (cellState == _STATE_SUSCEPTIBLE && (!bOwnCell || pLandscape->aCells[cellToChallenge].tInf < 0.0))
+				{
+					pTile->sStats.numNonInfected++;
+					if (tileRandom(pTile) < pLandscape->aCells[cellToChallenge].relSus * pLandscape->aCells[cellToChallenge].propFull)
+					{
+						if (bOwnCell)
+						{
+							pLandscape->aCells[cellToChallenge].tInf = thisTime;
+							pLandscape->aCells[cellToChallenge].infType = _SEC_INF_TYPE;
+							pLandscape->aCells[cellToChallenge].infBy = thisCell;
+							pTile->aInfCells[pTile->numInf++] = cellToChallenge;
+							tileNextSecondary(pParams, pLandscape, pTile, cellToChallenge, thisTime, windowEnd);
+						}
+						else if (!addTileMsg(&pTile->aMsgs, &pTile->numMsgs, &pTile->maxMsgs, thisTime, cellToChallenge, thisCell))
+						{
+							pTile->bNoMemory = 1;
+						}
+					}
+				}
+			}
+			tileNextSecondary(pParams, pLandscape, pTile, thisCell, thisTime, windowEnd);
+		}
+		else if (nextIn < pTile->numIn)
+		{
+			/* infection from elsewhere, unless the cell has already been infected */
+			thisCell = pTile->aIn[nextIn].cell;
+			if (pLandscape->aCells[thisCell].tInf < 0.0)
+			{
+				pLandscape->aCells[thisCell].tInf = pTile->aIn[nextIn].tInf;
+				pLandscape->aCells[thisCell].infType = (pTile->aIn[nextIn].infBy == _EMPTY_CELL) ? _PRI_INF_TYPE : _SEC_INF_TYPE;
+				pLandscape->aCells[thisCell].infBy = pTile->aIn[nextIn].infBy;
+				pTile->aInfCells[pTile->numInf++] = thisCell;
+				tileNextSecondary(pParams, pLandscape, pTile, thisCell, pTile->aIn[nextIn].tInf, windowEnd);
+			}
+			nextIn++;
+		}
+		else
+		{
+			break;
+		}
+	}
+}
+
+/*
+	Pass messages on to the tiles containing the cells they infect, for the next pass over the tiles
+*/
+int routeTileMsgs(t_Tiling *pTiling, t_Landscape *pLandscape, t_TileMsg *aMsgs, int numMsgs)
+{
+	int		i;
+	t_Tile	*pTile;
+
+	for (i = 0; i < numMsgs; i++)
+	{
+		pTile = &pTiling->aTiles[tileOf(pTiling, pLandscape, aMsgs[i].cell)];
+		if (!addTileMsg(&pTile->aNextIn, &pTile->numNextIn, &pTile->maxNextIn, aMsgs[i].tInf, aMsgs[i].cell, aMsgs[i].infBy))
+		{
+			fprintf(stderr, "couldn't allocate memory for the infections of tile %d\n", tileOf(pTiling, pLandscape, aMsgs[i].cell));
+			return 0;
+		}
+	}
+	return 1;
+}
+
+/*
+	Single window of the tiled engine, which sets *pThisTime to the time at the end of the window
+
+	The landscape is divided into tiles, and each tile is run through the window on its own (in parallel, if compiled
+	with OpenMP) by runTileWindow(), with its own priority queue and random number stream
+		- primary infections in the window are drawn first, and passed to the tiles containing the cells
+		- after each pass over the tiles, the infections each tile caused in the others are passed on, and any tile
+			whose infections from elsewhere have changed is run through the window again, from the same random numbers
+		- this stops once nothing changes, when every tile has been run with exactly the infections from elsewhere
+			that the other tiles' runs cause (a tile's run only changes after the first time its infections from
+			elsewhere change, and a change only causes others later on, so this takes a few passes)
+	The result is the same as running the tiles one event at a time in order of time, so runs are a realisation of the
+	same model as the exact engine, not an approximation to it. Windows are sized as tau-leaping steps (tauLeapEpsilon),
+	which only sets how often the tiles are synchronised; runs depend on tileSize and the windows (which decide the
+	random numbers), but not on the number of threads
+	So the run reacts when the exact engine would, a window ends by windowLimit (the next report), and the run stops at
+	the first new infection at which landscape incidence reaches stopIncidence (the next value of maxIncidence, or <= 0
+	for none), which is when the exact engine would notice it
+*/
+int tiledStep(t_Params *pParams, t_Landscape *pLandscape, t_PriInf *pPriInf, t_Dispersal *pDispersal, t_Epidemic *pEpidemic, t_Tiling *pTiling, t_RunStats *pRunStats, double windowLimit, double stopIncidence, double *pThisTime, int *pDoneInf)
+{
+	int				i,j,t,numAtStart,thisCell,numDirty,bFirst,numSwap,left,right,mid;
+	long			numChallenges,k;
+	double			thisTime,windowEnd,tau,logisticJ,age,sigma,incidence,incidenceRate;
+	unsigned long	aKey[2];
+	t_Tile			*pTile;
+	t_TileMsg		*pSwap;
+
+	thisTime = *pThisTime;
+	/* the tile streams are seeded from the dispersal stream the first time the engine is used in a run */
+	if (!pTiling->bSeeded)
+	{
+		aKey[0] = (unsigned long)(streamRandom(_STREAM_DISPERSAL) * 4294967296.0);
+		for (t = 0; t < pTiling->numTiles; t++)
+		{
+			aKey[1] = (unsigned long)t;
+			if (g_rng == _RNG_XOSHIRO)
+			{
+				xoshiro_seed(&pTiling->aTiles[t].sBlockRandom, aKey, 2);
+			}
+			else
+			{
+				init_by_array_r(&pTiling->aTiles[t].sRandom, aKey, 2);
+			}
+		}
+		pTiling->bSeeded = 1;
+	}
+	/* hand infections since the last window (or before the switch from the exact engine) to their tiles */
+	for (i = pTiling->numAssigned; i < pEpidemic->totalInf; i++)
+	{
+		pTile = &pTiling->aTiles[tileOf(pTiling, pLandscape, pEpidemic->aInfCells[i])];
+		pTile->aInfCells[pTile->numInf++] = pEpidemic->aInfCells[i];
+	}
+	numAtStart = pEpidemic->totalInf;
+	/* choose the size of the window from the current state (summed within tiles, and then over tiles in order) */
+#pragma omp parallel for private(pTile, i, thisCell, logisticJ, age, sigma) schedule(dynamic)
+	for (t = 0; t < pTiling->numTiles; t++)
+	{
+		pTile = &pTiling->aTiles[t];
+		pTile->numInfStart = pTile->numInf;
+		pTile->bSaved = 0;
+		pTile->numMsgs = 0;
+		memset(&pTile->sStats, 0, sizeof(t_RunStats));
+		pTile->incidence = pTile->incidenceRate = 0.0;
+		for (i = 0; i < pTile->numInf; i++)
+		{
+			thisCell = pTile->aInfCells[i];
+			logisticJ = getLogisticJ(pLandscape, thisCell, pParams->withinCellMin, pParams->trueMinFlag);
+			age = thisTime - pLandscape->aCells[thisCell].tInf;
+			sigma = 1.0 / (1.0 + logisticJ * exp(-pParams->withinCellBulkUp * age));
+			pTile->incidence += pLandscape->aCells[thisCell].propFull * sigma;
+			pTile->incidenceRate += pLandscape->aCells[thisCell].propFull * pParams->withinCellBulkUp * sigma * (1.0 - sigma);
+		}
+	}
+	incidence = incidenceRate = 0.0;
+	for (t = 0; t < pTiling->numTiles; t++)
+	{
+		incidence += pTiling->aTiles[t].incidence;
+		incidenceRate += pTiling->aTiles[t].incidenceRate;
+	}
+	tau = tauLeapStepSize(pParams, thisTime, incidence, incidenceRate);
+	if (thisTime + tau > windowLimit)
+	{
+		tau = windowLimit - thisTime;
+	}
+	windowEnd = thisTime + tau;
+	/* primary infection over the whole window */
+	pTiling->numPriMsgs = 0;
+	numChallenges = poissonRandom(pPriInf->ratePri * tau, _STREAM_PRIMARY, NULL);
+	for (k = 0; k < numChallenges; k++)
+	{
+		pRunStats->numPrimaryAttempts++;
+		thisCell = whichCellPrimary(pPriInf, pLandscape->numCells);
+		if (!addTileMsg(&pTiling->aPriMsgs, &pTiling->numPriMsgs, &pTiling->maxPriMsgs, thisTime + tau * streamRandom(_STREAM_PRIMARY), thisCell, _EMPTY_CELL))
+		{
+			fprintf(stderr, "couldn't allocate memory for primary infection in the tiled engine\n");
+			return 0;
+		}
+	}
+	/* pass over the tiles until the infections passed between them stop changing */
+	bFirst = 1;
+	for (;;)
+	{
+		for (t = 0; t < pTiling->numTiles; t++)
+		{
+			pTiling->aTiles[t].numNextIn = 0;
+		}
+		/* (primary infections first, then the challenges from each tile in order) */
+		if (!routeTileMsgs(pTiling, pLandscape, pTiling->aPriMsgs, pTiling->numPriMsgs))
+		{
+			return 0;
+		}
+		for (t = 0; t < pTiling->numTiles; t++)
+		{
+			if (pTiling->aTiles[t].bNoMemory)
+			{
+				fprintf(stderr, "couldn't allocate memory for the challenges from tile %d\n", t);
+				return 0;
+			}
+			if (!routeTileMsgs(pTiling, pLandscape, pTiling->aTiles[t].aMsgs, pTiling->aTiles[t].numMsgs))
+			{
+				return 0;
+			}
+		}
+		numDirty = 0;
+#pragma omp parallel for private(pTile, pSwap, numSwap) reduction(+:numDirty) schedule(dynamic)
+		for (t = 0; t < pTiling->numTiles; t++)
+		{
+			pTile = &pTiling->aTiles[t];
+			qsort(pTile->aNextIn, pTile->numNextIn, sizeof(t_TileMsg), cmpTileMsg);
+			pTile->bDirty = bFirst || pTile->numNextIn != pTile->numIn || memcmp(pTile->aNextIn, pTile->aIn, sizeof(t_TileMsg) * pTile->numIn) != 0;
+			if (pTile->bDirty)
+			{
+				pSwap = pTile->aIn;
+				pTile->aIn = pTile->aNextIn;
+				pTile->aNextIn = pSwap;
+				numSwap = pTile->maxIn;
+				pTile->maxIn = pTile->maxNextIn;
+				pTile->maxNextIn = numSwap;
+				pTile->numIn = pTile->numNextIn;
+				numDirty++;
+			}
+		}
+		if (numDirty == 0)
+		{
+			break;
+		}
+#pragma omp parallel for schedule(dynamic)
+		for (t = 0; t < pTiling->numTiles; t++)
+		{
+			if (pTiling->aTiles[t].bDirty)
+			{
+				runTileWindow(pParams, pLandscape, pDispersal, pTiling, t, thisTime, windowEnd);
+			}
+		}
+		pTiling->numPasses++;
+		bFirst = 0;
+	}
+	pTiling->numWindows++;
+	/* the window is settled, so add the new infections to the epidemic (in tile order, and then sorted by time) */
+	for (t = 0; t < pTiling->numTiles; t++)
+	{
+		pTile = &pTiling->aTiles[t];
+		pRunStats->numSecondaryAttempts += pTile->sStats.numSecondaryAttempts;
+		pRunStats->numNonEmpty += pTile->sStats.numNonEmpty;
+		pRunStats->numNonInfected += pTile->sStats.numNonInfected;
+		pRunStats->numFindNextSecondary += pTile->sStats.numFindNextSecondary;
+		for (i = pTile->numInfStart; i < pTile->numInf; i++)
+		{
+			thisCell = pTile->aInfCells[i];
+			setCellState(pLandscape, thisCell, _STATE_INFECTED);
+			pEpidemic->aInfCells[pEpidemic->totalInf++] = thisCell;
+			if (pLandscape->aCells[thisCell].infType == _SEC_INF_TYPE)
+			{
+				pRunStats->numSuccessful++;
+			}
+			*pDoneInf = 1;
+		}
+	}
+	sortNewInfections(pLandscape, pEpidemic, numAtStart);
+	*pThisTime = windowEnd;
+	/* stop at the first new infection which takes the landscape incidence to stopIncidence, if there is one */
+	if (stopIncidence > 0.0 && pEpidemic->totalInf > numAtStart && sumIncidence(pLandscape, pEpidemic, pLandscape->aCells[pEpidemic->aInfCells[pEpidemic->totalInf - 1]].tInf, pEpidemic->totalInf, pParams->withinCellMin, pParams->withinCellBulkUp, pParams->trueMinFlag) >= stopIncidence)
+	{
+		/* (incidence at the time of each new infection only goes up, so a binary chop finds it) */
+		left = numAtStart - 1;
+		right = pEpidemic->totalInf - 1;
+		while ((right - left) > 1)
+		{
+			mid = (left + right) / 2;
+			if (sumIncidence(pLandscape, pEpidemic, pLandscape->aCells[pEpidemic->aInfCells[mid]].tInf, mid + 1, pParams->withinCellMin, pParams->withinCellBulkUp, pParams->trueMinFlag) >= stopIncidence)
+			{
+				right = mid;
+			}
+			else
+			{
+				left = mid;
+			}
+		}
+		/* the run up to then is exactly as if it had been simulated one event at a time, so drop the later infections */
+		*pThisTime = pLandscape->aCells[pEpidemic->aInfCells[right]].tInf;
+		for (i = right + 1; i < pEpidemic->totalInf; i++)
+		{
+			thisCell = pEpidemic->aInfCells[i];
+			setCellState(pLandscape, thisCell, _STATE_SUSCEPTIBLE);
+			pLandscape->aCells[thisCell].tInf = _UNDEF_TIME;
+			pLandscape->aCells[thisCell].tNext = _UNDEF_TIME;
+			pLandscape->aCells[thisCell].infType = _EMPTY_CELL;
+			pLandscape->aCells[thisCell].infBy = _EMPTY_CELL;
+		}
+		pEpidemic->totalInf = right + 1;
+		for (t = 0; t < pTiling->numTiles; t++)
+		{
+			pTile = &pTiling->aTiles[t];
+			for (i = j = pTile->numInfStart; i < pTile->numInf; i++)
+			{
+				if (pLandscape->aCells[pTile->aInfCells[i]].tInf >= 0.0)
+				{
+					pTile->aInfCells[j++] = pTile->aInfCells[i];
+				}
+			}
+			pTile->numInf = j;
+		}
+	}
+	pTiling->numAssigned = pEpidemic->totalInf;
+	return 1;
+}
+
+/*
+	In place radix-2 FFT of a single line of n values (n must be a power of two)
+	bInverse=1 does the inverse transform, but without dividing by n
+*/
+void fft1D(double *aRe, double *aIm, int n, int bInverse)
+{
+	int		i,j,k,len,half;
+	double	ang,wRe,wIm,curRe,curIm,tRe,tIm,tmp;
+
+	/* bit reversal permutation */
+	for (i = 1, j = 0; i < n; i++)
+	{
+		k = n >> 1;
+		while (j & k)
+		{
+			j ^= k;
+			k >>= 1;
+		}
+		j |= k;
+		if (i < j)
+		{
+			tmp = aRe[i];
+			aRe[i] = aRe[j];
+			aRe[j] = tmp;
+			tmp = aIm[i];
+			aIm[i] = aIm[j];
+			aIm[j] = tmp;
+		}
+	}
+	/* butterflies */
+	for (len = 2; len <= n; len <<= 1)
+	{
+		half = len >> 1;
+		ang = (bInverse ? 2.0 : -2.0) * _PI / len;
+		wRe = cos(ang);
+		wIm = sin(ang);
+		for (i = 0; i < n; i += len)
+		{
+			curRe = 1.0;
+			curIm = 0.0;
+			for (k = 0; k < half; k++)
+			{
+				tRe = aRe[i + k + half] * curRe - aIm[i + k + half] * curIm;
+				tIm = aRe[i + k + half] * curIm + aIm[i + k + half] * curRe;
+				aRe[i + k + half] = aRe[i + k] - tRe;
+				aIm[i + k + half] = aIm[i + k] - tIm;
+				aRe[i + k] += tRe;
+				aIm[i + k] += tIm;
+				tmp = curRe * wRe - curIm * wIm;
+				curIm = curRe * wIm + curIm * wRe;
+				curRe = tmp;
+			}
+		}
+	}
+}
+
+/*
+	FFT down the columns of an nx by ny array, working on whole rows at once so that memory is accessed in order
+*/
+void fftColumns(double *aRe, double *aIm, int nx, int ny, int bInverse)
+{
+	int		i,j,k,x,len,half;
+	double	ang,wRe,wIm,tRe,tIm,tmp;
+	double	*pRe,*pIm,*qRe,*qIm;
+
+	for (i = 1, j = 0; i < ny; i++)
+	{
+		k = ny >> 1;
+		while (j & k)
+		{
+			j ^= k;
+			k >>= 1;
+		}
+		j |= k;
+		if (i < j)
+		{
+			for (x = 0; x < nx; x++)
+			{
+				tmp = aRe[x + i * nx];
+				aRe[x + i * nx] = aRe[x + j * nx];
+				aRe[x + j * nx] = tmp;
+				tmp = aIm[x + i * nx];
+				aIm[x + i * nx] = aIm[x + j * nx];
+				aIm[x + j * nx] = tmp;
+			}
+		}
+	}
+	for (len = 2; len <= ny; len <<= 1)
+	{
+		half = len >> 1;
+		for (k = 0; k < half; k++)
+		{
+			ang = (bInverse ? 2.0 : -2.0) * _PI * k / len;
+			wRe = cos(ang);
+			wIm = sin(ang);
+			for (i = 0; i < ny; i += len)
+			{
+				pRe = aRe + (i + k) * nx;
+				pIm = aIm + (i + k) * nx;
+				qRe = aRe + (i + k + half) * nx;
+				qIm = aIm + (i + k + half) * nx;
+				for (x = 0; x < nx; x++)
+				{
+					tRe = qRe[x] * wRe - qIm[x] * wIm;
+					tIm = qRe[x] * wIm + qIm[x] * wRe;
+					qRe[x] = pRe[x] - tRe;
+					qIm[x] = pIm[x] - tIm;
+					pRe[x] += tRe;
+					pIm[x] += tIm;
+				}
+			}
+		}
+	}
+}
+
+/*
+	2D FFT of the work space, transforming rows then columns
+	Only the first numRows rows are transformed along the row direction, since all other rows are either
+	zero padding (forward transform) or not needed (inverse transform, which is done the other way round)
+*/
+void fft2D(t_FFTKernel *pFFT, double *aRe, double *aIm, int numRows, int bInverse)
+{
+	int j;
+
+	if (!bInverse)
+	{
+		for (j = 0; j < numRows; j++)
+		{
+			fft1D(aRe + j * pFFT->nx, aIm + j * pFFT->nx, pFFT->nx, bInverse);
+		}
+	}
+	fftColumns(aRe, aIm, pFFT->nx, pFFT->ny, bInverse);
+	if (bInverse)
+	{
+		for (j = 0; j < numRows; j++)
+		{
+			fft1D(aRe + j * pFFT->nx, aIm + j * pFFT->nx, pFFT->nx, bInverse);
+		}
+	}
+}
+
+/*
+	Set up the transform of the dispersal kernel
+
+	The probability a single challenge from (x,y) lands on (x+dx,y+dy) follows from how whichCellSecondary() unfolds the
+	single stored quadrant: offsets with dx and dy both non-zero come from one quadrant, offsets along an axis from two
+	(dispersal back into the source cell is never successful, so is left out)
+*/
+int setupFFTKernel(t_FFTKernel *pFFT, t_Dispersal *pDispersal, t_Landscape *pLandscape)
+{
+	int		dx,dy,i,numPos,maxDist,maxDistX,maxDistY;
+	double	thisProb,inside,total;
+
+	fprintf(stdout, "setupFFTKernel()\n");
+	memset(pFFT, 0, sizeof(t_FFTKernel));
+	/*
+		Find how far the kernel actually reaches (to within _FFT_KERNEL_TAIL), since the landscape
+		only needs padding by that distance to prevent the circular convolution wrapping around
+	*/
+	total = pDispersal->aProbs[pDispersal->numProbs - 1] - pDispersal->aProbs[0];
+	inside = 0.0;
+	maxDist = 0;
+	while (maxDist < pLandscape->numCols - 1 || maxDist < pLandscape->numRows - 1)
+	{
+		maxDist++;
+		for (i = 0; i <= maxDist; i++)
+		{
+			if (i < pLandscape->numCols && maxDist < pLandscape->numRows)
+			{
+				inside += pDispersal->aProbs[gridToPos(i, maxDist, pLandscape->numCols)] - pDispersal->aProbs[gridToPos(i, maxDist, pLandscape->numCols) - 1];
+			}
+			if (i < maxDist && maxDist < pLandscape->numCols && i < pLandscape->numRows)
+			{
+				inside += pDispersal->aProbs[gridToPos(maxDist, i, pLandscape->numCols)] - pDispersal->aProbs[gridToPos(maxDist, i, pLandscape->numCols) - 1];
+			}
+		}
+		if (inside >= (1.0 - _FFT_KERNEL_TAIL) * total)
+		{
+			break;
+		}
+	}
+	maxDistX = maxDist < pLandscape->numCols - 1 ? maxDist : pLandscape->numCols - 1;
+	maxDistY = maxDist < pLandscape->numRows - 1 ? maxDist : pLandscape->numRows - 1;
+	pFFT->nx = 1;
+	while (pFFT->nx < pLandscape->numCols + maxDistX)
+	{
+		pFFT->nx <<= 1;
+	}
+	pFFT->ny = 1;
+	while (pFFT->ny < pLandscape->numRows + maxDistY)
+	{
+		pFFT->ny <<= 1;
+	}
+	numPos = pFFT->nx * pFFT->ny;
+	pFFT->aKernelRe = mem_calloc(numPos, sizeof(double), "fftKernel");
+	pFFT->aKernelIm = mem_calloc(numPos, sizeof(double), "fftKernel");
+	pFFT->aWorkRe = mem_malloc(sizeof(double) * numPos, "fftWork");
+	pFFT->aWorkIm = mem_malloc(sizeof(double) * numPos, "fftWork");
+	pFFT->aInfectivity = mem_calloc(pLandscape->numCells, sizeof(double), "fftCells");
+	pFFT->aForce = mem_calloc(pLandscape->numCells, sizeof(double), "fftCells");
+	if (!(pFFT->aKernelRe && pFFT->aKernelIm && pFFT->aWorkRe && pFFT->aWorkIm && pFFT->aInfectivity && pFFT->aForce))
+	{
+		fprintf(stderr, "out of memory\n");
+		return 0;
+	}
+	for (dy = -maxDistY; dy <= maxDistY; dy++)
+	{
+		for (dx = -maxDistX; dx <= maxDistX; dx++)
+		{
+			if (dx != 0 || dy != 0)
+			{
+				i = gridToPos(abs(dx), abs(dy), pLandscape->numCols);
+				thisProb = pDispersal->aProbs[i] - pDispersal->aProbs[i - 1];
+				thisProb *= (dx != 0 && dy != 0) ? 0.25 : 0.5;
+				pFFT->aKernelRe[(dx + pFFT->nx) % pFFT->nx + ((dy + pFFT->ny) % pFFT->ny) * pFFT->nx] = thisProb;
+			}
+		}
+	}
+	fft2D(pFFT, pFFT->aKernelRe, pFFT->aKernelIm, pFFT->ny, 0);
+	pFFT->lastTotal = -1.0;
+	pFFT->lastNumInf = 0;
+	fprintf(stdout, "\tkernel truncated at distance %d; padded to %d x %d\n", maxDist, pFFT->nx, pFFT->ny);
+	return 1;
+}
+
+/*
+	Convolve infectivity of all cells with the kernel to find the force of infection on each cell
+*/
+void calcForceOfInfection(t_FFTKernel *pFFT, t_Landscape *pLandscape)
+{
+	int		i,pos,numPos;
+	double	re,im;
+
+	numPos = pFFT->nx * pFFT->ny;
+	memset(pFFT->aWorkRe, 0, sizeof(double) * numPos);
+	memset(pFFT->aWorkIm, 0, sizeof(double) * numPos);
+	for (i = 0; i < pLandscape->numCells; i++)
+	{
+		pFFT->aWorkRe[pLandscape->aCells[i].xPos + pLandscape->aCells[i].yPos * pFFT->nx] = pFFT->aInfectivity[i];
+	}
+	fft2D(pFFT, pFFT->aWorkRe, pFFT->aWorkIm, pLandscape->numRows, 0);
+	for (pos = 0; pos < numPos; pos++)
+	{
+		re = pFFT->aWorkRe[pos] * pFFT->aKernelRe[pos] - pFFT->aWorkIm[pos] * pFFT->aKernelIm[pos];
+		im = pFFT->aWorkRe[pos] * pFFT->aKernelIm[pos] + pFFT->aWorkIm[pos] * pFFT->aKernelRe[pos];
+		pFFT->aWorkRe[pos] = re;
+		pFFT->aWorkIm[pos] = im;
+	}
+	fft2D(pFFT, pFFT->aWorkRe, pFFT->aWorkIm, pLandscape->numRows, 1);
+	for (i = 0; i < pLandscape->numCells; i++)
+	{
+		pFFT->aForce[i] = pFFT->aWorkRe[pLandscape->aCells[i].xPos + pLandscape->aCells[i].yPos * pFFT->nx] / numPos;
+	}
+}
+
+/*
+	Find the force of infection, only actually redoing the convolution if the total infectivity (or the number of infected cells)
+	has changed by more than a fraction fftTolerance since it was last done; otherwise the old force is rescaled
+	(returns the factor by which to scale pFFT->aForce)
+*/
+double updateForceOfInfection(t_FFTKernel *pFFT, t_Landscape *pLandscape, double totalInfectivity, int numInf, double fftTolerance)
+{
+	if (pFFT->lastTotal <= 0.0 || fabs(totalInfectivity - pFFT->lastTotal) > fftTolerance * pFFT->lastTotal || (numInf - pFFT->lastNumInf) > fftTolerance * pFFT->lastNumInf)
+	{
+		calcForceOfInfection(pFFT, pLandscape);
+		pFFT->lastTotal = totalInfectivity;
+		pFFT->lastNumInf = numInf;
+		return 1.0;
+	}
+	return totalInfectivity / pFFT->lastTotal;
+}
+
+/*
+	Single step of the (approximate) FFT engine, returning the time at the end of the step
+
+	Every susceptible cell is infected with probability 1-exp(-hazard*fftStep), with the hazard found by convolution,
+	so no challenges are wasted off the landscape or on cells without host
+		- infectivity of each cell is averaged over the step
+		- as in the tau-leaping engine, cells infected during a step only cause infections from the next step
+		- the cell which caused a secondary infection is not tracked (infBy is recorded as _EMPTY_CELL)
+*/
+double fftEngineStep(t_Params *pParams, t_Landscape *pLandscape, t_PriInf *pPriInf, t_FFTKernel *pFFT, t_Epidemic *pEpidemic, t_RunStats *pRunStats, double thisTime, int *pDoneInf)
+{
+	int		i,numAtStart,thisCell,cellToChallenge;
+	long	numChallenges,k;
+	double	dt,logisticJ,age,totalInfectivity,forceScale,hazard;
+
+	dt = pParams->fftStep;
+	if (thisTime + dt > pParams->maxTime)
+	{
+		dt = pParams->maxTime - thisTime;
+	}
+	numAtStart = pEpidemic->totalInf;
+	totalInfectivity = 0.0;
+	for (i = 0; i < numAtStart; i++)
+	{
+		thisCell = pEpidemic->aInfCells[i];
+		logisticJ = getLogisticJ(pLandscape, thisCell, pParams->withinCellMin, pParams->trueMinFlag);
+		age = thisTime - pLandscape->aCells[thisCell].tInf;
+		pFFT->aInfectivity[thisCell] = pLandscape->aCells[thisCell].propFull * pLandscape->aCells[thisCell].relInf * pParams->rateSecInf * integratedInfectivity(age, dt, logisticJ, pParams->withinCellBulkUp) / dt;
+		totalInfectivity += pFFT->aInfectivity[thisCell];
+	}
+	forceScale = updateForceOfInfection(pFFT, pLandscape, totalInfectivity, numAtStart, pParams->fftTolerance);
+	/* secondary infection */
+	for (i = 0; i < pLandscape->numCells; i++)
+	{
+		if (pLandscape->aCells[i].tInf < 0.0)
+		{
+			hazard = forceScale * pFFT->aForce[i] * pLandscape->aCells[i].relSus * pLandscape->aCells[i].propFull * dt;
+			if (hazard > _MIN_FFT_HAZARD)
+			{
+				pRunStats->numSecondaryAttempts++;
+				if (streamRandom(_STREAM_SUSCEPTIBILITY) < 1.0 - exp(-hazard))
+				{
+					pRunStats->numSuccessful++;
+					recordInfection(pLandscape, i, thisTime + dt * streamRandom(_STREAM_DISPERSAL), pEpidemic, _SEC_INF_TYPE, _EMPTY_CELL);
+					*pDoneInf = 1;
+				}
+			}
+		}
+	}
+	/* primary infection */
+	numChallenges = poissonRandom(pPriInf->ratePri * dt, _STREAM_PRIMARY, NULL);
+	for (k = 0; k < numChallenges; k++)
+	{
+		pRunStats->numPrimaryAttempts++;
+		cellToChallenge = whichCellPrimary(pPriInf, pLandscape->numCells);
+		if (pLandscape->aCells[cellToChallenge].tInf < 0.0)
+		{
+			recordInfection(pLandscape, cellToChallenge, thisTime + dt * streamRandom(_STREAM_PRIMARY), pEpidemic, _PRI_INF_TYPE, _EMPTY_CELL);
+			*pDoneInf = 1;
+		}
+	}
+	sortNewInfections(pLandscape, pEpidemic, numAtStart);
+	return thisTime + dt;
+}
+
+/*
+	Allocate (or free) the saved state for each level of multilevel splitting
+*/
+int allocSplitStates(t_SplitState *aSplit, int numLevels, t_Landscape *pLandscape)
+{
+	int i;
+
+	memset(aSplit, 0, sizeof(t_SplitState) * numLevels);
+	for (i = 0; i < numLevels; i++)
+	{
+		aSplit[i].aCells = mem_malloc(sizeof(t_Cell) * pLandscape->numCells, "splitStates");
+		aSplit[i].aQueueCells = mem_malloc(sizeof(int) * pLandscape->numCells, "splitStates");
+		aSplit[i].aInfCells = mem_malloc(sizeof(int) * pLandscape->numCells, "splitStates");
+		if (!aSplit[i].aCells || !aSplit[i].aQueueCells || !aSplit[i].aInfCells)
+		{
+			fprintf(stderr, "couldn't allocate memory for splitLevels\n");
+			return 0;
+		}
+	}
+	return 1;
+}
+
+void freeSplitStates(t_SplitState *aSplit, int numLevels)
+{
+	int i;
+
+	for (i = 0; i < numLevels; i++)
+	{
+		mem_free(aSplit[i].aCells);
+		mem_free(aSplit[i].aQueueCells);
+		mem_free(aSplit[i].aInfCells);
+	}
+}
+
+/*
+	Save (or restore) the state of the landscape and epidemic for a level of multilevel splitting
+	(quantities local to runEpidemics() are copied there)
+*/
+void saveSplitState(t_SplitState *pSplit, t_Landscape *pLandscape, t_PriInf *pPriInf, t_Epidemic *pEpidemic)
+{
+	memcpy(pSplit->aCells, pLandscape->aCells, sizeof(t_Cell) * pLandscape->numCells);
+	memcpy(pSplit->aQueueCells, pEpidemic->aQueueCells, sizeof(int) * pEpidemic->queueLen);
+	pSplit->queueLen = pEpidemic->queueLen;
+	memcpy(pSplit->aInfCells, pEpidemic->aInfCells, sizeof(int) * pEpidemic->totalInf);
+	pSplit->totalInf = pEpidemic->totalInf;
+	pSplit->priNextT = pPriInf->nextT;
+}
+
+void restoreSplitState(t_SplitState *pSplit, t_Landscape *pLandscape, t_PriInf *pPriInf, t_Epidemic *pEpidemic)
+{
+	int j;
+
+	/* (the landscape has just been reset, so only the saved infections need marking in the state map) */
+	for (j = 0; j < pSplit->totalInf; j++)
+	{
+		setCellState(pLandscape, pSplit->aInfCells[j], _STATE_INFECTED);
+	}
+	memcpy(pLandscape->aCells, pSplit->aCells, sizeof(t_Cell) * pLandscape->numCells);
+	memcpy(pEpidemic->aQueueCells, pSplit->aQueueCells, sizeof(int) * pSplit->queueLen);
+	pEpidemic->queueLen = pSplit->queueLen;
+	memcpy(pEpidemic->aInfCells, pSplit->aInfCells, sizeof(int) * pSplit->totalInf);
+	pEpidemic->totalInf = pSplit->totalInf;
+	pPriInf->nextT = pSplit->priNextT;
+}
+
+/*
+	Start the dpc file of a copy with the part of the run it was split from (i.e. the first numBytes of szFrom)
+*/
+int copyFilePrefix(char *szFrom, FILE *fTo, long numBytes)
+{
+	FILE	*fFrom;
+	char	aBuff[_MAX_STATIC_BUFF_LEN];
+	size_t	numRead;
+
+	fFrom = fopen(szFrom, "rb");
+	if (!fFrom)
+	{
+		return 0;
+	}
+	while (numBytes > 0 && (numRead = fread(aBuff, 1, (numBytes < (long)sizeof(aBuff)) ? (size_t)numBytes : sizeof(aBuff), fFrom)) > 0)
+	{
+		fwrite(aBuff, 1, numRead, fTo);
+		numBytes -= (long)numRead;
+	}
+	fclose(fFrom);
+	return (numBytes == 0);
+}
+
+/*
+	Write (or read) the state of a random number generator in a snapshot
+*/
+int writeRandomState(FILE *fOut, mt_state *pState)
+{
+	unsigned int	aWords[624];
+	int				i;
+
+	for (i = 0; i < 624; i++)
+	{
+		aWords[i] = (unsigned int)pState->mt[i];
+	}
+	return (fwrite(aWords, sizeof(unsigned int), 624, fOut) == 624 && fwrite(&pState->mti, sizeof(int), 1, fOut) == 1);
+}
+
+int readRandomState(FILE *fIn, mt_state *pState)
+{
+	unsigned int	aWords[624];
+	int				i;
+
+	if (fread(aWords, sizeof(unsigned int), 624, fIn) != 624 || fread(&pState->mti, sizeof(int), 1, fIn) != 1)
+	{
+		return 0;
+	}
+	for (i = 0; i < 624; i++)
+	{
+		pState->mt[i] = aWords[i];
+	}
+	return 1;
+}
+
+/*
+	Write a snapshot of the current run (quantities local to runEpidemics() are passed in)
+*/
+int writeSnapshot(char *szFile, t_Params *pParams, t_Landscape *pLandscape, t_PriInf *pPriInf, t_Epidemic *pEpidemic, double thisTime, double nextReport, double trueIncidence, int numCrossed, double *aThreshTime, int *aThreshNumInf)
+{
+	FILE		*fOut;
+	mt_state	sRandom;
+	int			j,thisCell,thisID,infByID,bOK;
+
+	fOut = fopen(szFile, "wb");
+	if (!fOut)
+	{
+		return 0;
+	}
+	bOK = (fwrite(_SNAPSHOT_MAGIC, 1, strlen(_SNAPSHOT_MAGIC), fOut) == strlen(_SNAPSHOT_MAGIC));
+	bOK = bOK && fwrite(&pLandscape->numRows, sizeof(int), 1, fOut) == 1 && fwrite(&pLandscape->numCols, sizeof(int), 1, fOut) == 1 && fwrite(&pLandscape->numCells, sizeof(int), 1, fOut) == 1;
+	bOK = bOK && fwrite(&thisTime, sizeof(double), 1, fOut) == 1 && fwrite(&nextReport, sizeof(double), 1, fOut) == 1 && fwrite(&trueIncidence, sizeof(double), 1, fOut) == 1 && fwrite(&pPriInf->nextT, sizeof(double), 1, fOut) == 1;
+	bOK = bOK && fwrite(&numCrossed, sizeof(int), 1, fOut) == 1;
+	for (j = 0; bOK && j < numCrossed; j++)
+	{
+		bOK = fwrite(&pParams->aThresholds[j], sizeof(double), 1, fOut) == 1 && fwrite(&aThreshTime[j], sizeof(double), 1, fOut) == 1 && fwrite(&aThreshNumInf[j], sizeof(int), 1, fOut) == 1;
+	}
+	bOK = bOK && fwrite(&pEpidemic->totalInf, sizeof(int), 1, fOut) == 1;
+	for (j = 0; bOK && j < pEpidemic->totalInf; j++)
+	{
+		/* cells are stored by their original number, so snapshots don't depend on cellOrder */
+		thisCell = pEpidemic->aInfCells[j];
+		thisID = cellID(pLandscape, thisCell);
+		infByID = (pLandscape->aCells[thisCell].infBy == _EMPTY_CELL) ? _EMPTY_CELL : cellID(pLandscape, pLandscape->aCells[thisCell].infBy);
+		bOK = fwrite(&thisID, sizeof(int), 1, fOut) == 1 && fwrite(&pLandscape->aCells[thisCell].tInf, sizeof(double), 1, fOut) == 1 && fwrite(&pLandscape->aCells[thisCell].tNext, sizeof(double), 1, fOut) == 1
+			&& fwrite(&pLandscape->aCells[thisCell].infType, sizeof(int), 1, fOut) == 1 && fwrite(&infByID, sizeof(int), 1, fOut) == 1;
+	}
+	bOK = bOK && fwrite(&pEpidemic->queueLen, sizeof(int), 1, fOut) == 1;
+	for (j = 0; bOK && j < pEpidemic->queueLen; j++)
+	{
+		thisID = cellID(pLandscape, pEpidemic->aQueueCells[j]);
+		bOK = fwrite(&thisID, sizeof(int), 1, fOut) == 1;
+	}
+	bOK = bOK && fwrite(&pParams->commonRandom, sizeof(int), 1, fOut) == 1 && fwrite(&pParams->rng, sizeof(int), 1, fOut) == 1;
+	if (pParams->rng == _RNG_XOSHIRO)
+	{
+		/* (the buffers are part of the state, so the run carries on with exactly the same numbers) */
+		bOK = bOK && fwrite(g_aBlockStreams, sizeof(xoshiro_state), pParams->commonRandom ? _NUM_STREAMS : 1, fOut) == (size_t)(pParams->commonRandom ? _NUM_STREAMS : 1);
+	}
+	else if (pParams->commonRandom)
+	{
+		for (j = 0; bOK && j < _NUM_STREAMS; j++)
+		{
+			bOK = writeRandomState(fOut, &g_aRandomStreams[j]);
+		}
+	}
+	else
+	{
+		get_genrand_state(&sRandom);
+		bOK = bOK && writeRandomState(fOut, &sRandom);
+	}
+	fclose(fOut);
+	return bOK;
+}
+
+void freeSnapshot(t_Snapshot *pSnapshot)
+{
+	mem_free(pSnapshot->aInfCells);
+	mem_free(pSnapshot->aTInf);
+	mem_free(pSnapshot->aTNext);
+	mem_free(pSnapshot->aInfType);
+	mem_free(pSnapshot->aInfBy);
+	mem_free(pSnapshot->aQueueCells);
+}
+
+/*
+	Read a snapshot, checking it is for this landscape, and matching values of maxIncidence reached before it to the current list
+*/
+int readSnapshot(char *szFile, t_Snapshot *pSnapshot, t_Params *pParams, t_Landscape *pLandscape)
+{
+	FILE	*fIn;
+	char	szMagic[_MAX_STATIC_BUFF_LEN];
+	int		aSize[3];
+	double	aFileVal[_MAX_THRESHOLDS],aFileTime[_MAX_THRESHOLDS];
+	int		aFileNumInf[_MAX_THRESHOLDS];
+	int		j,k,numFile,bOK;
+
+	fprintf(stdout, "readSnapshot(%s)\n", szFile);
+	memset(pSnapshot, 0, sizeof(t_Snapshot));
+	fIn = fopen(szFile, "rb");
+	if (!fIn)
+	{
+		fprintf(stderr, "couldn't open snapshot %s\n", szFile);
+		return 0;
+	}
+	bOK = (fread(szMagic, 1, strlen(_SNAPSHOT_MAGIC), fIn) == strlen(_SNAPSHOT_MAGIC) && strncmp(szMagic, _SNAPSHOT_MAGIC, strlen(_SNAPSHOT_MAGIC)) == 0);
+	bOK = bOK && fread(aSize, sizeof(int), 3, fIn) == 3;
+	if (bOK && (aSize[0] != pLandscape->numRows || aSize[1] != pLandscape->numCols || aSize[2] != pLandscape->numCells))
+	{
+		fprintf(stderr, "snapshot %s is for a different landscape (%dx%d with %d cells)\n", szFile, aSize[0], aSize[1], aSize[2]);
+		fclose(fIn);
+		return 0;
+	}
+	bOK = bOK && fread(&pSnapshot->thisTime, sizeof(double), 1, fIn) == 1 && fread(&pSnapshot->nextReport, sizeof(double), 1, fIn) == 1 && fread(&pSnapshot->trueIncidence, sizeof(double), 1, fIn) == 1 && fread(&pSnapshot->priNextT, sizeof(double), 1, fIn) == 1;
+	bOK = bOK && fread(&numFile, sizeof(int), 1, fIn) == 1 && numFile >= 0 && numFile <= _MAX_THRESHOLDS;
+	for (j = 0; bOK && j < numFile; j++)
+	{
+		bOK = fread(&aFileVal[j], sizeof(double), 1, fIn) == 1 && fread(&aFileTime[j], sizeof(double), 1, fIn) == 1 && fread(&aFileNumInf[j], sizeof(int), 1, fIn) == 1;
+	}
+	bOK = bOK && fread(&pSnapshot->numInf, sizeof(int), 1, fIn) == 1 && pSnapshot->numInf >= 0 && pSnapshot->numInf <= pLandscape->numCells;
+	if (bOK)
+	{
+		pSnapshot->aInfCells = mem_malloc(sizeof(int) * (pSnapshot->numInf + 1), "snapshot");
+		pSnapshot->aTInf = mem_malloc(sizeof(double) * (pSnapshot->numInf + 1), "snapshot");
+		pSnapshot->aTNext = mem_malloc(sizeof(double) * (pSnapshot->numInf + 1), "snapshot");
+		pSnapshot->aInfType = mem_malloc(sizeof(int) * (pSnapshot->numInf + 1), "snapshot");
+		pSnapshot->aInfBy = mem_malloc(sizeof(int) * (pSnapshot->numInf + 1), "snapshot");
+		pSnapshot->aQueueCells = mem_malloc(sizeof(int) * pLandscape->numCells, "snapshot");
+		bOK = (pSnapshot->aInfCells && pSnapshot->aTInf && pSnapshot->aTNext && pSnapshot->aInfType && pSnapshot->aInfBy && pSnapshot->aQueueCells);
+	}
+	for (j = 0; bOK && j < pSnapshot->numInf; j++)
+	{
+		bOK = fread(&pSnapshot->aInfCells[j], sizeof(int), 1, fIn) == 1 && fread(&pSnapshot->aTInf[j], sizeof(double), 1, fIn) == 1 && fread(&pSnapshot->aTNext[j], sizeof(double), 1, fIn) == 1
+			&& fread(&pSnapshot->aInfType[j], sizeof(int), 1, fIn) == 1 && fread(&pSnapshot->aInfBy[j], sizeof(int), 1, fIn) == 1
+			&& pSnapshot->aInfCells[j] >= 0 && pSnapshot->aInfCells[j] < pLandscape->numCells
+			&& pSnapshot->aInfBy[j] >= _EMPTY_CELL && pSnapshot->aInfBy[j] < pLandscape->numCells;
+		if (bOK)
+		{
+			pSnapshot->aInfCells[j] = cellIndex(pLandscape, pSnapshot->aInfCells[j]);
+			if (pSnapshot->aInfBy[j] != _EMPTY_CELL)
+			{
+				pSnapshot->aInfBy[j] = cellIndex(pLandscape, pSnapshot->aInfBy[j]);
+			}
+		}
+	}
+	bOK = bOK && fread(&pSnapshot->queueLen, sizeof(int), 1, fIn) == 1 && pSnapshot->queueLen >= 0 && pSnapshot->queueLen <= pLandscape->numCells;
+	for (j = 0; bOK && j < pSnapshot->queueLen; j++)
+	{
+		bOK = fread(&pSnapshot->aQueueCells[j], sizeof(int), 1, fIn) == 1 && pSnapshot->aQueueCells[j] >= 0 && pSnapshot->aQueueCells[j] < pLandscape->numCells;
+		if (bOK)
+		{
+			pSnapshot->aQueueCells[j] = cellIndex(pLandscape, pSnapshot->aQueueCells[j]);
+		}
+	}
+	bOK = bOK && fread(&pSnapshot->commonRandom, sizeof(int), 1, fIn) == 1 && fread(&pSnapshot->rng, sizeof(int), 1, fIn) == 1 && pSnapshot->rng >= 0 && pSnapshot->rng < _NUM_RNGS;
+	if (bOK && pSnapshot->rng == _RNG_XOSHIRO)
+	{
+		bOK = fread(pSnapshot->aBlockStreams, sizeof(xoshiro_state), pSnapshot->commonRandom ? _NUM_STREAMS : 1, fIn) == (size_t)(pSnapshot->commonRandom ? _NUM_STREAMS : 1);
+	}
+	else if (pSnapshot->commonRandom)
+	{
+		for (j = 0; bOK && j < _NUM_STREAMS; j++)
+		{
+			bOK = readRandomState(fIn, &pSnapshot->aStreams[j]);
+		}
+	}
+	else
+	{
+		bOK = bOK && readRandomState(fIn, &pSnapshot->sRandom);
+	}
+	fclose(fIn);
+	if (!bOK)
+	{
+		fprintf(stderr, "couldn't read snapshot %s\n", szFile);
+		return 0;
+	}
+	/* values of maxIncidence which had already been reached must have been in the list when the snapshot was written */
+	pSnapshot->numCrossed = 0;
+	while (pSnapshot->numCrossed < pParams->numThresholds && pSnapshot->trueIncidence >= pParams->aThresholds[pSnapshot->numCrossed] * pLandscape->totalFull)
+	{
+		for (k = 0; k < numFile && fabs(aFileVal[k] - pParams->aThresholds[pSnapshot->numCrossed]) >= 1e-6; k++)
+		{
+		}
+		if (k == numFile)
+		{
+			fprintf(stderr, "maxIncidence=%f was reached before snapshot %s was written, but was not in the list then\n", pParams->aThresholds[pSnapshot->numCrossed], szFile);
+			return 0;
+		}
+		pSnapshot->aThreshVal[pSnapshot->numCrossed] = aFileVal[k];
+		pSnapshot->aThreshTime[pSnapshot->numCrossed] = aFileTime[k];
+		pSnapshot->aThreshNumInf[pSnapshot->numCrossed] = aFileNumInf[k];
+		pSnapshot->numCrossed++;
+	}
+	fprintf(stdout, "\t%d infected cells at t=%.4f (trueInc=%.4f)\n", pSnapshot->numInf, pSnapshot->thisTime, pSnapshot->trueIncidence / pLandscape->totalFull);
+	return 1;
+}
+
+/*
+	Put the landscape and epidemic into the state in a snapshot
+	(and the random number generator too if bRandom is set, so the run carries on exactly as the one the snapshot was taken from)
+*/
+void applySnapshot(t_Snapshot *pSnapshot, t_Landscape *pLandscape, t_PriInf *pPriInf, t_Epidemic *pEpidemic, int bRandom)
+{
+	int j,thisCell;
+
+	for (j = 0; j < pSnapshot->numInf; j++)
+	{
+		thisCell = pSnapshot->aInfCells[j];
+		pLandscape->aCells[thisCell].tInf = pSnapshot->aTInf[j];
+		pLandscape->aCells[thisCell].tNext = pSnapshot->aTNext[j];
+		pLandscape->aCells[thisCell].infType = pSnapshot->aInfType[j];
+		pLandscape->aCells[thisCell].infBy = pSnapshot->aInfBy[j];
+		setCellState(pLandscape, thisCell, _STATE_INFECTED);
+		pEpidemic->aInfCells[j] = thisCell;
+	}
+	pEpidemic->totalInf = pSnapshot->numInf;
+	memcpy(pEpidemic->aQueueCells, pSnapshot->aQueueCells, sizeof(int) * pSnapshot->queueLen);
+	pEpidemic->queueLen = pSnapshot->queueLen;
+	pPriInf->nextT = pSnapshot->priNextT;
+	if (bRandom && pSnapshot->commonRandom == g_bCommonRandom && pSnapshot->rng == g_rng)
+	{
+		if (pSnapshot->rng == _RNG_XOSHIRO)
+		{
+			memcpy(g_aBlockStreams, pSnapshot->aBlockStreams, sizeof(xoshiro_state) * (pSnapshot->commonRandom ? _NUM_STREAMS : 1));
+		}
+		else if (pSnapshot->commonRandom)
+		{
+			memcpy(g_aRandomStreams, pSnapshot->aStreams, sizeof(mt_state) * _NUM_STREAMS);
+		}
+		else
+		{
+			set_genrand_state(&pSnapshot->sRandom);
+		}
+	}
+}
+
+void freeSurveillance(t_Surveillance *pSurvey)
+{
+	int k;
+
+	for (k = 0; k < pSurvey->numPatterns; k++)
+	{
+		mem_free(pSurvey->aaSites[k]);
+	}
+	mem_free(pSurvey->aaSites);
+	mem_free(pSurvey->aNumSites);
+	mem_free(pSurvey->aTInf);
+	mem_free(pSurvey->aInfSites);
+	mem_free(pSurvey->aPHost);
+	mem_free(pSurvey->aPNotHost);
+	if (pSurvey->fOut)
+	{
+		fclose(pSurvey->fOut);
+	}
+}
+
+/*
+	Read the sampling patterns in surveyFile (one per line, as the cell numbers in activeLandscape.txt, e.g. the last line of
+	objectiveFunction.txt from simulatedAnnealing without its first two columns), and open surveillance.txt
+*/
+int setupSurveillance(t_Surveillance *pSurvey, t_Params *pParams, t_Landscape *pLandscape)
+{
+	FILE	*fIn;
+	char	*szBuffer;
+	char	outFile[_MAX_STATIC_BUFF_LEN];
+	char	*pPtr;
+	int		*aSites,*pNewSites,numSites,id,retVal;
+
+	memset(pSurvey, 0, sizeof(t_Surveillance));
+	fIn = fopen(pParams->surveyFile, "rb");
+	if (!fIn)
+	{
+		fprintf(stderr, "couldn't open surveyFile %s\n", pParams->surveyFile);
+		return 0;
+	}
+	szBuffer = (char*)mem_malloc(_MAX_DYNAMIC_BUFF_LEN*sizeof(char), "inputBuffer");
+	if (!szBuffer)
+	{
+		fprintf(stderr, "couldn't allocate memory for reading %s\n", pParams->surveyFile);
+		fclose(fIn);
+		return 0;
+	}
+	retVal = 1;
+	while (retVal && fgets(szBuffer, _MAX_DYNAMIC_BUFF_LEN, fIn))
+	{
+		if (szBuffer[0] == '#')
+		{
+			continue;
+		}
+		aSites = NULL;
+		numSites = 0;
+		pPtr = strtok(szBuffer, _GIS_WHITESPACE _GIS_NEWLINES);
+		while (retVal && pPtr)
+		{
+			id = atoi(pPtr);
+			if (id < 0 || id >= pLandscape->numCells)
+			{
+				fprintf(stderr, "site %d in pattern %d of %s is not a cell in activeLandscape.txt\n", id, pSurvey->numPatterns, pParams->surveyFile);
+				retVal = 0;
+			}
+			else
+			{
+				pNewSites = (int*)mem_realloc(aSites, sizeof(int) * (numSites + 1), "surveillance");
+				if (!pNewSites)
+				{
+					fprintf(stderr, "couldn't allocate memory for sampling patterns\n");
+					retVal = 0;
+				}
+				else
+				{
+					aSites = pNewSites;
+					aSites[numSites++] = cellIndex(pLandscape, id);
+					pPtr = strtok(NULL, _GIS_WHITESPACE _GIS_NEWLINES);
+				}
+			}
+		}
+		if (retVal && numSites)
+		{
+			pSurvey->aNumSites = (int*)mem_realloc(pSurvey->aNumSites, sizeof(int) * (pSurvey->numPatterns + 1), "surveillance");
+			pSurvey->aaSites = (int**)mem_realloc(pSurvey->aaSites, sizeof(int*) * (pSurvey->numPatterns + 1), "surveillance");
+			if (!pSurvey->aNumSites || !pSurvey->aaSites)
+			{
+				fprintf(stderr, "couldn't allocate memory for sampling patterns\n");
+				retVal = 0;
+			}
+			else
+			{
+				pSurvey->aNumSites[pSurvey->numPatterns] = numSites;
+				pSurvey->aaSites[pSurvey->numPatterns] = aSites;
+				pSurvey->numPatterns++;
+				if (numSites > pSurvey->maxSites)
+				{
+					pSurvey->maxSites = numSites;
+				}
+				aSites = NULL;
+			}
+		}
+		/* (unless it has been kept as a pattern) */
+		mem_free(aSites);
+	}
+	mem_free(szBuffer);
+	fclose(fIn);
+	if (!retVal)
+	{
+		freeSurveillance(pSurvey);
+		return 0;
+	}
+	if (!pSurvey->numPatterns)
+	{
+		fprintf(stderr, "no sampling patterns in %s\n", pParams->surveyFile);
+		return 0;
+	}
+	pSurvey->aTInf = (double*)mem_malloc(sizeof(double) * pSurvey->maxSites, "surveillance");
+	pSurvey->aInfSites = (int*)mem_malloc(sizeof(int) * pSurvey->maxSites, "surveillance");
+	pSurvey->aPHost = (double*)mem_malloc(sizeof(double) * pSurvey->maxSites, "surveillance");
+	pSurvey->aPNotHost = (double*)mem_malloc(sizeof(double) * pSurvey->maxSites, "surveillance");
+	sprintf(outFile, "%s%csurveillance.txt", pParams->outDir, C_DIR_DELIMITER);
+	pSurvey->fOut = fopen(outFile, "wb");
+	if (!pSurvey->aTInf || !pSurvey->aInfSites || !pSurvey->aPHost || !pSurvey->aPNotHost || !pSurvey->fOut)
+	{
+		fprintf(stderr, "couldn't set up evaluation of sampling patterns\n");
+		freeSurveillance(pSurvey);
+		return 0;
+	}
+	fprintf(stdout, "evaluating %d sampling pattern(s) from %s in every run\n", pSurvey->numPatterns, pParams->surveyFile);
+	return 1;
+}
+
+/*
+	Probability a single survey of a site detects infection, as in simulatedAnnealing (samplesPerSite samples, each positive
+	with probability testSens times the logistic bulk up of infection in the cell, after a lag of detLag)
+*/
+double surveyDetectProb(t_Params *pParams, t_Landscape *pLandscape, int cell, double timeSinceInf)
+{
+	double logisticJ;
+
+	if (timeSinceInf < pParams->surveyDetLag)
+	{
+		return 0.0;
+	}
+	logisticJ = getLogisticJ(pLandscape, cell, pParams->withinCellMin, pParams->trueMinFlag);
+	return 1.0 - pow(1.0 - pParams->surveyTestSens / (1.0 + logisticJ * exp(-pParams->withinCellBulkUp * (timeSinceInf - pParams->surveyDetLag))), pParams->surveySamples);
+}
+
+/*
+	Evaluate each sampling pattern on a run which has just finished, up to the time each value of maxIncidence was reached
+	(only the sites in the pattern are needed, so this takes no time compared to the run), writing a line to surveillance.txt
+		<run> <pattern> <maxIncidence> <weight> <pDetect> <pFirstDetect> <meanDetectTime>
+	where
+		pDetect			= probability of detection as in the objective function of simulatedAnnealing (each site's probability
+							of detection is averaged over the start time of the surveys, and sites are then taken as independent)
+		pFirstDetect	= probability of detection when all sites are surveyed at the same times (averaged over the start time)
+		meanDetectTime	= mean time of the first detection in that case, given there is one (-1 if there can't be)
+*/
+void evaluateSurveillance(t_Surveillance *pSurvey, t_Params *pParams, t_Landscape *pLandscape, int runNum, double weight, double *aThreshTime)
+{
+	int		k,j,h,n,numInf,numStarts,numSurveys;
+	int		*aSites;
+	double	maxTime,firstOffset,timeSurvey,pThisSurvey,pNotThisSurvey,pNotDetect,pNotOverall,pFirst,sumTime;
+
+	for (k = 0; k < pSurvey->numPatterns; k++)
+	{
+		aSites = pSurvey->aaSites[k];
+		for (j = 0; j < pParams->numThresholds; j++)
+		{
+			maxTime = aThreshTime[j];
+			/* only sites infected by then can be detected */
+			numInf = 0;
+			for (h = 0; h < pSurvey->aNumSites[k]; h++)
+			{
+				if (pLandscape->aCells[aSites[h]].tInf >= 0.0 && pLandscape->aCells[aSites[h]].tInf <= maxTime)
+				{
+					pSurvey->aTInf[numInf] = pLandscape->aCells[aSites[h]].tInf;
+					pSurvey->aInfSites[numInf] = aSites[h];
+					pSurvey->aPHost[numInf] = 0.0;
+					numInf++;
+				}
+			}
+			/* surveys every delta from each start time (in steps of a day), and only up to maxTime */
+			pFirst = sumTime = 0.0;
+			numStarts = 0;
+			numSurveys = (int)((maxTime + _SURVEY_TINY_EPS) / pParams->surveyDelta) + 1;
+			for (firstOffset = 0.0; numInf && firstOffset < pParams->surveyDelta; firstOffset += _SURVEY_OFFSET_STEP)
+			{
+				for (h = 0; h < numInf; h++)
+				{
+					pSurvey->aPNotHost[h] = 1.0;
+				}
+				pNotDetect = 1.0;
+				for (n = 0; n < numSurveys; n++)
+				{
+					timeSurvey = firstOffset + n * pParams->surveyDelta;
+					if (timeSurvey > maxTime)
+					{
+						break;
+					}
+					pNotThisSurvey = 1.0;
+					for (h = 0; h < numInf; h++)
+					{
+						if (timeSurvey >= pSurvey->aTInf[h])
+						{
+							pThisSurvey = surveyDetectProb(pParams, pLandscape, pSurvey->aInfSites[h], timeSurvey - pSurvey->aTInf[h]);
+							pSurvey->aPNotHost[h] *= (1.0 - pThisSurvey);
+							pNotThisSurvey *= (1.0 - pThisSurvey);
+						}
+					}
+					sumTime += timeSurvey * pNotDetect * (1.0 - pNotThisSurvey);
+					pNotDetect *= pNotThisSurvey;
+				}
+				for (h = 0; h < numInf; h++)
+				{
+					pSurvey->aPHost[h] += (1.0 - pSurvey->aPNotHost[h]);
+				}
+				pFirst += (1.0 - pNotDetect);
+				numStarts++;
+			}
+			pNotOverall = 1.0;
+			for (h = 0; h < numInf; h++)
+			{
+				pNotOverall *= (1.0 - pSurvey->aPHost[h] / numStarts);
+			}
+			fprintf(pSurvey->fOut, "%d %d %f %.12g %.6f %.6f %.4f\n", runNum, k, pParams->aThresholds[j], weight, 1.0 - pNotOverall, numStarts ? pFirst / numStarts : 0.0, (pFirst > 0.0) ? sumTime / pFirst : -1.0);
+		}
+	}
+}
+
+/*
+	Summarise surveillance.txt in a directory (weighted means over the runs) into surveillanceSummary.txt
+		<pattern> <maxIncidence> <numRuns> <pDetect> <pFirstDetect> <meanDetectTime>
+	(for pDetect the mean is the objective function simulatedAnnealing would give the pattern, and meanDetectTime is
+	 averaged over the runs in proportion to pFirstDetect)
+*/
+int writeSurveillanceSummary(char *szDir)
+{
+	typedef struct
+	{
+		int		pattern;
+		double	threshold;
+		int		numRuns;
+		double	sumWeight,sumPDetect,sumPFirst,sumTime;
+	} t_SurveySum;
+	char		szFile[_MAX_STATIC_BUFF_LEN],szBuffer[_MAX_STATIC_BUFF_LEN];
+	int			runNum,pattern,i,numSums;
+	double		threshold,weight,pDetect,pFirst,meanTime;
+	t_SurveySum	*aSums,*pTmp;
+	FILE		*fIn,*fOut;
+
+	sprintf(szFile, "%s%csurveillance.txt", szDir, C_DIR_DELIMITER);
+	fIn = fopen(szFile, "rb");
+	if (!fIn)
+	{
+		fprintf(stderr, "couldn't read %s\n", szFile);
+		return 0;
+	}
+	aSums = NULL;
+	numSums = 0;
+	while (fgets(szBuffer, _MAX_STATIC_BUFF_LEN, fIn))
+	{
+		if (sscanf(szBuffer, "%d %d %lf %lf %lf %lf %lf", &runNum, &pattern, &threshold, &weight, &pDetect, &pFirst, &meanTime) != 7)
+		{
+			continue;
+		}
+		for (i = 0; i < numSums && !(aSums[i].pattern == pattern && aSums[i].threshold == threshold); i++)
+		{
+		}
+		if (i == numSums)
+		{
+			pTmp = (t_SurveySum*)realloc(aSums, sizeof(t_SurveySum) * (numSums + 1));
+			if (!pTmp)
+			{
+				fprintf(stderr, "couldn't allocate memory to summarise %s\n", szFile);
+				free(aSums);
+				fclose(fIn);
+				return 0;
+			}
+			aSums = pTmp;
+			memset(&aSums[numSums], 0, sizeof(t_SurveySum));
+			aSums[numSums].pattern = pattern;
+			aSums[numSums].threshold = threshold;
+			numSums++;
+		}
+		aSums[i].numRuns++;
+		aSums[i].sumWeight += weight;
+		aSums[i].sumPDetect += weight * pDetect;
+		aSums[i].sumPFirst += weight * pFirst;
+		if (pFirst > 0.0)
+		{
+			aSums[i].sumTime += weight * pFirst * meanTime;
+		}
+	}
+	fclose(fIn);
+	sprintf(szFile, "%s%csurveillanceSummary.txt", szDir, C_DIR_DELIMITER);
+	fOut = fopen(szFile, "wb");
+	if (!fOut)
+	{
+		fprintf(stderr, "couldn't open %s for writing\n", szFile);
+		free(aSums);
+		return 0;
+	}
+	for (i = 0; i < numSums; i++)
+	{
+		fprintf(fOut, "%d %f %d %.6f %.6f %.4f\n", aSums[i].pattern, aSums[i].threshold, aSums[i].numRuns, aSums[i].sumPDetect / aSums[i].sumWeight, aSums[i].sumPFirst / aSums[i].sumWeight, (aSums[i].sumPFirst > 0.0) ? aSums[i].sumTime / aSums[i].sumPFirst : -1.0);
+		fprintf(stdout, "\tpattern %d (maxIncidence=%f): pDetect=%.4f pFirstDetect=%.4f meanDetectTime=%.4f over %d runs\n", aSums[i].pattern, aSums[i].threshold, aSums[i].sumPDetect / aSums[i].sumWeight, aSums[i].sumPFirst / aSums[i].sumWeight, (aSums[i].sumPFirst > 0.0) ? aSums[i].sumTime / aSums[i].sumPFirst : -1.0, aSums[i].numRuns);
+	}
+	fclose(fOut);
+	free(aSums);
+	return 1;
+}
+
+/*
+	Per-cell summaries of an ensemble (see t_Aggregate), which are written as rasters aggregate_<name>.asc with the
+	header of the host raster, so they line up with it (or with the coarse grid, with coarsen)
+		probInf			(weighted) proportion of runs in which the cell was infected
+		meanFinalInc	mean over all runs of the incidence in the cell at the end of the run (as a proportion of its host)
+		meanTimeInf		mean time of infection, over the runs in which the cell was infected
+		sdTimeInf		and the standard deviation of that
+		propPrimary		proportion of the runs in which the cell was infected where it was by primary infection
+	Cells with no host are NODATA, as are the last three for cells never infected
+	aggregate.txt gives the number of runs and their total weight (so the rasters of several shards can be combined)
+*/
+int allocAggregate(t_Aggregate *pAgg, int numCells)
+{
+	pAgg->numCells = numCells;
+	pAgg->numRuns = 0;
+	pAgg->totalWeight = 0.0;
+	pAgg->aPos = (int*)mem_malloc(sizeof(int) * numCells, "aggregate");
+	pAgg->aInfWeight = (double*)mem_calloc(numCells, sizeof(double), "aggregate");
+	pAgg->aSumFinal = (double*)mem_calloc(numCells, sizeof(double), "aggregate");
+	pAgg->aSumTime = (double*)mem_calloc(numCells, sizeof(double), "aggregate");
+	pAgg->aSumTimeSq = (double*)mem_calloc(numCells, sizeof(double), "aggregate");
+	pAgg->aPriWeight = (double*)mem_calloc(numCells, sizeof(double), "aggregate");
+	if (!pAgg->aPos || !pAgg->aInfWeight || !pAgg->aSumFinal || !pAgg->aSumTime || !pAgg->aSumTimeSq || !pAgg->aPriWeight)
+	{
+		fprintf(stderr, "couldn't allocate memory for the aggregate rasters\n");
+		return 0;
+	}
+	return 1;
+}
+
+void freeAggregate(t_Aggregate *pAgg)
+{
+	mem_free(pAgg->aPos);
+	mem_free(pAgg->aInfWeight);
+	mem_free(pAgg->aSumFinal);
+	mem_free(pAgg->aSumTime);
+	mem_free(pAgg->aSumTimeSq);
+	mem_free(pAgg->aPriWeight);
+	memset(pAgg, 0, sizeof(t_Aggregate));
+}
+
+int setupAggregate(t_Aggregate *pAgg, t_Landscape *pLandscape)
+{
+	int c;
+
+	memset(pAgg, 0, sizeof(t_Aggregate));
+	memcpy(pAgg->aszGISHeader, pLandscape->aszGISHeader, sizeof(pAgg->aszGISHeader));
+	pAgg->numRows = pLandscape->numRows;
+	pAgg->numCols = pLandscape->numCols;
+	if (!allocAggregate(pAgg, pLandscape->numCells))
+	{
+		return 0;
+	}
+	for (c = 0; c < pLandscape->numCells; c++)
+	{
+		pAgg->aPos[c] = gridToPos(pLandscape->aCells[c].xPos, pLandscape->aCells[c].yPos, pLandscape->numCols);
+	}
+	return 1;
+}
+
+/*
+	Add a run which finished at thisTime (cells are in the same order as aCells, so nothing needs to be looked up)
+*/
+void addToAggregate(t_Aggregate *pAgg, t_Params *pParams, t_Landscape *pLandscape, t_Epidemic *pEpidemic, double thisTime, double weight)
+{
+	int		j,c;
+	double	tInf;
+
+	for (j = 0; j < pEpidemic->totalInf; j++)
+	{
+		c = pEpidemic->aInfCells[j];
+		tInf = pLandscape->aCells[c].tInf;
+		pAgg->aInfWeight[c] += weight;
+		pAgg->aSumFinal[c] += weight * getIncidence(pLandscape, pEpidemic, thisTime, c, pParams->withinCellMin, pParams->withinCellBulkUp, pParams->trueMinFlag) / pLandscape->aCells[c].propFull;
+		pAgg->aSumTime[c] += weight * tInf;
+		pAgg->aSumTimeSq[c] += weight * tInf * tInf;
+		if (pLandscape->aCells[c].infType == _PRI_INF_TYPE)
+		{
+			pAgg->aPriWeight[c] += weight;
+		}
+	}
+	pAgg->numRuns++;
+	pAgg->totalWeight += weight;
+}
+
+int writeAggregate(t_Aggregate *pAgg, char *szDir)
+{
+	char	szFile[_MAX_STATIC_BUFF_LEN];
+	double	*aRaster,infWeight,meanTime,varTime;
+	int		k,c,pos;
+	FILE	*fOut;
+
+	aRaster = (double*)mem_malloc(sizeof(double) * pAgg->numRows * pAgg->numCols, "aggregateRaster");
+	if (!aRaster)
+	{
+		fprintf(stderr, "couldn't allocate memory for the aggregate rasters\n");
+		return 0;
+	}
+	for (k = 0; k < _NUM_AGGREGATES; k++)
+	{
+		for (pos = 0; pos < pAgg->numRows * pAgg->numCols; pos++)
+		{
+			aRaster[pos] = _GIS_NODATA_VALUE;
+		}
+		for (c = 0; c < pAgg->numCells && pAgg->totalWeight > 0.0; c++)
+		{
+			infWeight = pAgg->aInfWeight[c];
+			meanTime = (infWeight > 0.0) ? pAgg->aSumTime[c] / infWeight : 0.0;
+			switch (k)
+			{
+			case _AGGREGATE_PROB_INF:
+				aRaster[pAgg->aPos[c]] = infWeight / pAgg->totalWeight;
+				break;
+			case _AGGREGATE_MEAN_FINAL_INC:
+				aRaster[pAgg->aPos[c]] = pAgg->aSumFinal[c] / pAgg->totalWeight;
+				break;
+			case _AGGREGATE_MEAN_TIME_INF:
+				if (infWeight > 0.0)
+				{
+					aRaster[pAgg->aPos[c]] = meanTime;
+				}
+				break;
+			case _AGGREGATE_SD_TIME_INF:
+				if (infWeight > 0.0)
+				{
+					/* (a variance within rounding of the sum of squares is taken as 0, so the same runs summed in a different
+						order, e.g. merged from shards, give the same result) */
+					varTime = pAgg->aSumTimeSq[c] / infWeight - meanTime * meanTime;
+					aRaster[pAgg->aPos[c]] = (varTime > 1e-10 * meanTime * meanTime) ? sqrt(varTime) : 0.0;
+				}
+				break;
+			case _AGGREGATE_PROP_PRIMARY:
+				if (infWeight > 0.0)
+				{
+					aRaster[pAgg->aPos[c]] = pAgg->aPriWeight[c] / infWeight;
+				}
+				break;
+			default:
+				fprintf(stderr, "writeAggregate(): shouldn't get here...\n");
+				break;
+			}
+		}
+		sprintf(szFile, "%s%caggregate_%s.asc", szDir, C_DIR_DELIMITER, g_aAggregateNames[k]);
+		fOut = fopen(szFile, "wb");
+		if (!fOut)
+		{
+			fprintf(stderr, "couldn't open %s for writing\n", szFile);
+			mem_free(aRaster);
+			return 0;
+		}
+		for (c = 0; c < _GIS_HEADER_LENGTH; c++)
+		{
+			fprintf(fOut, "%s\n", pAgg->aszGISHeader[c]);
+		}
+		for (pos = 0; pos < pAgg->numRows * pAgg->numCols; pos++)
+		{
+			if (aRaster[pos] == _GIS_NODATA_VALUE)
+			{
+				fprintf(fOut, "%s%c", _GIS_NODATA, ((pos + 1) % pAgg->numCols) ? ' ' : '\n');
+			}
+			else
+			{
+				fprintf(fOut, "%.10g%c", aRaster[pos], ((pos + 1) % pAgg->numCols) ? ' ' : '\n');
+			}
+		}
+		fclose(fOut);
+	}
+	mem_free(aRaster);
+	sprintf(szFile, "%s%caggregate.txt", szDir, C_DIR_DELIMITER);
+	fOut = fopen(szFile, "wb");
+	if (!fOut)
+	{
+		fprintf(stderr, "couldn't open %s for writing\n", szFile);
+		return 0;
+	}
+	fprintf(fOut, "%d %.12g\n", pAgg->numRuns, pAgg->totalWeight);
+	fclose(fOut);
+	fprintf(stdout, "\twrote %d aggregate rasters over %d runs to %s\n", _NUM_AGGREGATES, pAgg->numRuns, szDir);
+	return 1;
+}
+
+#ifndef _MSC_VER
+double wallSeconds()
+{
+	struct timeval	sTime;
+
+	gettimeofday(&sTime, NULL);
+	return (double)sTime.tv_sec + 1e-6 * (double)sTime.tv_usec;
+}
+
+/*
+	Every interval seconds (checking whether to stop more often than that), report
+		progress: iteration=<i> numIts=<n> t=<time in the run> events=<events so far> eventsPerSec=<since the last report>
+*/
+void *progressThread(void *pArg)
+{
+	t_Progress	*pProgress;
+	double		lastWall,thisWall,nextWall;
+	long		lastEvents,numEvents;
+
+	pProgress = (t_Progress*)pArg;
+	lastWall = wallSeconds();
+	nextWall = lastWall + pProgress->interval;
+	lastEvents = 0;
+	while (!pProgress->bStop)
+	{
+		usleep((useconds_t)(1e6 * fmin(pProgress->interval, _PROGRESS_POLL_SECS)));
+		thisWall = wallSeconds();
+		if (thisWall >= nextWall && !pProgress->bStop)
+		{
+			numEvents = pProgress->numEvents;
+			fprintf(stdout, "progress: iteration=%d numIts=%d t=%.4f events=%ld eventsPerSec=%.1f\n", pProgress->iteration, pProgress->numIts, pProgress->thisTime, numEvents, (numEvents - lastEvents) / (thisWall - lastWall));
+			fflush(stdout);
+			lastWall = thisWall;
+			lastEvents = numEvents;
+			nextWall = thisWall + pProgress->interval;
+		}
+	}
+	return NULL;
+}
+#endif
+
+/*
+	Start and stop the thread reporting progress (if progressInterval is set)
+*/
+void stopProgress()
+{
+#ifndef _MSC_VER
+	if (g_sProgress.bRunning)
+	{
+		g_sProgress.bStop = 1;
+		pthread_join(g_sProgress.thread, NULL);
+		g_sProgress.bRunning = 0;
+	}
+#endif
+}
+
+int startProgress(t_Params *pParams)
+{
+	stopProgress();
+	memset((void*)&g_sProgress, 0, sizeof(t_Progress));
+	g_sProgress.numIts = pParams->numIts;
+	g_sProgress.interval = pParams->progressInterval;
+#ifndef _MSC_VER
+	if (pParams->progressInterval > 0.0)
+	{
+		if (pthread_create(&g_sProgress.thread, NULL, progressThread, &g_sProgress) != 0)
+		{
+			fprintf(stderr, "couldn't start the thread reporting progress\n");
+			return 0;
+		}
+		g_sProgress.bRunning = 1;
+	}
+#endif
+	return 1;
+}
+
+/*
+	Main routine to run an ensemble of epidemics and dump the results
+	(event counts summed over all iterations are returned in pTotalStats)
+*/
+int runEpidemics(t_Params *pParams, t_Landscape *pLandscape, t_PriInf *pPriInf, t_Dispersal *pDispersal, t_FFTKernel *pFFT, t_Epidemic *pEpidemic, t_RunStats *pTotalStats)
+{
+	int			doneInf,firstInf,continueRunning,j,i,retVal,cellToChallenge,cellState,cellInfectFrom,thisReason;
+	double		thisTime,nextPri,nextSec,randDbl,infectProb,nextReport,trueIncidence,maxFullIncidence,thisFinalIncidence,nextLevel;
+	double		aThreshTime[_MAX_THRESHOLDS];		/* time each value of maxIncidence was first reached */
+	int			aThreshNumInf[_MAX_THRESHOLDS];	/* number of cells infected by then (i.e. lines of the infection log to use) */
+	int			numCrossed;
+	int			runNum,numRuns,depth;	/* with splitLevels each iteration can give several runs (numbered in the order they finish) */
+	t_SplitState	aSplit[_MAX_SPLIT_LEVELS];
+	t_SplitState	*pSplit;
+	t_Snapshot		sSnapshot;
+	int			bSnapshotDone;	/* whether this run has reached snapshotIncidence */
+	int			thisStratum;	/* with introStrata, stratum the first infection of this iteration is drawn from (-1 once it has been) */
+	double		stratumWeight;	/* and the weight of the iteration (so each stratum has weight in proportion to its probability) */
+	char		outFile[_MAX_STATIC_BUFF_LEN],dpcFile[_MAX_STATIC_BUFF_LEN];
+	FILE		*fOut,*fEnd,*fSingleEnd,*fDPC;
+	t_RunStats	runStats;
+	t_Tiling	sTiling;
+	t_Surveillance	sSurvey;
+	t_Aggregate		sAggregate;
+
+	trueIncidence = 0.0;
+	memset(pTotalStats, 0, sizeof(t_RunStats));
+	fprintf(stdout, "runEpidemics()\n");
+	g_bCommonRandom = pParams->commonRandom;
+	g_rng = pParams->rng;
+	retVal = 1;
+	numRuns = 0;
+	if (pParams->numSplitLevels && !allocSplitStates(aSplit, pParams->numSplitLevels, pLandscape))
+	{
+		return 0;
+	}
+	if (pParams->snapshotFile[0] != '\0' && !readSnapshot(pParams->snapshotFile, &sSnapshot, pParams, pLandscape))
+	{
+		return 0;
+	}
+	if (pParams->engine == _ENGINE_TILED && !setupTiling(&sTiling, pParams, pLandscape))
+	{
+		return 0;
+	}
+	if (pParams->surveyFile[0] != '\0' && !setupSurveillance(&sSurvey, pParams, pLandscape))
+	{
+		return 0;
+	}
+	if (pParams->aggregateRasters && !setupAggregate(&sAggregate, pLandscape))
+	{
+		return 0;
+	}
+	if (!startProgress(pParams))
+	{
+		return 0;
+	}
+	sprintf(outFile, "%s%cendTimes.txt", pParams->outDir, C_DIR_DELIMITER);
+	fEnd = fopen(outFile, "wb");
+	if(!fEnd)
+	{
+		fprintf(stderr, "couldn't open endTimes file for writing\n");
+		return 0;
+	}
+	for(i=pParams->shardIndex;i<pParams->numIts;i+=(pParams->numShards ? pParams->numShards : 1))
+	{
+		runNum = (pParams->numSplitLevels ? numRuns : i);
+		thisReason = 0;		/* will be set to 1 if simulation stops because hit threshold incidence */
+		sprintf(dpcFile, "%s%c%s_dpc_%d.txt", pParams->outDir, C_DIR_DELIMITER, pParams->outStub, runNum);
+		fDPC = NULL;
+		if (pParams->archiveRuns)
+		{
+			fDPC = fopen(dpcFile, "wb");
+		}
+		if(fDPC || !pParams->archiveRuns)
+		{
+			if (g_logLevel >= _LOG_NORMAL)
+			{
+				fprintf(stdout, "\titeration %d\n", runNum);
+			}
+			g_sProgress.iteration = runNum;
+			memset(&runStats, 0, sizeof(t_RunStats));
+			if (pParams->commonRandom)
+			{
+				seedStreams(pParams->seed, i);
+			}
+			if (pParams->engine == _ENGINE_TILED)
+			{
+				resetTiling(&sTiling);
+			}
+			thisStratum = -1;
+			stratumWeight = 1.0;
+			if (pParams->introStrata > 1)
+			{
+				thisStratum = i % pParams->introStrata;
+				stratumWeight = pParams->numIts / (double)(pParams->introStrata * ((pParams->numIts - thisStratum + pParams->introStrata - 1) / pParams->introStrata));
+			}
+			if (pParams->snapshotFile[0] != '\0')
+			{
+				/* carry on from the snapshot (iteration 0 also takes its random numbers, so carries on exactly as the run it was taken from) */
+				applySnapshot(&sSnapshot, pLandscape, pPriInf, pEpidemic, i == 0);
+				thisTime = sSnapshot.thisTime;
+				nextReport = sSnapshot.nextReport;
+				trueIncidence = sSnapshot.trueIncidence;
+				numCrossed = sSnapshot.numCrossed;
+				memcpy(aThreshTime, sSnapshot.aThreshTime, sizeof(double) * numCrossed);
+				memcpy(aThreshNumInf, sSnapshot.aThreshNumInf, sizeof(int) * numCrossed);
+				if (g_logLevel >= _LOG_NORMAL)
+				{
+					fprintf(stdout, "carrying on from snapshot at t=%.4f\n", thisTime);
+				}
+			}
+			else
+			{
+				thisTime = 0.0;
+				setNextPossPriTime(pPriInf, thisTime);
+				nextReport = 0.0;
+				if (pParams->ratePriInf == 0.0)
+				{
+					if (thisStratum >= 0)
+					{
+						firstInf = (int)((double)pLandscape->numCells*(thisStratum + streamRandom(_STREAM_PRIMARY)) / pParams->introStrata);
+						thisStratum = -1;
+					}
+					else
+					{
+						firstInf = (int)((double)pLandscape->numCells*streamRandom(_STREAM_PRIMARY));
+					}
+					infectCell(pLandscape, firstInf, 0.0, pParams->rateSecInf, pEpidemic, _PRI_INF_TYPE, _EMPTY_CELL, &runStats, pParams->withinCellMin, pParams->withinCellBulkUp, pParams->trueMinFlag);
+					if (g_logLevel >= _LOG_VERBOSE)
+					{
+						fprintf(stdout, "infecting %d at t=0.0\n", cellID(pLandscape, firstInf));
+					}
+				}
+				numCrossed = 0;
+			}
+			bSnapshotDone = (pParams->snapshotFile[0] != '\0' && pParams->snapshotIncidence > 0.0 && trueIncidence >= pParams->snapshotIncidence * pLandscape->totalFull);
+			continueRunning = 1;
+			maxFullIncidence = pParams->maxIncidence * pLandscape->totalFull;
+			depth = 0;
+			perf_begin(&g_sProfileEventLoop);
+			do
+			{
+				while (retVal && continueRunning)
+				{
+					doneInf = 0;
+					g_sProgress.thisTime = thisTime;
+					g_sProgress.numEvents = pTotalStats->numPrimaryAttempts + pTotalStats->numSecondaryAttempts + runStats.numPrimaryAttempts + runStats.numSecondaryAttempts;
+					while (nextReport <= thisTime)
+					{
+						trueIncidence = sumIncidence(pLandscape, pEpidemic, nextReport, pEpidemic->totalInf, pParams->withinCellMin, pParams->withinCellBulkUp, pParams->trueMinFlag);
+						if (g_logLevel >= _LOG_VERBOSE)
+						{
+							fprintf(stdout, "\t\tt=%.4f (infNum=%d propInf=%.4f trueInc=%.4f)\n", nextReport, pEpidemic->totalInf, pEpidemic->totalInf / (double)pLandscape->numCells, trueIncidence / pLandscape->totalFull);
+						}
+						if (fDPC)
+						{
+							fprintf(fDPC, "%.4f %d %.4f %.4f\n", nextReport, pEpidemic->totalInf, pEpidemic->totalInf / (double)pLandscape->numCells, trueIncidence / pLandscape->totalFull);
+						}
+						nextReport += pParams->reportTime;
+					}
+					nextPri = getNextPossPriTime(pPriInf);
+					nextSec = getNextPossSecTime(pEpidemic, pLandscape, nextPri);
+					if (pParams->engine == _ENGINE_TAULEAP && pEpidemic->totalInf >= pParams->tauLeapSwitch && pEpidemic->totalInf > 0)
+					{
+						/* late in the epidemic switch to (approximate) tau-leaping; the event queue is no longer used */
+						thisTime = tauLeapStep(pParams, pLandscape, pPriInf, pDispersal, pEpidemic, &runStats, thisTime, &doneInf);
+					}
+					else if (pParams->engine == _ENGINE_TILED && pEpidemic->totalInf >= pParams->tauLeapSwitch && pEpidemic->totalInf > 0)
+					{
+						/* or to the tiled engine, which runs the exact model in parallel over tiles of the landscape, a window at a time */
+						nextLevel = -1.0;
+						if (pParams->maxIncidence > 0.0 && numCrossed < pParams->numThresholds)
+						{
+							nextLevel = pParams->aThresholds[numCrossed] * pLandscape->totalFull;
+						}
+						retVal = tiledStep(pParams, pLandscape, pPriInf, pDispersal, pEpidemic, &sTiling, &runStats, nextReport, nextLevel, &thisTime, &doneInf);
+					}
+					else if (pParams->engine == _ENGINE_FFT && pEpidemic->totalInf >= pParams->fftSwitch && pEpidemic->totalInf > 0)
+					{
+						/* similarly for the FFT engine */
+						thisTime = fftEngineStep(pParams, pLandscape, pPriInf, pFFT, pEpidemic, &runStats, thisTime, &doneInf);
+					}
+					else if (nextPri < nextSec)
+					{
+						/* attempt a primary infection */
+						if (nextPri < pParams->maxTime)
+						{
+							/* update time */
+							thisTime = nextPri;
+							runStats.numPrimaryAttempts++;
+							/* find the cell to challenge */
+							if (thisStratum >= 0)
+							{
+								/* the first infection (primary infection can't hit an infected cell before there are any) */
+								cellToChallenge = whichCellPrimaryStratum(pPriInf, pLandscape->numCells, thisStratum, pParams->introStrata);
+								thisStratum = -1;
+							}
+							else
+							{
+								cellToChallenge = whichCellPrimary(pPriInf, pLandscape->numCells);
+							}
+#ifdef _DEBUG_PRINT_MSG
+							fprintf(stdout, "\t\t(primary) challenging %d at %.4f\n", cellToChallenge, thisTime);
+#endif
+							/*
+								Note that have built relSus and area into the rate of primary infection
+								for each cell, so just need to check whether it is already infected or not
+							*/
+							if (pLandscape->aCells[cellToChallenge].tInf >= 0.0)					/* already infected */
+							{
+#ifdef _DEBUG_PRINT_MSG
+								fprintf(stdout, "\t\t\talready infected\n");
+#endif
+							}
+							else
+							{
+								/* infect */
+#ifdef _DEBUG_PRINT_MSG
+								fprintf(stdout, "\t\t\tinfecting\n");
+#endif
+								infectCell(pLandscape, cellToChallenge, thisTime, pParams->rateSecInf, pEpidemic, _PRI_INF_TYPE, _EMPTY_CELL, &runStats, pParams->withinCellMin, pParams->withinCellBulkUp, pParams->trueMinFlag);
+								doneInf = 1;
+							}
+							setNextPossPriTime(pPriInf, thisTime);
+						}
+						else
+						{
+							thisTime = pParams->maxTime;
+						}
+					}
+					else
+					{
+						/* attempt a secondary infection */
+						if (nextSec < pParams->maxTime)
+						{
+							thisTime = nextSec;
+							/* find a cell to challenge, and challenge it if makes sense to */
+							cellInfectFrom = getCellInfectFrom(pEpidemic, pLandscape);
+#ifdef _DEBUG_PRINT_MSG
+							fprintf(stdout, "\t\t(secondary) challenging from %d at %.4f\n", cellInfectFrom, thisTime);
+#endif
+							if (cellInfectFrom != _EMPTY_CELL)
+							{
+								runStats.numSecondaryAttempts++;
+								cellToChallenge = whichCellSecondary(pDispersal, pLandscape, cellInfectFrom, pParams, &cellState);
+#ifdef _DEBUG_PRINT_MSG
+								fprintf(stdout, "\t\t\tchallenging %d\n", cellToChallenge);
+#endif
+								if (cellState != _STATE_NO_HOST)
+								{
+									runStats.numNonEmpty++;
+									if (cellState == _STATE_INFECTED)					/* already infected */
+									{
+#ifdef _DEBUG_PRINT_MSG
+										fprintf(stdout, "\t\t\talready infected\n");
+#endif
+									}
+									else
+									{
+										runStats.numNonInfected++;
+										/* possibly infect, depending on relative susceptibility */
+										infectProb = pLandscape->aCells[cellToChallenge].relSus*pLandscape->aCells[cellToChallenge].propFull;
+#ifdef _DEBUG_PRINT_MSG
+										fprintf(stdout, "\t\t\tp(infect)=%f\n", infectProb);
+#endif
+										randDbl = streamRandom(_STREAM_SUSCEPTIBILITY);
+										if (randDbl < infectProb)
+										{
+											runStats.numSuccessful++;
+#ifdef _DEBUG_PRINT_MSG
+											fprintf(stdout, "\t\t\t\tinfecting\n");
+#endif
+											infectCell(pLandscape, cellToChallenge, thisTime, pParams->rateSecInf, pEpidemic, _SEC_INF_TYPE, cellInfectFrom, &runStats, pParams->withinCellMin, pParams->withinCellBulkUp, pParams->trueMinFlag);
+											doneInf = 1;
+										}
+										else
+										{
+#ifdef _DEBUG_PRINT_MSG
+											fprintf(stdout, "\t\t\t\tfailed to infect\n");
+#endif
+										}
+									}
+								}
+								/* need to update the source cell's time of next secondary infection too */
+								findNextSecondary(pLandscape, cellInfectFrom, thisTime, pParams->rateSecInf, pEpidemic, &runStats, pParams->withinCellMin, pParams->withinCellBulkUp, pParams->trueMinFlag);
+							}
+							else
+							{
+								fprintf(stderr, "\tsecondary infection from invalid cell...\n");
+								retVal = 0;
+							}
+						}
+						else
+						{
+							thisTime = pParams->maxTime;
+						}
+					}
+					if (doneInf)
+					{
+						trueIncidence = sumIncidence(pLandscape, pEpidemic, thisTime, pEpidemic->totalInf, pParams->withinCellMin, pParams->withinCellBulkUp, pParams->trueMinFlag);
+					}
+#if 0
+					if (maxInfected > 0)
+					{
+						if (pEpidemic->totalInf >= maxInfected)
+						{
+							continueRunning = 0;
+						}
+					}
+#endif
+					if (pParams->maxIncidence > 0.0)
+					{
+						/* note when each of the smaller thresholds is crossed on the way */
+						while (numCrossed < pParams->numThresholds && trueIncidence >= pParams->aThresholds[numCrossed] * pLandscape->totalFull)
+						{
+							aThreshTime[numCrossed] = thisTime;
+							aThreshNumInf[numCrossed] = pEpidemic->totalInf;
+							numCrossed++;
+						}
+						if (trueIncidence >= maxFullIncidence)
+						{
+							continueRunning = 0;
+							thisReason = 1;
+						}
+					}
+					if (thisTime >= pParams->maxTime)
+					{
+						continueRunning = 0;
+					}
+					if (pParams->snapshotIncidence > 0.0 && !bSnapshotDone && trueIncidence >= pParams->snapshotIncidence * pLandscape->totalFull)
+					{
+						sprintf(outFile, "%s%csnapshot_%d.bin", pParams->outDir, C_DIR_DELIMITER, runNum);
+						if (g_logLevel >= _LOG_NORMAL)
+						{
+							fprintf(stdout, "\t\twriting snapshot %s\n", outFile);
+						}
+						if (!writeSnapshot(outFile, pParams, pLandscape, pPriInf, pEpidemic, thisTime, nextReport, trueIncidence, numCrossed, aThreshTime, aThreshNumInf))
+						{
+							fprintf(stderr, "couldn't write snapshot %s\n", outFile);
+							return 0;
+						}
+						bSnapshotDone = 1;
+					}
+					while (continueRunning && depth < pParams->numSplitLevels && trueIncidence >= pParams->aSplitLevels[depth] * pLandscape->totalFull)
+					{
+						/* reached the next splitLevel: save the state for the other copies, and carry on as the first of them */
+						pSplit = &aSplit[depth];
+						saveSplitState(pSplit, pLandscape, pPriInf, pEpidemic);
+						pSplit->thisTime = thisTime;
+						pSplit->nextReport = nextReport;
+						pSplit->trueIncidence = trueIncidence;
+						pSplit->numCrossed = numCrossed;
+						memcpy(pSplit->aThreshTime, aThreshTime, sizeof(double) * numCrossed);
+						memcpy(pSplit->aThreshNumInf, aThreshNumInf, sizeof(int) * numCrossed);
+						strcpy(pSplit->dpcFile, dpcFile);
+						pSplit->dpcLength = (fDPC ? ftell(fDPC) : 0);
+						pSplit->numCopiesLeft = pParams->splitFactor - 1;
+						depth++;
+					}
+				}
+#if _CHECK_HEAP
+				{
+					FILE *fpTmp = fopen("checkHeap.txt", "wb");
+
+					if (fpTmp)
+					{
+						checkHeap(fpTmp, pEpidemic, pLandscape);
+						fclose(fpTmp);
+					}
+				}
+#endif
+				/* Do a final round of printing to the screen */
+				{
+					trueIncidence = sumIncidence(pLandscape, pEpidemic, thisTime, pEpidemic->totalInf, pParams->withinCellMin, pParams->withinCellBulkUp, pParams->trueMinFlag);
+					if (g_logLevel >= _LOG_NORMAL)
+					{
+						fprintf(stdout, "\t\tt=%.4f (infNum=%d propInf=%.4f trueInc=%.4f)\n", thisTime, pEpidemic->totalInf, pEpidemic->totalInf / (double)pLandscape->numCells, trueIncidence / pLandscape->totalFull);
+					}
+					if (fDPC)
+					{
+						fprintf(fDPC, "%.4f %d %.4f %.4f\n", thisTime, pEpidemic->totalInf, pEpidemic->totalInf / (double)pLandscape->numCells, trueIncidence / pLandscape->totalFull);
+					}
+				}
+				fprintf(fEnd, "%f\n", thisTime);
+				for (j = numCrossed; j < pParams->numThresholds; j++)
+				{
+					aThreshTime[j] = thisTime;
+					aThreshNumInf[j] = pEpidemic->totalInf;
+				}
+				if (pParams->surveyFile[0] != '\0')
+				{
+					evaluateSurveillance(&sSurvey, pParams, pLandscape, runNum, pParams->numSplitLevels ? stratumWeight * pow((double)pParams->splitFactor, -depth) : stratumWeight, aThreshTime);
+				}
+				if (pParams->aggregateRasters)
+				{
+					addToAggregate(&sAggregate, pParams, pLandscape, pEpidemic, thisTime, pParams->numSplitLevels ? stratumWeight * pow((double)pParams->splitFactor, -depth) : stratumWeight);
+				}
+				if (pParams->archiveRuns)
+				{
+					sprintf(outFile, "%s%cendTime_%d.txt", pParams->outDir, C_DIR_DELIMITER, runNum);
+					fSingleEnd = fopen(outFile, "wb");
+					if (!fSingleEnd)
+					{
+						fprintf(stderr, "couldn't open endTimes file for writing\n");
+						return 0;
+					}
+					fprintf(fSingleEnd, "%f\n", thisTime);
+					fclose(fSingleEnd);
+
+					/*
+						Dump reason simulation stopped to a file
+					*/
+					sprintf(outFile, "%s%cendReason_%d.txt", pParams->outDir, C_DIR_DELIMITER, runNum);
+					fSingleEnd = fopen(outFile, "wb");
+					if (!fSingleEnd)
+					{
+						fprintf(stderr, "couldn't open endReason file for writing\n");
+						return 0;
+					}
+					fprintf(fSingleEnd, "%d\n", thisReason);
+					fclose(fSingleEnd);
+
+					/*
+						Dump end time, reason and number of cells infected for each value of maxIncidence
+						(values not reached are given the end of the run, with reason 0)
+					*/
+					sprintf(outFile, "%s%cthresholds_%d.txt", pParams->outDir, C_DIR_DELIMITER, runNum);
+					fSingleEnd = fopen(outFile, "wb");
+					if (!fSingleEnd)
+					{
+						fprintf(stderr, "couldn't open thresholds file for writing\n");
+						return 0;
+					}
+					for (j = 0; j < pParams->numThresholds; j++)
+					{
+						fprintf(fSingleEnd, "%f %f %d %d\n", pParams->aThresholds[j], aThreshTime[j], (j < numCrossed) ? 1 : 0, aThreshNumInf[j]);
+					}
+					fclose(fSingleEnd);
+
+					/*
+						With splitLevels or introStrata, dump the weight of the run (each split shares the weight of a run equally
+						between its copies, and each stratum has weight in proportion to its probability)
+					*/
+					if (pParams->numSplitLevels || pParams->introStrata > 1)
+					{
+						sprintf(outFile, "%s%cweight_%d.txt", pParams->outDir, C_DIR_DELIMITER, runNum);
+						fSingleEnd = fopen(outFile, "wb");
+						if (!fSingleEnd)
+						{
+							fprintf(stderr, "couldn't open weight file for writing\n");
+							return 0;
+						}
+						fprintf(fSingleEnd, "%.12g\n", stratumWeight * pow((double)pParams->splitFactor, -depth));
+						fclose(fSingleEnd);
+					}
+
+
+					/*
+						Dump all the information
+					*/
+					sprintf(outFile, "%s%c%s_%d.txt", pParams->outDir, C_DIR_DELIMITER, pParams->outStub, runNum);
+					fOut = fopen(outFile, "wb");
+					if (fOut)
+					{
+						for (j = 0; j < pEpidemic->totalInf; j++)
+						{
+							thisFinalIncidence = getIncidence(pLandscape, pEpidemic, thisTime, pEpidemic->aInfCells[j], pParams->withinCellMin, pParams->withinCellBulkUp, pParams->trueMinFlag)/pLandscape->aCells[pEpidemic->aInfCells[j]].propFull;
+							trueIncidence = sumIncidence(pLandscape, pEpidemic, pLandscape->aCells[pEpidemic->aInfCells[j]].tInf, j + 1, pParams->withinCellMin, pParams->withinCellBulkUp, pParams->trueMinFlag);
+							fprintf(fOut, "%d %d %.4f %d %d %d %.4f %.4f %.4f %.4f %d %.4f %d %.4f %.4f\n",
+								pLandscape->aCells[pEpidemic->aInfCells[j]].xPos,
+								pLandscape->aCells[pEpidemic->aInfCells[j]].yPos,
+								pLandscape->aCells[pEpidemic->aInfCells[j]].tInf,
+								pLandscape->aCells[pEpidemic->aInfCells[j]].infType,
+								(pLandscape->aCells[pEpidemic->aInfCells[j]].infBy == _EMPTY_CELL) ? _EMPTY_CELL : pLandscape->aCells[pLandscape->aCells[pEpidemic->aInfCells[j]].infBy].xPos,
+								(pLandscape->aCells[pEpidemic->aInfCells[j]].infBy == _EMPTY_CELL) ? _EMPTY_CELL : pLandscape->aCells[pLandscape->aCells[pEpidemic->aInfCells[j]].infBy].yPos,
+								pLandscape->aCells[pEpidemic->aInfCells[j]].propFull,
+								pLandscape->aCells[pEpidemic->aInfCells[j]].relInf,
+								pLandscape->aCells[pEpidemic->aInfCells[j]].relSus,
+								pLandscape->aCells[pEpidemic->aInfCells[j]].relPri,
+								(j + 1),
+								(j + 1.0) / (double)pLandscape->numCells,
+								cellID(pLandscape, pEpidemic->aInfCells[j]),
+								trueIncidence / pLandscape->totalFull,
+								thisFinalIncidence);
+						}
+						fclose(fOut);
+					}
+				}
+#ifdef _PIPELINE
+				/*
+					Pass the run straight to the annealer
+				*/
+				for (j = 0; j < pEpidemic->totalInf; j++)
+				{
+					if (!pipelineAddInfection(runNum, cellID(pLandscape, pEpidemic->aInfCells[j]), pLandscape->aCells[pEpidemic->aInfCells[j]].tInf, pLandscape->aCells[pEpidemic->aInfCells[j]].propFull))
+					{
+						fprintf(stderr, "couldn't allocate memory for run %d in the annealer\n", runNum);
+						return 0;
+					}
+				}
+				if (!pipelineEndRun(runNum, thisTime, stratumWeight, pParams->numThresholds, pParams->aThresholds, aThreshTime, aThreshNumInf))
+				{
+					return 0;
+				}
+#endif
+				/*
+					Blank all the information so start next simulation totally afresh
+				*/
+				for (j = 0; j < pEpidemic->totalInf; j++)
+				{
+					setCellState(pLandscape, pEpidemic->aInfCells[j], _STATE_SUSCEPTIBLE);
+				}
+				pEpidemic->queueLen = 0;
+				pEpidemic->totalInf = 0;
+				for (j = 0; j < pLandscape->numCells; j++)
+				{
+					pLandscape->aCells[j].tInf = _UNDEF_TIME;
+					pLandscape->aCells[j].tNext = _UNDEF_TIME;
+					pLandscape->aCells[j].infBy = _EMPTY_CELL;
+					pLandscape->aCells[j].infType = _EMPTY_CELL;
+				}
+				pPriInf->nextT = _UNDEF_TIME;
+				if (pFFT)
+				{
+					memset(pFFT->aInfectivity, 0, sizeof(double) * pLandscape->numCells);
+					pFFT->lastTotal = -1.0;
+					pFFT->lastNumInf = 0;
+				}
+				/*
+					Print out information on runstats
+				*/
+				if (g_logLevel >= _LOG_VERBOSE)
+				{
+					fprintf(stdout, "\trunStats:\n\t\tnumPrimaryAttempts=%ld\n\t\tnumSecondaryAttempts=%ld\n\t\tnumFindNextSecondary=%ld\n\t\tnumNonEmpty=%ld\n\t\tnumNonInfected=%ld\n\t\tnumSuccessful=%ld\n", runStats.numPrimaryAttempts, runStats.numSecondaryAttempts, runStats.numFindNextSecondary, runStats.numNonEmpty, runStats.numNonInfected, runStats.numSuccessful);
+				}
+				pTotalStats->numPrimaryAttempts += runStats.numPrimaryAttempts;
+				pTotalStats->numSecondaryAttempts += runStats.numSecondaryAttempts;
+				pTotalStats->numFindNextSecondary += runStats.numFindNextSecondary;
+				pTotalStats->numNonEmpty += runStats.numNonEmpty;
+				pTotalStats->numNonInfected += runStats.numNonInfected;
+				pTotalStats->numSuccessful += runStats.numSuccessful;
+				if (fDPC)
+				{
+					fclose(fDPC);
+				}
+				numRuns++;
+				/*
+					With splitLevels, go back to the deepest level which still has copies to run, and start the next one from there
+				*/
+				while (depth > 0 && aSplit[depth - 1].numCopiesLeft == 0)
+				{
+					depth--;
+				}
+				if (depth > 0)
+				{
+					pSplit = &aSplit[depth - 1];
+					pSplit->numCopiesLeft--;
+					restoreSplitState(pSplit, pLandscape, pPriInf, pEpidemic);
+					thisTime = pSplit->thisTime;
+					nextReport = pSplit->nextReport;
+					trueIncidence = pSplit->trueIncidence;
+					numCrossed = pSplit->numCrossed;
+					memcpy(aThreshTime, pSplit->aThreshTime, sizeof(double) * numCrossed);
+					memcpy(aThreshNumInf, pSplit->aThreshNumInf, sizeof(int) * numCrossed);
+					runNum = numRuns;
+					thisReason = 0;
+					continueRunning = 1;
+					bSnapshotDone = (pParams->snapshotIncidence > 0.0 && trueIncidence >= pParams->snapshotIncidence * pLandscape->totalFull);
+					sprintf(dpcFile, "%s%c%s_dpc_%d.txt", pParams->outDir, C_DIR_DELIMITER, pParams->outStub, runNum);
+					fDPC = NULL;
+					if (pParams->archiveRuns)
+					{
+						fDPC = fopen(dpcFile, "wb");
+						if (!fDPC || !copyFilePrefix(pSplit->dpcFile, fDPC, pSplit->dpcLength))
+						{
+							fprintf(stderr, "couldn't start dpc file %s\n", dpcFile);
+							return 0;
+						}
+					}
+					if (g_logLevel >= _LOG_NORMAL)
+					{
+						fprintf(stdout, "\titeration %d (copy of iteration %d from splitLevel=%f)\n", runNum, i, pParams->aSplitLevels[depth - 1]);
+					}
+					g_sProgress.iteration = runNum;
+					memset(&runStats, 0, sizeof(t_RunStats));
+				}
+			} while (depth > 0);
+			perf_end(&g_sProfileEventLoop);
+		}
+	}
+	stopProgress();
+	if (pParams->numSplitLevels)
+	{
+		fprintf(stdout, "\t%d runs from %d iterations (splitLevels)\n", numRuns, pParams->numIts);
+		freeSplitStates(aSplit, pParams->numSplitLevels);
+	}
+	if (pParams->snapshotFile[0] != '\0')
+	{
+		freeSnapshot(&sSnapshot);
+	}
+	if (pParams->engine == _ENGINE_TILED)
+	{
+		if (g_logLevel >= _LOG_NORMAL && sTiling.numWindows > 0)
+		{
+			fprintf(stdout, "\ttiled engine: %ld windows, %.2f passes over the tiles in each\n", sTiling.numWindows, sTiling.numPasses / (double)sTiling.numWindows);
+		}
+		freeTiling(&sTiling);
+	}
+	if (pParams->surveyFile[0] != '\0')
+	{
+		freeSurveillance(&sSurvey);
+		if (!writeSurveillanceSummary(pParams->outDir))
+		{
+			retVal = 0;
+		}
+	}
+	if (pParams->aggregateRasters)
+	{
+		if (!writeAggregate(&sAggregate, pParams->outDir))
+		{
+			retVal = 0;
+		}
+		freeAggregate(&sAggregate);
+	}
+	if (pParams->numShards)
+	{
+		/*
+			Mark the shard as complete (lastRunNumber.txt is written when the shards are merged)
+		*/
+		sprintf(outFile, "%s%cshard.txt", pParams->outDir, C_DIR_DELIMITER);
+		fOut = fopen(outFile, "wb");
+		if (fOut)
+		{
+			fprintf(fOut, "%d %d %d\n", pParams->shardIndex, pParams->numShards, pParams->numIts);
+			fclose(fOut);
+		}
+	}
+	else if (i == pParams->numIts)
+	{
+		/*
+			Dump out a file of the last simulation that was run this time
+			Can be useful to keep track of which results are which if repeatedly do simulations with same file name
+		*/
+		sprintf(outFile, "%s%clastRunNumber.txt", pParams->outDir, C_DIR_DELIMITER);
+		fOut = fopen(outFile, "wb");
+		if (fOut)
+		{
+			fprintf(fOut, "%d", numRuns);
+			fclose(fOut);
+		}
+	}
+	fclose(fEnd);
+	return retVal;
+}
+
+/*
+	With coarsen=k distances are measured in coarse cells, so dispScale is divided by k, and the host in each coarse cell is
+	stored as a proportion of an area k^2 times larger (see coarsenLandscape()), so rateSecInf is multiplied by k^2 to keep
+	the rate of challenges from the summed host the same, and withinCellMin divided by k^2 so a newly infected coarse cell
+	starts with as much infection as a newly infected fine cell would
+*/
+void coarsenParams(t_Params *pParams)
+{
+	double dOldDispScale,dOldRateSec,dOldWithinCellMin,area;
+
+	if (pParams->coarsen > 1)
+	{
+		area = (double)pParams->coarsen * pParams->coarsen;
+		dOldDispScale = pParams->dispScale;
+		dOldRateSec = pParams->rateSecInf;
+		dOldWithinCellMin = pParams->withinCellMin;
+		pParams->dispScale /= pParams->coarsen;
+		pParams->rateSecInf *= area;
+		pParams->withinCellMin /= area;
+		fprintf(stdout, "coarsen=%d -> dispScale=%f (was %f), rateSecInf=%f (was %f), withinCellMin=%f (was %f)\n", pParams->coarsen, pParams->dispScale, dOldDispScale, pParams->rateSecInf, dOldRateSec, pParams->withinCellMin, dOldWithinCellMin);
+	}
+}
+
+/*
+	Initialise the dispersal kernel
+*/
+int setupDispersal(t_Dispersal *pDispersal, t_Landscape *pLandscape, double dispScale, double *pRateSecInf)
+{
+	int		i,retVal,x,y;
+	double	checkDisp, thisDistSq, thisProb, cumProb;
+
+	fprintf(stdout, "setupDispersal()\n\t");
+	checkDisp = 0.0;
+	retVal = 0;
+	pDispersal->numProbs = pLandscape->numCols * pLandscape->numRows;
+	pDispersal->aProbs = mem_malloc(sizeof(double) * pDispersal->numProbs, "aProbs");
+	if(pDispersal->aProbs)
+	{
+		fprintf(stdout, "Functional form type kernel\n\t\t");
+		for(i=0;i<pDispersal->numProbs;i++)
+		{
+			posToGrid(i, pLandscape->numCols, &x, &y);
+			thisDistSq = (double) x * (double) x + (double) y * (double) y;
+			thisProb = exp(-sqrt(thisDistSq)/dispScale);
+			thisProb /= (dispScale*dispScale*2.0*_PI);
+			if(x==0)
+			{
+				thisProb /= 2.0;
+			}
+			if(y==0)
 			{
-				fprintf(stderr, "couldn't open %s\n", fileName);
-				retVal = 0;
-				break;
+				thisProb /= 2.0;
+			}
+			thisProb *= 4.0;
+			pDispersal->aProbs[i] = thisProb;
+			checkDisp += thisProb;
+			if(g_logLevel >= _LOG_VERBOSE && i % _SETUP_DISPERSAL_PRINT_DOT == 0)
+			{
+				fprintf(stdout, ".");
 			}
 		}
-		free(inBuff);
+		pDispersal->inCell = pDispersal->aProbs[0];
+		pDispersal->onLandscape = checkDisp;
+		retVal = 1;
+		/*
+			Store the dispersal kernel as a list of cumulative sums
+			(to make it easy to find what infects what)
+		*/
+		cumProb = 0.0;
+		for(i=0;i<pDispersal->numProbs;i++)
+		{
+			cumProb += pDispersal->aProbs[i];
+			pDispersal->aProbs[i] = cumProb;
+		}
+		fprintf(stdout, "\n\t\tinCell=%f onLandscape=%f\n", pDispersal->inCell, pDispersal->onLandscape);
+		/*
+			Note that it is possible to have onLandscape > 1.0 for certain dispersal kernels (particularly long ranged ones)
+			This can happen even thought the kernel is normalised because of discretisation error in
+				adding up the kernel but approximating the value of each cell by the value at its centre
+			If this happens then renormalise so that all cells can be hit
+				(note onLandscape < 1.0 is ok; corresponds to appreciable fraction of dispersals going so far that do not stay within landscape)
+		*/
+		if (pDispersal->onLandscape > 1.0)
+		{
+			double dOldRateSec;
+
+			dOldRateSec = *pRateSecInf;
+			*pRateSecInf = dOldRateSec * pDispersal->onLandscape;
+			for (i = 0; i<pDispersal->numProbs; i++)
+			{
+				pDispersal->aProbs[i] /= pDispersal->onLandscape;
+			}
+			pDispersal->onLandscape = 1.0;
+			pDispersal->inCell = pDispersal->aProbs[0];
+			fprintf(stdout, "\tonLandscape > 1.0 -> Renormalising kernel (and rateSecInf)...\n");
+			fprintf(stdout, "\t\tinCell=%f onLandscape=%f\n", pDispersal->inCell, pDispersal->onLandscape);
+			fprintf(stdout, "\t\trateSecInf=%f (was %f)\n", *pRateSecInf, dOldRateSec);
+		}
 	}
-	else
+	return retVal;
+}
+
+/*
+	Deterministic mean-field approximation, using the same FFT convolution as the fft engine
+
+	For each cell tracks P (probability the cell has been infected) and W (expected proportion of the cell infected),
+	treating all infections within a cell as a single cohort for within-cell bulk up
+	A single run replaces the ensemble, with output to
+		<outStub>_meanfield_dpc.txt		time, expected number of infected cells, expected proportion of cells infected, expected incidence
+		<outStub>_meanfield.txt			x, y, P, W, propFull for each cell at the end of the run
+		meanFieldEnd.txt				end time and reason (as in endTime_i.txt and endReason_i.txt)
+*/
+int runMeanField(t_Params *pParams, t_Landscape *pLandscape, t_PriInf *pPriInf, t_FFTKernel *pFFT)
+{
+	int		i,id,thisReason,retVal;
+	double	*aProb,*aW;
+	double	thisTime,nextReport,dt,expNumInf,expIncidence,totalInfectivity,forceScale,hazard,dProb,logisticJ,growth,thisPressure;
+	char	outFile[_MAX_STATIC_BUFF_LEN];
+	FILE	*fOut;
+
+	fprintf(stdout, "runMeanField()\n");
+	pFFT->lastTotal = -1.0;
+	aProb = mem_calloc(pLandscape->numCells, sizeof(double), "meanField");
+	aW = mem_calloc(pLandscape->numCells, sizeof(double), "meanField");
+	if (!aProb || !aW)
 	{
 		fprintf(stderr, "out of memory\n");
-		retVal = 0;
+		return 0;
 	}
-	/*
-		Write out information on all cells that are active in the simulation (i.e. >= cellThresh)
-	*/
-	if(retVal)
+	sprintf(outFile, "%s%c%s_meanfield_dpc.txt", pParams->outDir, C_DIR_DELIMITER, pParams->outStub);
+	fOut = fopen(outFile, "wb");
+	if (!fOut)
 	{
-		FILE *fpOut;
-		int	 i;
-
-		sprintf(outFile, "%s%cactiveLandscape.txt", outStub, C_DIR_DELIMITER);
-		fpOut = fopen(outFile, "wb");
-		if(fpOut)
+		fprintf(stderr, "couldn't open %s for writing\n", outFile);
+		mem_free(aProb);
+		mem_free(aW);
+		return 0;
+	}
+	if (pParams->ratePriInf == 0.0)
+	{
+		/* the stochastic model infects one cell chosen at random at t=0 */
+		for (i = 0; i < pLandscape->numCells; i++)
+		{
+			aProb[i] = 1.0 / pLandscape->numCells;
+			aW[i] = aProb[i] / (1.0 + getLogisticJ(pLandscape, i, pParams->withinCellMin, pParams->trueMinFlag));
+		}
+	}
+	retVal = 1;
+	thisReason = 0;
+	thisTime = 0.0;
+	nextReport = 0.0;
+	while (1)
+	{
+		expNumInf = 0.0;
+		expIncidence = 0.0;
+		for (i = 0; i < pLandscape->numCells; i++)
+		{
+			expNumInf += aProb[i];
+			expIncidence += pLandscape->aCells[i].propFull * aW[i];
+		}
+		while (nextReport <= thisTime)
 		{
-			for(i=0;i<pLandscape->numCells;i++)
+			if (g_logLevel >= _LOG_VERBOSE)
 			{
-				fprintf(fpOut, "%d %d %f %d\n", pLandscape->aCells[i].xPos, pLandscape->aCells[i].yPos, pLandscape->aCells[i].propFull, i);
+				fprintf(stdout, "\t\tt=%.4f (expInfNum=%.4f expPropInf=%.4f expInc=%.4f)\n", nextReport, expNumInf, expNumInf / pLandscape->numCells, expIncidence / pLandscape->totalFull);
 			}
-			fclose(fpOut);
+			fprintf(fOut, "%.4f %.4f %.4f %.4f\n", nextReport, expNumInf, expNumInf / pLandscape->numCells, expIncidence / pLandscape->totalFull);
+			nextReport += pParams->reportTime;
 		}
-		fprintf(stdout, "\t%d valid cells (%d rows; %d cols)\n", pLandscape->numCells, pLandscape->numRows, pLandscape->numCols);
-		fprintf(stdout, "\ttotalFull=%f\n", pLandscape->totalFull);
+		if (pParams->maxIncidence > 0.0 && expIncidence >= pParams->maxIncidence * pLandscape->totalFull)
+		{
+			thisReason = 1;
+			break;
+		}
+		if (thisTime >= pParams->maxTime)
+		{
+			break;
+		}
+		dt = pParams->fftStep;
+		if (thisTime + dt > pParams->maxTime)
+		{
+			dt = pParams->maxTime - thisTime;
+		}
+		totalInfectivity = 0.0;
+		for (i = 0; i < pLandscape->numCells; i++)
+		{
+			pFFT->aInfectivity[i] = pLandscape->aCells[i].propFull * pLandscape->aCells[i].relInf * pParams->rateSecInf * aW[i];
+			totalInfectivity += pFFT->aInfectivity[i];
+		}
+		forceScale = updateForceOfInfection(pFFT, pLandscape, totalInfectivity, (int)expNumInf, pParams->fftTolerance);
+		growth = exp(pParams->withinCellBulkUp * dt);
+		for (i = 0; i < pLandscape->numCells; i++)
+		{
+			thisPressure = pPriInf->aCumPressure[i] - (i > 0 ? pPriInf->aCumPressure[i - 1] : 0.0);
+			hazard = forceScale * pFFT->aForce[i] * pLandscape->aCells[i].relSus * pLandscape->aCells[i].propFull;
+			if (hazard < 0.0)
+			{
+				hazard = 0.0;	/* rounding error in the FFT */
+			}
+			hazard += pPriInf->ratePri * thisPressure / pPriInf->totalPressure;
+			dProb = (1.0 - aProb[i]) * (1.0 - exp(-hazard * dt));
+			logisticJ = getLogisticJ(pLandscape, i, pParams->withinCellMin, pParams->trueMinFlag);
+			if (aProb[i] > 0.0)
+			{
+				/* exact logistic growth of the existing cohort over the step */
+				aW[i] = aProb[i] * (aW[i] / aProb[i]) * growth / (1.0 - aW[i] / aProb[i] + (aW[i] / aProb[i]) * growth);
+			}
+			aW[i] += dProb / (1.0 + logisticJ);
+			aProb[i] += dProb;
+		}
+		thisTime += dt;
+	}
+	fclose(fOut);
+	sprintf(outFile, "%s%c%s_meanfield.txt", pParams->outDir, C_DIR_DELIMITER, pParams->outStub);
+	fOut = fopen(outFile, "wb");
+	if (fOut)
+	{
+		for (id = 0; id < pLandscape->numCells; id++)
+		{
+			i = cellIndex(pLandscape, id);
+			fprintf(fOut, "%d %d %.6f %.6f %.4f\n", pLandscape->aCells[i].xPos, pLandscape->aCells[i].yPos, aProb[i], aW[i], pLandscape->aCells[i].propFull);
+		}
+		fclose(fOut);
+	}
+	else
+	{
+		fprintf(stderr, "couldn't open %s for writing\n", outFile);
+		retVal = 0;
+	}
+	sprintf(outFile, "%s%cmeanFieldEnd.txt", pParams->outDir, C_DIR_DELIMITER);
+	fOut = fopen(outFile, "wb");
+	if (fOut)
+	{
+		fprintf(fOut, "%f %d\n", thisTime, thisReason);
+		fclose(fOut);
 	}
+	else
+	{
+		fprintf(stderr, "couldn't open %s for writing\n", outFile);
+		retVal = 0;
+	}
+	mem_free(aProb);
+	mem_free(aW);
 	return retVal;
 }
 
+double secondsSince(clock_t beforeClock)
+{
+	return ((double)clock()-(double)beforeClock)/((double)CLOCKS_PER_SEC);
+}
+
 /*
-	Primary rate of infection is stored in cumulative form to make it easier to find out which cell is infected next
+	Number of iterations run by this process (fewer than numIts if the ensemble is sharded)
 */
-int setupPrimary(t_PriInf *pPriInf, t_Landscape *pLandscape, double ratePri)
+int numItsThisProcess(t_Params *pParams)
 {
-	int		i,retVal;
-	double	thisVal,cumVal;
-
-	fprintf(stdout, "setupPrimary()\n");
-	retVal = 0;
-	memset(pPriInf,0,sizeof(t_PriInf));
-	pPriInf->aCumPressure = malloc(sizeof(double)*pLandscape->numCells);
-	if(pPriInf->aCumPressure)
+	if (pParams->numShards)
 	{
-		cumVal = 0;
-		for(i=0;i<pLandscape->numCells;i++)
-		{
-			/*
-				Values in the GIS file are multipled by proportion of cell occupied, as well as relative susceptibility
-			*/
-			thisVal = pLandscape->aCells[i].propFull * pLandscape->aCells[i].relPri * pLandscape->aCells[i].relSus;
-			cumVal += thisVal;
-			pPriInf->aCumPressure[i] = cumVal;
-		}
-		pPriInf->totalPressure = cumVal;
-		pPriInf->nextT = _UNDEF_TIME;
-		pPriInf->ratePri = ratePri;
-		retVal = 1;
-		fprintf(stdout, "\ttotalPressure=%f\n", pPriInf->totalPressure);
+		return (pParams->numIts - pParams->shardIndex + pParams->numShards - 1) / pParams->numShards;
 	}
-	return retVal;
+	return pParams->numIts;
 }
 
 /*
-	Allocate memory for epidemic
+	With profile=1, report the profiled regions to the screen and to profile.txt (events are infection attempts), then start
+	again for the next set of a sweep
 */
-int setupEpidemic(t_Epidemic *pEpidemic, t_Landscape *pLandscape, double dispScale)
+void writeProfile(t_Params *pParams, long numEvents)
 {
-	int retVal;
+	perf_region	*apRegions[2] = { &g_sProfileEventLoop, &g_sProfileWhichCell };
+	FILE		*fOut;
+	char		outFile[_MAX_STATIC_BUFF_LEN];
 
-	fprintf(stdout, "setupEpidemic()\n");
-	retVal = 0;
-	memset(pEpidemic,0,sizeof(t_Epidemic));
-	pEpidemic->queueLen = 0;
-	pEpidemic->aQueueCells = malloc(sizeof(int) * pLandscape->numCells);
-	pEpidemic->totalInf = 0;
-	pEpidemic->aInfCells = malloc(sizeof(int) * pLandscape->numCells);
-	if(pEpidemic->aQueueCells && pEpidemic->aInfCells)
+	if (pParams->profile)
 	{
-		retVal = 1;
-		fprintf(stdout, "\t%d cells\n", pLandscape->numCells);
+		g_sProfileEventLoop.numEvents = numEvents;
+		perf_report(stdout, apRegions, 2);
+		sprintf(outFile, "%s%cprofile.txt", pParams->outDir, C_DIR_DELIMITER);
+		fOut = fopen(outFile, "wb");
+		if (fOut)
+		{
+			perf_report(fOut, apRegions, 2);
+			fclose(fOut);
+		}
+		else
+		{
+			fprintf(stderr, "couldn't open %s for writing\n", outFile);
+		}
+		perf_reset(apRegions, 2);
 	}
-	return retVal;
 }
 
 /*
-	Find the time of the next primary infection across the landscape
-		given that the total rate of entry on an entirely susceptible landscape is pPriInf->ratePri
-		per unit of time [that some will hit already infected cells is handled later]
+	Memory held by each structure (current and peak, over the whole process) and the RSS, to the screen and memory.txt
 */
-void setNextPossPriTime(t_PriInf *pPriInf, double thisTime)
+void writeMemory(t_Params *pParams)
 {
-	double randDbl;
+	FILE	*fOut;
+	char	outFile[_MAX_STATIC_BUFF_LEN];
 
-	randDbl = uniformRandom();
-	if(pPriInf->ratePri > 0.0)
+	if (g_logLevel >= _LOG_NORMAL)
+	{
+		mem_report(stdout);
+	}
+	sprintf(outFile, "%s%cmemory.txt", pParams->outDir, C_DIR_DELIMITER);
+	fOut = fopen(outFile, "wb");
+	if (fOut)
 	{
-		pPriInf->nextT = thisTime - log(randDbl)/pPriInf->ratePri;
+		mem_report(fOut);
+		fclose(fOut);
 	}
 	else
 	{
-		pPriInf->nextT=_VERY_LONG_TIME;
+		fprintf(stderr, "couldn't open %s for writing\n", outFile);
 	}
 }
 
-double getNextPossPriTime(t_PriInf *pPriInf)
-{
-	return pPriInf->nextT;
-}
-
 /*
-	Binary chop to figure out cell which is infected by primary infection
+	Dump out timings and event throughput, so that performance can be compared between builds
+	(read by runBenchmark.sh)
 */
-int		whichCellPrimary(t_PriInf *pPriInf,int numCells)
+void writeBenchmark(t_Params *pParams, t_Landscape *pLandscape, t_Timings *pTimings, t_RunStats *pTotalStats)
 {
-	double  randDbl;//,runningSum;
-	int		left,right,mid;//,cellID;
+	FILE	*fOut;
+	char	outFile[_MAX_STATIC_BUFF_LEN];
+	long	numEvents;
 
-	randDbl = pPriInf->totalPressure * uniformRandom();
-	left = 0;
-	right = numCells-1;
-	while((right-left) > 1)
+	numEvents = pTotalStats->numPrimaryAttempts + pTotalStats->numSecondaryAttempts;
+	fprintf(stdout, "benchmark:\n");
+	fprintf(stdout, "\treadLandscape=%.3fs setupPrimary=%.3fs setupDispersal=%.3fs setupEpidemic=%.3fs runEpidemics=%.3fs\n", pTimings->readLandscape, pTimings->setupPrimary, pTimings->setupDispersal, pTimings->setupEpidemic, pTimings->runEpidemics);
+	fprintf(stdout, "\t%ld events (%.1f events/sec; %.3f runs/sec); peak RSS %ld kB\n", numEvents, pTimings->runEpidemics > 0.0 ? numEvents / pTimings->runEpidemics : 0.0, pTimings->runEpidemics > 0.0 ? numItsThisProcess(pParams) / pTimings->runEpidemics : 0.0, mem_peak_rss());
+	sprintf(outFile, "%s%cbenchmark.txt", pParams->outDir, C_DIR_DELIMITER);
+	fOut = fopen(outFile, "wb");
+	if(fOut)
 	{
-		mid=(left+right)/2;
-		if(pPriInf->aCumPressure[mid] < randDbl)
-		{
-			left = mid;
-		}
-		else
-		{
-			right = mid;
-		}
+		fprintf(fOut, "numCells=%d\n", pLandscape->numCells);
+		fprintf(fOut, "numRows=%d\n", pLandscape->numRows);
+		fprintf(fOut, "numCols=%d\n", pLandscape->numCols);
+		fprintf(fOut, "numIts=%d\n", pParams->numIts);
+		fprintf(fOut, "readLandscapeSecs=%.4f\n", pTimings->readLandscape);
+		fprintf(fOut, "setupPrimarySecs=%.4f\n", pTimings->setupPrimary);
+		fprintf(fOut, "setupDispersalSecs=%.4f\n", pTimings->setupDispersal);
+		fprintf(fOut, "setupEpidemicSecs=%.4f\n", pTimings->setupEpidemic);
+		fprintf(fOut, "runEpidemicsSecs=%.4f\n", pTimings->runEpidemics);
+		fprintf(fOut, "numPrimaryAttempts=%ld\n", pTotalStats->numPrimaryAttempts);
+		fprintf(fOut, "numSecondaryAttempts=%ld\n", pTotalStats->numSecondaryAttempts);
+		fprintf(fOut, "numSuccessful=%ld\n", pTotalStats->numSuccessful);
+		fprintf(fOut, "eventsPerSec=%.1f\n", pTimings->runEpidemics > 0.0 ? numEvents / pTimings->runEpidemics : 0.0);
+		fprintf(fOut, "runsPerSec=%.4f\n", pTimings->runEpidemics > 0.0 ? numItsThisProcess(pParams) / pTimings->runEpidemics : 0.0);
+		fprintf(fOut, "peakRSSkB=%ld\n", mem_peak_rss());
+		fprintf(fOut, "trackedPeakkB=%ld\n", (long)(mem_peak() / 1024));
+		fprintf(fOut, "singlePrecision=%d\n", _SINGLE_PRECISION_FLAG);
+		fprintf(fOut, "bytesPerCell=%d\n", (int)sizeof(t_Cell));
+		fprintf(fOut, "cellOrder=%s\n", g_aCellOrderNames[pParams->cellOrder]);
+		fclose(fOut);
 	}
-	return right;
+	else
+	{
+		fprintf(stderr, "couldn't open %s for writing\n", outFile);
+	}
+	writeProfile(pParams, numEvents);
+	writeMemory(pParams);
 }
 
 /*
-	Figure out which cell is challenged by a potential secondary infection
+	Run every set of parameters listed in sweepFile in this one process, so the landscape is only read (and primary infection
+	set up) once, and dispersal kernels are only set up once for each distinct dispScale
+		- each line of sweepFile is a set of space separated key=value pairs, which take precedence over the command line and cfg file
+		- lines which are blank or start with # are ignored
+		- output for the i'th set goes to <outStub>/<outStub>_<i>, and <outStub>/sweepIndex.txt records which set is which
+		- the landscape (filePropFull, fileRelInf, fileRelSus, fileRelPri, cellThresh, coarsen) cannot be changed within a sweep
 */
-int whichCellSecondary(t_Dispersal *pDispersal, t_Landscape *pLandscape, int cellInfectFrom, t_Params *pParams)
+int runSweep(t_Params *pBaseParams, int argc, char **argv)
 {
-	double	randDbl;
-	int		posToChallenge,x,y,xOffset,yOffset,left,right,mid,cellToChallenge,cellQuad;
+	t_Params		sParams;
+	t_Landscape		sLandscape;
+	t_PriInf		sPriInf;
+	t_Epidemic		sEpidemic;
+	t_KernelCache	*aKernels,*pKernel,*pTmp;
+	t_FFTKernel		*pFFT;
+	t_RunStats		sTotalStats;
+	t_Timings		sTimings;
+	clock_t			beforeClock;
+	FILE			*fSweep,*fIndex;
+	char			szLine[_MAX_STATIC_BUFF_LEN];
+	char			outFile[_MAX_STATIC_BUFF_LEN];
+	char			**aSweepArgv;
+	char			*pPtr;
+	int				i,numKernels,numSets,retVal;
 
-	cellToChallenge = _EMPTY_CELL;
+	fprintf(stdout, "runSweep()\n");
+	fSweep = fopen(pBaseParams->sweepFile, "rb");
+	if (!fSweep)
+	{
+		fprintf(stderr, "couldn't open sweep file %s\n", pBaseParams->sweepFile);
+		return 0;
+	}
+	sprintf(outFile, "%s%csweepIndex.txt", pBaseParams->outStub, C_DIR_DELIMITER);
+	fIndex = fopen(outFile, "wb");
+	if (!fIndex)
+	{
+		fprintf(stderr, "couldn't open %s for writing\n", outFile);
+		fclose(fSweep);
+		return 0;
+	}
 	/*
-		First need to find cell to challenge
+		Shared setup (timings are reported with the first set)
 	*/
-	randDbl = 4.0 * uniformRandom();
-	cellQuad = (int)randDbl;
-	randDbl -= cellQuad;
-	if(!(randDbl < pDispersal->inCell || randDbl > pDispersal->onLandscape))
+	memset(&sTimings, 0, sizeof(t_Timings));
+	beforeClock = clock();
+	if (!readLandscape(&sLandscape, pBaseParams->filePropFull, pBaseParams->fileRelInf, pBaseParams->fileRelPri, pBaseParams->fileRelSus, pBaseParams->cellThresh, pBaseParams->coarsen, pBaseParams->cellOrder, pBaseParams->outDir))
 	{
-		left = 0;
-		right = pDispersal->numProbs-1;
-		while((right-left) > 1)
+		return 0;
+	}
+	sTimings.readLandscape = secondsSince(beforeClock);
+	beforeClock = clock();
+	if (!setupPrimary(&sPriInf, &sLandscape, pBaseParams->ratePriInf))
+	{
+		return 0;
+	}
+	sTimings.setupPrimary = secondsSince(beforeClock);
+	beforeClock = clock();
+	if (!setupEpidemic(&sEpidemic, &sLandscape, pBaseParams->dispScale))
+	{
+		return 0;
+	}
+	sTimings.setupEpidemic = secondsSince(beforeClock);
+	/*
+		Parameters for each set are read by putting the line from the sweep file in front of the actual command line
+	*/
+	aSweepArgv = malloc(sizeof(char*) * (argc + 1));
+	if (!aSweepArgv)
+	{
+		fprintf(stderr, "out of memory\n");
+		return 0;
+	}
+	aSweepArgv[0] = argv[0];
+	aSweepArgv[1] = szLine;
+	for (i = 1; i < argc; i++)
+	{
+		aSweepArgv[i + 1] = argv[i];
+	}
+	aKernels = NULL;
+	numKernels = 0;
+	numSets = 0;
+	retVal = 1;
+	while (retVal && fgets(szLine, _MAX_STATIC_BUFF_LEN, fSweep))
+	{
+		if ((pPtr = strpbrk(szLine, "\r\n")) != NULL)
 		{
-			mid=(left+right)/2;
-			if(pDispersal->aProbs[mid] < randDbl)
-			{
-				left = mid;
-			}
-			else
-			{
-				right = mid;
-			}
+			*pPtr = '\0';
 		}
-		/* right is the cell to challenge*/;
-		posToGrid(right, pLandscape->numCols, &xOffset, &yOffset);
-		/* but need to account for only storing one quarter of the kernel */
-		switch(cellQuad)
+		pPtr = szLine + strspn(szLine, " \t");
+		if (*pPtr == '\0' || *pPtr == '#')
 		{
-		case 0:
-			/* do nothing */
-			break;
-		case 1:
-			xOffset *= -1;
-			break;
-		case 2:
-			xOffset *= -1;
-			yOffset *= -1;
-			break;
-		case 3:
-			yOffset *= -1;
+			continue;
+		}
+		fprintf(stdout, "sweep set %d: %s\n", numSets, szLine);
+		if (!readParams(&sParams, argc + 1, aSweepArgv, numSets))
+		{
+			retVal = 0;
 			break;
-		default:
-			fprintf(stderr, "should never get here...\n");
+		}
+		if (strcmp(sParams.filePropFull, pBaseParams->filePropFull) || strcmp(sParams.fileRelInf, pBaseParams->fileRelInf) || strcmp(sParams.fileRelSus, pBaseParams->fileRelSus) || strcmp(sParams.fileRelPri, pBaseParams->fileRelPri) || sParams.cellThresh != pBaseParams->cellThresh || sParams.coarsen != pBaseParams->coarsen)
+		{
+			fprintf(stderr, "the landscape cannot be changed within a sweep (set %d)\n", numSets);
+			retVal = 0;
 			break;
 		}
-		x = pLandscape->aCells[cellInfectFrom].xPos + xOffset;
-		if(x >= 0 && x < pLandscape->numCols)
+		coarsenParams(&sParams);
+		/* find (or set up) the kernel for this dispersal scale */
+		pKernel = NULL;
+		for (i = 0; i < numKernels; i++)
 		{
-			y = pLandscape->aCells[cellInfectFrom].yPos + yOffset;
-			if(y >=0 && y < pLandscape->numRows)
+			if (aKernels[i].dispScale == sParams.dispScale)
+			{
+				pKernel = &aKernels[i];
+			}
+		}
+		beforeClock = clock();
+		if (!pKernel)
+		{
+			pTmp = realloc(aKernels, sizeof(t_KernelCache) * (numKernels + 1));
+			if (!pTmp)
 			{
-				posToChallenge = gridToPos(x, y, pLandscape->numCols);
-				cellToChallenge = pLandscape->aCellLookup[posToChallenge];
-				if(cellToChallenge == _EMPTY_CELL)
-				{
-#ifdef _DEBUG_PRINT_MSG
-					fprintf(stdout, "\t\t\t\tno hosts\n");
-#endif
-				}
+				fprintf(stderr, "out of memory\n");
+				retVal = 0;
+				break;
 			}
-			else
+			aKernels = pTmp;
+			pKernel = &aKernels[numKernels++];
+			memset(pKernel, 0, sizeof(t_KernelCache));
+			pKernel->dispScale = sParams.dispScale;
+			pKernel->rateSecFactor = 1.0;
+			if (!setupDispersal(&pKernel->sDispersal, &sLandscape, sParams.dispScale, &pKernel->rateSecFactor))
 			{
-#ifdef _DEBUG_PRINT_MSG
-				fprintf(stdout, "\t\t\t\toff landscape\n");
-#endif
+				retVal = 0;
+				break;
 			}
 		}
-		else
+		sParams.rateSecInf *= pKernel->rateSecFactor;
+		pFFT = NULL;
+		if (sParams.engine == _ENGINE_FFT || sParams.engine == _ENGINE_MEANFIELD)
 		{
-#ifdef _DEBUG_PRINT_MSG
-			fprintf(stdout, "\t\t\t\toff landscape\n");
-#endif
+			if (!pKernel->bFFT)
+			{
+				if (!setupFFTKernel(&pKernel->sFFT, &pKernel->sDispersal, &sLandscape))
+				{
+					retVal = 0;
+					break;
+				}
+				pKernel->bFFT = 1;
+			}
+			pFFT = &pKernel->sFFT;
 		}
-	}
-	else
-	{
-		if(randDbl > pDispersal->onLandscape)
+		sTimings.setupDispersal = secondsSince(beforeClock);
+		sPriInf.ratePri = sParams.ratePriInf;
+		sPriInf.nextT = _UNDEF_TIME;
+		writeActiveLandscape(&sLandscape, sParams.outDir);
+		seedRandom(sParams.seed);
+		beforeClock = clock();
+		if (sParams.engine == _ENGINE_MEANFIELD)
 		{
-#ifdef _DEBUG_PRINT_MSG
-			fprintf(stdout, "\t\t\t\toff landscape\n");
-#endif
+			memset(&sTotalStats, 0, sizeof(t_RunStats));
+			retVal = runMeanField(&sParams, &sLandscape, &sPriInf, pFFT);
 		}
 		else
 		{
-#ifdef _DEBUG_PRINT_MSG
-			fprintf(stdout, "\t\t\t\twithin cell\n");
-#endif
+			retVal = runEpidemics(&sParams, &sLandscape, &sPriInf, &pKernel->sDispersal, pFFT, &sEpidemic, &sTotalStats);
 		}
+		sTimings.runEpidemics = secondsSince(beforeClock);
+		fprintf(stdout, "%d iterations in %.3f seconds\n", sParams.numIts, sTimings.runEpidemics);
+		writeBenchmark(&sParams, &sLandscape, &sTimings, &sTotalStats);
+		fprintf(fIndex, "%d %s %s\n", numSets, sParams.outDir, szLine);
+		numSets++;
+		sTimings.readLandscape = 0.0;
+		sTimings.setupPrimary = 0.0;
+		sTimings.setupEpidemic = 0.0;
 	}
-	return cellToChallenge;
+	fclose(fIndex);
+	fclose(fSweep);
+	free(aSweepArgv);
+	fprintf(stdout, "%d parameter sets run from %s (%d distinct kernels)\n", numSets, pBaseParams->sweepFile, numKernels);
+	return retVal;
 }
 
 /*
-	Peek at minimum element in the priority queue to find time of next secondary infection
+	Move a file, replacing any existing file of the same name
 */
-double getNextPossSecTime(t_Epidemic *pEpidemic, t_Landscape *pLandscape, double tPrimary)
+int moveFile(char *szFrom, char *szTo)
 {
-	if(pEpidemic->queueLen > 0)
+	remove(szTo);
+	if (rename(szFrom, szTo) != 0)
 	{
-		/* Peek at min element of queue (do not remove it) */
-		return pLandscape->aCells[pEpidemic->aQueueCells[0]].tNext;
+		fprintf(stderr, "couldn't move %s to %s\n", szFrom, szTo);
+		return 0;
 	}
-	/*
-		If nothing in the queue (i.e. no primary infection has happened) make sure
-		the putative secondary comes after the next primary (and so won't be selected anyway)
-	*/
-	return tPrimary + 1.0;
+	return 1;
 }
 
 /*
-	Retrieve element from the priority queue
+	Check two paramsOut.txt files match, other than the shard that was run
 */
-int getCellInfectFrom(t_Epidemic *pEpidemic, t_Landscape *pLandscape)
+int sameShardParams(char *szFile1, char *szFile2)
 {
-	int minCell;
+	FILE	*fp1,*fp2;
+	char	szLine1[_MAX_STATIC_BUFF_LEN],szLine2[_MAX_STATIC_BUFF_LEN];
+	int		bRet,bMore1,bMore2;
 
-	if(pEpidemic->queueLen > 0)
+	bRet = 0;
+	fp1 = fopen(szFile1, "rb");
+	fp2 = fopen(szFile2, "rb");
+	if (fp1 && fp2)
 	{
-		minCell = pEpidemic->aQueueCells[0];
-		removeMinElement(pEpidemic, pLandscape);
-		return minCell;
+		bRet = 1;
+		do
+		{
+			do
+			{
+				bMore1 = (fgets(szLine1, _MAX_STATIC_BUFF_LEN, fp1) != NULL);
+			} while (bMore1 && strncmp(szLine1, "pParams->shard=", 15) == 0);
+			do
+			{
+				bMore2 = (fgets(szLine2, _MAX_STATIC_BUFF_LEN, fp2) != NULL);
+			} while (bMore2 && strncmp(szLine2, "pParams->shard=", 15) == 0);
+			if (bMore1 != bMore2 || (bMore1 && strcmp(szLine1, szLine2) != 0))
+			{
+				bRet = 0;
+			}
+		} while (bRet && bMore1);
 	}
-	return _EMPTY_CELL;
+	if (fp1)
+	{
+		fclose(fp1);
+	}
+	if (fp2)
+	{
+		fclose(fp2);
+	}
+	return bRet;
 }
 
 /*
-	Find the time of the next secondary infection from a given cell
+	Merge the surveillance.txt of each shard (in order of iteration, as an unsharded ensemble would have it), and summarise it
 */
-void findNextSecondary(t_Landscape *pLandscape, int thisCell, double thisTime, double rateSecInf, t_Epidemic *pEpidemic, t_RunStats *pRunStats, double withinCellMin, double withinCellBulkUp, int trueMinFlag)
+int mergeSurveillance(t_Params *pParams, int numIts)
 {
-	double	randDbl,rateSec;
-	double	deltaMin;			/* delay before next infection if cell were full of infection */
-	double	tSinceInf;			/* time since this cell was infected */
-	double	deltaReal;			/* delay before next infection accounting for logistic bulk up */
-	double	logisticJ;			/* J= (1-withinCellMin)/withinCellMin */
-	double  thisWCM;
+	char	szFile[_MAX_STATIC_BUFF_LEN];
+	char	*aszLines;
+	int		*abPending;
+	int		i,k,bRet;
+	FILE	**afIn,*fOut;
 
-	pRunStats->numFindNextSecondary++;
-	randDbl = uniformRandom();
-	/* find maximum rate of infection from this cell */
-	rateSec = pLandscape->aCells[thisCell].propFull*pLandscape->aCells[thisCell].relInf*rateSecInf;
-	if(rateSec > 0)
+	afIn = (FILE**)calloc(pParams->mergeShards, sizeof(FILE*));
+	aszLines = (char*)malloc(sizeof(char) * _MAX_STATIC_BUFF_LEN * pParams->mergeShards);
+	abPending = (int*)calloc(pParams->mergeShards, sizeof(int));
+	sprintf(szFile, "%s%csurveillance.txt", pParams->outStub, C_DIR_DELIMITER);
+	fOut = fopen(szFile, "wb");
+	bRet = (afIn && aszLines && abPending && fOut);
+	for (k = 0; bRet && k < pParams->mergeShards; k++)
+	{
+		sprintf(szFile, "%s%c%s_shard%d%csurveillance.txt", pParams->outStub, C_DIR_DELIMITER, pParams->outStub, k, C_DIR_DELIMITER);
+		afIn[k] = fopen(szFile, "rb");
+		if (!afIn[k])
+		{
+			fprintf(stderr, "shard %d has no %s\n", k, szFile);
+			bRet = 0;
+		}
+	}
+	/* each shard has the lines for its iterations in order, so take them from the shards in turn */
+	for (i = 0; bRet && i < numIts; i++)
 	{
-		/* lengthen length of time until the infection to account for infectivity bulking up logistically */
-		deltaMin = -log(randDbl)/rateSec;
-		tSinceInf = thisTime - pLandscape->aCells[thisCell].tInf;
-		if (trueMinFlag)
+		k = i % pParams->mergeShards;
+		for (;;)
 		{
-			if (withinCellMin >= pLandscape->aCells[thisCell].propFull)
+			if (!abPending[k])
 			{
-				/* make it fully infected - i.e. incidence = pLandscape->aCells[thisCell].propFull - immediately */
-				logisticJ = 0;
+				abPending[k] = (fgets(&aszLines[k * _MAX_STATIC_BUFF_LEN], _MAX_STATIC_BUFF_LEN, afIn[k]) != NULL);
 			}
-			else
+			if (!abPending[k] || atoi(&aszLines[k * _MAX_STATIC_BUFF_LEN]) != i)
 			{
-				/* figure out the correct fraction initially infected to make the initial incidence = withinCellMin */
-				thisWCM = withinCellMin / pLandscape->aCells[thisCell].propFull;
-				logisticJ = (1.0 - thisWCM) / thisWCM;
+				break;
 			}
+			fputs(&aszLines[k * _MAX_STATIC_BUFF_LEN], fOut);
+			abPending[k] = 0;
 		}
-		else
+	}
+	for (k = 0; afIn && k < pParams->mergeShards; k++)
+	{
+		if (afIn[k])
 		{
-			logisticJ = (1.0 - withinCellMin) / withinCellMin;
+			fclose(afIn[k]);
 		}
-		deltaReal = (1.0/withinCellBulkUp)*(log(exp(withinCellBulkUp*(tSinceInf+deltaMin)) + logisticJ*(exp(withinCellBulkUp*deltaMin)-1.0))) - tSinceInf;
-		pLandscape->aCells[thisCell].tNext = thisTime + deltaReal;
-		/* Add this entry to queue */
-		insertElement(thisCell, pEpidemic, pLandscape);
 	}
+	if (fOut)
+	{
+		fclose(fOut);
+	}
+	free(afIn);
+	free(aszLines);
+	free(abPending);
+	if (!bRet)
+	{
+		fprintf(stderr, "couldn't merge surveillance.txt from the shards\n");
+		return 0;
+	}
+	return writeSurveillanceSummary(pParams->outStub);
 }
 
 /*
-	Book-keeping to handle a cell newly becoming infected
-*/
-void infectCell(t_Landscape *pLandscape, int thisCell, double thisTime, double rateSecInf, t_Epidemic *pEpidemic, int infType, int infBy, t_RunStats *pRunStats, double withinCellMin, double withinCellBulkUp, int trueMinFlag)
-{
-	/* set the time of infection */
-	pLandscape->aCells[thisCell].tInf = thisTime;
-	pLandscape->aCells[thisCell].infType = infType;
-	pLandscape->aCells[thisCell].infBy = infBy;
-	/* add to the list of all infections for later dumping */
-	pEpidemic->aInfCells[pEpidemic->totalInf] = thisCell;
-	pEpidemic->totalInf++;
-	/* find time of next (potential) secondary infection from this cell */
-	findNextSecondary(pLandscape, thisCell, thisTime, rateSecInf, pEpidemic, pRunStats, withinCellMin, withinCellBulkUp, trueMinFlag);
-}
-
-/*
-	Find the incidence in a given cell based on the current time and its time of infection
+	Read one of the aggregate rasters of a shard into aRaster (with bHeader, the header is taken from it and pAgg allocated
+	with a cell for each position that has data; otherwise it must be the same size as the rasters already read)
 */
-double getIncidence(t_Landscape *pLandscape, t_Epidemic *pEpidemic, double thisTime, int hostID, double withinCellMin, double withinCellBulkUp, int trueMinFlag)
+int readAggregateRaster(char *szFile, t_Aggregate *pAgg, int bHeader, double **paRaster)
 {
-	double tSinceInf,logisticJ,thisIncidence,thisWCM;
+	char	szBuffer[_MAX_STATIC_BUFF_LEN];
+	char	*pPtr;
+	int		numRows,numCols,pos,c,bRet;
+	FILE	*fIn;
 
-	tSinceInf = thisTime - pLandscape->aCells[hostID].tInf;
-	if (tSinceInf >= 0.0)	/* getIncidence() can be called before a cell has become infected...if so ignore */
+	fIn = fopen(szFile, "rb");
+	if (!fIn)
+	{
+		fprintf(stderr, "couldn't read %s\n", szFile);
+		return 0;
+	}
+	numRows = numCols = 0;
+	bRet = 1;
+	for (c = 0; bRet && c < _GIS_HEADER_LENGTH; c++)
 	{
-		if (trueMinFlag)
+		bRet = (fgets(szBuffer, _MAX_STATIC_BUFF_LEN, fIn) != NULL);
+		pPtr = strpbrk(szBuffer, _GIS_NEWLINES);
+		if (pPtr)
 		{
-			if (withinCellMin >= pLandscape->aCells[hostID].propFull)
-			{
-				logisticJ = 0.0;
-			}
-			else
-			{
-				thisWCM = withinCellMin / pLandscape->aCells[hostID].propFull;
-				logisticJ = (1.0 - thisWCM) / thisWCM;
-			}
+			pPtr[0] = '\0';
 		}
-		else
+		if (strncmp(szBuffer, "ncols", strlen("ncols")) == 0)
 		{
-			logisticJ = (1.0 - withinCellMin) / withinCellMin;
+			pPtr = strpbrk(szBuffer, _GIS_WHITESPACE);
+			numCols = pPtr ? atoi(pPtr) : 0;
+		}
+		if (strncmp(szBuffer, "nrows", strlen("nrows")) == 0)
+		{
+			pPtr = strpbrk(szBuffer, _GIS_WHITESPACE);
+			numRows = pPtr ? atoi(pPtr) : 0;
+		}
+		if (bHeader)
+		{
+			strcpy(pAgg->aszGISHeader[c], szBuffer);
 		}
-		thisIncidence = pLandscape->aCells[hostID].propFull / (1 + logisticJ * exp(-withinCellBulkUp*tSinceInf));
 	}
-	else
+	if (bRet && bHeader)
 	{
-		thisIncidence = 0.0;
+		pAgg->numRows = numRows;
+		pAgg->numCols = numCols;
+		*paRaster = (double*)malloc(sizeof(double) * numRows * numCols);
+		bRet = (*paRaster != NULL);
 	}
-	return thisIncidence;
+	bRet = bRet && numRows > 0 && numRows == pAgg->numRows && numCols == pAgg->numCols;
+	for (pos = 0; bRet && pos < numRows * numCols; pos++)
+	{
+		bRet = (fscanf(fIn, "%lf", &(*paRaster)[pos]) == 1);
+	}
+	fclose(fIn);
+	if (bRet && bHeader)
+	{
+		c = 0;
+		for (pos = 0; pos < numRows * numCols; pos++)
+		{
+			c += ((*paRaster)[pos] != _GIS_NODATA_VALUE);
+		}
+		bRet = allocAggregate(pAgg, c);
+		c = 0;
+		for (pos = 0; bRet && pos < numRows * numCols; pos++)
+		{
+			if ((*paRaster)[pos] != _GIS_NODATA_VALUE)
+			{
+				pAgg->aPos[c++] = pos;
+			}
+		}
+	}
+	if (!bRet)
+	{
+		fprintf(stderr, "couldn't parse %s\n", szFile);
+	}
+	return bRet;
 }
 
 /*
-	Main routine to run an ensemble of epidemics and dump the results
+	Combine the aggregate rasters of the shards (the totals are rebuilt from the means in each shard, and its total weight)
 */
-int runEpidemics(t_Params *pParams, t_Landscape *pLandscape, t_PriInf *pPriInf, t_Dispersal *pDispersal, t_Epidemic *pEpidemic)
+int mergeAggregate(t_Params *pParams)
 {
-	int			doneInf,firstInf,continueRunning,j,i,k,retVal,cellToChallenge,cellInfectFrom,thisReason;
-	double		thisTime,nextPri,nextSec,randDbl,infectProb,nextReport,trueIncidence,maxFullIncidence,thisFinalIncidence;
-	char		outFile[_MAX_STATIC_BUFF_LEN],dpcFile[_MAX_STATIC_BUFF_LEN];
-	FILE		*fOut,*fEnd,*fSingleEnd,*fDPC;
-	t_RunStats	runStats;
+	char	szShardDir[_MAX_STATIC_BUFF_LEN],szFile[_MAX_STATIC_BUFF_LEN];
+	double	*aaRaster[_NUM_AGGREGATES];
+	double	weight,infWeight,meanTime;
+	int		k,g,c,pos,numRuns,bRet;
+	t_Aggregate	sAggregate;
+	FILE	*fIn;
 
-	trueIncidence = 0.0;
-	fprintf(stdout, "runEpidemics()\n");
-	retVal = 1;
-	sprintf(outFile, "%s%cendTimes.txt", pParams->outStub, C_DIR_DELIMITER);
-	fEnd = fopen(outFile, "wb");
-	if(!fEnd)
-	{
-		fprintf(stderr, "couldn't open endTimes file for writing\n");
-		return 0;
-	}
-	for(i=0;i<pParams->numIts;i++)
+	memset(&sAggregate, 0, sizeof(t_Aggregate));
+	memset(aaRaster, 0, sizeof(aaRaster));
+	bRet = 1;
+	for (k = 0; bRet && k < pParams->mergeShards; k++)
 	{
-		thisReason = 0;		/* will be set to 1 if simulation stops because hit threshold incidence */
-		sprintf(dpcFile, "%s%c%s_dpc_%d.txt", pParams->outStub, C_DIR_DELIMITER, pParams->outStub, i);
-		fDPC = fopen(dpcFile, "wb");
-		if(fDPC)
+		sprintf(szShardDir, "%s%c%s_shard%d", pParams->outStub, C_DIR_DELIMITER, pParams->outStub, k);
+		sprintf(szFile, "%s%caggregate.txt", szShardDir, C_DIR_DELIMITER);
+		fIn = fopen(szFile, "rb");
+		bRet = (fIn && fscanf(fIn, "%d %lf", &numRuns, &weight) == 2);
+		if (fIn)
 		{
-			fprintf(stdout, "\titeration %d\n", i);
-			memset(&runStats, 0, sizeof(t_RunStats));
-			thisTime = 0.0;
-			setNextPossPriTime(pPriInf, thisTime);
-			nextReport = 0.0;
-			if (pParams->ratePriInf == 0.0)
-			{
-				firstInf = (int)((double)pLandscape->numCells*uniformRandom());
-				infectCell(pLandscape, firstInf, 0.0, pParams->rateSecInf, pEpidemic, _PRI_INF_TYPE, _EMPTY_CELL, &runStats, pParams->withinCellMin, pParams->withinCellBulkUp, pParams->trueMinFlag);
-				fprintf(stdout, "infecting %d at t=0.0\n", firstInf);
-			}
-			continueRunning = 1;
-			maxFullIncidence = pParams->maxIncidence * pLandscape->totalFull;
-			while (retVal && continueRunning)
-			{
-				doneInf = 0;
-				while (nextReport <= thisTime)
-				{
-					trueIncidence = 0.0;
-					for (j = 0; j < pEpidemic->totalInf; j++)
-					{
-						trueIncidence += getIncidence(pLandscape, pEpidemic, nextReport, pEpidemic->aInfCells[j], pParams->withinCellMin, pParams->withinCellBulkUp, pParams->trueMinFlag);
-					}
-					fprintf(stdout, "\t\tt=%.4f (infNum=%d propInf=%.4f trueInc=%.4f)\n", nextReport, pEpidemic->totalInf, pEpidemic->totalInf / (double)pLandscape->numCells, trueIncidence / pLandscape->totalFull);
-					fprintf(fDPC, "%.4f %d %.4f %.4f\n", nextReport, pEpidemic->totalInf, pEpidemic->totalInf / (double)pLandscape->numCells, trueIncidence / pLandscape->totalFull);
-					nextReport += pParams->reportTime;
-				}
-				nextPri = getNextPossPriTime(pPriInf);
-				nextSec = getNextPossSecTime(pEpidemic, pLandscape, nextPri);
-				if (nextPri < nextSec)
-				{
-					/* attempt a primary infection */
-					if (nextPri < pParams->maxTime)
-					{
-						/* update time */
-						thisTime = nextPri;
-						/* find the cell to challenge */
-						cellToChallenge = whichCellPrimary(pPriInf, pLandscape->numCells);
-#ifdef _DEBUG_PRINT_MSG
-						fprintf(stdout, "\t\t(primary) challenging %d at %.4f\n", cellToChallenge, thisTime);
-#endif
-						/*
-							Note that have built relSus and area into the rate of primary infection
-							for each cell, so just need to check whether it is already infected or not
-						*/
-						if (pLandscape->aCells[cellToChallenge].tInf >= 0.0)					/* already infected */
-						{
-#ifdef _DEBUG_PRINT_MSG
-							fprintf(stdout, "\t\t\talready infected\n");
-#endif
-						}
-						else
-						{
-							/* infect */
-#ifdef _DEBUG_PRINT_MSG
-							fprintf(stdout, "\t\t\tinfecting\n");
-#endif
-							infectCell(pLandscape, cellToChallenge, thisTime, pParams->rateSecInf, pEpidemic, _PRI_INF_TYPE, _EMPTY_CELL, &runStats, pParams->withinCellMin, pParams->withinCellBulkUp, pParams->trueMinFlag);
-							doneInf = 1;
-						}
-						setNextPossPriTime(pPriInf, thisTime);
-					}
-					else
-					{
-						thisTime = pParams->maxTime;
-					}
-				}
-				else
-				{
-					/* attempt a secondary infection */
-					if (nextSec < pParams->maxTime)
-					{
-						thisTime = nextSec;
-						/* find a cell to challenge, and challenge it if makes sense to */
-						cellInfectFrom = getCellInfectFrom(pEpidemic, pLandscape);
-#ifdef _DEBUG_PRINT_MSG
-						fprintf(stdout, "\t\t(secondary) challenging from %d at %.4f\n", cellInfectFrom, thisTime);
-#endif
-						if (cellInfectFrom != _EMPTY_CELL)
-						{
-							runStats.numSecondaryAttempts++;
-							cellToChallenge = whichCellSecondary(pDispersal, pLandscape, cellInfectFrom, pParams);
-#ifdef _DEBUG_PRINT_MSG
-							fprintf(stdout, "\t\t\tchallenging %d\n", cellToChallenge);
-#endif
-							if (cellToChallenge != _EMPTY_CELL)
-							{
-								runStats.numNonEmpty++;
-								if (pLandscape->aCells[cellToChallenge].tInf >= 0.0)					/* already infected */
-								{
-#ifdef _DEBUG_PRINT_MSG
-									fprintf(stdout, "\t\t\talready infected\n");
-#endif
-								}
-								else
-								{
-									runStats.numNonInfected++;
-									/* possibly infect, depending on relative susceptibility */
-									infectProb = pLandscape->aCells[cellToChallenge].relSus*pLandscape->aCells[cellToChallenge].propFull;
-#ifdef _DEBUG_PRINT_MSG
-									fprintf(stdout, "\t\t\tp(infect)=%f\n", infectProb);
-#endif
-									randDbl = uniformRandom();
-									if (randDbl < infectProb)
-									{
-										runStats.numSuccessful++;
-#ifdef _DEBUG_PRINT_MSG
-										fprintf(stdout, "\t\t\t\tinfecting\n");
-#endif
-										infectCell(pLandscape, cellToChallenge, thisTime, pParams->rateSecInf, pEpidemic, _SEC_INF_TYPE, cellInfectFrom, &runStats, pParams->withinCellMin, pParams->withinCellBulkUp, pParams->trueMinFlag);
-										doneInf = 1;
-									}
-									else
-									{
-#ifdef _DEBUG_PRINT_MSG
-										fprintf(stdout, "\t\t\t\tfailed to infect\n");
-#endif
-									}
-								}
-							}
-							/* need to update the source cell's time of next secondary infection too */
-							findNextSecondary(pLandscape, cellInfectFrom, thisTime, pParams->rateSecInf, pEpidemic, &runStats, pParams->withinCellMin, pParams->withinCellBulkUp, pParams->trueMinFlag);
-						}
-						else
-						{
-							fprintf(stderr, "\tsecondary infection from invalid cell...\n");
-							retVal = 0;
-						}
-					}
-					else
-					{
-						thisTime = pParams->maxTime;
-					}
-				}
-				if (doneInf)
-				{
-					trueIncidence = 0.0;
-					for (j = 0; j < pEpidemic->totalInf; j++)
-					{
-						trueIncidence += getIncidence(pLandscape, pEpidemic, thisTime, pEpidemic->aInfCells[j], pParams->withinCellMin, pParams->withinCellBulkUp, pParams->trueMinFlag);
-					}
-				}
-#if 0
-				if (maxInfected > 0)
-				{
-					if (pEpidemic->totalInf >= maxInfected)
-					{
-						continueRunning = 0;
-					}
-				}
-#endif
-				if (pParams->maxIncidence > 0.0)
-				{
-					if (trueIncidence >= maxFullIncidence)
-					{
-						continueRunning = 0;
-						thisReason = 1;
-					}
-				}
-				if (thisTime >= pParams->maxTime)
-				{
-					continueRunning = 0;
-				}
-			}
-#if _CHECK_HEAP
-			{
-				FILE *fpTmp = fopen("checkHeap.txt", "wb");
-
-				if (fpTmp)
-				{
-					checkHeap(fpTmp, pEpidemic, pLandscape);
-					fclose(fpTmp);
-				}
-			}
-#endif
-			/* Do a final round of printing to the screen */
+			fclose(fIn);
+		}
+		if (!bRet)
+		{
+			fprintf(stderr, "shard %d has no %s\n", k, szFile);
+		}
+		for (g = 0; bRet && g < _NUM_AGGREGATES; g++)
+		{
+			sprintf(szFile, "%s%caggregate_%s.asc", szShardDir, C_DIR_DELIMITER, g_aAggregateNames[g]);
+			if (k == 0 && g > 0)
 			{
-				trueIncidence = 0.0;
-				for (j = 0; j < pEpidemic->totalInf; j++)
-				{
-					trueIncidence += getIncidence(pLandscape, pEpidemic, thisTime, pEpidemic->aInfCells[j], pParams->withinCellMin, pParams->withinCellBulkUp, pParams->trueMinFlag);
-				}
-				fprintf(stdout, "\t\tt=%.4f (infNum=%d propInf=%.4f trueInc=%.4f)\n", thisTime, pEpidemic->totalInf, pEpidemic->totalInf / (double)pLandscape->numCells, trueIncidence / pLandscape->totalFull);
-				fprintf(fDPC, "%.4f %d %.4f %.4f\n", thisTime, pEpidemic->totalInf, pEpidemic->totalInf / (double)pLandscape->numCells, trueIncidence / pLandscape->totalFull);
+				aaRaster[g] = (double*)malloc(sizeof(double) * sAggregate.numRows * sAggregate.numCols);
+				bRet = (aaRaster[g] != NULL);
 			}
-			fprintf(fEnd, "%f\n", thisTime);
-			sprintf(outFile, "%s%cendTime_%d.txt", pParams->outStub, C_DIR_DELIMITER, i);
-			fSingleEnd = fopen(outFile, "wb");
-			if (!fSingleEnd)
+			bRet = bRet && readAggregateRaster(szFile, &sAggregate, k == 0 && g == 0, &aaRaster[g]);
+		}
+		for (c = 0; bRet && c < sAggregate.numCells; c++)
+		{
+			pos = sAggregate.aPos[c];
+			if (aaRaster[_AGGREGATE_PROB_INF][pos] == _GIS_NODATA_VALUE)
 			{
-				fprintf(stderr, "couldn't open endTimes file for writing\n");
-				return 0;
+				fprintf(stderr, "shard %d was run on a different landscape to shard 0\n", k);
+				bRet = 0;
+				break;
 			}
-			fprintf(fSingleEnd, "%f\n", thisTime);
-			fclose(fSingleEnd);
-
-			/*
-				Dump reason simulation stopped to a file
-			*/
-			sprintf(outFile, "%s%cendReason_%d.txt", pParams->outStub, C_DIR_DELIMITER, i);
-			fSingleEnd = fopen(outFile, "wb");
-			if (!fSingleEnd)
+			infWeight = aaRaster[_AGGREGATE_PROB_INF][pos] * weight;
+			sAggregate.aInfWeight[c] += infWeight;
+			sAggregate.aSumFinal[c] += aaRaster[_AGGREGATE_MEAN_FINAL_INC][pos] * weight;
+			if (infWeight > 0.0)
 			{
-				fprintf(stderr, "couldn't open endReason file for writing\n");
-				return 0;
+				meanTime = aaRaster[_AGGREGATE_MEAN_TIME_INF][pos];
+				sAggregate.aSumTime[c] += meanTime * infWeight;
+				sAggregate.aSumTimeSq[c] += (aaRaster[_AGGREGATE_SD_TIME_INF][pos] * aaRaster[_AGGREGATE_SD_TIME_INF][pos] + meanTime * meanTime) * infWeight;
+				sAggregate.aPriWeight[c] += aaRaster[_AGGREGATE_PROP_PRIMARY][pos] * infWeight;
 			}
-			fprintf(fSingleEnd, "%d\n", thisReason);
-			fclose(fSingleEnd);
+		}
+		sAggregate.numRuns += numRuns;
+		sAggregate.totalWeight += weight;
+	}
+	bRet = bRet && writeAggregate(&sAggregate, pParams->outStub);
+	for (g = 0; g < _NUM_AGGREGATES; g++)
+	{
+		free(aaRaster[g]);
+	}
+	freeAggregate(&sAggregate);
+	if (!bRet)
+	{
+		fprintf(stderr, "couldn't merge the aggregate rasters from the shards\n");
+	}
+	return bRet;
+}
 
+/*
+	Merge the output of an ensemble run as mergeShards separate shards (shard=k/n) into the outStub directory, so it looks
+	exactly like an ensemble run in one go (and so can be read by simulatedAnnealing)
+		- shard k must have finished (written <outStub>/<outStub>_shard<k>/shard.txt), with the same parameters as shard 0
+		- every iteration's files must be present before anything is moved (including weight_<i>.txt, if shard 0 wrote
+			one for iteration 0, i.e. the shards used introStrata)
+		- endTimes.txt is rebuilt in order of iteration, and lastRunNumber.txt written
+		- with surveyFile, surveillance.txt is merged in the same way (and summarised)
+		- the aggregate rasters are combined (see writeAggregate())
+*/
+int mergeShards(t_Params *pParams)
+{
+	char	szShardDir[_MAX_STATIC_BUFF_LEN],szFile[_MAX_STATIC_BUFF_LEN],szFrom[_MAX_STATIC_BUFF_LEN],szTo[_MAX_STATIC_BUFF_LEN];
+	char	szFirstParams[_MAX_STATIC_BUFF_LEN],szBuffer[_MAX_STATIC_BUFF_LEN];
+	char	*aszRunFiles[6] = {"endTime_%d.txt", "endReason_%d.txt", "thresholds_%d.txt", "%s_%d.txt", "%s_dpc_%d.txt", "weight_%d.txt"};
+	int		k,i,j,numIts,thisShard,thisNumShards,thisNumIts,bPass,numRunFiles;
+	FILE	*fp,*fEnd;
 
-			/*
-				Dump all the information
-			*/
-			sprintf(outFile, "%s%c%s_%d.txt", pParams->outStub, C_DIR_DELIMITER, pParams->outStub, i);
-			fOut = fopen(outFile, "wb");
-			if (fOut)
+	fprintf(stdout, "mergeShards()\n");
+	numIts = -1;
+	for (k = 0; k < pParams->mergeShards; k++)
+	{
+		sprintf(szShardDir, "%s%c%s_shard%d", pParams->outStub, C_DIR_DELIMITER, pParams->outStub, k);
+		sprintf(szFile, "%s%cshard.txt", szShardDir, C_DIR_DELIMITER);
+		fp = fopen(szFile, "rb");
+		if (!fp)
+		{
+			fprintf(stderr, "shard %d is missing or did not finish (no %s)\n", k, szFile);
+			return 0;
+		}
+		if (fscanf(fp, "%d %d %d", &thisShard, &thisNumShards, &thisNumIts) != 3 || thisShard != k || thisNumShards != pParams->mergeShards)
+		{
+			fprintf(stderr, "%s is not from shard %d/%d\n", szFile, k, pParams->mergeShards);
+			fclose(fp);
+			return 0;
+		}
+		fclose(fp);
+		sprintf(szFile, "%s%cparamsOut.txt", szShardDir, C_DIR_DELIMITER);
+		if (k == 0)
+		{
+			numIts = thisNumIts;
+			strcpy(szFirstParams, szFile);
+		}
+		else if (thisNumIts != numIts || !sameShardParams(szFirstParams, szFile))
+		{
+			fprintf(stderr, "shard %d was run with different parameters to shard 0 (compare %s and %s)\n", k, szFirstParams, szFile);
+			return 0;
+		}
+	}
+	fprintf(stdout, "\t%d shards of %d iterations found\n", pParams->mergeShards, numIts);
+	/* runs are weighted with introStrata (the only weighting which can be sharded), so then the weights are needed too */
+	numRunFiles = 5;
+	sprintf(szFile, "%s%c%s_shard0%cweight_0.txt", pParams->outStub, C_DIR_DELIMITER, pParams->outStub, C_DIR_DELIMITER);
+	fp = fopen(szFile, "rb");
+	if (fp)
+	{
+		fclose(fp);
+		numRunFiles = 6;
+		fprintf(stdout, "	merging the weights of the runs\n");
+	}
+	/* check every file is there on a first pass, and only move them on the second */
+	for (bPass = 0; bPass < 2; bPass++)
+	{
+		for (i = 0; i < numIts; i++)
+		{
+			sprintf(szShardDir, "%s%c%s_shard%d", pParams->outStub, C_DIR_DELIMITER, pParams->outStub, i % pParams->mergeShards);
+			for (j = 0; j < numRunFiles; j++)
 			{
-				for (j = 0; j < pEpidemic->totalInf; j++)
+				if (j < 3 || j == 5)
 				{
-					thisFinalIncidence = getIncidence(pLandscape, pEpidemic, thisTime, pEpidemic->aInfCells[j], pParams->withinCellMin, pParams->withinCellBulkUp, pParams->trueMinFlag)/pLandscape->aCells[pEpidemic->aInfCells[j]].propFull;
-					trueIncidence = 0.0;
-					for (k = 0; k <= j; k++)
+					sprintf(szFile, aszRunFiles[j], i);
+				}
+				else
+				{
+					sprintf(szFile, aszRunFiles[j], pParams->outStub, i);
+				}
+				sprintf(szFrom, "%s%c%s", szShardDir, C_DIR_DELIMITER, szFile);
+				sprintf(szTo, "%s%c%s", pParams->outStub, C_DIR_DELIMITER, szFile);
+				if (bPass == 0)
+				{
+					fp = fopen(szFrom, "rb");
+					if (!fp)
 					{
-						trueIncidence += getIncidence(pLandscape, pEpidemic, pLandscape->aCells[pEpidemic->aInfCells[j]].tInf, pEpidemic->aInfCells[k], pParams->withinCellMin, pParams->withinCellBulkUp, pParams->trueMinFlag);
+						fprintf(stderr, "iteration %d is incomplete (no %s)\n", i, szFrom);
+						return 0;
 					}
-					fprintf(fOut, "%d %d %.4f %d %d %d %.4f %.4f %.4f %.4f %d %.4f %d %.4f %.4f\n",
-						pLandscape->aCells[pEpidemic->aInfCells[j]].xPos,
-						pLandscape->aCells[pEpidemic->aInfCells[j]].yPos,
-						pLandscape->aCells[pEpidemic->aInfCells[j]].tInf,
-						pLandscape->aCells[pEpidemic->aInfCells[j]].infType,
-						(pLandscape->aCells[pEpidemic->aInfCells[j]].infBy == _EMPTY_CELL) ? _EMPTY_CELL : pLandscape->aCells[pLandscape->aCells[pEpidemic->aInfCells[j]].infBy].xPos,
-						(pLandscape->aCells[pEpidemic->aInfCells[j]].infBy == _EMPTY_CELL) ? _EMPTY_CELL : pLandscape->aCells[pLandscape->aCells[pEpidemic->aInfCells[j]].infBy].yPos,
-						pLandscape->aCells[pEpidemic->aInfCells[j]].propFull,
-						pLandscape->aCells[pEpidemic->aInfCells[j]].relInf,
-						pLandscape->aCells[pEpidemic->aInfCells[j]].relSus,
-						pLandscape->aCells[pEpidemic->aInfCells[j]].relPri,
-						(j + 1),
-						(j + 1.0) / (double)pLandscape->numCells,
-						pEpidemic->aInfCells[j],
-						trueIncidence / pLandscape->totalFull,
-						thisFinalIncidence);
+					fclose(fp);
+				}
+				else if (!moveFile(szFrom, szTo))
+				{
+					return 0;
 				}
-				fclose(fOut);
 			}
-			/*
-				Blank all the information so start next simulation totally afresh
-			*/
-			pEpidemic->queueLen = 0;
-			pEpidemic->totalInf = 0;
-			for (j = 0; j < pLandscape->numCells; j++)
+		}
+	}
+	/* files describing the whole ensemble */
+	sprintf(szShardDir, "%s%c%s_shard0", pParams->outStub, C_DIR_DELIMITER, pParams->outStub);
+	for (j = 0; j < 2; j++)
+	{
+		sprintf(szFrom, "%s%c%s", szShardDir, C_DIR_DELIMITER, j ? "paramsOut.txt" : "activeLandscape.txt");
+		sprintf(szTo, "%s%c%s", pParams->outStub, C_DIR_DELIMITER, j ? "paramsOut.txt" : "activeLandscape.txt");
+		if (!moveFile(szFrom, szTo))
+		{
+			return 0;
+		}
+	}
+	sprintf(szTo, "%s%cendTimes.txt", pParams->outStub, C_DIR_DELIMITER);
+	fEnd = fopen(szTo, "wb");
+	if (!fEnd)
+	{
+		fprintf(stderr, "couldn't open endTimes file for writing\n");
+		return 0;
+	}
+	for (i = 0; i < numIts; i++)
+	{
+		sprintf(szFile, "%s%cendTime_%d.txt", pParams->outStub, C_DIR_DELIMITER, i);
+		fp = fopen(szFile, "rb");
+		if (fp)
+		{
+			if (fgets(szBuffer, _MAX_STATIC_BUFF_LEN, fp))
 			{
-				pLandscape->aCells[j].tInf = _UNDEF_TIME;
-				pLandscape->aCells[j].tNext = _UNDEF_TIME;
-				pLandscape->aCells[j].infBy = _EMPTY_CELL;
-				pLandscape->aCells[j].infType = _EMPTY_CELL;
+				fputs(szBuffer, fEnd);
 			}
-			pPriInf->nextT = _UNDEF_TIME;
-			/*
-				Print out information on runstats
-			*/
-			fprintf(stdout, "\trunStats:\n\t\tnumSecondaryAttempts=%ld\n\t\tnumFindNextSecondary=%ld\n\t\tnumNonEmpty=%ld\n\t\tnumNonInfected=%ld\n\t\tnumSuccessful=%ld\n", runStats.numSecondaryAttempts, runStats.numFindNextSecondary, runStats.numNonEmpty, runStats.numNonInfected, runStats.numSuccessful);
-			fclose(fDPC);
+			fclose(fp);
 		}
 	}
-	if (i == pParams->numIts)
+	fclose(fEnd);
+	/* sampling patterns evaluated in the runs (surveyFile) */
+	sprintf(szFrom, "%s%c%s_shard0%csurveillance.txt", pParams->outStub, C_DIR_DELIMITER, pParams->outStub, C_DIR_DELIMITER);
+	fp = fopen(szFrom, "rb");
+	if (fp)
 	{
-		/*
-			Dump out a file of the last simulation that was run this time
-			Can be useful to keep track of which results are which if repeatedly do simulations with same file name
-		*/
-		sprintf(outFile, "%s%clastRunNumber.txt", pParams->outStub, C_DIR_DELIMITER);
-		fOut = fopen(outFile, "wb");
-		if (fOut)
+		fclose(fp);
+		if (!mergeSurveillance(pParams, numIts))
 		{
-			fprintf(fOut, "%d", pParams->numIts);
-			fclose(fOut);
+			return 0;
 		}
 	}
-	fclose(fEnd);
-	return retVal;
+	/* per-cell summaries (aggregateRasters) */
+	sprintf(szFrom, "%s%c%s_shard0%caggregate.txt", pParams->outStub, C_DIR_DELIMITER, pParams->outStub, C_DIR_DELIMITER);
+	fp = fopen(szFrom, "rb");
+	if (fp)
+	{
+		fclose(fp);
+		if (!mergeAggregate(pParams))
+		{
+			return 0;
+		}
+	}
+	sprintf(szTo, "%s%clastRunNumber.txt", pParams->outStub, C_DIR_DELIMITER);
+	fp = fopen(szTo, "wb");
+	if (fp)
+	{
+		fprintf(fp, "%d", numIts);
+		fclose(fp);
+	}
+	fprintf(stdout, "\tmerged %d iterations into %s\n", numIts, pParams->outStub);
+	return 1;
 }
 
 /*
-	Initialise the dispersal kernel
+	Add a line to the estimate made by estimateMemory()
 */
-int setupDispersal(t_Dispersal *pDispersal, t_Landscape *pLandscape, double dispScale, double *pRateSecInf)
+double addEstimate(char *szName, double bytes, double total)
 {
-	int		i,retVal,x,y;
-	double	checkDisp, thisDistSq;
+	if (bytes > 0.0)
+	{
+		fprintf(stdout, "\t%s: %.3f\n", szName, MEM_MB(bytes));
+	}
+	return total + bytes;
+}
 
-	fprintf(stdout, "setupDispersal()\n\t");
-	checkDisp = 0.0;
-	retVal = 0;
-	pDispersal->numProbs = pLandscape->numCols * pLandscape->numRows;
-	pDispersal->aProbs = malloc(sizeof(double) * pDispersal->numProbs);
-	if(pDispersal->aProbs)
+/*
+	Count the sampling patterns in surveyFile, the sites in them and the most in any one, for estimateMemory()
+	(as setupSurveillance() would read them, but without checking the cells), reading lines into szBuffer
+	(of _MAX_DYNAMIC_BUFF_LEN)
+*/
+int countSurveySites(char *szFile, char *szBuffer, long *pNumPatterns, long *pNumSites, long *pMaxSites)
+{
+	FILE	*fIn;
+	char	*pPtr;
+	long	numSites;
+
+	*pNumPatterns = *pNumSites = *pMaxSites = 0;
+	fIn = fopen(szFile, "rb");
+	if (!fIn)
 	{
-		fprintf(stdout, "Functional form type kernel\n\t\t");
-		for(i=0;i<pDispersal->numProbs;i++)
+		fprintf(stderr, "couldn't open surveyFile %s\n", szFile);
+		return 0;
+	}
+	while (fgets(szBuffer, _MAX_DYNAMIC_BUFF_LEN, fIn))
+	{
+		if (szBuffer[0] == '#')
 		{
-			posToGrid(i, pLandscape->numCols, &x, &y);
-			thisDistSq = (double) x * (double) x + (double) y * (double) y;
-			pDispersal->aProbs[i] = exp(-sqrt(thisDistSq)/dispScale);
-			pDispersal->aProbs[i] /= (dispScale*dispScale*2.0*_PI);
-			if(x==0)
-			{
-				pDispersal->aProbs[i] /= 2.0;
-			}
-			if(y==0)
-			{
-				pDispersal->aProbs[i] /= 2.0;
-			}
-			pDispersal->aProbs[i] *= 4.0;
-			checkDisp += pDispersal->aProbs[i];
-			if(i % _SETUP_DISPERSAL_PRINT_DOT == 0)
+			continue;
+		}
+		numSites = 0;
+		for (pPtr = strtok(szBuffer, _GIS_WHITESPACE _GIS_NEWLINES); pPtr; pPtr = strtok(NULL, _GIS_WHITESPACE _GIS_NEWLINES))
+		{
+			numSites++;
+		}
+		if (numSites)
+		{
+			(*pNumPatterns)++;
+			*pNumSites += numSites;
+			if (numSites > *pMaxSites)
 			{
-				fprintf(stdout, ".");
+				*pMaxSites = numSites;
 			}
 		}
-		pDispersal->inCell = pDispersal->aProbs[0];
-		pDispersal->onLandscape = checkDisp;
-		retVal = 1;
-		/*
-			Store the dispersal kernel as a list of cumulative sums
-			(to make it easy to find what infects what)
-		*/
-		for(i=1;i<pDispersal->numProbs;i++)
+	}
+	fclose(fIn);
+	return 1;
+}
+
+/*
+	dryRun=1: estimate the memory the simulation will need, from the header of filePropFull and the parameters, and stop
+	before any of it is allocated; the raster is read a line at a time to count the cells over cellThresh (and the coarse
+	cells they fall in), which fixes the size of everything else
+		- the names are those in memory.txt, so the estimate can be checked against a real run
+		- the total is an upper bound, as it includes the temporary arrays used while the landscape is set up, and
+			takes the FFT grid as large as the kernel could make it
+*/
+int estimateMemory(t_Params *pParams)
+{
+	FILE	*fIn;
+	char	*inBuff,*pPtr,*abCoarse;
+	int		numRows,numCols,coarse,headerCount,thisX,thisY,numBitsX,numBitsY,nx,ny,numTiles,retVal;
+	long	numFine,numCells,numSpace,lookupSize,fineLookupSize,numCoarseRows,numCoarseCols,numPatterns,numSites,maxSites;
+	double	thisVal,total;
+
+	fprintf(stdout, "estimateMemory()\n");
+	fIn = fopen(pParams->filePropFull, "rb");
+	if (!fIn)
+	{
+		fprintf(stderr, "couldn't open %s\n", pParams->filePropFull);
+		return 0;
+	}
+	inBuff = malloc(_MAX_DYNAMIC_BUFF_LEN*sizeof(char));
+	if (!inBuff)
+	{
+		fprintf(stderr, "out of memory\n");
+		fclose(fIn);
+		return 0;
+	}
+	numRows = numCols = 0;
+	for (headerCount = 0; headerCount < _GIS_HEADER_LENGTH && fgets(inBuff, _MAX_DYNAMIC_BUFF_LEN, fIn); headerCount++)
+	{
+		pPtr = strpbrk(inBuff, _GIS_WHITESPACE);
+		if (strncmp(inBuff, "ncols", strlen("ncols")) == 0 && pPtr)
 		{
-			pDispersal->aProbs[i] += pDispersal->aProbs[i-1];
+			numCols = atoi(pPtr);
 		}
-		fprintf(stdout, "\n\t\tinCell=%f onLandscape=%f\n", pDispersal->inCell, pDispersal->onLandscape);
-		/*
-			Note that it is possible to have onLandscape > 1.0 for certain dispersal kernels (particularly long ranged ones)
-			This can happen even thought the kernel is normalised because of discretisation error in
-				adding up the kernel but approximating the value of each cell by the value at its centre
-			If this happens then renormalise so that all cells can be hit
-				(note onLandscape < 1.0 is ok; corresponds to appreciable fraction of dispersals going so far that do not stay within landscape)
-		*/
-		if (pDispersal->onLandscape > 1.0)
+		if (strncmp(inBuff, "nrows", strlen("nrows")) == 0 && pPtr)
 		{
-			double dOldRateSec;
-
-			dOldRateSec = *pRateSecInf;
-			*pRateSecInf = dOldRateSec * pDispersal->onLandscape;
-			for (i = 0; i<pDispersal->numProbs; i++)
+			numRows = atoi(pPtr);
+		}
+	}
+	if (numRows <= 0 || numCols <= 0)
+	{
+		fprintf(stderr, "estimateMemory(): failed to parse gis header\n");
+		free(inBuff);
+		fclose(fIn);
+		return 0;
+	}
+	/* count the active cells, and mark the coarse cells they go into */
+	coarse = (pParams->coarsen > 1) ? pParams->coarsen : 1;
+	numCoarseRows = (numRows + coarse - 1) / coarse;
+	numCoarseCols = (numCols + coarse - 1) / coarse;
+	abCoarse = NULL;
+	if (coarse > 1)
+	{
+		abCoarse = calloc(numCoarseRows * numCoarseCols, 1);
+		if (!abCoarse)
+		{
+			fprintf(stderr, "out of memory\n");
+			free(inBuff);
+			fclose(fIn);
+			return 0;
+		}
+	}
+	numFine = 0;
+	numCells = 0;
+	retVal = 1;
+	for (thisY = 0; retVal && thisY < numRows && fgets(inBuff, _MAX_DYNAMIC_BUFF_LEN, fIn); thisY++)
+	{
+		if (!strpbrk(inBuff, _GIS_NEWLINES))
+		{
+			fprintf(stderr, "estimateMemory(): line too long\n");
+			retVal = 0;
+		}
+		thisX = 0;
+		for (pPtr = strtok(inBuff, _GIS_WHITESPACE _GIS_NEWLINES); retVal && pPtr && thisX < numCols; pPtr = strtok(NULL, _GIS_WHITESPACE _GIS_NEWLINES))
+		{
+			thisVal = atof(pPtr);
+			if (strcmp(pPtr, _GIS_NODATA) != 0 && thisVal >= pParams->cellThresh)
 			{
-				pDispersal->aProbs[i] /= pDispersal->onLandscape;
+				numFine++;
+				if (abCoarse && !abCoarse[gridToPos(thisX / coarse, thisY / coarse, (int)numCoarseCols)])
+				{
+					abCoarse[gridToPos(thisX / coarse, thisY / coarse, (int)numCoarseCols)] = 1;
+					numCells++;
+				}
 			}
-			pDispersal->onLandscape = 1.0;
-			pDispersal->inCell = pDispersal->aProbs[0];
-			fprintf(stdout, "\tonLandscape > 1.0 -> Renormalising kernel (and rateSecInf)...\n");
-			fprintf(stdout, "\t\tinCell=%f onLandscape=%f\n", pDispersal->inCell, pDispersal->onLandscape);
-			fprintf(stdout, "\t\trateSecInf=%f (was %f)\n", *pRateSecInf, dOldRateSec);
+			thisX++;
 		}
 	}
-	return retVal;
+	fclose(fIn);
+	free(abCoarse);
+	if (!retVal)
+	{
+		free(inBuff);
+		return 0;
+	}
+	if (coarse == 1)
+	{
+		numCells = numFine;
+	}
+	fineLookupSize = (long)numRows * numCols;
+	numRows = (int)numCoarseRows;
+	numCols = (int)numCoarseCols;
+	/* cells are read into blocks of _LANDSCAPE_BLOCK_SIZE, and copied into an array of exactly as many as were read if
+		coarsened or reordered */
+	numSpace = ((numFine + _LANDSCAPE_BLOCK_SIZE - 1) / _LANDSCAPE_BLOCK_SIZE) * _LANDSCAPE_BLOCK_SIZE;
+	if (coarse > 1 || pParams->cellOrder != _CELL_ORDER_RASTER)
+	{
+		numSpace = numFine;
+	}
+	lookupSize = (long)numRows * numCols;
+	if (pParams->cellOrder != _CELL_ORDER_RASTER)
+	{
+		for (numBitsX = 0; (1 << numBitsX) < numCols; numBitsX++)
+		{
+		}
+		for (numBitsY = 0; (1 << numBitsY) < numRows; numBitsY++)
+		{
+		}
+		lookupSize = 1L << (numBitsX + numBitsY);
+	}
+	fprintf(stdout, "\t%ld valid cells (%d rows; %d cols)\n", numCells, numRows, numCols);
+	fprintf(stdout, "estimated memory (MB):\n");
+	total = 0.0;
+	total = addEstimate("inputBuffer", (double)_MAX_DYNAMIC_BUFF_LEN, total);
+	total = addEstimate("aCells", (double)sizeof(t_Cell) * numSpace, total);
+	total = addEstimate("aCellLookup", (double)sizeof(int) * lookupSize, total);
+	total = addEstimate("aStateMap", (double)((lookupSize + 3) / 4), total);
+	if (coarse > 1)
+	{
+		/* (the landscape at full resolution, and the sums for each coarse cell) */
+		total = addEstimate("coarsenTemp", (double)sizeof(t_Cell) * numFine + (double)sizeof(int) * fineLookupSize + (sizeof(int) + 4.0 * sizeof(double)) * numFine, total);
+	}
+	if (pParams->cellOrder != _CELL_ORDER_RASTER)
+	{
+		total = addEstimate("aCellID", (double)sizeof(int) * numCells, total);
+		total = addEstimate("aCellIndex", (double)sizeof(int) * numCells, total);
+		total = addEstimate("reorderKeys", (double)sizeof(t_CellKey) * numCells, total);
+	}
+	total = addEstimate("aCumPressure", (double)sizeof(double) * numCells, total);
+	total = addEstimate("aProbs", (double)sizeof(double) * numRows * numCols, total);
+	if (pParams->engine == _ENGINE_FFT || pParams->engine == _ENGINE_MEANFIELD)
+	{
+		for (nx = 1; nx < 2 * numCols - 1; nx <<= 1)
+		{
+		}
+		for (ny = 1; ny < 2 * numRows - 1; ny <<= 1)
+		{
+		}
+		total = addEstimate("fftKernel", 2.0 * sizeof(double) * nx * ny, total);
+		total = addEstimate("fftWork", 2.0 * sizeof(double) * nx * ny, total);
+		total = addEstimate("fftCells", 2.0 * sizeof(double) * numCells, total);
+	}
+	if (pParams->engine == _ENGINE_MEANFIELD)
+	{
+		total = addEstimate("meanField", 2.0 * sizeof(double) * numCells, total);
+	}
+	total = addEstimate("aQueueCells", (double)sizeof(int) * numCells, total);
+	total = addEstimate("aInfCells", (double)sizeof(int) * numCells, total);
+	if (pParams->engine == _ENGINE_TILED)
+	{
+		numTiles = ((numCols + pParams->tileSize - 1) / pParams->tileSize) * ((numRows + pParams->tileSize - 1) / pParams->tileSize);
+		total = addEstimate("tiles", (double)sizeof(t_Tile) * numTiles + (double)sizeof(int) * 2.0 * (numCells + numTiles), total);
+		total = addEstimate("tileMsgs", (double)sizeof(t_TileMsg) * _TILE_MSG_BLOCK * (3.0 * numTiles + 1.0), total);
+	}
+	total = addEstimate("splitStates", (double)pParams->numSplitLevels * (sizeof(t_Cell) + 2 * sizeof(int)) * numCells, total);
+	if (pParams->snapshotFile[0] != '\0')
+	{
+		total = addEstimate("snapshot", (3.0 * sizeof(int) + 2.0 * sizeof(double)) * (numCells + 1) + (double)sizeof(int) * numCells, total);
+	}
+	if (pParams->surveyFile[0] != '\0')
+	{
+		if (!countSurveySites(pParams->surveyFile, inBuff, &numPatterns, &numSites, &maxSites))
+		{
+			free(inBuff);
+			return 0;
+		}
+		total = addEstimate("surveillance", (double)sizeof(int) * numSites + (double)(sizeof(int) + sizeof(int*)) * numPatterns + (3.0 * sizeof(double) + sizeof(int)) * maxSites, total);
+	}
+	if (pParams->aggregateRasters)
+	{
+		total = addEstimate("aggregate", ((double)sizeof(int) + 5.0 * sizeof(double)) * numCells, total);
+		total = addEstimate("aggregateRaster", (double)sizeof(double) * numRows * numCols, total);
+	}
+	fprintf(stdout, "\ttotal (at most): %.3f\n", MEM_MB(total));
+	if (pParams->sweepFile[0] != '\0')
+	{
+		fprintf(stdout, "\t(for one set of sweepFile: each distinct dispScale keeps its own aProbs)\n");
+	}
+	if (pParams->engine == _ENGINE_TILED)
+	{
+		fprintf(stdout, "\t(tileMsgs as first allocated: each tile's buffers grow to hold the infections it sends and receives in a window)\n");
+	}
+#ifdef _PIPELINE
+	fprintf(stdout, "\t(not including the annealer, whose arrays grow with the number of infections)\n");
+#endif
+	free(inBuff);
+	return 1;
 }
 
 int main(int argc, char **argv)
@@ -1647,26 +6595,90 @@ int main(int argc, char **argv)
 	t_PriInf		sPriInf;
 	t_Epidemic		sEpidemic;
 	t_Dispersal		sDispersal;
+	t_FFTKernel		sFFT;
+	t_FFTKernel		*pFFT;
+	t_RunStats		sTotalStats;
+	t_Timings		sTimings;
 	clock_t			beforeClock;
-	clock_t			afterClock;
-	double			totalSeconds;
+#ifdef _PIPELINE
+	int				i,j;
+#endif
 
-	seedRandom();
-	if(readParams(&sParams, argc, argv))
+	memset(&sTimings, 0, sizeof(t_Timings));
+	memset(&sTotalStats, 0, sizeof(t_RunStats));
+	pFFT = NULL;
+	if(readParams(&sParams, argc, argv, -1))
 	{
-		if(readLandscape(&sLandscape,sParams.filePropFull,sParams.fileRelInf,sParams.fileRelPri,sParams.fileRelSus,sParams.cellThresh,sParams.outStub))
+		if(sParams.dryRun)
+		{
+			return estimateMemory(&sParams) ? EXIT_SUCCESS : EXIT_FAILURE;
+		}
+		if(sParams.mergeShards > 0)
+		{
+			return mergeShards(&sParams) ? EXIT_SUCCESS : EXIT_FAILURE;
+		}
+		if(sParams.sweepFile[0] != '\0')
+		{
+			return runSweep(&sParams, argc, argv) ? EXIT_SUCCESS : EXIT_FAILURE;
+		}
+		seedRandom(sParams.seed);
+		coarsenParams(&sParams);
+		beforeClock = clock();
+		if(readLandscape(&sLandscape,sParams.filePropFull,sParams.fileRelInf,sParams.fileRelPri,sParams.fileRelSus,sParams.cellThresh,sParams.coarsen,sParams.cellOrder,sParams.outDir))
 		{
+#ifdef _PIPELINE
+			if(!pipelineBegin(argc, argv, sParams.numIts, sParams.outStub))
+			{
+				return EXIT_FAILURE;
+			}
+			for(i=0;i<sLandscape.numCells;i++)
+			{
+				j = cellIndex(&sLandscape, i);
+				if(!pipelineAddHost(sLandscape.aCells[j].xPos, sLandscape.aCells[j].yPos, sLandscape.aCells[j].propFull))
+				{
+					return EXIT_FAILURE;
+				}
+			}
+#endif
+			sTimings.readLandscape = secondsSince(beforeClock);
+			beforeClock = clock();
 			if(setupPrimary(&sPriInf,&sLandscape,sParams.ratePriInf))
 			{
+				sTimings.setupPrimary = secondsSince(beforeClock);
+				beforeClock = clock();
 				if(setupDispersal(&sDispersal, &sLandscape, sParams.dispScale, &sParams.rateSecInf))
 				{
+					if(sParams.engine == _ENGINE_FFT || sParams.engine == _ENGINE_MEANFIELD)
+					{
+						if(!setupFFTKernel(&sFFT, &sDispersal, &sLandscape))
+						{
+							return EXIT_FAILURE;
+						}
+						pFFT = &sFFT;
+					}
+					sTimings.setupDispersal = secondsSince(beforeClock);
+					beforeClock = clock();
 					if(setupEpidemic(&sEpidemic,&sLandscape,sParams.dispScale))
 					{
+						sTimings.setupEpidemic = secondsSince(beforeClock);
 						beforeClock = clock();
-						runEpidemics(&sParams,&sLandscape,&sPriInf,&sDispersal,&sEpidemic);
-						afterClock = clock();
-						totalSeconds = ((double)afterClock-(double)beforeClock)/((double)CLOCKS_PER_SEC);
-						fprintf(stdout, "%d iterations in %.3f seconds\n", sParams.numIts, totalSeconds);
+						if(sParams.engine == _ENGINE_MEANFIELD)
+						{
+							runMeanField(&sParams,&sLandscape,&sPriInf,pFFT);
+						}
+						else
+						{
+							runEpidemics(&sParams,&sLandscape,&sPriInf,&sDispersal,pFFT,&sEpidemic,&sTotalStats);
+						}
+#ifdef _PIPELINE
+						if(!pipelineFinish())
+						{
+							return EXIT_FAILURE;
+						}
+#endif
+						sTimings.runEpidemics = secondsSince(beforeClock);
+						fprintf(stdout, "%d iterations in %.3f seconds\n", numItsThisProcess(&sParams), sTimings.runEpidemics);
+						writeBenchmark(&sParams, &sLandscape, &sTimings, &sTotalStats);
 					}
 				}
 			}
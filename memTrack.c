@@ -0,0 +1,232 @@
+/*
+	Memory accounting by structure (see memTrack.h)
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include "memTrack.h"
+
+#ifndef _MSC_VER
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+
+#define _MEM_MAX_NAMES	64
+
+/*
+	Header in front of each block (a union with the widest types, so the block after it is aligned as malloc's would be)
+*/
+typedef union
+{
+	struct
+	{
+		size_t	size;
+		int		name;		/* index into g_aNames */
+	} s;
+	long double	align1;
+	void		*align2;
+} t_MemHeader;
+
+typedef struct
+{
+	const char	*szName;
+	size_t		current;
+	size_t		peak;
+	long		numAllocs;
+} t_MemName;
+
+static t_MemName	g_aNames[_MEM_MAX_NAMES];
+static int			g_numNames = 0;
+static size_t		g_current = 0;
+static size_t		g_peak = 0;
+
+/*
+	Names are looked up by their contents, so the same name used in different places is counted together
+	(anything beyond _MEM_MAX_NAMES is counted under the last one)
+*/
+static int findName(const char *szName)
+{
+	int i;
+
+	for (i = 0; i < g_numNames; i++)
+	{
+		if (strcmp(g_aNames[i].szName, szName) == 0)
+		{
+			return i;
+		}
+	}
+	if (g_numNames == _MEM_MAX_NAMES)
+	{
+		g_aNames[_MEM_MAX_NAMES - 1].szName = "other";
+		return _MEM_MAX_NAMES - 1;
+	}
+	g_aNames[g_numNames].szName = szName;
+	return g_numNames++;
+}
+
+static void addBytes(int name, size_t size)
+{
+	g_aNames[name].current += size;
+	if (g_aNames[name].current > g_aNames[name].peak)
+	{
+		g_aNames[name].peak = g_aNames[name].current;
+	}
+	g_current += size;
+	if (g_current > g_peak)
+	{
+		g_peak = g_current;
+	}
+}
+
+static void removeBytes(int name, size_t size)
+{
+	g_aNames[name].current -= size;
+	g_current -= size;
+}
+
+void *mem_malloc(size_t size, const char *szName)
+{
+	t_MemHeader	*pHeader;
+	int			name;
+
+	pHeader = (t_MemHeader*)malloc(sizeof(t_MemHeader) + size);
+	if (!pHeader)
+	{
+		return NULL;
+	}
+	name = findName(szName);
+	pHeader->s.size = size;
+	pHeader->s.name = name;
+	g_aNames[name].numAllocs++;
+	addBytes(name, size);
+	return pHeader + 1;
+}
+
+void *mem_calloc(size_t num, size_t size, const char *szName)
+{
+	void *pBlock;
+
+	pBlock = mem_malloc(num * size, szName);
+	if (pBlock)
+	{
+		memset(pBlock, 0, num * size);
+	}
+	return pBlock;
+}
+
+/*
+	As realloc(), the block is left as it was if it can't be resized
+*/
+void *mem_realloc(void *pBlock, size_t size, const char *szName)
+{
+	t_MemHeader	*pHeader;
+	size_t		oldSize;
+	int			name;
+
+	if (!pBlock)
+	{
+		return mem_malloc(size, szName);
+	}
+	pHeader = (t_MemHeader*)pBlock - 1;
+	oldSize = pHeader->s.size;
+	name = pHeader->s.name;
+	pHeader = (t_MemHeader*)realloc(pHeader, sizeof(t_MemHeader) + size);
+	if (!pHeader)
+	{
+		return NULL;
+	}
+	pHeader->s.size = size;
+	removeBytes(name, oldSize);
+	addBytes(name, size);
+	return pHeader + 1;
+}
+
+void mem_free(void *pBlock)
+{
+	t_MemHeader	*pHeader;
+
+	if (pBlock)
+	{
+		pHeader = (t_MemHeader*)pBlock - 1;
+		removeBytes(pHeader->s.name, pHeader->s.size);
+		free(pHeader);
+	}
+}
+
+size_t mem_current()
+{
+	return g_current;
+}
+
+size_t mem_peak()
+{
+	return g_peak;
+}
+
+/*
+	Current RSS is only available on Linux (from /proc/self/statm)
+*/
+long mem_current_rss()
+{
+#ifdef __linux__
+	FILE	*fIn;
+	long	size,resident;
+
+	fIn = fopen("/proc/self/statm", "rb");
+	if (fIn)
+	{
+		if (fscanf(fIn, "%ld %ld", &size, &resident) == 2)
+		{
+			fclose(fIn);
+			return resident * (sysconf(_SC_PAGESIZE) / 1024);
+		}
+		fclose(fIn);
+	}
+#endif
+	return -1;
+}
+
+/*
+	(Linux only updates the peak it reports now and then, so it can be less than the current RSS)
+*/
+long mem_peak_rss()
+{
+	long	peak,current;
+#ifndef _MSC_VER
+	struct rusage	sUsage;
+#endif
+
+	peak = -1;
+#ifndef _MSC_VER
+	if (getrusage(RUSAGE_SELF, &sUsage) == 0)
+	{
+#ifdef __APPLE__
+		peak = (long)(sUsage.ru_maxrss / 1024);	/* reported in bytes on OS X */
+#else
+		peak = (long)sUsage.ru_maxrss;
+#endif
+	}
+#endif
+	current = mem_current_rss();
+	return (current > peak) ? current : peak;
+}
+
+void mem_report(FILE *fOut)
+{
+	int i;
+
+	fprintf(fOut, "memory (MB current/peak):\n");
+	for (i = 0; i < g_numNames; i++)
+	{
+		fprintf(fOut, "\t%s: %.3f/%.3f (%ld allocations)\n", g_aNames[i].szName, MEM_MB(g_aNames[i].current), MEM_MB(g_aNames[i].peak), g_aNames[i].numAllocs);
+	}
+	fprintf(fOut, "\ttracked total: %.3f/%.3f\n", MEM_MB(g_current), MEM_MB(g_peak));
+	if (mem_current_rss() >= 0)
+	{
+		fprintf(fOut, "\tRSS: %.3f/%.3f\n", mem_current_rss() / 1024.0, mem_peak_rss() / 1024.0);
+	}
+	else if (mem_peak_rss() >= 0)
+	{
+		fprintf(fOut, "\tRSS: -/%.3f\n", mem_peak_rss() / 1024.0);
+	}
+}
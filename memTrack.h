@@ -0,0 +1,39 @@
+#ifndef _MEM_TRACK_H_
+#define _MEM_TRACK_H_
+
+/*
+	Memory accounting by structure, for sizing jobs
+
+	Allocations made with mem_malloc(), mem_calloc() and mem_realloc() are counted against the name they are given
+	(e.g. "aCells"), and must be freed with mem_free(); a small header in front of each block records its size and
+	name, so frees and reallocs are counted without the caller having to say how big the block was (the counts aren't
+	locked, so tracked blocks should only be allocated and freed by one thread at a time)
+
+	mem_report() lists the current and peak bytes held under each name, the peak of the total (which can be less than
+	the sum of the peaks, as temporary arrays come and go), and the current and peak resident set size of the process
+*/
+
+#include <stdio.h>
+#include <stddef.h>
+
+/* allocate, reallocate and free blocks counted against szName (which must be a string constant) */
+void	*mem_malloc(size_t size, const char *szName);
+void	*mem_calloc(size_t num, size_t size, const char *szName);
+void	*mem_realloc(void *pBlock, size_t size, const char *szName);
+void	mem_free(void *pBlock);
+
+/* bytes currently held in tracked blocks, and the most there have been */
+size_t	mem_current();
+size_t	mem_peak();
+
+/* resident set size of the process in kB (-1 if it can't be found on this platform) */
+long	mem_current_rss();
+long	mem_peak_rss();
+
+/* write a line per name, then the totals */
+void	mem_report(FILE *fOut);
+
+/* number of bytes as MB with three decimal places, for estimates and reports */
+#define MEM_MB(bytes)	((double)(bytes) / (1024.0 * 1024.0))
+
+#endif /* _MEM_TRACK_H_ */
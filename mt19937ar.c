@@ -42,6 +42,7 @@
 */
 
 #include <stdio.h>
+#include "mt19937ar.h"
 
 /* Period parameters */  
 #define N 624
@@ -173,3 +174,113 @@ double genrand_res53(void)
     unsigned long a=genrand_int32()>>5, b=genrand_int32()>>6; 
     return((double)a*67108864.0+(double)b)*(1.0/9007199254740992.0); 
 } 
+
+/*
+   Re-entrant versions of the above, with the state held by the caller
+   rather than in static storage, so that several independent streams
+   can be used at once (given the same seed, each stream produces
+   exactly the same sequence as the static versions)
+*/
+
+/* initializes a stream with a seed */
+void init_genrand_r(mt_state *pState, unsigned long s)
+{
+    unsigned long *st = pState->mt;
+    int i;
+
+    st[0]= s & 0xffffffffUL;
+    for (i=1; i<N; i++) {
+        st[i] = 
+	    (1812433253UL * (st[i-1] ^ (st[i-1] >> 30)) + (unsigned long) i); 
+        st[i] &= 0xffffffffUL;
+    }
+    pState->mti = N;
+}
+
+/* initializes a stream by an array with array-length */
+void init_by_array_r(mt_state *pState, unsigned long init_key[], int key_length)
+{
+    unsigned long *st = pState->mt;
+    int i, j, k;
+
+    init_genrand_r(pState, 19650218UL);
+    i=1; j=0;
+    k = (N>key_length ? N : key_length);
+    for (; k; k--) {
+        st[i] = (st[i] ^ ((st[i-1] ^ (st[i-1] >> 30)) * 1664525UL))
+          + init_key[j] + (unsigned long)j; /* non linear */
+        st[i] &= 0xffffffffUL; /* for WORDSIZE > 32 machines */
+        i++; j++;
+        if (i>=N) { st[0] = st[N-1]; i=1; }
+        if (j>=key_length) j=0;
+    }
+    for (k=N-1; k; k--) {
+        st[i] = (st[i] ^ ((st[i-1] ^ (st[i-1] >> 30)) * 1566083941UL))
+          - (unsigned long)i; /* non linear */
+        st[i] &= 0xffffffffUL; /* for WORDSIZE > 32 machines */
+        i++;
+        if (i>=N) { st[0] = st[N-1]; i=1; }
+    }
+
+    st[0] = 0x80000000UL; /* MSB is 1; assuring non-zero initial array */ 
+}
+
+/* generates a random number on [0,0xffffffff]-interval from a stream */
+unsigned long genrand_int32_r(mt_state *pState)
+{
+    unsigned long *st = pState->mt;
+    unsigned long y;
+    static unsigned long mag01[2]={0x0UL, MATRIX_A};
+
+    if (pState->mti >= N) { /* generate N words at one time */
+        int kk;
+
+        for (kk=0;kk<N-M;kk++) {
+            y = (st[kk]&UPPER_MASK)|(st[kk+1]&LOWER_MASK);
+            st[kk] = st[kk+M] ^ (y >> 1) ^ mag01[y & 0x1UL];
+        }
+        for (;kk<N-1;kk++) {
+            y = (st[kk]&UPPER_MASK)|(st[kk+1]&LOWER_MASK);
+            st[kk] = st[kk+(M-N)] ^ (y >> 1) ^ mag01[y & 0x1UL];
+        }
+        y = (st[N-1]&UPPER_MASK)|(st[0]&LOWER_MASK);
+        st[N-1] = st[M-1] ^ (y >> 1) ^ mag01[y & 0x1UL];
+
+        pState->mti = 0;
+    }
+  
+    y = st[pState->mti++];
+
+    /* Tempering */
+    y ^= (y >> 11);
+    y ^= (y << 7) & 0x9d2c5680UL;
+    y ^= (y << 15) & 0xefc60000UL;
+    y ^= (y >> 18);
+
+    return y;
+}
+
+/* generates a random number on (0,1)-real-interval from a stream */
+double genrand_real3_r(mt_state *pState)
+{
+    return (((double)genrand_int32_r(pState)) + 0.5)*(1.0/4294967296.0); 
+    /* divided by 2^32 */
+}
+
+/* copies the state of the static generator (e.g. so a simulation can be saved and carried on later) */
+void get_genrand_state(mt_state *pState)
+{
+    int i;
+
+    for (i=0; i<N; i++) pState->mt[i] = mt[i];
+    pState->mti = mti;
+}
+
+/* sets the state of the static generator to one copied by get_genrand_state() */
+void set_genrand_state(mt_state *pState)
+{
+    int i;
+
+    for (i=0; i<N; i++) mt[i] = pState->mt[i];
+    mti = pState->mti;
+}
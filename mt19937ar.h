@@ -1,4 +1,12 @@
 #ifndef _MT19937AR_H_
+#define _MT19937AR_H_
+
+/* state of a single stream, for the re-entrant (_r) versions */
+typedef struct
+{
+	unsigned long	mt[624];
+	int				mti;
+} mt_state;
 
 /* initializes mt[N] with a seed */
 void init_genrand(unsigned long s);
@@ -18,4 +26,14 @@ double genrand_real3(void);
 /* generates a random number on [0,1) with 53-bit resolution*/
 double genrand_res53(void);
 
+/* re-entrant versions, with the state of the stream held by the caller */
+void init_genrand_r(mt_state *pState, unsigned long s);
+void init_by_array_r(mt_state *pState, unsigned long init_key[], int key_length);
+unsigned long genrand_int32_r(mt_state *pState);
+double genrand_real3_r(mt_state *pState);
+
+/* copy (or set) the state of the static generator */
+void get_genrand_state(mt_state *pState);
+void set_genrand_state(mt_state *pState);
+
 #endif /* _MT19937AR_H_ */
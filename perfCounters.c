@@ -0,0 +1,311 @@
+/*
+	Hardware performance counters around named regions of code (see perfCounters.h)
+*/
+
+#include <string.h>
+#include <time.h>
+#include "perfCounters.h"
+
+#ifdef __linux__
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+int		g_perfEnabled = 0;
+int		g_perfEvery = 1;
+
+static const char *g_aszCounterNames[PERF_NUM_COUNTERS] = { "cycles", "instructions", "L1d-misses", "LLC-misses", "branch-misses" };
+
+#ifdef __linux__
+static int							g_aFd[PERF_NUM_COUNTERS];
+static struct perf_event_mmap_page	*g_apPage[PERF_NUM_COUNTERS];	/* (NULL if the counter can't be read with rdpmc) */
+static int							g_leader = -1;	/* counter leading the group (the first opened), which also reads the times */
+
+/*
+	Open a counter in the group led by groupFd (or as the leader, with the enabled and running times in its read_format,
+	if groupFd is -1)
+*/
+static int openCounter(uint32_t type, uint64_t config, int groupFd)
+{
+	struct perf_event_attr	sAttr;
+
+	memset(&sAttr, 0, sizeof(sAttr));
+	sAttr.size = sizeof(sAttr);
+	sAttr.type = type;
+	sAttr.config = config;
+	sAttr.exclude_kernel = 1;
+	sAttr.exclude_hv = 1;
+	if (groupFd < 0)
+	{
+		sAttr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+	}
+	return (int)syscall(__NR_perf_event_open, &sAttr, 0, -1, groupFd, 0);
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+static inline uint64_t rdpmc(uint32_t counter)
+{
+	uint32_t	low,high;
+
+	__asm__ volatile("rdpmc" : "=a" (low), "=d" (high) : "c" (counter));
+	return ((uint64_t)high << 32) | low;
+}
+
+static inline uint64_t rdtsc()
+{
+	uint32_t	low,high;
+
+	__asm__ volatile("rdtsc" : "=a" (low), "=d" (high));
+	return ((uint64_t)high << 32) | low;
+}
+
+/*
+	Read a counter in user space (the kernel's offset plus the hardware counter, sign extended from its width), retrying
+	if the kernel changed the page while it was being read; returns 0 if the counter isn't on the hardware just now
+	If aTimes isn't NULL the enabled and running times are read too (the kernel's values at the last schedule, plus the
+	time since from the TSC), which needs cap_user_time
+*/
+static inline int readUserCounter(struct perf_event_mmap_page *pPage, uint64_t *pCount, uint64_t aTimes[2])
+{
+	uint32_t	seq,index;
+	uint64_t	count,pmc,enabled,running,cyc,delta;
+	int			bOK;
+
+	do
+	{
+		seq = pPage->lock;
+		__asm__ volatile("" ::: "memory");
+		index = pPage->index;
+		count = pPage->offset;
+		enabled = pPage->time_enabled;
+		running = pPage->time_running;
+		bOK = (pPage->cap_user_rdpmc && index != 0 && (!aTimes || pPage->cap_user_time));
+		if (bOK)
+		{
+			pmc = rdpmc(index - 1);
+			pmc <<= 64 - pPage->pmc_width;
+			count += (uint64_t)((int64_t)pmc >> (64 - pPage->pmc_width));
+			if (aTimes)
+			{
+				cyc = rdtsc();
+				delta = pPage->time_offset + (cyc >> pPage->time_shift) * pPage->time_mult
+					+ (((cyc & (((uint64_t)1 << pPage->time_shift) - 1)) * pPage->time_mult) >> pPage->time_shift);
+				enabled += delta;
+				running += delta;	/* (the counter is on the hardware, so running too) */
+			}
+		}
+		__asm__ volatile("" ::: "memory");
+	} while (pPage->lock != seq);
+	*pCount = count;
+	if (aTimes)
+	{
+		aTimes[0] = enabled;
+		aTimes[1] = running;
+	}
+	return bOK;
+}
+#else
+static inline int readUserCounter(struct perf_event_mmap_page *pPage, uint64_t *pCount, uint64_t aTimes[2])
+{
+	return 0;
+}
+#endif
+#endif
+
+int perf_init(int every)
+{
+	int		numOpen,k;
+#ifdef __linux__
+	const uint32_t aType[PERF_NUM_COUNTERS] = { PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HW_CACHE, PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE };
+	const uint64_t aConfig[PERF_NUM_COUNTERS] = { PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+		PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+		PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES };
+	void	*pPage;
+	int		lastErrno;
+#endif
+
+	if (g_perfEnabled)
+	{
+		return 0;	/* (already set up, e.g. by the other half of samplingPipeline) */
+	}
+	g_perfEvery = (every > 0) ? every : 1;
+	numOpen = 0;
+#ifdef __linux__
+	lastErrno = 0;
+	g_leader = -1;
+	for (k = 0; k < PERF_NUM_COUNTERS; k++)
+	{
+		g_apPage[k] = NULL;
+		g_aFd[k] = openCounter(aType[k], aConfig[k], (g_leader >= 0) ? g_aFd[g_leader] : -1);
+		if (g_aFd[k] < 0)
+		{
+			lastErrno = errno;
+			continue;
+		}
+		if (g_leader < 0)
+		{
+			g_leader = k;
+		}
+		numOpen++;
+		pPage = mmap(NULL, (size_t)sysconf(_SC_PAGESIZE), PROT_READ, MAP_SHARED, g_aFd[k], 0);
+		if (pPage != MAP_FAILED)
+		{
+			g_apPage[k] = (struct perf_event_mmap_page*)pPage;
+		}
+	}
+	fprintf(stdout, "profiling: %d of %d hardware counters available", numOpen, PERF_NUM_COUNTERS);
+	if (numOpen < PERF_NUM_COUNTERS)
+	{
+		fprintf(stdout, " (perf_event_open: %s)", strerror(lastErrno));
+	}
+	fprintf(stdout, "; measuring 1 in %d calls\n", g_perfEvery);
+#else
+	fprintf(stdout, "profiling: hardware counters not available on this platform (wall time only)\n");
+#endif
+	g_perfEnabled = 1;
+	return numOpen;
+}
+
+void perf_read(uint64_t aCounts[PERF_NUM_READINGS])
+{
+	int k;
+#ifdef __linux__
+	uint64_t	aLeader[3];		/* (the leader's value, then its enabled and running times) */
+#endif
+
+	for (k = 0; k < PERF_NUM_READINGS; k++)
+	{
+		aCounts[k] = 0;
+	}
+#ifdef __linux__
+	for (k = 0; k < PERF_NUM_COUNTERS; k++)
+	{
+		if (k == g_leader)
+		{
+			if (!(g_apPage[k] && readUserCounter(g_apPage[k], &aCounts[k], &aCounts[PERF_TIME_ENABLED])))
+			{
+				if (read(g_aFd[k], aLeader, sizeof(aLeader)) == sizeof(aLeader))
+				{
+					aCounts[k] = aLeader[0];
+					aCounts[PERF_TIME_ENABLED] = aLeader[1];
+					aCounts[PERF_TIME_RUNNING] = aLeader[2];
+				}
+				else
+				{
+					aCounts[k] = aCounts[PERF_TIME_ENABLED] = aCounts[PERF_TIME_RUNNING] = 0;
+				}
+			}
+		}
+		else if (g_aFd[k] >= 0 && !(g_apPage[k] && readUserCounter(g_apPage[k], &aCounts[k], NULL)))
+		{
+			if (read(g_aFd[k], &aCounts[k], sizeof(uint64_t)) != sizeof(uint64_t))
+			{
+				aCounts[k] = 0;
+			}
+		}
+	}
+#endif
+}
+
+double perf_wall()
+{
+#if defined(__linux__) || defined(__APPLE__)
+	struct timespec	sTime;
+
+	clock_gettime(CLOCK_MONOTONIC, &sTime);
+	return (double)sTime.tv_sec + 1e-9 * (double)sTime.tv_nsec;
+#else
+	return (double)clock() / CLOCKS_PER_SEC;
+#endif
+}
+
+/*
+	Totals are scaled up from the measured calls to all of them, and from the time the group was counting to the time it
+	was enabled (shown as counting=, the percentage of the time it wasn't multiplexed out); counters that couldn't be
+	opened are given as "-"
+*/
+void perf_report(FILE *fOut, perf_region *apRegions[], int numRegions)
+{
+	perf_region	*pRegion;
+	double		scale,counting,numEvents,aTotal[PERF_NUM_COUNTERS];
+	int			i,k,numAvailable,bAvailable[PERF_NUM_COUNTERS];
+
+	if (!g_perfEnabled)
+	{
+		return;
+	}
+	numAvailable = 0;
+	for (k = 0; k < PERF_NUM_COUNTERS; k++)
+	{
+#ifdef __linux__
+		bAvailable[k] = (g_aFd[k] >= 0);
+#else
+		bAvailable[k] = 0;
+#endif
+		numAvailable += bAvailable[k];
+	}
+	fprintf(fOut, "profile (unavailable counters shown as -):\n");
+	for (i = 0; i < numRegions; i++)
+	{
+		pRegion = apRegions[i];
+		scale = pRegion->numSampled ? (double)pRegion->numCalls / pRegion->numSampled : 0.0;
+		counting = (pRegion->aTotal[PERF_TIME_ENABLED] > 0) ? (double)pRegion->aTotal[PERF_TIME_RUNNING] / (double)pRegion->aTotal[PERF_TIME_ENABLED] : 1.0;
+		numEvents = (double)(pRegion->numEvents ? pRegion->numEvents : pRegion->numCalls);
+		for (k = 0; k < PERF_NUM_COUNTERS; k++)
+		{
+			aTotal[k] = (counting > 0.0) ? scale * (double)pRegion->aTotal[k] / counting : 0.0;
+		}
+		fprintf(fOut, "\t%s: calls=%ld sampled=%ld events=%.0f secs=%.4f", pRegion->szName, pRegion->numCalls, pRegion->numSampled, numEvents, scale * pRegion->wallSecs);
+		if (numAvailable)
+		{
+			fprintf(fOut, " counting=%.1f%%", 100.0 * counting);
+		}
+		for (k = 0; k < PERF_NUM_COUNTERS; k++)
+		{
+			if (bAvailable[k])
+			{
+				fprintf(fOut, " %s=%.0f", g_aszCounterNames[k], aTotal[k]);
+			}
+			else
+			{
+				fprintf(fOut, " %s=-", g_aszCounterNames[k]);
+			}
+		}
+		if (bAvailable[PERF_CYCLES] && bAvailable[PERF_INSTRUCTIONS] && aTotal[PERF_CYCLES] > 0.0)
+		{
+			fprintf(fOut, " IPC=%.3f", aTotal[PERF_INSTRUCTIONS] / aTotal[PERF_CYCLES]);
+		}
+		else
+		{
+			fprintf(fOut, " IPC=-");
+		}
+		for (k = PERF_L1D_MISSES; k <= PERF_BRANCH_MISSES; k++)
+		{
+			if (bAvailable[k] && numEvents > 0.0)
+			{
+				fprintf(fOut, " %sPerEvent=%.4f", g_aszCounterNames[k], aTotal[k] / numEvents);
+			}
+			else
+			{
+				fprintf(fOut, " %sPerEvent=-", g_aszCounterNames[k]);
+			}
+		}
+		fprintf(fOut, "\n");
+	}
+}
+
+void perf_reset(perf_region *apRegions[], int numRegions)
+{
+	const char	*szName;
+	int			i;
+
+	for (i = 0; i < numRegions; i++)
+	{
+		szName = apRegions[i]->szName;
+		memset(apRegions[i], 0, sizeof(perf_region));
+		apRegions[i]->szName = szName;
+	}
+}
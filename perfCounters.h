@@ -0,0 +1,93 @@
+#ifndef _PERF_COUNTERS_H_
+#define _PERF_COUNTERS_H_
+
+/*
+	Hardware performance counters around named regions of code, for profiling where perf itself can't be run
+
+	On Linux the counters are opened with perf_event_open for this thread only (user space only, so they work with the
+	usual perf_event_paranoid=2), and read with rdpmc where the kernel allows it (a few tens of cycles) or read()
+	otherwise; each counter that can't be opened (e.g. in a virtual machine, or on other platforms) is just reported as
+	unavailable, and wall time is always recorded, so profiling never stops a program running
+
+	The counters are opened as one group (led by cycles), so the kernel only ever schedules them together and ratios
+	between them (IPC) are over the same time; the times the group was enabled and actually counting are read with
+	them, so when it is multiplexed with other events (e.g. on a shared node) the counts are scaled up to the whole time
+
+	Regions are timed between perf_begin() and perf_end(), which do nothing unless perf_init() has been called; for a
+	region entered millions of times, perf_init(every) with every > 1 only measures one call in every (and scales up)
+*/
+
+#include <stdio.h>
+#include <stdint.h>
+
+#define PERF_CYCLES			0
+#define PERF_INSTRUCTIONS	1
+#define PERF_L1D_MISSES		2
+#define PERF_LLC_MISSES		3
+#define PERF_BRANCH_MISSES	4
+#define PERF_NUM_COUNTERS	5
+#define PERF_TIME_ENABLED	5	/* (nanoseconds the group was enabled and counting, read after the counters) */
+#define PERF_TIME_RUNNING	6
+#define PERF_NUM_READINGS	7
+
+typedef struct
+{
+	const char	*szName;
+	long		numCalls;
+	long		numSampled;		/* calls which were measured */
+	long		numEvents;		/* what "per event" is per in the report (set by the caller; the number of calls if 0) */
+	uint64_t	aTotal[PERF_NUM_READINGS];	/* over the measured calls */
+	double		wallSecs;
+	uint64_t	aStart[PERF_NUM_READINGS];
+	double		startWall;
+	int			bSampled;		/* whether the current call is being measured */
+} perf_region;
+
+extern int	g_perfEnabled;
+extern int	g_perfEvery;
+
+/* open the counters (returns the number available, or 0 if already open; profiling is on even if there are none) */
+int		perf_init(int every);
+
+/* read all the counters and the group's enabled and running times (unavailable ones read 0), and the wall clock in seconds */
+void	perf_read(uint64_t aCounts[PERF_NUM_READINGS]);
+double	perf_wall();
+
+/* write a line per region (calls, time, IPC and misses per event) */
+void	perf_report(FILE *fOut, perf_region *apRegions[], int numRegions);
+
+/* zero the regions (e.g. between the parameter sets of a sweep) */
+void	perf_reset(perf_region *apRegions[], int numRegions);
+
+static inline void perf_begin(perf_region *pRegion)
+{
+	if (g_perfEnabled)
+	{
+		pRegion->bSampled = (pRegion->numCalls++ % g_perfEvery) == 0;
+		if (pRegion->bSampled)
+		{
+			perf_read(pRegion->aStart);
+			pRegion->startWall = perf_wall();
+		}
+	}
+}
+
+static inline void perf_end(perf_region *pRegion)
+{
+	uint64_t	aNow[PERF_NUM_READINGS];
+	int			k;
+
+	if (pRegion->bSampled)
+	{
+		pRegion->wallSecs += perf_wall() - pRegion->startWall;
+		perf_read(aNow);
+		for (k = 0; k < PERF_NUM_READINGS; k++)
+		{
+			pRegion->aTotal[k] += aNow[k] - pRegion->aStart[k];
+		}
+		pRegion->numSampled++;
+		pRegion->bSampled = 0;
+	}
+}
+
+#endif /* _PERF_COUNTERS_H_ */
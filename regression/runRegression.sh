@@ -0,0 +1,655 @@
+#!/bin/bash
+
+#
+# Regression harness for landscapeScaleSimulation and simulatedAnnealing (and samplingPipeline, which combines them)
+#
+# Runs entirely offline on the small landscape in regression/landscape, and has two parts
+#	1) exact checks: with a fixed seed, output of each run is diffed against stored references
+#		(for changes which are meant to leave results bit-identical)
+#	2) statistical checks: an ensemble is compared to an ensemble from the exact engine using
+#		Kolmogorov-Smirnov tests on end times and numbers of infected cells, and a test of the probability of infection in each cell
+#		(for engines which are only meant to be statistically equivalent; see compareEnsembles.c)
+#
+# Usage (from anywhere)
+#	./regression/runRegression.sh			run all checks
+#	./regression/runRegression.sh update	regenerate the stored references (only do this deliberately!)
+#
+# Programs are built with "make -f Makefile.regression", so to check a build with different flags use e.g.
+#	make -f Makefile.regression clean; make -f Makefile.regression CFLAGS="-O3 -D<FLAG>"; ./regression/runRegression.sh
+#
+
+cd "$(dirname "$0")/.." || exit 1
+
+LANDSCAPE=regression/landscape
+REFERENCE=regression/reference
+OUTPUT=regression/output
+STUB=regressionRuns
+
+#
+# Parameters shared by every run of the simulation
+#
+SIM_ARGS="filePropFull=$LANDSCAPE/propFull.txt fileRelInf=$LANDSCAPE/relInfectivity.txt fileRelSus=$LANDSCAPE/relSusceptibility.txt fileRelPri=$LANDSCAPE/relPrimaryInf.txt outStub=$STUB ratePriInf=0.05 rateSecInf=10 dispScale=3 withinCellBulkUp=1.25 withinCellMin=0.006 trueMinFlag=0 cellThresh=0.0 maxTime=1000000.0 reportTime=1"
+EXACT_ARGS="numIts=8 seed=11 maxIncidence=0.1"
+STAT_ARGS="numIts=200 maxIncidence=0.2"
+STAT_REF_SEED=101
+STAT_TEST_SEED=202
+ANNEAL_ARGS="numIts=-1 numSites=5 samplesPerSite=50 withinCellBulkUp=1.0 withinCellMin=0.006 trueMinFlag=0 testSens=0.5 detLag=0.0 allowDuplicates=0 delta=1.0 objFuncOut=objectiveFunction.txt cool=10 alpha=0.999 simann_n=300 seed=5"
+
+#
+# Files which legitimately differ between runs (paths, timings)
+#
+IGNORE_FILES="paramsOut.txt benchmark.txt memory.txt ${STUB}_paramsOut.txt"
+
+NUM_FAILED=0
+SIM_PROG=./landscapeScaleSimulation
+
+make -f Makefile.regression all > /dev/null || exit 1
+mkdir -p $OUTPUT
+
+#
+# runSim <name> <args> : run the simulation, with output ending up in $OUTPUT/<name>
+#	(the first value given for a key on the command line is used, so <args> override $SIM_ARGS)
+#
+runSim()
+{
+	rm -rf $STUB $OUTPUT/$1
+	$SIM_PROG $2 $SIM_ARGS > $OUTPUT/$1.log 2>&1
+	mv $STUB $OUTPUT/$1
+}
+
+#
+# diffDirs <name> <reference dir> <output dir> : diff every file in the reference
+#
+diffDirs()
+{
+	local BAD=0
+	for REF_FILE in $2/*
+	do
+		FILE_NAME=$(basename $REF_FILE)
+		if ! cmp -s $REF_FILE $3/$FILE_NAME
+		then
+			echo "	$FILE_NAME differs"
+			BAD=1
+		fi
+	done
+	if [ $BAD -eq 0 ]
+	then
+		echo "exact      $1: ok"
+	else
+		echo "exact      $1: FAILED"
+		NUM_FAILED=$((NUM_FAILED+1))
+	fi
+}
+
+stripIgnored()
+{
+	for FILE_NAME in $IGNORE_FILES
+	do
+		rm -f $1/$FILE_NAME
+	done
+}
+
+#
+# exactCheck <name> <args> : outputs with these (extra) arguments must be bit-identical to the exact reference
+#
+exactCheck()
+{
+	runSim $1 "$2 $EXACT_ARGS"
+	diffDirs $1 $REFERENCE/exact $OUTPUT/$1
+}
+
+#
+# sweepCheck <name> : a parameter sweep must give the same output for each set as separate runs, so
+#	a set with the exact check parameters after one with a different kernel must match the exact reference,
+#	and repeating the first set (so reusing its cached kernel) must give identical output
+#
+sweepCheck()
+{
+	printf "# regression sweep\ndispScale=5 rateSecInf=20\nseed=11\n\ndispScale=5 rateSecInf=20\n" > $OUTPUT/$1.txt
+	runSim $1 "sweepFile=$OUTPUT/$1.txt $EXACT_ARGS"
+	stripIgnored $OUTPUT/$1/${STUB}_0
+	stripIgnored $OUTPUT/$1/${STUB}_2
+	diffDirs $1 $REFERENCE/exact $OUTPUT/$1/${STUB}_1
+	diffDirs $1Repeat $OUTPUT/$1/${STUB}_0 $OUTPUT/$1/${STUB}_2
+}
+
+#
+# crnCheck <name> : with common random numbers, iteration i must have the same first (primary) infection
+#	whatever the rate of secondary infection
+#
+crnCheck()
+{
+	local BAD=0
+	runSim ${1}A "commonRandomNumbers=1 $EXACT_ARGS"
+	runSim ${1}B "commonRandomNumbers=1 rateSecInf=20 dispScale=5 $EXACT_ARGS"
+	for ((i=0; i<$(cat $OUTPUT/${1}A/lastRunNumber.txt); i++))
+	do
+		if [ "$(head -1 $OUTPUT/${1}A/${STUB}_$i.txt | cut -d' ' -f1-4)" != "$(head -1 $OUTPUT/${1}B/${STUB}_$i.txt | cut -d' ' -f1-4)" ]
+		then
+			echo "	first infection differs in run $i"
+			BAD=1
+		fi
+	done
+	if [ $BAD -eq 0 ]
+	then
+		echo "exact      $1: ok"
+	else
+		echo "exact      $1: FAILED"
+		NUM_FAILED=$((NUM_FAILED+1))
+	fi
+}
+
+#
+# shardCheck <name> <args> : an ensemble run as three shards and merged must be identical to one run in a single process
+#	(sharding always uses common random numbers, so iteration i draws the same random numbers whichever shard runs it),
+#	including the weights of the runs with introStrata
+#
+shardCheck()
+{
+	runSim ${1}Single "commonRandomNumbers=1 aggregateRasters=1 $2 $EXACT_ARGS"
+	stripIgnored $OUTPUT/${1}Single
+	# (merged aggregate rasters, and the total weight with introStrata, only agree to rounding, so are set aside for aggregateCheck)
+	rm -rf $OUTPUT/${1}SingleAggregate
+	mkdir -p $OUTPUT/${1}SingleAggregate
+	mv $OUTPUT/${1}Single/aggregate_*.asc $OUTPUT/${1}Single/aggregate.txt $OUTPUT/${1}SingleAggregate
+	rm -rf $STUB $OUTPUT/$1
+	for k in 0 1 2
+	do
+		$SIM_PROG shard=$k/3 aggregateRasters=1 $2 $EXACT_ARGS $SIM_ARGS > $OUTPUT/$1_$k.log 2>&1
+	done
+	$SIM_PROG mergeShards=3 $SIM_ARGS > $OUTPUT/$1Merge.log 2>&1
+	mv $STUB $OUTPUT/$1
+	diffDirs $1 $OUTPUT/${1}Single $OUTPUT/$1
+}
+
+#
+# snapshotCheck <name> : writing snapshots must not change the exact reference, and iteration 0 of a simulation carrying on
+#	from a snapshot must finish exactly as the run the snapshot was taken from (later iterations are independent continuations)
+#
+snapshotCheck()
+{
+	local BAD=0
+	exactCheck $1 "snapshotIncidence=0.05"
+	runSim ${1}Fork "snapshotFile=$OUTPUT/$1/snapshot_3.bin numIts=2 seed=12 maxIncidence=0.1"
+	for FILE_NAME in ${STUB}_ endTime_ endReason_
+	do
+		if ! cmp -s $REFERENCE/exact/${FILE_NAME}3.txt $OUTPUT/${1}Fork/${FILE_NAME}0.txt
+		then
+			echo "	${FILE_NAME}0.txt differs from the run the snapshot was taken from"
+			BAD=1
+		fi
+	done
+	if ! cmp -s <(tail -n $(wc -l < $OUTPUT/${1}Fork/${STUB}_dpc_0.txt) $REFERENCE/exact/${STUB}_dpc_3.txt) $OUTPUT/${1}Fork/${STUB}_dpc_0.txt
+	then
+		echo "	${STUB}_dpc_0.txt differs from the end of the run the snapshot was taken from"
+		BAD=1
+	fi
+	if [ $BAD -eq 0 ]
+	then
+		echo "exact      ${1}Fork: ok"
+	else
+		echo "exact      ${1}Fork: FAILED"
+		NUM_FAILED=$((NUM_FAILED+1))
+	fi
+}
+
+#
+# annealCheck <name> <args> : annealing on output of the exact check must reproduce the reference pattern
+#
+annealCheck()
+{
+	rm -rf $OUTPUT/$1
+	./simulatedAnnealing inputDirectory=$OUTPUT/exact/ outStub=$STUB outputDirectory=$OUTPUT/$1 $2 $ANNEAL_ARGS > $OUTPUT/$1.log 2>&1
+	diffDirs $1 $REFERENCE/anneal $OUTPUT/$1
+}
+
+#
+# thresholdCheck <name> : a run continuing through a list of maxIncidence values must match the exact reference at the largest,
+#	and annealing at a smaller value must match annealing on a run which stopped there
+#	(using common random numbers, so where one run stops does not affect the random numbers used by the next)
+#
+thresholdCheck()
+{
+	runSim $1 "maxIncidence=0.05,0.1 $EXACT_ARGS"
+	diffDirs $1 $REFERENCE/exact $OUTPUT/$1
+	runSim ${1}List "commonRandomNumbers=1 maxIncidence=0.05,0.1 $EXACT_ARGS"
+	runSim ${1}Small "commonRandomNumbers=1 maxIncidence=0.05 $EXACT_ARGS"
+	rm -rf $OUTPUT/${1}Anneal $OUTPUT/${1}SmallAnneal
+	./simulatedAnnealing inputDirectory=$OUTPUT/${1}List/ outStub=$STUB outputDirectory=$OUTPUT/${1}Anneal threshold=0.05 $ANNEAL_ARGS > $OUTPUT/${1}Anneal.log 2>&1
+	./simulatedAnnealing inputDirectory=$OUTPUT/${1}Small/ outStub=$STUB outputDirectory=$OUTPUT/${1}SmallAnneal $ANNEAL_ARGS > $OUTPUT/${1}SmallAnneal.log 2>&1
+	stripIgnored $OUTPUT/${1}Anneal
+	stripIgnored $OUTPUT/${1}SmallAnneal
+	diffDirs ${1}Anneal $OUTPUT/${1}SmallAnneal $OUTPUT/${1}Anneal
+}
+
+#
+# pipelineCheck <name> : runs archived by samplingPipeline must match the exact reference, and the sequence of sampling patterns
+#	must match annealing on those files (objective values can differ in the last place, as infection times are rounded in the files),
+#	and must be identical when runs are not archived
+#
+pipelineCheck()
+{
+	local PIPE_ARGS="outputDirectory=$OUTPUT/$1Pattern numSites=5 samplesPerSite=50 testSens=0.5 detLag=0.0 allowDuplicates=0 delta=1.0 objFuncOut=objectiveFunction.txt cool=10 alpha=0.999 simann_n=300"
+	local BAD=0
+	rm -rf $STUB $OUTPUT/$1 $OUTPUT/$1Pattern $OUTPUT/$1Archive $OUTPUT/$1NoArchivePattern $OUTPUT/$1FileAnneal
+	./samplingPipeline $PIPE_ARGS $EXACT_ARGS $SIM_ARGS > $OUTPUT/$1.log 2>&1
+	mv $STUB $OUTPUT/$1
+	diffDirs $1 $REFERENCE/exact $OUTPUT/$1
+	./simulatedAnnealing inputDirectory=$OUTPUT/$1/ outputDirectory=$OUTPUT/$1FileAnneal $PIPE_ARGS $EXACT_ARGS $SIM_ARGS > $OUTPUT/$1FileAnneal.log 2>&1
+	if ! cmp -s <(cut -d' ' -f1,3- $OUTPUT/$1FileAnneal/objectiveFunction.txt) <(cut -d' ' -f1,3- $OUTPUT/$1Pattern/objectiveFunction.txt)
+	then
+		echo "	sampling patterns differ from annealing on archived runs"
+		BAD=1
+	fi
+	mv $OUTPUT/$1Pattern $OUTPUT/$1Archive
+	./samplingPipeline archiveRuns=0 $PIPE_ARGS $EXACT_ARGS $SIM_ARGS > $OUTPUT/$1NoArchive.log 2>&1
+	mv $OUTPUT/$1Pattern $OUTPUT/$1NoArchivePattern
+	if ! cmp -s $OUTPUT/$1Archive/objectiveFunction.txt $OUTPUT/$1NoArchivePattern/objectiveFunction.txt
+	then
+		echo "	sampling patterns differ when runs are not archived"
+		BAD=1
+	fi
+	if ls $STUB/${STUB}_0.txt > /dev/null 2>&1
+	then
+		echo "	runs were archived with archiveRuns=0"
+		BAD=1
+	fi
+	rm -rf $STUB
+	if [ $BAD -eq 0 ]
+	then
+		echo "exact      ${1}Anneal: ok"
+	else
+		echo "exact      ${1}Anneal: FAILED"
+		NUM_FAILED=$((NUM_FAILED+1))
+	fi
+}
+
+#
+# surveillanceCheck <name> : evaluating the final pattern from pipelineCheck in the runs (surveyFile) must not change them, and
+#	must give the annealer's objective function for it (to the precision it is printed), whether or not the runs are archived
+#	(also with splitLevels, where the copies of a run start from its dpc file when archived), and identical output for an
+#	ensemble run as three shards and merged
+#
+surveillanceCheck()
+{
+	local SURVEY_ARGS="surveyFile=$OUTPUT/$1Pattern.txt delta=1.0 samplesPerSite=50 testSens=0.5 detLag=0.0"
+	local BAD=0
+	tail -1 $OUTPUT/pipelineFileAnneal/objectiveFunction.txt | cut -d' ' -f3- > $OUTPUT/$1Pattern.txt
+	exactCheck $1 "$SURVEY_ARGS"
+	if ! awk -v obj=$(tail -1 $OUTPUT/pipelineFileAnneal/objectiveFunction.txt | cut -d' ' -f2) '{d=$4-obj; exit (d > 0.0001 || d < -0.0001)}' $OUTPUT/$1/surveillanceSummary.txt
+	then
+		echo "	pDetect differs from the objective function of the pattern"
+		BAD=1
+	fi
+	runSim ${1}NoArchive "archiveRuns=0 $SURVEY_ARGS $EXACT_ARGS"
+	if ! cmp -s $OUTPUT/$1/surveillance.txt $OUTPUT/${1}NoArchive/surveillance.txt || ls $OUTPUT/${1}NoArchive/${STUB}_0.txt > /dev/null 2>&1
+	then
+		echo "	output differs (or runs were archived) with archiveRuns=0"
+		BAD=1
+	fi
+	runSim ${1}Split "splitLevels=0.01 splitFactor=2 $SURVEY_ARGS $EXACT_ARGS"
+	runSim ${1}SplitNoArchive "splitLevels=0.01 splitFactor=2 archiveRuns=0 $SURVEY_ARGS $EXACT_ARGS"
+	if ! cmp -s $OUTPUT/${1}Split/surveillance.txt $OUTPUT/${1}SplitNoArchive/surveillance.txt || ls $OUTPUT/${1}SplitNoArchive/${STUB}_dpc_0.txt > /dev/null 2>&1
+	then
+		echo "	output differs (or runs were archived) with splitLevels and archiveRuns=0"
+		BAD=1
+	fi
+	runSim ${1}Single "commonRandomNumbers=1 $SURVEY_ARGS $EXACT_ARGS"
+	rm -rf $STUB $OUTPUT/${1}Shards
+	for k in 0 1 2
+	do
+		$SIM_PROG shard=$k/3 $SURVEY_ARGS $EXACT_ARGS $SIM_ARGS > $OUTPUT/${1}Shards_$k.log 2>&1
+	done
+	$SIM_PROG mergeShards=3 $SIM_ARGS > $OUTPUT/${1}ShardsMerge.log 2>&1
+	mv $STUB $OUTPUT/${1}Shards
+	for FILE_NAME in surveillance.txt surveillanceSummary.txt
+	do
+		if ! cmp -s $OUTPUT/${1}Single/$FILE_NAME $OUTPUT/${1}Shards/$FILE_NAME
+		then
+			echo "	$FILE_NAME differs when merged from shards"
+			BAD=1
+		fi
+	done
+	if [ $BAD -eq 0 ]
+	then
+		echo "exact      ${1}Patterns: ok"
+	else
+		echo "exact      ${1}Patterns: FAILED"
+		NUM_FAILED=$((NUM_FAILED+1))
+	fi
+}
+
+#
+# aggregateCheck <name> : the aggregate rasters of the exact check must agree with the runs written out (number of runs each
+#	cell was infected in, and mean final incidence), those merged from shards must agree with a single process to rounding,
+#	and with coarsen=3 the header must describe the coarse grid (the 40x40 landscape overhangs by two cells at the bottom);
+#	they must not be written unless asked for (aggregateRasters=1)
+#
+aggregateCheck()
+{
+	local BAD=0
+	if ! awk -v n=$(cat $OUTPUT/exact/lastRunNumber.txt) '
+		FILENAME ~ /\.asc$/ { if (FNR == 1) { y = -1; g++ } if (FNR > 6) { y++; for (x = 1; x <= NF; x++) { v[g, x - 1, y] = $x } } next }
+		{ cnt[$1, $2]++; fin[$1, $2] += $15 }
+		END {
+			for (k in v) { split(k, a, SUBSEP); if (a[1] == 1) { c = (a[2] SUBSEP a[3]) in cnt ? cnt[a[2], a[3]] : 0; f = (a[2] SUBSEP a[3]) in fin ? fin[a[2], a[3]] : 0;
+				if (v[k] != -9999 && ((v[k] * n - c) ^ 2 > 1e-12 || (v[2, a[2], a[3]] * n - f) ^ 2 > 1e-6)) { bad = 1 } } }
+			exit bad }' $OUTPUT/exact/${STUB}_[0-9]*.txt $OUTPUT/exact/aggregate_probInf.asc $OUTPUT/exact/aggregate_meanFinalInc.asc
+	then
+		echo "	aggregate rasters disagree with the runs"
+		BAD=1
+	fi
+	for FILE_NAME in $OUTPUT/shardSingleAggregate/aggregate* $OUTPUT/shardStrataSingleAggregate/aggregate*
+	do
+		SHARD_DIR=$(basename $(dirname $FILE_NAME) SingleAggregate)
+		if ! paste -d' ' $FILE_NAME $OUTPUT/$SHARD_DIR/$(basename $FILE_NAME) | awk -v skip=$([ "${FILE_NAME%.asc}" != "$FILE_NAME" ] && echo 6 || echo 0) 'NR > skip { for (x = 1; x <= NF / 2; x++) { d = $x - $(x + NF / 2); if (d * d > 1e-14) { exit 1 } } }'
+		then
+			echo "	$(basename $FILE_NAME) differs when merged from shards ($SHARD_DIR)"
+			BAD=1
+		fi
+	done
+	if [ "$(head -6 $OUTPUT/coarsen/aggregate_probInf.asc | tr '\t' ' ' | tr '\n' ' ')" != "ncols 14 nrows 14 xllcorner 0 yllcorner -2000 cellsize 3000 NODATA_value -9999 " ]
+	then
+		echo "	header of the coarse aggregate rasters is wrong"
+		BAD=1
+	fi
+	if ls $OUTPUT/thresholds/aggregate* > /dev/null 2>&1
+	then
+		echo "	aggregate rasters written without aggregateRasters=1"
+		BAD=1
+	fi
+	if [ $BAD -eq 0 ]
+	then
+		echo "exact      $1: ok"
+	else
+		echo "exact      $1: FAILED"
+		NUM_FAILED=$((NUM_FAILED+1))
+	fi
+}
+
+#
+# statCheck <name> <args> [<shared args>] : ensemble with these (extra) arguments must be statistically equivalent to the exact engine
+#	(if <shared args> are given they are used in both ensembles, and the exact engine has its own reference ensemble)
+#
+statCheck()
+{
+	local REF=statRef
+	if [ -n "$3" ]
+	then
+		REF=${1}Ref
+		runSim $REF "$3 $STAT_ARGS seed=$STAT_REF_SEED"
+	elif [ ! -d $OUTPUT/statRef ]
+	then
+		runSim statRef "$STAT_ARGS seed=$STAT_REF_SEED"
+	fi
+	runSim $1 "$2 $3 $STAT_ARGS seed=$STAT_TEST_SEED"
+	compareCheck $1 $REF
+}
+
+#
+# compareCheck <name> <ref> : the ensemble in $OUTPUT/<name> must be statistically equivalent to the one in $OUTPUT/<ref>
+#
+compareCheck()
+{
+	if ./compareEnsembles refDirectory=$OUTPUT/$2 testDirectory=$OUTPUT/$1 outStub=$STUB > $OUTPUT/$1.compare.log 2>&1
+	then
+		echo "statistical $1: ok"
+	else
+		echo "statistical $1: FAILED"
+		grep "p=" $OUTPUT/$1.compare.log
+		NUM_FAILED=$((NUM_FAILED+1))
+	fi
+}
+
+#
+# shiftCheck <name> <ensemble> : compareEnsembles must reject a copy of an ensemble with every infection moved half the
+#	landscape away (the same numbers of infected cells and end times, and the same spread of probabilities over the cells)
+#
+shiftCheck()
+{
+	rm -rf $OUTPUT/$1
+	cp -r $OUTPUT/$2 $OUTPUT/$1
+	for FILE_NAME in $OUTPUT/$1/${STUB}_[0-9]*.txt
+	do
+		awk -v n=$(wc -l < $OUTPUT/$1/activeLandscape.txt) '{ $13 = ($13 + int(n / 2)) % n; print }' $FILE_NAME > $FILE_NAME.tmp
+		mv $FILE_NAME.tmp $FILE_NAME
+	done
+	if ./compareEnsembles refDirectory=$OUTPUT/statRef testDirectory=$OUTPUT/$1 outStub=$STUB > $OUTPUT/$1.compare.log 2>&1
+	then
+		echo "statistical $1: FAILED (a shifted epidemic was accepted)"
+		NUM_FAILED=$((NUM_FAILED+1))
+	else
+		echo "statistical $1: ok"
+	fi
+}
+
+#
+# kernelTailCheck <name> : on a larger synthetic landscape with a long kernel (so most of the kernel table is entries too
+#	small to resolve next to 1 in single precision), the single precision build must still be statistically equivalent
+#	to the double precision one
+#
+kernelTailCheck()
+{
+	local LARGE_ARGS="filePropFull=$OUTPUT/largeLandscape/propFull.txt fileRelInf=$OUTPUT/largeLandscape/relInfectivity.txt fileRelSus=$OUTPUT/largeLandscape/relSusceptibility.txt fileRelPri=$OUTPUT/largeLandscape/relPrimaryInf.txt dispScale=20 numIts=200 maxIncidence=0.02"
+	./generateLandscape numRows=250 numCols=250 hostDensity=0.3 clusterScale=5 seed=1 outDir=$OUTPUT/largeLandscape > /dev/null
+	runSim ${1}Ref "$LARGE_ARGS seed=$STAT_REF_SEED"
+	SIM_PROG=./single/landscapeScaleSimulation
+	runSim $1 "singlePrecision=1 $LARGE_ARGS seed=$STAT_TEST_SEED"
+	SIM_PROG=./landscapeScaleSimulation
+	compareCheck $1 ${1}Ref
+}
+
+#
+# cellOrderCheck <name> <order> : storing cells along a space-filling curve must be statistically equivalent to raster order,
+#	and all output must still use raster cell numbers (so activeLandscape.txt is identical)
+#
+cellOrderCheck()
+{
+	statCheck $1 "cellOrder=$2"
+	if cmp -s $REFERENCE/exact/activeLandscape.txt $OUTPUT/$1/activeLandscape.txt
+	then
+		echo "exact      $1: ok"
+	else
+		echo "	activeLandscape.txt differs"
+		echo "exact      $1: FAILED"
+		NUM_FAILED=$((NUM_FAILED+1))
+	fi
+}
+
+#
+# tiledCheck <name> <args> : the tiled engine must be statistically equivalent to the exact engine, and give identical
+#	output whatever the number of threads (it is exact, so is checked with windows long enough to bias tau-leaping)
+#
+tiledCheck()
+{
+	statCheck $1 "$2"
+	runSim ${1}OneThread "$2 numThreads=1 $EXACT_ARGS"
+	runSim ${1}Threads "$2 numThreads=3 $EXACT_ARGS"
+	stripIgnored $OUTPUT/${1}OneThread
+	stripIgnored $OUTPUT/${1}Threads
+	diffDirs ${1}Threads $OUTPUT/${1}OneThread $OUTPUT/${1}Threads
+}
+
+#
+# profileCheck <name> : profiling must not change the output of either program, and must write profile.txt for each
+#	(whether or not hardware counters are available)
+#
+profileCheck()
+{
+	local BAD=0
+	exactCheck $1 "profile=1 profileEvery=4"
+	annealCheck ${1}Anneal "profile=1"
+	if ! grep -q "eventLoop: calls=8 " $OUTPUT/$1/profile.txt 2>/dev/null || ! grep -q "whichCellSecondary: " $OUTPUT/$1/profile.txt
+	then
+		echo "	no simulation profile.txt"
+		BAD=1
+	fi
+	if ! grep -q "annealing: calls=1 " $OUTPUT/${1}Anneal/profile.txt 2>/dev/null || ! grep -q "calcObjFunction: " $OUTPUT/${1}Anneal/profile.txt
+	then
+		echo "	no annealing profile.txt"
+		BAD=1
+	fi
+	if [ $BAD -eq 0 ]
+	then
+		echo "exact      ${1}Report: ok"
+	else
+		echo "exact      ${1}Report: FAILED"
+		NUM_FAILED=$((NUM_FAILED+1))
+	fi
+}
+
+#
+# memoryCheck <name> : dryRun=1 must stop before running anything (and write no output directory), and estimate at least
+#	the peak of the memory tracked in the exact and annealing reference runs (the annealer's estimate is exact, to the MB shown)
+#
+memoryCheck()
+{
+	local BAD=0
+	rm -rf $STUB $OUTPUT/${1}Anneal
+	$SIM_PROG dryRun=1 aggregateRasters=1 $EXACT_ARGS $SIM_ARGS > $OUTPUT/$1.log 2>&1
+	if [ -e $STUB ]
+	then
+		echo "	dryRun wrote an output directory"
+		BAD=1
+	fi
+	if ! awk -v peak="$(sed -n 's/.*tracked total: .*\///p' $OUTPUT/exact/memory.txt)" '/total \(at most\)/ {found=1; if ($4 < peak) bad=1} END {exit !(found && !bad)}' $OUTPUT/$1.log
+	then
+		echo "	simulation estimate is less than the tracked peak"
+		BAD=1
+	fi
+	./simulatedAnnealing inputDirectory=$OUTPUT/exact/ outStub=$STUB outputDirectory=$OUTPUT/${1}Anneal dryRun=1 $ANNEAL_ARGS > $OUTPUT/${1}Anneal.log 2>&1
+	if [ -e $OUTPUT/${1}Anneal ]
+	then
+		echo "	annealing dryRun wrote an output directory"
+		BAD=1
+	fi
+	if ! awk -v peak="$(sed -n 's/.*tracked total: .*\///p' $OUTPUT/anneal/memory.txt)" '/^\ttotal:/ {found=1; if ($2 != peak) bad=1} END {exit !(found && !bad)}' $OUTPUT/${1}Anneal.log
+	then
+		echo "	annealing estimate is not the tracked peak"
+		BAD=1
+	fi
+	if [ $BAD -eq 0 ]
+	then
+		echo "exact      $1: ok"
+	else
+		echo "exact      $1: FAILED"
+		NUM_FAILED=$((NUM_FAILED+1))
+	fi
+}
+
+#
+# coarsenCheck <name> <k> : coarsen=k must keep all the host (so totalFull is divided by k^2), and map every active fine cell
+#	to a coarse cell
+#
+coarsenCheck()
+{
+	local BAD=0
+	runSim $1 "coarsen=$2 aggregateRasters=1 $EXACT_ARGS"
+	if [ "$(awk -v k=$2 '{s+=$3}END{printf "%.2f",s*k*k}' $OUTPUT/$1/activeLandscape.txt)" != "$(awk '{s+=$3}END{printf "%.2f",s}' $REFERENCE/exact/activeLandscape.txt)" ]
+	then
+		echo "	host is not conserved"
+		BAD=1
+	fi
+	if [ "$(wc -l < $OUTPUT/$1/coarsenMap.txt)" != "$(wc -l < $REFERENCE/exact/activeLandscape.txt)" ] || [ "$(awk '{print $4}' $OUTPUT/$1/coarsenMap.txt | sort -un | wc -l)" != "$(wc -l < $OUTPUT/$1/activeLandscape.txt)" ]
+	then
+		echo "	coarsenMap.txt does not map every fine cell onto the coarse cells"
+		BAD=1
+	fi
+	if [ $BAD -eq 0 ]
+	then
+		echo "exact      $1: ok"
+	else
+		echo "exact      $1: FAILED"
+		NUM_FAILED=$((NUM_FAILED+1))
+	fi
+}
+
+#
+# precisionCheck <name> : a build storing cell attributes, the kernel and detection probabilities as float (-D_SINGLE_PRECISION)
+#	must be statistically equivalent to the exact engine; its effect on the fixed-seed runs and annealing is reported
+#	(but not checked, as the output is expected to differ)
+#
+precisionCheck()
+{
+	local SAME=0
+	local SAME_INF=0
+	SIM_PROG=./single/landscapeScaleSimulation
+	statCheck $1 "singlePrecision=1"
+	runSim ${1}Exact "singlePrecision=1 $EXACT_ARGS"
+	SIM_PROG=./landscapeScaleSimulation
+	for ((i=0; i<$(cat $REFERENCE/exact/lastRunNumber.txt); i++))
+	do
+		if cmp -s $REFERENCE/exact/${STUB}_$i.txt $OUTPUT/${1}Exact/${STUB}_$i.txt
+		then
+			SAME=$((SAME+1))
+		fi
+		if cmp -s <(cut -d' ' -f3,13 $REFERENCE/exact/${STUB}_$i.txt) <(cut -d' ' -f3,13 $OUTPUT/${1}Exact/${STUB}_$i.txt)
+		then
+			SAME_INF=$((SAME_INF+1))
+		fi
+	done
+	rm -rf $OUTPUT/${1}Anneal
+	./single/simulatedAnnealing inputDirectory=$OUTPUT/exact/ outStub=$STUB outputDirectory=$OUTPUT/${1}Anneal singlePrecision=1 $ANNEAL_ARGS > $OUTPUT/${1}Anneal.log 2>&1
+	echo "info       $1: $SAME_INF of $i fixed-seed runs have the same infections ($SAME identical to the last printed digit), largest change in end time $(paste $REFERENCE/exact/endTimes.txt $OUTPUT/${1}Exact/endTimes.txt | awk '{d=$2-$1; if(d<0) d=-d; if(d>m) m=d} END {printf "%g", m}')"
+	echo "info       $1: final objective function $(tail -n 1 $OUTPUT/${1}Anneal/objectiveFunction.txt | cut -d' ' -f2) (was $(tail -n 1 $REFERENCE/anneal/objectiveFunction.txt | cut -d' ' -f2)), $(cmp -s <(tail -n 1 $OUTPUT/${1}Anneal/objectiveFunction.txt | cut -d' ' -f3-) <(tail -n 1 $REFERENCE/anneal/objectiveFunction.txt | cut -d' ' -f3-) && echo "same" || echo "different") sampling pattern"
+}
+
+if [ "$1" == "update" ]
+then
+	rm -rf $REFERENCE
+	mkdir -p $REFERENCE
+	runSim exact "$EXACT_ARGS"
+	cp -r $OUTPUT/exact $REFERENCE/exact
+	stripIgnored $REFERENCE/exact
+	./simulatedAnnealing inputDirectory=$OUTPUT/exact/ outStub=$STUB outputDirectory=$REFERENCE/anneal $ANNEAL_ARGS > $OUTPUT/anneal.log 2>&1
+	stripIgnored $REFERENCE/anneal
+	echo "references regenerated in $REFERENCE"
+	exit 0
+fi
+
+rm -rf $OUTPUT/statRef
+
+#
+# Exact checks
+#
+exactCheck exact "aggregateRasters=1"
+exactCheck quiet "logLevel=quiet progressInterval=0.001"
+profileCheck profile
+annealCheck anneal ""
+memoryCheck memory
+sweepCheck sweep
+crnCheck crn
+shardCheck shard ""
+shardCheck shardStrata "introStrata=3"
+thresholdCheck thresholds
+snapshotCheck snapshot
+coarsenCheck coarsen 3
+pipelineCheck pipeline
+surveillanceCheck surveillance
+aggregateCheck aggregate
+
+#
+# Statistical checks
+#
+statCheck exactOtherSeed ""
+shiftCheck shifted exactOtherSeed
+statCheck tauleap "engine=tauleap tauLeapSwitch=20 tauLeapEpsilon=0.02"
+statCheck fft "engine=fft fftSwitch=20 fftStep=0.05 fftTolerance=0.01"
+statCheck crn "commonRandomNumbers=1"
+statCheck split "splitLevels=0.01,0.05 splitFactor=3" "maxTime=30"
+statCheck strata "introStrata=7"
+statCheck xoshiro "rng=xoshiro"
+statCheck xoshiroCrn "rng=xoshiro commonRandomNumbers=1"
+tiledCheck tiled "engine=tiled tauLeapSwitch=20 tauLeapEpsilon=1 tileSize=4"
+cellOrderCheck morton morton
+cellOrderCheck hilbert hilbert
+precisionCheck single
+kernelTailCheck singleKernelTail
+
+if [ $NUM_FAILED -eq 0 ]
+then
+	echo "all regression checks passed"
+	exit 0
+fi
+echo "$NUM_FAILED regression check(s) FAILED"
+exit 1
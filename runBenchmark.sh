@@ -0,0 +1,54 @@
+#!/bin/bash
+
+#
+# Benchmark the landscape scale simulation on synthetic landscapes
+#
+# For each landscape size, generates a synthetic landscape (see generateLandscape.cfg), and then
+# runs a fixed-seed ensemble for each combination of dispScale, rateSecInf and maxIncidence below.
+# Each run of the simulation writes <outStub>/benchmark.txt; these are collated into one
+# line per run in benchmarkSummary.txt
+#
+# Build first with
+#	make -f Makefile.benchmark
+#
+
+SIZES="250 500 1000"
+HOST_DENSITY=0.3
+CLUSTER_SCALE=5
+DISP_SCALES="5 20"
+RATE_SEC_INFS="10 40"
+MAX_INCIDENCES="0.01 0.05"
+NUM_ITS=10
+SEED=1
+
+LANDSCAPE_DIR=benchmarkLandscape
+OUT_STUB=benchmarkRuns
+SUMMARY=benchmarkSummary.txt
+
+echo "size dispScale rateSecInf maxIncidence numCells readLandscapeSecs setupPrimarySecs setupDispersalSecs setupEpidemicSecs runEpidemicsSecs eventsPerSec runsPerSec peakRSSkB" > $SUMMARY
+
+for SIZE in $SIZES
+do
+	./generateLandscape numRows=$SIZE numCols=$SIZE hostDensity=$HOST_DENSITY clusterScale=$CLUSTER_SCALE seed=$SEED outDir=${LANDSCAPE_DIR}_$SIZE > /dev/null || exit 1
+	for DISP_SCALE in $DISP_SCALES
+	do
+		for RATE_SEC_INF in $RATE_SEC_INFS
+		do
+			for MAX_INCIDENCE in $MAX_INCIDENCES
+			do
+				./landscapeScaleSimulation \
+					filePropFull=${LANDSCAPE_DIR}_$SIZE/propFull.txt \
+					fileRelInf=${LANDSCAPE_DIR}_$SIZE/relInfectivity.txt \
+					fileRelSus=${LANDSCAPE_DIR}_$SIZE/relSusceptibility.txt \
+					fileRelPri=${LANDSCAPE_DIR}_$SIZE/relPrimaryInf.txt \
+					outStub=$OUT_STUB numIts=$NUM_ITS seed=$SEED reportTime=1000 \
+					dispScale=$DISP_SCALE rateSecInf=$RATE_SEC_INF maxIncidence=$MAX_INCIDENCE > /dev/null || exit 1
+				#
+				# Pull the values out of the key=value pairs in benchmark.txt
+				#
+				getValue() { grep "^$1=" $OUT_STUB/benchmark.txt | cut -d= -f2; }
+				echo "$SIZE $DISP_SCALE $RATE_SEC_INF $MAX_INCIDENCE $(getValue numCells) $(getValue readLandscapeSecs) $(getValue setupPrimarySecs) $(getValue setupDispersalSecs) $(getValue setupEpidemicSecs) $(getValue runEpidemicsSecs) $(getValue eventsPerSec) $(getValue runsPerSec) $(getValue peakRSSkB)" | tee -a $SUMMARY
+			done
+		done
+	done
+done
@@ -9,6 +9,12 @@
 #
 ./landscapeScaleSimulation maxIncidence=0.02
 
+#
+# To run many parameter sets it is quicker to list them in a sweep file (see landscapeScaleSimulation.cfg)
+# which shares the landscape (and dispersal kernels) between sets, e.g.
+#	./landscapeScaleSimulation sweepFile=sweep.txt
+#
+
 #
 # Produce an optimised sampling pattern based on these simulation results
 #
@@ -0,0 +1,26 @@
+#ifndef _SAMPLING_PIPELINE_H_
+#define _SAMPLING_PIPELINE_H_
+
+/*
+	Combined simulation and optimisation in a single process (samplingPipeline, see Makefile.pipeline)
+
+	landscapeScaleSimulation.c and simulatedAnnealing.c are both compiled with -D_PIPELINE, so that
+	the annealer is fed each run as soon as it finishes, rather than reading epidemicRuns/ back in
+*/
+
+/* utility functions shared by the two programs (defined in landscapeScaleSimulation.c) */
+int		getCfgFileName(char *szProgName, char *szCfgFile);
+int		readStringFromCfg(int argc, char **argv, char *szCfgFile, char *szKey, char *szValue);
+int		readDoubleFromCfg(int argc, char **argv, char *szCfgFile, char *szKey, double *pdValue);
+int		readIntFromCfg(int argc, char **argv, char *szCfgFile, char *szKey, int *pnValue);
+double	uniformRandom();
+void	seedRandom(int fixedSeed);
+
+/* called by the simulation (defined in simulatedAnnealing.c) */
+int		pipelineBegin(int argc, char **argv, int numRuns, char *szOutStub);
+int		pipelineAddHost(int hostX, int hostY, double hostDensity);
+int		pipelineAddInfection(int runNum, int hostID, double timeInf, double hostDensity);
+int		pipelineEndRun(int runNum, double endTime, double weight, int numThresholds, double *aThresholds, double *aThreshTime, int *aThreshNumInf);
+int		pipelineFinish();
+
+#endif /* _SAMPLING_PIPELINE_H_ */
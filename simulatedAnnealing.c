@@ -10,6 +10,39 @@
 */
 #include "mt19937ar.h"
 
+/*
+	Hardware performance counters around the main stages (only used if profile=1)
+*/
+#include "perfCounters.h"
+
+/*
+	Memory accounting by structure (memory.txt, and the estimate made with dryRun=1)
+*/
+#include "memTrack.h"
+
+/*
+	When built as part of samplingPipeline, the cfg utilities and random numbers come from the simulation
+*/
+#ifdef _PIPELINE
+#include "samplingPipeline.h"
+#define		readParams				readAnnealingParams
+#define		CFG_PROG_NAME			"simulatedAnnealing"		/* the pipeline reads the cfg files of both programs */
+#else
+#define		CFG_PROG_NAME			argv[0]
+#endif
+
+/*
+	Storage of host densities and detection probabilities (compile with -D_SINGLE_PRECISION to store them as float,
+	which roughly halves the memory needed for the runs; times and the objective function are always double)
+*/
+#ifdef _SINGLE_PRECISION
+typedef float	t_Real;
+#define		_SINGLE_PRECISION_FLAG	1
+#else
+typedef double	t_Real;
+#define		_SINGLE_PRECISION_FLAG	0
+#endif
+
 #ifdef _MSC_VER
 #define 	C_DIR_DELIMITER '\\'
 #include 	<direct.h>
@@ -35,7 +68,7 @@
 #define		_MY_TINY_EPS			1e-10
 #define		_SCREEN_PRINT_STEP		100
 
-#define		OUT_DIR				"samplingPattern"
+#define		DEFAULT_OUT_DIR			"samplingPattern"			/* Used unless outputDirectory is set */
 #define		HOST_INFO_FILE			"activeLandscape.txt"		/* This file is created by the landscape scale model when it runs */
 #define		DEBUG_DUMP_INFO			0							/* Whether (1) or not (0) to dump information at the end to check the calculation */
 #define		PARAM_OBJ_FUNC_TYPE		0							/*
@@ -50,6 +83,9 @@
 char	INPUT_DIR[_MAX_STATIC_BUFF_LEN];
 char	SIM_OUTPUT_STUB[_MAX_STATIC_BUFF_LEN];
 char	OBJ_FUNC_OUT[_MAX_STATIC_BUFF_LEN];
+char	OUT_DIR[_MAX_STATIC_BUFF_LEN];
+int		RAND_SEED;
+double	THRESHOLD;
 int		NUM_RUNS;
 int		PARAM_N;
 int		PARAM_n;
@@ -63,13 +99,23 @@ double	PARAM_COOL;
 double	PARAM_ALPHA;
 int		SIMANN_N;
 int		B_ALLOW_DUPLICATES;
+int		PROFILE;
+int		PROFILE_EVERY;
+int		DRY_RUN;
+
+/*
+	Regions profiled with profile=1 (events are infected hosts, host lookups and annealing steps respectively)
+*/
+perf_region	g_sProfileProbDetect = { .szName = "calcProbDetect" };
+perf_region	g_sProfileObjFunction = { .szName = "calcObjFunction" };
+perf_region	g_sProfileAnnealing = { .szName = "annealing" };
 
 typedef struct
 {
 	int				hostID;
 	int				hostX;
 	int				hostY;
-	double			hostDensity;
+	t_Real			hostDensity;
 } t_HostInfo;
 
 typedef struct
@@ -84,8 +130,9 @@ typedef struct
 	int				numInf;
 	t_HostLookup	*aHostLookup;
 	double			*aTimeInf;
-	double			*aHostDensity;
-	double			*aPDetect;
+	t_Real			*aHostDensity;
+	t_Real			*aPDetect;
+	double			weight;		/* weight of the run in the ensemble (=1 unless the simulation used splitLevels) */
 } t_RunInfo;
 
 typedef struct
@@ -104,6 +151,22 @@ typedef struct
 	t_InfInfo		*aInfInfo;	/* this stores information on how frequently hosts infected (used to avoid ever choosing non-infected hosts) */
 } t_SSAInfo;
 
+/*
+	What the objective function needs to know about the current pattern in each run, so a change to a single site can be
+	scored without going back over all of the others (see setObjState() and swapObjective())
+*/
+typedef struct
+{
+	int				numSites;
+	t_Real			*aSiteP;		/* p(detect) of the host at each site in each run (aSiteP[site * numRuns + run]) */
+	double			*aNotDetect;	/* product of 1-p over the sites with p < 1, in each run */
+	int				*aNumCertain;	/* number of sites with p = 1 (so the pattern is certain to detect), in each run */
+	double			*aExpectedFinds;	/* sum of p over the sites, in each run */
+	t_Real			*aNewP;			/* p(detect) of the host proposed for a site, in each run */
+	double			totalWeight;
+} t_ObjState;
+
+#ifndef _PIPELINE
 /*
 	Utility functions for reading configuration options
 */
@@ -269,25 +332,34 @@ double	uniformRandom()
 	seed random number generator
 
 	encapsulated to allow easy replacement if necessary
+	(a non-zero fixedSeed gives reproducible output)
 */
-void	seedRandom()
+void	seedRandom(int fixedSeed)
 {
 	unsigned long		ulnSeed;
 	unsigned long		myPID;
 
-	ulnSeed =(unsigned long) time(NULL);
+	if(fixedSeed)
+	{
+		ulnSeed = (unsigned long) fixedSeed;
+	}
+	else
+	{
+		ulnSeed =(unsigned long) time(NULL);
 #ifndef _WIN32	/* make sure different processes started at same time have different seeds */
-	myPID = (unsigned long) getpid();
+		myPID = (unsigned long) getpid();
 #else
-	myPID = (unsigned long) _getpid();
+		myPID = (unsigned long) _getpid();
 #endif
-	ulnSeed += myPID;
+		ulnSeed += myPID;
+	}
 #if 0
 	srand((unsigned int)ulnSeed);
 #else
 	init_genrand(ulnSeed);
 #endif
 }
+#endif /* _PIPELINE */
 
 int readHostInfo(t_SSAInfo *pSSAInfo)
 {
@@ -311,7 +383,7 @@ int readHostInfo(t_SSAInfo *pSSAInfo)
 			if(pSSAInfo->numHosts == numAlloc)
 			{
 				numAlloc += MY_REALLOC_BLOCK_SIZE;
-				pSSAInfo->aHostInfo = realloc(pSSAInfo->aHostInfo, sizeof(*pSSAInfo->aHostInfo) * numAlloc);
+				pSSAInfo->aHostInfo = mem_realloc(pSSAInfo->aHostInfo, sizeof(*pSSAInfo->aHostInfo) * numAlloc, "aHostInfo");
 				if(!pSSAInfo->aHostInfo)
 				{
 					bRet = 0;
@@ -393,13 +465,81 @@ static int cmpInfInfo(const void *p1, const void *p2)
 	return pHL1->hostID - pHL2->hostID;
 }
 
+/*
+	Find when a single run first reached incidence threshold (one of the values of maxIncidence in the simulation)
+	and how many cells had been infected by then, from the thresholds_<i>.txt file written by the simulation
+*/
+int readThreshold(int runNum, double threshold, double *pThreshTime, int *pNumInf)
+{
+	char	szInputFile[_MAX_STATIC_BUFF_LEN];
+	char	szBuffer[_MAX_STATIC_BUFF_LEN];
+	FILE	*fIn;
+	double	thisThreshold,thisTime;
+	int		thisReason,thisNumInf,bRet;
+
+	bRet = 0;
+	sprintf(szInputFile, "%sthresholds_%d.txt", INPUT_DIR, runNum);
+	fIn = fopen(szInputFile, "rb");
+	if (fIn)
+	{
+		while (!bRet && fgets(szBuffer, _MAX_STATIC_BUFF_LEN, fIn))
+		{
+			if (sscanf(szBuffer, "%lf %lf %d %d", &thisThreshold, &thisTime, &thisReason, &thisNumInf) == 4 && fabs(thisThreshold - threshold) < 1e-6)
+			{
+				*pThreshTime = thisTime;
+				*pNumInf = thisNumInf;
+				bRet = 1;
+			}
+		}
+		fclose(fIn);
+		if (!bRet)
+		{
+			fprintf(stderr, "threshold %f was not one of the values of maxIncidence in %s\n", threshold, szInputFile);
+		}
+	}
+	else
+	{
+		fprintf(stderr, "couldn't open %s (needed for threshold=%f)\n", szInputFile, threshold);
+	}
+	return bRet;
+}
+
+/*
+	Reduce the list of every infection in every run to the list of hosts ever infected (and in how many runs)
+*/
+void collateInfInfo(t_SSAInfo *pSSAInfo)
+{
+	int		infFrom,infTo;
+
+	fprintf(stdout, "\t%d hosts infected in total\n", pSSAInfo->numInf);
+	qsort(pSSAInfo->aInfInfo, pSSAInfo->numInf, sizeof(*pSSAInfo->aInfInfo), cmpInfInfo);
+	pSSAInfo->aInfInfo[0].numSims = 1;
+	infTo = 0;
+	for (infFrom = 1; infFrom < pSSAInfo->numInf; infFrom++)
+	{
+		if (pSSAInfo->aInfInfo[infTo].hostID == pSSAInfo->aInfInfo[infFrom].hostID)
+		{
+			pSSAInfo->aInfInfo[infTo].numSims++;
+		}
+		else
+		{
+			infTo++;
+			pSSAInfo->aInfInfo[infTo].hostID = pSSAInfo->aInfInfo[infFrom].hostID;
+			pSSAInfo->aInfInfo[infTo].numSims = 1;
+		}
+	}
+	pSSAInfo->numInf = infTo + 1;
+	fprintf(stdout, "\t%d unique hosts infected\n", pSSAInfo->numInf);
+}
+
 int	readSims(t_SSAInfo *pSSAInfo)
 {
 	int		bRet;
 	int		i;
 	char	szInputFile[_MAX_STATIC_BUFF_LEN];
 	char	szEndTimeFile[_MAX_STATIC_BUFF_LEN];
-	FILE	*fIn,*fEnd;
+	char	szWeightFile[_MAX_STATIC_BUFF_LEN];
+	FILE	*fIn,*fEnd,*fWeight;
 	char	szBuffer[_MAX_STATIC_BUFF_LEN];
 	char	*pPtr;
 	int		thisTok;
@@ -407,7 +547,8 @@ int	readSims(t_SSAInfo *pSSAInfo)
 	int		hostID;
 	double	readMaxTime;
 	int		everInfAlloc;
-	int		infFrom,infTo;
+	int		maxLines;
+	double	threshTime;
 
 	fprintf(stdout, "readSims()\n");
 	everInfAlloc = 0;
@@ -456,11 +597,19 @@ int	readSims(t_SSAInfo *pSSAInfo)
 	}
 	if (pSSAInfo->numRuns)
 	{
-		pSSAInfo->aRunInfo = malloc(sizeof(*pSSAInfo->aRunInfo)*pSSAInfo->numRuns);
+		pSSAInfo->aRunInfo = mem_malloc(sizeof(*pSSAInfo->aRunInfo)*pSSAInfo->numRuns, "aRunInfo");
 		if (pSSAInfo->aRunInfo)
 		{
 			for (i = 0; bRet && i < pSSAInfo->numRuns; i++)
 			{
+				/* if using a threshold, only the part of the run before it was reached is used */
+				maxLines = -1;
+				threshTime = 0.0;
+				if (THRESHOLD > 0.0 && !readThreshold(i, THRESHOLD, &threshTime, &maxLines))
+				{
+					bRet = 0;
+					break;
+				}
 				sprintf(szInputFile, "%s%s_%d.txt", INPUT_DIR, SIM_OUTPUT_STUB, i);
 				fprintf(stdout, "\t%s_%d\n", SIM_OUTPUT_STUB, i);
 				fIn = fopen(szInputFile, "rb");
@@ -468,17 +617,18 @@ int	readSims(t_SSAInfo *pSSAInfo)
 				{
 					pSSAInfo->aRunInfo[i].numInf = 0;
 					pSSAInfo->aRunInfo[i].aHostLookup = NULL;
-					pSSAInfo->aRunInfo[i].aPDetect = pSSAInfo->aRunInfo[i].aTimeInf = pSSAInfo->aRunInfo[i].aHostDensity = NULL;
+					pSSAInfo->aRunInfo[i].aTimeInf = NULL;
+					pSSAInfo->aRunInfo[i].aPDetect = pSSAInfo->aRunInfo[i].aHostDensity = NULL;
 					numAlloc = 0;
-					while (bRet && fgets(szBuffer, _MAX_STATIC_BUFF_LEN, fIn))
+					while (bRet && (maxLines < 0 || pSSAInfo->aRunInfo[i].numInf < maxLines) && fgets(szBuffer, _MAX_STATIC_BUFF_LEN, fIn))
 					{
 						if (pSSAInfo->aRunInfo[i].numInf == numAlloc)
 						{
 							numAlloc += MY_REALLOC_BLOCK_SIZE;
-							pSSAInfo->aRunInfo[i].aHostLookup = realloc(pSSAInfo->aRunInfo[i].aHostLookup, sizeof(*pSSAInfo->aRunInfo[i].aHostLookup) * numAlloc);
-							pSSAInfo->aRunInfo[i].aPDetect = realloc(pSSAInfo->aRunInfo[i].aPDetect, sizeof(*pSSAInfo->aRunInfo[i].aPDetect) * numAlloc);
-							pSSAInfo->aRunInfo[i].aTimeInf = realloc(pSSAInfo->aRunInfo[i].aTimeInf, sizeof(*pSSAInfo->aRunInfo[i].aTimeInf) * numAlloc);
-							pSSAInfo->aRunInfo[i].aHostDensity = realloc(pSSAInfo->aRunInfo[i].aHostDensity, sizeof(*pSSAInfo->aRunInfo[i].aHostDensity) * numAlloc);
+							pSSAInfo->aRunInfo[i].aHostLookup = mem_realloc(pSSAInfo->aRunInfo[i].aHostLookup, sizeof(*pSSAInfo->aRunInfo[i].aHostLookup) * numAlloc, "aHostLookup");
+							pSSAInfo->aRunInfo[i].aPDetect = mem_realloc(pSSAInfo->aRunInfo[i].aPDetect, sizeof(*pSSAInfo->aRunInfo[i].aPDetect) * numAlloc, "aPDetect");
+							pSSAInfo->aRunInfo[i].aTimeInf = mem_realloc(pSSAInfo->aRunInfo[i].aTimeInf, sizeof(*pSSAInfo->aRunInfo[i].aTimeInf) * numAlloc, "aTimeInf");
+							pSSAInfo->aRunInfo[i].aHostDensity = mem_realloc(pSSAInfo->aRunInfo[i].aHostDensity, sizeof(*pSSAInfo->aRunInfo[i].aHostDensity) * numAlloc, "aHostDensity");
 							if (!(pSSAInfo->aHostInfo && pSSAInfo->aRunInfo[i].aPDetect && pSSAInfo->aRunInfo[i].aTimeInf && pSSAInfo->aRunInfo[i].aHostDensity))
 							{
 								bRet = 0;
@@ -504,7 +654,7 @@ int	readSims(t_SSAInfo *pSSAInfo)
 									if (pSSAInfo->numInf == everInfAlloc)
 									{
 										everInfAlloc += MY_REALLOC_BLOCK_SIZE;
-										pSSAInfo->aInfInfo = realloc(pSSAInfo->aInfInfo, sizeof(*pSSAInfo->aInfInfo)*everInfAlloc);
+										pSSAInfo->aInfInfo = mem_realloc(pSSAInfo->aInfInfo, sizeof(*pSSAInfo->aInfInfo)*everInfAlloc, "aInfInfo");
 										if (!pSSAInfo->aInfInfo)
 										{
 											bRet = 0;
@@ -541,6 +691,10 @@ int	readSims(t_SSAInfo *pSSAInfo)
 					{
 						fgets(szBuffer, _MAX_STATIC_BUFF_LEN, fEnd);
 						readMaxTime = atof(szBuffer);
+						if (maxLines >= 0)
+						{
+							readMaxTime = threshTime;
+						}
 						pSSAInfo->aRunInfo[i].maxTimeInf = readMaxTime;
 						fprintf(stdout, "\t\tread %d infections (maxTime=%.4f)\n", pSSAInfo->aRunInfo[i].numInf, pSSAInfo->aRunInfo[i].maxTimeInf);
 						qsort(pSSAInfo->aRunInfo[i].aHostLookup, pSSAInfo->aRunInfo[i].numInf, sizeof(*pSSAInfo->aRunInfo[i].aHostLookup), cmpHostLookup);
@@ -551,6 +705,16 @@ int	readSims(t_SSAInfo *pSSAInfo)
 						bRet = 0;
 						fprintf(stderr, "couldn't read %s\n", szEndTimeFile);
 					}
+					/* runs from a simulation with splitLevels or introStrata have a weight (otherwise all runs count equally) */
+					sprintf(szWeightFile, "%sweight_%d.txt", INPUT_DIR, i);
+					pSSAInfo->aRunInfo[i].weight = 1.0;
+					fWeight = fopen(szWeightFile, "rb");
+					if (fWeight)
+					{
+						fgets(szBuffer, _MAX_STATIC_BUFF_LEN, fWeight);
+						pSSAInfo->aRunInfo[i].weight = atof(szBuffer);
+						fclose(fWeight);
+					}
 				}
 				else
 				{
@@ -560,25 +724,7 @@ int	readSims(t_SSAInfo *pSSAInfo)
 			}
 			if (bRet)
 			{
-				fprintf(stdout, "\t%d hosts infected in total\n", pSSAInfo->numInf);
-				qsort(pSSAInfo->aInfInfo, pSSAInfo->numInf, sizeof(*pSSAInfo->aInfInfo), cmpInfInfo);
-				pSSAInfo->aInfInfo[0].numSims = 1;
-				infTo = 0;
-				for (infFrom = 1; infFrom < pSSAInfo->numInf; infFrom++)
-				{
-					if (pSSAInfo->aInfInfo[infTo].hostID == pSSAInfo->aInfInfo[infFrom].hostID)
-					{
-						pSSAInfo->aInfInfo[infTo].numSims++;
-					}
-					else
-					{
-						infTo++;
-						pSSAInfo->aInfInfo[infTo].hostID = pSSAInfo->aInfInfo[infFrom].hostID;
-						pSSAInfo->aInfInfo[infTo].numSims = 1;
-					}
-				}
-				pSSAInfo->numInf = infTo + 1;
-				fprintf(stdout, "\t%d unique hosts infected\n", pSSAInfo->numInf);
+				collateInfInfo(pSSAInfo);
 			}
 		}
 		else
@@ -643,129 +789,280 @@ double detectProbSingleSurvey(double timeSinceInf, int numSamples, double dHostD
 	return 1.0 - pow(1.0 - pDetectSingleSample, numSamples);
 }
 
-int calcProbDetect(t_SSAInfo *pSSAInfo)
+/*
+	Probability of detection of each infected host in a single run
+*/
+void calcProbDetectRun(t_SSAInfo *pSSAInfo, int i)
 {
-	int				numToAverage,bRet,i,j,k,numSurveys;
+	int				numToAverage,j,k,numSurveys;
 	double			timeSurvey,timeInf,pDetect,pDontDetect,pDetectThisTime,firstOffset,hostDensity;
 
-	fprintf(stdout, "calcProbDetect()\n");
-	bRet = 1;
-	for(i=0;i<pSSAInfo->numRuns;i++)
+	fprintf(stdout, "\tdoing simulation %d\n", i);
+	perf_begin(&g_sProfileProbDetect);
+	g_sProfileProbDetect.numEvents += pSSAInfo->aRunInfo[i].numInf;
+	numSurveys = (int)((pSSAInfo->aRunInfo[i].maxTimeInf+_MY_TINY_EPS)/PARAM_DELTA) + 1;
+	for(j=0;j<pSSAInfo->aRunInfo[i].numInf;j++)
 	{
-		fprintf(stdout, "\tdoing simulation %d\n", i);
-		numSurveys = (int)((pSSAInfo->aRunInfo[i].maxTimeInf+_MY_TINY_EPS)/PARAM_DELTA) + 1;
-		for(j=0;j<pSSAInfo->aRunInfo[i].numInf;j++)
+		timeInf = pSSAInfo->aRunInfo[i].aTimeInf[j];
+		hostDensity = pSSAInfo->aRunInfo[i].aHostDensity[j];
+		pDetect = 0.0;
+		numToAverage = 0;
+		firstOffset = 0.0;
+		/*
+			This loops over the different times surveying could start relative to time of first infection (step of one day)
+		*/
+		while(firstOffset < PARAM_DELTA)
 		{
-			timeInf = pSSAInfo->aRunInfo[i].aTimeInf[j];
-			hostDensity = pSSAInfo->aRunInfo[i].aHostDensity[j];
-			pDetect = 0.0;
-			numToAverage = 0;
-			firstOffset = 0.0;
-			/*
-				This loops over the different times surveying could start relative to time of first infection (step of one day)
-			*/
-			while(firstOffset < PARAM_DELTA)
+#ifdef _EXHAUSTIVE_SURVEY_DIAGNOSTICS
+			fprintf(stdout, "****\n");
+			fprintf(stdout, "surveyOffset=%.4f for host number %d to be infected (hostID=%d,firstInf=%.4f) in simulation %d (maxTimeInf=%.4f)\n",firstOffset,j, pSSAInfo->aRunInfo[i].aHostLookup[j].hostID, timeInf, i, pSSAInfo->aRunInfo[i].maxTimeInf);
+			fprintf(stdout, "****\n");
+#endif
+			pDontDetect = 1.0;
+			for(k=0;k<numSurveys;k++)
 			{
+				timeSurvey = firstOffset + k * PARAM_DELTA;
+				/*
+					Avoid doing any sample that is actually too late
+				*/
+				if(timeSurvey < timeInf)
+				{
+					pDetectThisTime = 0.0;
 #ifdef _EXHAUSTIVE_SURVEY_DIAGNOSTICS
-				fprintf(stdout, "****\n");
-				fprintf(stdout, "surveyOffset=%.4f for host number %d to be infected (hostID=%d,firstInf=%.4f) in simulation %d (maxTimeInf=%.4f)\n",firstOffset,j, pSSAInfo->aRunInfo[i].aHostLookup[j].hostID, timeInf, i, pSSAInfo->aRunInfo[i].maxTimeInf);
-				fprintf(stdout, "****\n");
+					fprintf(stdout, "do survey at %f (ignored in calculation since before first infection of this cell at %.4f)\n", timeSurvey, timeInf);
 #endif
-				pDontDetect = 1.0;
-				for(k=0;k<numSurveys;k++)
+				}
+				else
 				{
-					timeSurvey = firstOffset + k * PARAM_DELTA;
-					/*
-						Avoid doing any sample that is actually too late
-					*/
-					if(timeSurvey < timeInf)
+					if(timeSurvey > pSSAInfo->aRunInfo[i].maxTimeInf)
 					{
 						pDetectThisTime = 0.0;
 #ifdef _EXHAUSTIVE_SURVEY_DIAGNOSTICS
-						fprintf(stdout, "do survey at %f (ignored in calculation since before first infection of this cell at %.4f)\n", timeSurvey, timeInf);
+						fprintf(stdout, "do survey at %f (ignored in calculation since after maximum incidence reached at %.4f)\n", timeSurvey, pSSAInfo->aRunInfo[i].maxTimeInf);
 #endif
 					}
 					else
 					{
-						if(timeSurvey > pSSAInfo->aRunInfo[i].maxTimeInf)
-						{
-							pDetectThisTime = 0.0;
+						pDetectThisTime = detectProbSingleSurvey(timeSurvey - timeInf, PARAM_n, hostDensity);
 #ifdef _EXHAUSTIVE_SURVEY_DIAGNOSTICS
-							fprintf(stdout, "do survey at %f (ignored in calculation since after maximum incidence reached at %.4f)\n", timeSurvey, pSSAInfo->aRunInfo[i].maxTimeInf);
+						fprintf(stdout, "do survey at %f\n", timeSurvey);
 #endif
-						}
-						else
-						{
-							pDetectThisTime = detectProbSingleSurvey(timeSurvey - timeInf, PARAM_n, hostDensity);
-#ifdef _EXHAUSTIVE_SURVEY_DIAGNOSTICS
-							fprintf(stdout, "do survey at %f\n", timeSurvey);
-#endif
-						}
 					}
-					pDontDetect *= (1.0-pDetectThisTime);
 				}
-				pDetect += (1.0-pDontDetect);
-				firstOffset+=(1.0/365.0);
-				numToAverage++;
+				pDontDetect *= (1.0-pDetectThisTime);
 			}
-			pDetect /= numToAverage;
-			pSSAInfo->aRunInfo[i].aPDetect[j] = pDetect;
+			pDetect += (1.0-pDontDetect);
+			firstOffset+=(1.0/365.0);
+			numToAverage++;
 		}
+		pDetect /= numToAverage;
+		pSSAInfo->aRunInfo[i].aPDetect[j] = pDetect;
 	}
-	return bRet;
+	perf_end(&g_sProfileProbDetect);
+}
+
+int calcProbDetect(t_SSAInfo *pSSAInfo)
+{
+	int		i;
+
+	fprintf(stdout, "calcProbDetect()\n");
+	for(i=0;i<pSSAInfo->numRuns;i++)
+	{
+		calcProbDetectRun(pSSAInfo, i);
+	}
+	return 1;
+}
+
+/*
+	Probability the host is detected in a run (0 if it was never infected)
+*/
+double pDetectOfHost(t_SSAInfo *pSSAInfo, int i, int hostID)
+{
+	t_HostLookup	sLookup,*pFound;
+
+	sLookup.hostID = hostID;
+	pFound = bsearch(&sLookup,pSSAInfo->aRunInfo[i].aHostLookup, pSSAInfo->aRunInfo[i].numInf, sizeof(*pSSAInfo->aRunInfo[i].aHostLookup), cmpHostLookup);
+	if(pFound)
+	{
+		return pSSAInfo->aRunInfo[i].aPDetect[pFound->hostPos];
+	}
+	return 0.0;
+}
+
+/*
+	Contribution of a single run to the objective function (before dividing by the total weight)
+*/
+double runObjective(t_SSAInfo *pSSAInfo, int i, double pNotDetectOverall, double expectedFindsThisRun)
+{
+	double	randomDraw,pDetectFromThisPatternInThisRun,thisWeight;
+
+	thisWeight = pSSAInfo->aRunInfo[i].weight;
+	pDetectFromThisPatternInThisRun = 1 - pNotDetectOverall;
+	switch(PARAM_OBJ_FUNC_TYPE)
+	{
+	case 0:
+		return thisWeight * pDetectFromThisPatternInThisRun; /*THIS CALCULATES THE SUM OF THE PROBS OF DETECTION WHEN ALL J SAMPLED, SUMMED OVER ALL RUNS*/
+	case 1:
+		randomDraw = uniformRandom();
+		if(randomDraw < pDetectFromThisPatternInThisRun)
+		{
+			return thisWeight; /*THIS CALCULATES SUM OF DETECTIONS OR NOT WHEN ALL J SAMPLED, SUMMED OVER ALL RUNS*/
+		}
+		return 0.0;
+	case 2:
+		return thisWeight * expectedFindsThisRun;
+	default:
+		fprintf(stderr, "Not implemented\n");
+	}
+	return 0.0;
 }
 
 double calcObjFunction(t_SSAInfo *pSSAInfo, int numToSurvey, int *anHostID)
 {
-	int				thisHost,i,j;
-	double			randomDraw,objFunc,pNotDetectOverall,pDetectOnThisHost,pDetectFromThisPatternInThisRun;
+	int				i,j;
+	double			objFunc,pNotDetectOverall,pDetectOnThisHost,totalWeight;
 	double			expectedFindsThisRun; /* Calculating the expected maximum number of finds before the disease reaches a certain incidence */
-	t_HostLookup	sLookup,*pFound;
 
+	perf_begin(&g_sProfileObjFunction);
+	g_sProfileObjFunction.numEvents += (long)pSSAInfo->numRuns * numToSurvey;
 	objFunc = 0.0;
+	totalWeight = 0.0;
 	for(i=0; i < pSSAInfo->numRuns;i++)
 	{
+		totalWeight += pSSAInfo->aRunInfo[i].weight;
 		expectedFindsThisRun = 0.0;
 		pNotDetectOverall = 1.0;
 		for(j=0;j<numToSurvey;j++)
 		{
-			thisHost = anHostID[j];
-			sLookup.hostID = thisHost;
-			pFound = bsearch(&sLookup,pSSAInfo->aRunInfo[i].aHostLookup, pSSAInfo->aRunInfo[i].numInf, sizeof(*pSSAInfo->aRunInfo[i].aHostLookup), cmpHostLookup);
-			if(pFound)
-			{
-				pDetectOnThisHost = pSSAInfo->aRunInfo[i].aPDetect[pFound->hostPos];
-			}
-			else
-			{
-				pDetectOnThisHost = 0.0;
-			}
+			pDetectOnThisHost = pDetectOfHost(pSSAInfo, i, anHostID[j]);
 			pNotDetectOverall *= (1.0 - pDetectOnThisHost); /*PRODUCT OF NO DETECTION PROBABILITIES*/
 			expectedFindsThisRun += pDetectOnThisHost; /* ADDS UP EXPECTED NUMBER OF FINDS */
 		}
+		objFunc += runObjective(pSSAInfo, i, pNotDetectOverall, expectedFindsThisRun);
+	} /*DOES THIS FOR ALL I RUNS*/
+	objFunc /= totalWeight; /*THIS TAKES THE (WEIGHTED) MEAN OF WHATEVER FORM THE OF TAKES AS SPECIFIED ABOVE*/
+	perf_end(&g_sProfileObjFunction);
+	return objFunc;
+}
+
+int allocObjState(t_ObjState *pState, t_SSAInfo *pSSAInfo, int numSites)
+{
+	memset(pState, 0, sizeof(t_ObjState));
+	pState->numSites = numSites;
+	pState->aSiteP = mem_malloc(sizeof(t_Real) * numSites * pSSAInfo->numRuns, "objState");
+	pState->aNotDetect = mem_malloc(sizeof(double) * pSSAInfo->numRuns, "objState");
+	pState->aNumCertain = mem_malloc(sizeof(int) * pSSAInfo->numRuns, "objState");
+	pState->aExpectedFinds = mem_malloc(sizeof(double) * pSSAInfo->numRuns, "objState");
+	pState->aNewP = mem_malloc(sizeof(t_Real) * pSSAInfo->numRuns, "objState");
+	return (pState->aSiteP && pState->aNotDetect && pState->aNumCertain && pState->aExpectedFinds && pState->aNewP);
+}
+
+void freeObjState(t_ObjState *pState)
+{
+	mem_free(pState->aSiteP);
+	mem_free(pState->aNotDetect);
+	mem_free(pState->aNumCertain);
+	mem_free(pState->aExpectedFinds);
+	mem_free(pState->aNewP);
+}
+
+/*
+	Work out the state of each run for a whole pattern from scratch (drawing no random numbers, so it can be done at any time)
+		- sites with p = 1 are counted rather than multiplied in, so they can be taken out again
+*/
+void setObjState(t_ObjState *pState, t_SSAInfo *pSSAInfo, int *anHostID)
+{
+	int		i,j;
+	double	p;
 
-		pDetectFromThisPatternInThisRun = 1 - pNotDetectOverall;
-		switch(PARAM_OBJ_FUNC_TYPE)
+	pState->totalWeight = 0.0;
+	for (i = 0; i < pSSAInfo->numRuns; i++)
+	{
+		pState->totalWeight += pSSAInfo->aRunInfo[i].weight;
+		pState->aNotDetect[i] = 1.0;
+		pState->aNumCertain[i] = 0;
+		pState->aExpectedFinds[i] = 0.0;
+		for (j = 0; j < pState->numSites; j++)
 		{
-		case 0:
-			objFunc += pDetectFromThisPatternInThisRun; /*THIS CALCULATES THE SUM OF THE PROBS OF DETECTION WHEN ALL J SAMPLED, SUMMED OVER ALL RUNS*/
-			break;
-		case 1:
-			randomDraw = uniformRandom();
-			if(randomDraw < pDetectFromThisPatternInThisRun)
+			p = pDetectOfHost(pSSAInfo, i, anHostID[j]);
+			pState->aSiteP[j * pSSAInfo->numRuns + i] = (t_Real)p;
+			if (p >= 1.0)
 			{
-				objFunc++; /*THIS CALCULATES SUM OF DETECTIONS OR NOT WHEN ALL J SAMPLED, SUMMED OVER ALL RUNS*/
+				pState->aNumCertain[i]++;
 			}
-			break;
-		case 2:
-			objFunc += expectedFindsThisRun;
-			break;
-		default:
-			fprintf(stderr, "Not implemented\n");
+			else
+			{
+				pState->aNotDetect[i] *= (1.0 - p);
+			}
+			pState->aExpectedFinds[i] += p;
 		}
-	} /*DOES THIS FOR ALL I RUNS*/
-	objFunc /= (double)pSSAInfo->numRuns; /*THIS TAKES THE MEAN OF WHATEVER FORM THE OF TAKES AS SPECIFIED ABOVE*/
-	return objFunc;
+	}
+}
+
+/*
+	State of run i with the host at the site replaced by the one in aNewP (the old host is divided out and the new one multiplied in)
+*/
+static inline void swapRunState(t_ObjState *pState, int numRuns, int site, int i, double *pNotDetect, int *pNumCertain, double *pExpectedFinds)
+{
+	double	pOld,pNew;
+
+	pOld = pState->aSiteP[site * numRuns + i];
+	pNew = pState->aNewP[i];
+	*pNotDetect = pState->aNotDetect[i];
+	*pNumCertain = pState->aNumCertain[i];
+	if (pOld >= 1.0)
+	{
+		(*pNumCertain)--;
+	}
+	else
+	{
+		*pNotDetect /= (1.0 - pOld);
+	}
+	if (pNew >= 1.0)
+	{
+		(*pNumCertain)++;
+	}
+	else
+	{
+		*pNotDetect *= (1.0 - pNew);
+	}
+	*pExpectedFinds = pState->aExpectedFinds[i] - pOld + pNew;
+}
+
+/*
+	Objective function if the host at a single site were changed, in O(numRuns) rather than the O(numRuns numSites) of
+	calcObjFunction() (the state is left as it was, until acceptSwap())
+*/
+double swapObjective(t_ObjState *pState, t_SSAInfo *pSSAInfo, int site, int newHostID)
+{
+	int		i,numCertain;
+	double	objFunc,notDetect,expectedFinds;
+
+	perf_begin(&g_sProfileObjFunction);
+	g_sProfileObjFunction.numEvents += pSSAInfo->numRuns;
+	objFunc = 0.0;
+	for (i = 0; i < pSSAInfo->numRuns; i++)
+	{
+		pState->aNewP[i] = (t_Real)pDetectOfHost(pSSAInfo, i, newHostID);
+		swapRunState(pState, pSSAInfo->numRuns, site, i, &notDetect, &numCertain, &expectedFinds);
+		objFunc += runObjective(pSSAInfo, i, numCertain ? 0.0 : notDetect, expectedFinds);
+	}
+	perf_end(&g_sProfileObjFunction);
+	return objFunc / pState->totalWeight;
+}
+
+/*
+	Make the change scored by the last call of swapObjective()
+*/
+void acceptSwap(t_ObjState *pState, t_SSAInfo *pSSAInfo, int site)
+{
+	int i;
+
+	for (i = 0; i < pSSAInfo->numRuns; i++)
+	{
+		swapRunState(pState, pSSAInfo->numRuns, site, i, &pState->aNotDetect[i], &pState->aNumCertain[i], &pState->aExpectedFinds[i]);
+		pState->aSiteP[site * pSSAInfo->numRuns + i] = pState->aNewP[i];
+	}
 }
 
 /*
@@ -857,12 +1154,13 @@ void debugDumpInfo(t_SSAInfo *pSSAInfo)
 int readParams(int argc, char **argv)
 {
 	int		bRet = 1;
+	int		singlePrecision;
 	char	szCfgFile[_MAX_STATIC_BUFF_LEN];
 
 	fprintf(stdout, "readParams()\n");
-	if (!getCfgFileName(argv[0], szCfgFile))
+	if (!getCfgFileName(CFG_PROG_NAME, szCfgFile))
 	{
-		fprintf(stderr, "Couldn't find cfg file for program name '%s'\n", argv[0]);
+		fprintf(stderr, "Couldn't find cfg file for program name '%s'\n", CFG_PROG_NAME);
 		return 0;
 	}
 	if (!readStringFromCfg(argc, argv, szCfgFile, "inputDirectory", INPUT_DIR))
@@ -945,6 +1243,58 @@ int readParams(int argc, char **argv)
 		fprintf(stdout, "Couldn't read trueMinFlag\n");
 		return 0;
 	}
+	/* following are optional */
+	if (!readStringFromCfg(argc, argv, szCfgFile, "outputDirectory", OUT_DIR))
+	{
+		strcpy(OUT_DIR, DEFAULT_OUT_DIR);
+	}
+	if (!readIntFromCfg(argc, argv, szCfgFile, "seed", &RAND_SEED))
+	{
+		RAND_SEED = 0;
+	}
+	if (!readDoubleFromCfg(argc, argv, szCfgFile, "threshold", &THRESHOLD))
+	{
+		THRESHOLD = 0.0;
+	}
+	if (!readIntFromCfg(argc, argv, szCfgFile, "profile", &PROFILE))
+	{
+		PROFILE = 0;
+	}
+	if (!readIntFromCfg(argc, argv, szCfgFile, "profileEvery", &PROFILE_EVERY))
+	{
+		PROFILE_EVERY = 1;
+	}
+	if (PROFILE)
+	{
+		perf_init(PROFILE_EVERY);
+	}
+	if (!readIntFromCfg(argc, argv, szCfgFile, "dryRun", &DRY_RUN))
+	{
+		DRY_RUN = 0;
+	}
+	/* if set, singlePrecision is checked against how the program was compiled */
+	if (readIntFromCfg(argc, argv, szCfgFile, "singlePrecision", &singlePrecision) && singlePrecision != _SINGLE_PRECISION_FLAG)
+	{
+		fprintf(stdout, "singlePrecision=%d, but program was compiled %s -D_SINGLE_PRECISION\n", singlePrecision, _SINGLE_PRECISION_FLAG ? "with" : "without");
+		return 0;
+	}
+	if (DRY_RUN)
+	{
+		/* a dry run only estimates memory, so leaves the output directory alone */
+		return bRet;
+	}
+#ifdef _MSC_VER
+	if(!mkdir(OUT_DIR))
+#else
+	if(!mkdir(OUT_DIR, 0777))
+#endif
+	{
+		fprintf(stdout, "created directory %s for output\n", OUT_DIR);
+	}
+	else
+	{
+		fprintf(stdout, "directory %s already exists\n", OUT_DIR);
+	}
 	if (bRet)
 	{
 		/* dump out parameters as read and understood by the programme */
@@ -972,6 +1322,12 @@ int readParams(int argc, char **argv)
 			fprintf(paramsOut, "simann_n=%d\n", SIMANN_N);
 			fprintf(paramsOut, "objFuncOut=%s\n", OBJ_FUNC_OUT);
 			fprintf(paramsOut, "trueMinFlag=%d\n", PARAM_TRUE_MIN_FLAG);
+			fprintf(paramsOut, "outputDirectory=%s\n", OUT_DIR);
+			fprintf(paramsOut, "seed=%d\n", RAND_SEED);
+			fprintf(paramsOut, "threshold=%f\n", THRESHOLD);
+			fprintf(paramsOut, "profile=%d\n", PROFILE);
+			fprintf(paramsOut, "dryRun=%d\n", DRY_RUN);
+			fprintf(paramsOut, "singlePrecision=%d\n", _SINGLE_PRECISION_FLAG);
 			fclose(paramsOut);
 		}
 		else
@@ -983,234 +1339,554 @@ int readParams(int argc, char **argv)
 	return bRet;
 }
 
-int main(int argc, char **argv)
+/*
+	With profile=1, report the profiled regions to the screen and to profile.txt in the output directory
+*/
+void writeAnnealerProfile()
 {
-	t_SSAInfo	sSSAInfo;
-	int			bContinue;
+	perf_region	*apRegions[3] = { &g_sProfileProbDetect, &g_sProfileObjFunction, &g_sProfileAnnealing };
+	char		szOutFile[_MAX_STATIC_BUFF_LEN];
+	FILE		*fOut;
 
-	seedRandom();
-	memset(&sSSAInfo,0,sizeof(sSSAInfo));
-#ifdef _MSC_VER
-	if(!mkdir(OUT_DIR))
-#else
-	if(!mkdir(OUT_DIR, 0777))
-#endif
-	{
-		fprintf(stdout, "created directory %s for output\n", OUT_DIR);
-	}
-	else
+	if (PROFILE)
 	{
-		fprintf(stdout, "directory %s already exists\n", OUT_DIR);
+		perf_report(stdout, apRegions, 3);
+		sprintf(szOutFile, "%s//profile.txt", OUT_DIR);
+		fOut = fopen(szOutFile, "wb");
+		if (fOut)
+		{
+			perf_report(fOut, apRegions, 3);
+			fclose(fOut);
+		}
 	}
-	bContinue = 1;
-	/* read in parameters (stored globally) */
-	if (!readParams(argc,argv))
+}
+
+/*
+	Spatial simulated annealing to find the sampling pattern maximising the objective function
+	(detection probabilities must already have been calculated)
+*/
+void runAnnealing(t_SSAInfo *pSSAInfo)
+{
+	int				j,i,thisHost,randToChange,oldVal;
+	int				*anPattern, simann_n;
+	double			oldObj,newObj,objFunc, probAcc, dice, cool, alpha;
+	double			pDetect,pNotDetectThisRun,timeInf;
+	t_HostLookup	sLookup,*pFound;
+	t_ObjState		sState;
+	FILE			*fpObjOut,*fpFakeOutput;
+
+	cool = PARAM_COOL;
+	alpha = PARAM_ALPHA;
+	simann_n = SIMANN_N;
+
+	anPattern = mem_malloc(sizeof(int) * PARAM_N, "anPattern");
+	if(anPattern && allocObjState(&sState, pSSAInfo, PARAM_N))
 	{
-		fprintf(stderr, "couldn't read parameters\n");
-		bContinue = 0;
-	}
-	/* read in host info */
-	if(bContinue && !readHostInfo(&sSSAInfo))
-	{
-		fprintf(stderr, "couldn't read host info\n");
-		bContinue = 0;
-	}
-	/* read in inf info */
-	if(bContinue && !readSims(&sSSAInfo))
-	{
-		fprintf(stderr, "couldn't read simulation info\n");
-		bContinue = 0;
-	}
-	/* calculate detection probabilities */
-	if(bContinue && !calcProbDetect(&sSSAInfo))
-	{
-		fprintf(stderr, "couldn't calculate detection probabilities\n");
-		bContinue = 0;
-	}
-	if(bContinue && DEBUG_DUMP_INFO)
-	{
-		debugDumpInfo(&sSSAInfo);
-	}
-	/* do annealing */
-	if(bContinue)
-	{
-		int				j,i,thisHost,randToChange,oldVal;
-		int				*anPattern, simann_n;
-		double			oldObj,newObj,objFunc, probAcc, dice, cool, alpha;
-		double			pDetect,pNotDetectThisRun,timeInf;
-		t_HostLookup	sLookup,*pFound;
-		FILE			*fpObjOut,*fpFakeOutput;
-
-		cool = PARAM_COOL;
-		alpha = PARAM_ALPHA;
-		simann_n = SIMANN_N;
+		char szObjOutFile[_MAX_STATIC_BUFF_LEN];
 
-		anPattern = malloc(sizeof(int) * PARAM_N);
-		if(anPattern)
+		sprintf(szObjOutFile, "%s//%s", OUT_DIR, OBJ_FUNC_OUT);
+		fpObjOut = fopen(szObjOutFile, "wb");
+		if (fpObjOut)
 		{
-			char szObjOutFile[_MAX_STATIC_BUFF_LEN];
-
-			sprintf(szObjOutFile, "%s//%s", OUT_DIR, OBJ_FUNC_OUT);
-			fpObjOut = fopen(szObjOutFile, "wb");
-			if (fpObjOut)
+			/* create an initial pattern */
+			for (i = 0; i < PARAM_N; i++)
+			{
+				/* Random host from those that were ever infected */
+				anPattern[i] = randomValidHost(pSSAInfo, B_ALLOW_DUPLICATES, i, anPattern, i);
+			}
+			/* find its objective function */
+			oldObj = calcObjFunction(pSSAInfo, PARAM_N, anPattern);
+			setObjState(&sState, pSSAInfo, anPattern);
+			/* do SIMANN_N iterations of the spatial annealing */
+			perf_begin(&g_sProfileAnnealing);
+			g_sProfileAnnealing.numEvents = SIMANN_N + 1;
+			for (j = 0; j <= SIMANN_N; j++)
 			{
-				/* create an initial pattern */
-				for (i = 0; i < PARAM_N; i++)
+				/* randomly choose a position in the pattern to change */
+				randToChange = (int)(uniformRandom()*PARAM_N);
+				/* change it (storing old value) */
+				oldVal = anPattern[randToChange];
+				anPattern[randToChange] = randomValidHost(pSSAInfo, B_ALLOW_DUPLICATES, PARAM_N, anPattern, randToChange);
+				/* calculate new objective function (only the site that changed needs to be looked at) */
+				newObj = swapObjective(&sState, pSSAInfo, randToChange, anPattern[randToChange]);
+				/* always accept change if change increases objective function */
+				if(newObj > oldObj)
 				{
-					/* Random host from those that were ever infected */
-					anPattern[i] = randomValidHost(&sSSAInfo, B_ALLOW_DUPLICATES, i, anPattern, i);
+					probAcc = 1.;
 				}
-				/* find its objective function */
-				oldObj = calcObjFunction(&sSSAInfo, PARAM_N, anPattern);
-				/* do SIMANN_N iterations of the spatial annealing */
-				for (j = 0; j <= SIMANN_N; j++)
+				/* if ratio of difference to cooling parameter is very negative (lower than -99), do not swap */
+				else if ((newObj - oldObj)/cool < -99)
 				{
-					/* randomly choose a position in the pattern to change */
-					randToChange = (int)(uniformRandom()*PARAM_N);
-					/* change it (storing old value) */
-					oldVal = anPattern[randToChange];
-					anPattern[randToChange] = randomValidHost(&sSSAInfo, B_ALLOW_DUPLICATES, PARAM_N, anPattern, randToChange);
-					/* calculate new objective function */
-					newObj = calcObjFunction(&sSSAInfo, PARAM_N, anPattern);
-					/* always accept change if change increases objective function */
-					if(newObj > oldObj)
-					{
-						probAcc = 1.;
-					}
-					/* if ratio of difference to cooling parameter is very negative (lower than -99), do not swap */
-					else if ((newObj - oldObj)/cool < -99)
-					{
-						probAcc = 0.;
-					}
-					/* if objective function increases accept swap with this prob */
-					else
-					{
-						probAcc = exp((newObj - oldObj)/cool);
-					}
-					/* generate a random number between 0 and 1 */
-					dice = uniformRandom();
+					probAcc = 0.;
+				}
+				/* if objective function increases accept swap with this prob */
+				else
+				{
+					probAcc = exp((newObj - oldObj)/cool);
+				}
+				/* generate a random number between 0 and 1 */
+				dice = uniformRandom();
 
-					/* update obj function */
-					if(dice<probAcc)
-					{
-						oldObj = newObj;
-					}
-					/* revert change */
-					else
+				/* update obj function */
+				if(dice<probAcc)
+				{
+					oldObj = newObj;
+					acceptSwap(&sState, pSSAInfo, randToChange);
+				}
+				/* revert change */
+				else
+				{
+					anPattern[randToChange] = oldVal;
+				}
+
+				/* dump out information on the objective function */
+				if((j%_SCREEN_PRINT_STEP)==0)
+				{
+					/* print to screen every so often */
+					fprintf(stdout, "sample %d (%f)...\n\t", j, oldObj);
+					for (i = 0; i < PARAM_N; i++)
 					{
-						anPattern[randToChange] = oldVal;
+						fprintf(stdout, " %d", anPattern[i]);
 					}
-
-					/* dump out information on the objective function */
-					if((j%_SCREEN_PRINT_STEP)==0)
+					fprintf(stdout, "\n");
+				}
+					fprintf(fpObjOut, "%d %.4f", j, oldObj);
+					for (i = 0; i < PARAM_N; i++)
 					{
-						/* print to screen every so often */
-						fprintf(stdout, "sample %d (%f)...\n\t", j, oldObj);
-						for (i = 0; i < PARAM_N; i++)
-						{
-							fprintf(stdout, " %d", anPattern[i]);
-						}
-						fprintf(stdout, "\n");
+						fprintf(fpObjOut, " %d", anPattern[i]);
 					}
-						fprintf(fpObjOut, "%d %.4f", j, oldObj);
-						for (i = 0; i < PARAM_N; i++)
-						{
-							fprintf(fpObjOut, " %d", anPattern[i]);
-						}
-						fprintf(fpObjOut, "\n");
+					fprintf(fpObjOut, "\n");
 
-					/*
-						Reduce the cooling parameter
-					*/
-					cool = cool*alpha;
-				}
 				/*
-					Only used in debugging
+					Reduce the cooling parameter
+				*/
+				cool = cool*alpha;
+				/*
+					Start the state again from scratch every so often, so rounding in dividing out and multiplying in
+					hosts can't build up (at a cost per step of the same order as a swap)
 				*/
-				if (DEBUG_DUMP_INFO)
+				if ((j + 1) % PARAM_N == 0)
 				{
-					char szOutFile[_MAX_STATIC_BUFF_LEN];
+					setObjState(&sState, pSSAInfo, anPattern);
+				}
+			}
+			perf_end(&g_sProfileAnnealing);
+			writeAnnealerProfile();
+			/*
+				Only used in debugging
+			*/
+			if (DEBUG_DUMP_INFO)
+			{
+				char szOutFile[_MAX_STATIC_BUFF_LEN];
 
-					sprintf(szOutFile, "%s//debugOutput.txt", OUT_DIR);
-					/* print out information on the actual info on last pattern */
-					fpFakeOutput = fopen(szOutFile, "wb");
-					if (fpFakeOutput)
+				sprintf(szOutFile, "%s//debugOutput.txt", OUT_DIR);
+				/* print out information on the actual info on last pattern */
+				fpFakeOutput = fopen(szOutFile, "wb");
+				if (fpFakeOutput)
+				{
+					fprintf(fpFakeOutput, "pattern:\n");
+					for (i = 0; i < PARAM_N; i++)
+					{
+						fprintf(fpFakeOutput, "\tentry=%d, id=%d, x=%d, y=%d, density=%.4f\n",
+							i,												/* position in pattern */
+							anPattern[i],									/* hostID */
+							pSSAInfo->aHostInfo[anPattern[i]].hostX,			/* hostX */
+							pSSAInfo->aHostInfo[anPattern[i]].hostY,			/* hostY */
+							pSSAInfo->aHostInfo[anPattern[i]].hostDensity);	/* hostDensity */
+					}
+					fprintf(fpFakeOutput, "pattern performance by run:\n");
+					/* print out information on times and probabilities for this pattern from each sim... */
+					for (j = 0; j < pSSAInfo->numRuns; j++)
 					{
-						fprintf(fpFakeOutput, "pattern:\n");
+						fprintf(fpFakeOutput, "\trun %d (maxTime=%.4f):\n", j, pSSAInfo->aRunInfo[j].maxTimeInf);
+						pNotDetectThisRun = 1.0;
 						for (i = 0; i < PARAM_N; i++)
 						{
-							fprintf(fpFakeOutput, "\tentry=%d, id=%d, x=%d, y=%d, density=%.4f\n",
-								i,												/* position in pattern */
-								anPattern[i],									/* hostID */
-								sSSAInfo.aHostInfo[anPattern[i]].hostX,			/* hostX */
-								sSSAInfo.aHostInfo[anPattern[i]].hostY,			/* hostY */
-								sSSAInfo.aHostInfo[anPattern[i]].hostDensity);	/* hostDensity */
-						}
-						fprintf(fpFakeOutput, "pattern performance by run:\n");
-						/* print out information on times and probabilities for this pattern from each sim... */
-						for (j = 0; j < sSSAInfo.numRuns; j++)
-						{
-							fprintf(fpFakeOutput, "\trun %d (maxTime=%.4f):\n", j, sSSAInfo.aRunInfo[j].maxTimeInf);
-							pNotDetectThisRun = 1.0;
-							for (i = 0; i < PARAM_N; i++)
+							thisHost = pSSAInfo->aHostInfo[anPattern[i]].hostID;
+							sLookup.hostID = thisHost;
+							pFound = bsearch(&sLookup, pSSAInfo->aRunInfo[j].aHostLookup, pSSAInfo->aRunInfo[j].numInf, sizeof(*pSSAInfo->aRunInfo[j].aHostLookup), cmpHostLookup);
+							if (pFound)
 							{
-								thisHost = sSSAInfo.aHostInfo[anPattern[i]].hostID;
-								sLookup.hostID = thisHost;
-								pFound = bsearch(&sLookup, sSSAInfo.aRunInfo[j].aHostLookup, sSSAInfo.aRunInfo[j].numInf, sizeof(*sSSAInfo.aRunInfo[j].aHostLookup), cmpHostLookup);
-								if (pFound)
-								{
-									timeInf = sSSAInfo.aRunInfo[j].aTimeInf[pFound->hostPos];
-									pDetect = sSSAInfo.aRunInfo[j].aPDetect[pFound->hostPos];
-								}
-								else
-								{
-									timeInf = -1.0;
-									pDetect = 0.0;
-								}
-								pNotDetectThisRun *= (1.0 - pDetect);
-								fprintf(fpFakeOutput, "\t\tentry=%d, id=%d, x=%d, y=%d, density=%.4f, t=%.4f (p=%.4f)\n", i, anPattern[i], sSSAInfo.aHostInfo[anPattern[i]].hostX, sSSAInfo.aHostInfo[anPattern[i]].hostY, sSSAInfo.aHostInfo[anPattern[i]].hostDensity, timeInf, pDetect);
+								timeInf = pSSAInfo->aRunInfo[j].aTimeInf[pFound->hostPos];
+								pDetect = pSSAInfo->aRunInfo[j].aPDetect[pFound->hostPos];
+							}
+							else
+							{
+								timeInf = -1.0;
+								pDetect = 0.0;
 							}
-							fprintf(fpFakeOutput, "\t\t\t=> pDetectThisRun=%.4f\n", 1.0 - pNotDetectThisRun);
+							pNotDetectThisRun *= (1.0 - pDetect);
+							fprintf(fpFakeOutput, "\t\tentry=%d, id=%d, x=%d, y=%d, density=%.4f, t=%.4f (p=%.4f)\n", i, anPattern[i], pSSAInfo->aHostInfo[anPattern[i]].hostX, pSSAInfo->aHostInfo[anPattern[i]].hostY, pSSAInfo->aHostInfo[anPattern[i]].hostDensity, timeInf, pDetect);
 						}
-						objFunc = calcObjFunction(&sSSAInfo, PARAM_N, anPattern);
-						fprintf(fpFakeOutput, "calculated objective function:\n");
-						fprintf(fpFakeOutput, "\t%.4f\n", objFunc);
-						fclose(fpFakeOutput);
+						fprintf(fpFakeOutput, "\t\t\t=> pDetectThisRun=%.4f\n", 1.0 - pNotDetectThisRun);
 					}
+					objFunc = calcObjFunction(pSSAInfo, PARAM_N, anPattern);
+					fprintf(fpFakeOutput, "calculated objective function:\n");
+					fprintf(fpFakeOutput, "\t%.4f\n", objFunc);
+					fclose(fpFakeOutput);
 				}
-				fclose(fpObjOut);
 			}
-			free(anPattern);
+			fclose(fpObjOut);
 		}
-		else
+		freeObjState(&sState);
+		mem_free(anPattern);
+	}
+	else
+	{
+		fprintf(stderr, "Memory error; exiting");
+		exit(EXIT_FAILURE);
+	}
+}
+
+/*
+	Free up the memory that has been allocated
+*/
+void freeSSAInfo(t_SSAInfo *pSSAInfo)
+{
+	int		i;
+
+	if(pSSAInfo->numHosts)
+	{
+		mem_free(pSSAInfo->aHostInfo);
+	}
+	if(pSSAInfo->numInf)
+	{
+		mem_free(pSSAInfo->aInfInfo);
+	}
+	if(pSSAInfo->numRuns)
+	{
+		for(i=0;i<pSSAInfo->numRuns;i++)
+		{
+			if(pSSAInfo->aRunInfo[i].numInf)
+			{
+				mem_free(pSSAInfo->aRunInfo[i].aHostLookup);
+				mem_free(pSSAInfo->aRunInfo[i].aPDetect);
+				mem_free(pSSAInfo->aRunInfo[i].aTimeInf);
+				mem_free(pSSAInfo->aRunInfo[i].aHostDensity);
+			}
+		}
+		mem_free(pSSAInfo->aRunInfo);
+	}
+}
+
+#ifdef _PIPELINE
+/*
+	In-process interface used by the simulation in samplingPipeline
+	(each run is added as soon as it finishes, so detection probabilities are calculated while the simulation is still going)
+*/
+static t_SSAInfo	g_sPipeline;
+
+/*
+	Read the parameters of the annealer (numIts and outStub are always those of the simulation)
+*/
+int pipelineBegin(int argc, char **argv, int numRuns, char *szOutStub)
+{
+	memset(&g_sPipeline, 0, sizeof(g_sPipeline));
+	if (!readParams(argc, argv))
+	{
+		fprintf(stderr, "couldn't read parameters for annealing\n");
+		return 0;
+	}
+	NUM_RUNS = numRuns;
+	strcpy(SIM_OUTPUT_STUB, szOutStub);
+	g_sPipeline.numRuns = numRuns;
+	g_sPipeline.aRunInfo = mem_calloc(numRuns, sizeof(*g_sPipeline.aRunInfo), "aRunInfo");
+	if (!g_sPipeline.aRunInfo)
+	{
+		fprintf(stderr, "couldn't allocate memory for %d runs\n", numRuns);
+		return 0;
+	}
+	return 1;
+}
+
+/*
+	Hosts must be added in order of hostID (i.e. order of cells in activeLandscape.txt)
+*/
+int pipelineAddHost(int hostX, int hostY, double hostDensity)
+{
+	t_HostInfo	*pHost;
+
+	if (g_sPipeline.numHosts % MY_REALLOC_BLOCK_SIZE == 0)
+	{
+		g_sPipeline.aHostInfo = mem_realloc(g_sPipeline.aHostInfo, sizeof(*g_sPipeline.aHostInfo) * (g_sPipeline.numHosts + MY_REALLOC_BLOCK_SIZE), "aHostInfo");
+		if (!g_sPipeline.aHostInfo)
+		{
+			return 0;
+		}
+	}
+	pHost = &g_sPipeline.aHostInfo[g_sPipeline.numHosts];
+	pHost->hostID = g_sPipeline.numHosts;
+	pHost->hostX = hostX;
+	pHost->hostY = hostY;
+	pHost->hostDensity = hostDensity;
+	g_sPipeline.numHosts++;
+	return 1;
+}
+
+/*
+	Infections must be added in the order in which they occurred
+*/
+int pipelineAddInfection(int runNum, int hostID, double timeInf, double hostDensity)
+{
+	t_RunInfo	*pRun;
+
+	pRun = &g_sPipeline.aRunInfo[runNum];
+	if (pRun->numInf % MY_REALLOC_BLOCK_SIZE == 0)
+	{
+		pRun->aHostLookup = mem_realloc(pRun->aHostLookup, sizeof(*pRun->aHostLookup) * (pRun->numInf + MY_REALLOC_BLOCK_SIZE), "aHostLookup");
+		pRun->aPDetect = mem_realloc(pRun->aPDetect, sizeof(*pRun->aPDetect) * (pRun->numInf + MY_REALLOC_BLOCK_SIZE), "aPDetect");
+		pRun->aTimeInf = mem_realloc(pRun->aTimeInf, sizeof(*pRun->aTimeInf) * (pRun->numInf + MY_REALLOC_BLOCK_SIZE), "aTimeInf");
+		pRun->aHostDensity = mem_realloc(pRun->aHostDensity, sizeof(*pRun->aHostDensity) * (pRun->numInf + MY_REALLOC_BLOCK_SIZE), "aHostDensity");
+		if (!(pRun->aHostLookup && pRun->aPDetect && pRun->aTimeInf && pRun->aHostDensity))
 		{
-			fprintf(stderr, "Memory error; exiting");
-			exit(EXIT_FAILURE);
+			return 0;
 		}
+	}
+	pRun->aHostLookup[pRun->numInf].hostID = hostID;
+	pRun->aHostLookup[pRun->numInf].hostPos = pRun->numInf;
+	pRun->aTimeInf[pRun->numInf] = timeInf;
+	pRun->aHostDensity[pRun->numInf] = hostDensity;
+	pRun->numInf++;
+	return 1;
+}
 
-		/* free up the memory that has been allocated */
-		if(sSSAInfo.numHosts)
+/*
+	Finish off a single run and calculate the detection probabilities for it
+	(if using a threshold, only the part of the run before it was reached is kept, as in readSims())
+*/
+int pipelineEndRun(int runNum, double endTime, double weight, int numThresholds, double *aThresholds, double *aThreshTime, int *aThreshNumInf)
+{
+	t_RunInfo	*pRun;
+	int			j;
+
+	pRun = &g_sPipeline.aRunInfo[runNum];
+	pRun->maxTimeInf = endTime;
+	pRun->weight = weight;
+	if (THRESHOLD > 0.0)
+	{
+		for (j = 0; j < numThresholds && fabs(aThresholds[j] - THRESHOLD) >= 1e-6; j++)
 		{
-			free(sSSAInfo.aHostInfo);
 		}
-		if(sSSAInfo.numInf)
+		if (j == numThresholds)
 		{
-			free(sSSAInfo.aInfInfo);
+			fprintf(stderr, "threshold %f was not one of the values of maxIncidence\n", THRESHOLD);
+			return 0;
+		}
+		pRun->maxTimeInf = aThreshTime[j];
+		if (aThreshNumInf[j] < pRun->numInf)
+		{
+			pRun->numInf = aThreshNumInf[j];
+		}
+	}
+	/* note which hosts were infected */
+	if (pRun->numInf)
+	{
+		g_sPipeline.aInfInfo = mem_realloc(g_sPipeline.aInfInfo, sizeof(*g_sPipeline.aInfInfo) * (g_sPipeline.numInf + pRun->numInf), "aInfInfo");
+		if (!g_sPipeline.aInfInfo)
+		{
+			return 0;
 		}
-		if(sSSAInfo.numRuns)
+	}
+	for (j = 0; j < pRun->numInf; j++)
+	{
+		g_sPipeline.aInfInfo[g_sPipeline.numInf].hostID = pRun->aHostLookup[j].hostID;
+		g_sPipeline.numInf++;
+	}
+	fprintf(stdout, "\t%s_%d\n\t\t%d infections (maxTime=%.4f)\n", SIM_OUTPUT_STUB, runNum, pRun->numInf, pRun->maxTimeInf);
+	qsort(pRun->aHostLookup, pRun->numInf, sizeof(*pRun->aHostLookup), cmpHostLookup);
+	calcProbDetectRun(&g_sPipeline, runNum);
+	return 1;
+}
+
+/*
+	Optimise the sampling pattern once all runs have been added
+*/
+int pipelineFinish()
+{
+	int		bRet;
+
+	bRet = 0;
+	if (g_sPipeline.numInf)
+	{
+		collateInfInfo(&g_sPipeline);
+		seedRandom(RAND_SEED);
+		if (DEBUG_DUMP_INFO)
+		{
+			debugDumpInfo(&g_sPipeline);
+		}
+		runAnnealing(&g_sPipeline);
+		bRet = 1;
+	}
+	else
+	{
+		fprintf(stderr, "no infections to optimise sampling pattern for\n");
+	}
+	freeSSAInfo(&g_sPipeline);
+	return bRet;
+}
+#else
+/*
+	Number of lines in a file (-1 if it can't be opened)
+*/
+int countLines(char *szFile)
+{
+	FILE	*fIn;
+	char	szBuffer[_MAX_STATIC_BUFF_LEN];
+	int		numLines;
+
+	fIn = fopen(szFile, "rb");
+	if (!fIn)
+	{
+		return -1;
+	}
+	numLines = 0;
+	while (fgets(szBuffer, _MAX_STATIC_BUFF_LEN, fIn))
+	{
+		numLines++;
+	}
+	fclose(fIn);
+	return numLines;
+}
+
+/*
+	Round up to the blocks arrays are grown in
+*/
+double numAllocated(int num)
+{
+	return (double)(((num + MY_REALLOC_BLOCK_SIZE - 1) / MY_REALLOC_BLOCK_SIZE) * MY_REALLOC_BLOCK_SIZE);
+}
+
+/*
+	dryRun=1: estimate the memory needed from the number of lines in the input files (as readHostInfo() and readSims()
+	would read them) and stop before any of it is allocated
+*/
+int estimateMemory()
+{
+	char	szInputFile[_MAX_STATIC_BUFF_LEN];
+	int		numHosts,numRuns,numInf,maxLines;
+	double	threshTime,inRuns,infInfo,objState,total;
+
+	fprintf(stdout, "estimateMemory()\n");
+	sprintf(szInputFile, "%s%s", INPUT_DIR, HOST_INFO_FILE);
+	numHosts = countLines(szInputFile);
+	if (numHosts < 0)
+	{
+		fprintf(stderr, "couldn't open %s\n", szInputFile);
+		return 0;
+	}
+	inRuns = 0.0;
+	infInfo = 0.0;
+	for (numRuns = 0; NUM_RUNS < 0 || numRuns < NUM_RUNS; numRuns++)
+	{
+		sprintf(szInputFile, "%s%s_%d.txt", INPUT_DIR, SIM_OUTPUT_STUB, numRuns);
+		numInf = countLines(szInputFile);
+		if (numInf < 0)
 		{
-			for(i=0;i<sSSAInfo.numRuns;i++)
+			if (NUM_RUNS < 0)
 			{
-				if(sSSAInfo.aRunInfo[i].numInf)
-				{
-					free(sSSAInfo.aRunInfo[i].aHostLookup);
-					free(sSSAInfo.aRunInfo[i].aPDetect);
-					free(sSSAInfo.aRunInfo[i].aTimeInf);
-					free(sSSAInfo.aRunInfo[i].aHostDensity);
-				}
+				break;
+			}
+			fprintf(stderr, "couldn't open %s\n", szInputFile);
+			return 0;
+		}
+		if (THRESHOLD > 0.0)
+		{
+			if (!readThreshold(numRuns, THRESHOLD, &threshTime, &maxLines))
+			{
+				return 0;
 			}
-			free(sSSAInfo.aRunInfo);
+			numInf = (maxLines < numInf) ? maxLines : numInf;
 		}
+		inRuns += numAllocated(numInf);
+		infInfo += numInf;
+	}
+	fprintf(stdout, "\t%d hosts, %d runs, %.0f infections\n", numHosts, numRuns, infInfo);
+	fprintf(stdout, "estimated memory (MB):\n");
+	fprintf(stdout, "\taHostInfo: %.3f\n", MEM_MB(sizeof(t_HostInfo) * numAllocated(numHosts)));
+	fprintf(stdout, "\taRunInfo: %.3f\n", MEM_MB((double)sizeof(t_RunInfo) * numRuns));
+	fprintf(stdout, "\taHostLookup: %.3f\n", MEM_MB(sizeof(t_HostLookup) * inRuns));
+	fprintf(stdout, "\taPDetect: %.3f\n", MEM_MB(sizeof(t_Real) * inRuns));
+	fprintf(stdout, "\taTimeInf: %.3f\n", MEM_MB(sizeof(double) * inRuns));
+	fprintf(stdout, "\taHostDensity: %.3f\n", MEM_MB(sizeof(t_Real) * inRuns));
+	fprintf(stdout, "\taInfInfo: %.3f\n", MEM_MB(sizeof(t_InfInfo) * numAllocated((int)infInfo)));
+	fprintf(stdout, "\tanPattern: %.3f\n", MEM_MB((double)sizeof(int) * PARAM_N));
+	objState = (double)sizeof(t_Real) * PARAM_N * numRuns + (2 * sizeof(double) + sizeof(int) + sizeof(t_Real)) * (double)numRuns;
+	fprintf(stdout, "\tobjState: %.3f\n", MEM_MB(objState));
+	total = sizeof(t_HostInfo) * numAllocated(numHosts) + (double)sizeof(t_RunInfo) * numRuns;
+	total += (sizeof(t_HostLookup) + 2 * sizeof(t_Real) + sizeof(double)) * inRuns;
+	total += sizeof(t_InfInfo) * numAllocated((int)infInfo) + (double)sizeof(int) * PARAM_N + objState;
+	fprintf(stdout, "\ttotal: %.3f\n", MEM_MB(total));
+	return 1;
+}
+
+/*
+	Memory held by each structure (current and peak) and the RSS, to the screen and memory.txt in the output directory
+*/
+void writeAnnealerMemory()
+{
+	char	szOutFile[_MAX_STATIC_BUFF_LEN];
+	FILE	*fOut;
+
+	mem_report(stdout);
+	sprintf(szOutFile, "%s//memory.txt", OUT_DIR);
+	fOut = fopen(szOutFile, "wb");
+	if (fOut)
+	{
+		mem_report(fOut);
+		fclose(fOut);
+	}
+}
+
+int main(int argc, char **argv)
+{
+	t_SSAInfo	sSSAInfo;
+	int			bContinue;
+
+	memset(&sSSAInfo,0,sizeof(sSSAInfo));
+	bContinue = 1;
+	/* read in parameters (stored globally) */
+	if (!readParams(argc,argv))
+	{
+		fprintf(stderr, "couldn't read parameters\n");
+		bContinue = 0;
+	}
+	else if (DRY_RUN)
+	{
+		return estimateMemory() ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+	else
+	{
+		seedRandom(RAND_SEED);
+	}
+	/* read in host info */
+	if(bContinue && !readHostInfo(&sSSAInfo))
+	{
+		fprintf(stderr, "couldn't read host info\n");
+		bContinue = 0;
+	}
+	/* read in inf info */
+	if(bContinue && !readSims(&sSSAInfo))
+	{
+		fprintf(stderr, "couldn't read simulation info\n");
+		bContinue = 0;
+	}
+	/* calculate detection probabilities */
+	if(bContinue && !calcProbDetect(&sSSAInfo))
+	{
+		fprintf(stderr, "couldn't calculate detection probabilities\n");
+		bContinue = 0;
+	}
+	if(bContinue && DEBUG_DUMP_INFO)
+	{
+		debugDumpInfo(&sSSAInfo);
+	}
+	/* do annealing */
+	if(bContinue)
+	{
+		runAnnealing(&sSSAInfo);
+		writeAnnealerMemory();
+		freeSSAInfo(&sSSAInfo);
 	}
 	return EXIT_SUCCESS;
 }
+#endif /* _PIPELINE */
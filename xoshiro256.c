@@ -0,0 +1,203 @@
+/*
+	Block-generated uniform and exponential random numbers from xoshiro256+ (see xoshiro256.h)
+
+	xoshiro256+ and its jump polynomial are from Blackman and Vigna (2018), "Scrambled linear pseudorandom
+	number generators" (public domain reference code at http://prng.di.unimi.it/); splitmix64 is from
+	Steele, Lea and Flood (2014)
+*/
+
+#include <string.h>
+#include "xoshiro256.h"
+
+#define _SPLITMIX_GAMMA		0x9e3779b97f4a7c15ULL
+#define _DOUBLE_ONE_BITS	0x3ff0000000000000ULL
+#define _MANTISSA_MASK		0x000fffffffffffffULL
+#define _HALF_ULP			1.1102230246251565e-16		/* 2^-53 */
+#define _SQRT2_HIGH_BITS	0x6a09e						/* top 20 bits of the mantissa of sqrt(2) */
+#define _LN2				0.6931471805599453
+
+static uint64_t splitmix64(uint64_t *pX)
+{
+	uint64_t z;
+
+	z = (*pX += _SPLITMIX_GAMMA);
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	return z ^ (z >> 31);
+}
+
+static inline uint64_t rotl(uint64_t x, int k)
+{
+	return (x << k) | (x >> (64 - k));
+}
+
+/*
+	Advance every lane by one step (the output is taken before the step)
+*/
+static inline void stepLane(uint64_t s[4][XOSHIRO_LANES], int k)
+{
+	uint64_t t;
+
+	t = s[1][k] << 17;
+	s[2][k] ^= s[0][k];
+	s[3][k] ^= s[1][k];
+	s[1][k] ^= s[2][k];
+	s[0][k] ^= s[3][k];
+	s[2][k] ^= t;
+	s[3][k] = rotl(s[3][k], 45);
+}
+
+/*
+	Set lane k to lane k-1 advanced by 2^128 steps
+*/
+static void jumpLane(uint64_t s[4][XOSHIRO_LANES], int k)
+{
+	static const uint64_t aJump[4] = { 0x180ec6d33cfd0abaULL, 0xd5a61266f0c9392cULL, 0xa9582618e03fc9aaULL, 0x39abdc4529b1661cULL };
+	uint64_t	aAcc[4];
+	int			i,b,w;
+
+	for (w = 0; w < 4; w++)
+	{
+		s[w][k] = s[w][k - 1];
+		aAcc[w] = 0;
+	}
+	for (i = 0; i < 4; i++)
+	{
+		for (b = 0; b < 64; b++)
+		{
+			if (aJump[i] & (1ULL << b))
+			{
+				for (w = 0; w < 4; w++)
+				{
+					aAcc[w] ^= s[w][k];
+				}
+			}
+			stepLane(s, k);
+		}
+	}
+	for (w = 0; w < 4; w++)
+	{
+		s[w][k] = aAcc[w];
+	}
+}
+
+void xoshiro_seed(xoshiro_state *pState, unsigned long aKey[], int keyLength)
+{
+	uint64_t	hash;
+	int			i,k;
+
+	hash = 0;
+	for (i = 0; i < keyLength; i++)
+	{
+		hash ^= (uint64_t)aKey[i];
+		hash = splitmix64(&hash);
+	}
+	for (i = 0; i < 4; i++)
+	{
+		pState->s[i][0] = splitmix64(&hash);
+	}
+	for (k = 1; k < XOSHIRO_LANES; k++)
+	{
+		jumpLane(pState->s, k);
+	}
+	pState->nextUniform = XOSHIRO_BLOCK;
+	pState->nextExp = XOSHIRO_BLOCK;
+}
+
+/*
+	Fill aOut with uniforms on (0,1): the top 52 bits of each output are put into the mantissa of a double in [1,2),
+	and shifting down by 1-2^-53 leaves them centred in intervals of width 2^-52 (so 0 and 1 can't happen)
+*/
+static void fillBlock(xoshiro_state *pState, double *aOut)
+{
+	uint64_t	aBits[XOSHIRO_BLOCK];
+	uint64_t	s0[XOSHIRO_LANES],s1[XOSHIRO_LANES],s2[XOSHIRO_LANES],s3[XOSHIRO_LANES],t[XOSHIRO_LANES];
+	int			i,k;
+
+	/* (the state is copied into locals so the compiler can keep each word of all the lanes in a vector register) */
+	for (k = 0; k < XOSHIRO_LANES; k++)
+	{
+		s0[k] = pState->s[0][k];
+		s1[k] = pState->s[1][k];
+		s2[k] = pState->s[2][k];
+		s3[k] = pState->s[3][k];
+	}
+	for (i = 0; i < XOSHIRO_BLOCK; i += XOSHIRO_LANES)
+	{
+		for (k = 0; k < XOSHIRO_LANES; k++)
+		{
+			aBits[i + k] = ((s0[k] + s3[k]) >> 12) | _DOUBLE_ONE_BITS;
+			t[k] = s1[k] << 17;
+			s2[k] ^= s0[k];
+			s3[k] ^= s1[k];
+			s1[k] ^= s2[k];
+			s0[k] ^= s3[k];
+			s2[k] ^= t[k];
+			s3[k] = (s3[k] << 45) | (s3[k] >> 19);
+		}
+	}
+	for (k = 0; k < XOSHIRO_LANES; k++)
+	{
+		pState->s[0][k] = s0[k];
+		pState->s[1][k] = s1[k];
+		pState->s[2][k] = s2[k];
+		pState->s[3][k] = s3[k];
+	}
+	memcpy(aOut, aBits, sizeof(aBits));
+	for (i = 0; i < XOSHIRO_BLOCK; i++)
+	{
+		aOut[i] -= 1.0 - _HALF_ULP;
+	}
+}
+
+void xoshiro_fill_uniform(xoshiro_state *pState)
+{
+	fillBlock(pState, pState->aUniform);
+	pState->nextUniform = 0;
+}
+
+/*
+	-log(u) for a block of uniforms, written without branches or library calls so the loop vectorises:
+	u = m 2^e with m in [sqrt(1/2), sqrt(2)), and log(m) = 2 atanh(s) with s = (m-1)/(m+1), |s| < 0.172, summed to s^17
+	(agrees with -log() to within a few units in the last place)
+*/
+void xoshiro_fill_exponential(xoshiro_state *pState)
+{
+	uint64_t	aBits[XOSHIRO_BLOCK];
+	double		aMant[XOSHIRO_BLOCK];
+	int			aExponent[XOSHIRO_BLOCK],aBig[XOSHIRO_BLOCK];
+	double		m,s,z,poly,e,big;
+	int			i;
+
+	fillBlock(pState, pState->aExp);
+	/* split each u into its exponent and mantissa (as a double in [1,2)), and note if the mantissa is over sqrt(2)
+		(on the top bits only, as the comparison just needs to keep |s| small) */
+	memcpy(aBits, pState->aExp, sizeof(aBits));
+	for (i = 0; i < XOSHIRO_BLOCK; i++)
+	{
+		aExponent[i] = (int)(aBits[i] >> 52) - 1023;
+		aBig[i] = (int)((aBits[i] >> 32) & 0xfffff) > _SQRT2_HIGH_BITS;
+		aBits[i] = (aBits[i] & _MANTISSA_MASK) | _DOUBLE_ONE_BITS;
+	}
+	memcpy(aMant, aBits, sizeof(aBits));
+	for (i = 0; i < XOSHIRO_BLOCK; i++)
+	{
+		m = aMant[i];
+		big = (double)aBig[i];
+		m *= 1.0 - 0.5 * big;
+		e = (double)aExponent[i] + big;
+		s = (m - 1.0) / (m + 1.0);
+		z = s * s;
+		poly = 1.0 / 17.0;
+		poly = poly * z + 1.0 / 15.0;
+		poly = poly * z + 1.0 / 13.0;
+		poly = poly * z + 1.0 / 11.0;
+		poly = poly * z + 1.0 / 9.0;
+		poly = poly * z + 1.0 / 7.0;
+		poly = poly * z + 1.0 / 5.0;
+		poly = poly * z + 1.0 / 3.0;
+		poly = poly * z + 1.0;
+		pState->aExp[i] = -(e * _LN2 + 2.0 * s * poly);
+	}
+	pState->nextExp = 0;
+}
@@ -0,0 +1,57 @@
+#ifndef _XOSHIRO256_H_
+#define _XOSHIRO256_H_
+
+/*
+	Block-generated uniform and exponential random numbers from xoshiro256+ (Blackman and Vigna 2018)
+
+	Each stream runs XOSHIRO_LANES independent xoshiro256+ generators side by side (the state is stored
+	lane-innermost so refilling a block is a loop the compiler can vectorise), and hands out numbers from
+	buffers of XOSHIRO_BLOCK values, so most draws are just a load
+
+	Stream splitting: a stream is seeded from a key (e.g. seed, iteration, stream number), which is hashed
+	with splitmix64 into the state of lane 0; lane k is then lane 0 advanced by k jumps of 2^128 steps, so
+	the lanes of a stream never overlap, and different keys start at unrelated points in the 2^256 period
+*/
+
+#include <stdint.h>
+
+#define XOSHIRO_LANES	4
+#define XOSHIRO_BLOCK	256		/* must be a multiple of XOSHIRO_LANES */
+
+typedef struct
+{
+	uint64_t	s[4][XOSHIRO_LANES];		/* word k of the state of each lane */
+	double		aUniform[XOSHIRO_BLOCK];	/* uniforms on (0,1) */
+	int			nextUniform;
+	double		aExp[XOSHIRO_BLOCK];		/* -log of uniforms on (0,1), i.e. exponentials with mean 1 */
+	int			nextExp;
+} xoshiro_state;
+
+/* seed a stream from a key of keyLength words */
+void	xoshiro_seed(xoshiro_state *pState, unsigned long aKey[], int keyLength);
+
+/* refill the buffers (called when they run out) */
+void	xoshiro_fill_uniform(xoshiro_state *pState);
+void	xoshiro_fill_exponential(xoshiro_state *pState);
+
+/* next uniform random number on (0,1) */
+static inline double xoshiro_uniform(xoshiro_state *pState)
+{
+	if (pState->nextUniform == XOSHIRO_BLOCK)
+	{
+		xoshiro_fill_uniform(pState);
+	}
+	return pState->aUniform[pState->nextUniform++];
+}
+
+/* next exponential random number with mean 1 */
+static inline double xoshiro_exponential(xoshiro_state *pState)
+{
+	if (pState->nextExp == XOSHIRO_BLOCK)
+	{
+		xoshiro_fill_exponential(pState);
+	}
+	return pState->aExp[pState->nextExp++];
+}
+
+#endif /* _XOSHIRO256_H_ */